@@ -0,0 +1,658 @@
+#include <string.h>
+
+#include "batch.h"
+#include "llm.h"
+#include "llm_json.h"
+#include "llm_profiles.h"
+#include "llm_endpoints.h"
+#include "document_manager.h"
+#include "llm_trace.h"
+
+typedef enum {
+    BATCH_ITEM_QUEUED,
+    BATCH_ITEM_RUNNING,
+    BATCH_ITEM_DONE,
+    BATCH_ITEM_FAILED,
+    BATCH_ITEM_CANCELLED
+} BatchItemState;
+
+typedef enum {
+    BATCH_SOURCE_SELECTED,
+    BATCH_SOURCE_OPEN,
+    BATCH_SOURCE_PROJECT
+} BatchSource;
+
+typedef struct BatchRun BatchRun;
+
+/// @brief One file of a batch run.
+/// The worker owns the statistics while the job runs, the main thread owns the widgets.
+typedef struct {
+    BatchRun *run;
+    gchar *file_name;        // Path, or the name of an unsaved document
+    gchar *content;          // Snapshot of an open document, NULL to read file_name
+    guint job_id;
+    BatchItemState state;    // Main thread only
+    gchar *error;            // First error of the current attempt
+    gint64 start_time;       // Monotonic, microseconds
+    gint64 end_time;
+    guint chunks;            // Streamed tokens of the current attempt
+    GtkWidget *text_view;
+    GtkWidget *status_label;
+    GtkWidget *cancel_button;
+} BatchItem;
+
+/// @brief A batch window and its files. Referenced by the window, every
+/// job and every queued update, so late updates never touch freed memory.
+struct BatchRun {
+    gint ref_count;
+    LLMPlugin *plugin;
+    gchar *instruction;
+    LLMArgs *args;
+    GPtrArray *items;        // BatchItem*
+    guint finished;
+    gint64 start_time;
+    gboolean window_closed;
+    GtkWidget *window;
+    GtkWidget *progress_bar;
+    GtkWidget *summary_label;
+    GtkWidget *cancel_all_button;
+};
+
+typedef enum {
+    BATCH_UPDATE_STARTED,
+    BATCH_UPDATE_TEXT,
+    BATCH_UPDATE_FINISHED
+} BatchUpdateKind;
+
+typedef struct {
+    BatchItem *item;
+    BatchUpdateKind kind;
+    BatchItemState state;    // For BATCH_UPDATE_FINISHED
+    gchar *text;             // For BATCH_UPDATE_TEXT
+} BatchUpdate;
+
+static BatchRun *batch_run_ref(BatchRun *run)
+{
+    g_atomic_int_inc(&run->ref_count);
+    return run;
+}
+
+static void batch_item_free(gpointer data)
+{
+    BatchItem *item = (BatchItem *)data;
+    g_free(item->file_name);
+    g_free(item->content);
+    g_free(item->error);
+    g_free(item);
+}
+
+static void batch_run_unref(BatchRun *run)
+{
+    if (!g_atomic_int_dec_and_test(&run->ref_count)) {
+        return;
+    }
+    g_ptr_array_free(run->items, TRUE);
+    llm_args_free(run->args);
+    g_free(run->instruction);
+    g_free(run);
+}
+
+static gboolean batch_item_is_finished(const BatchItem *item)
+{
+    return item->state == BATCH_ITEM_DONE || item->state == BATCH_ITEM_FAILED ||
+           item->state == BATCH_ITEM_CANCELLED;
+}
+
+/// @brief Total run time and throughput, shown once the last file is finished
+static void batch_show_report(BatchRun *run)
+{
+    guint done = 0, failed = 0, cancelled = 0;
+    guint64 tokens = 0;
+    gint64 busy_usec = 0;
+
+    for (guint i = 0; i < run->items->len; i++) {
+        BatchItem *item = g_ptr_array_index(run->items, i);
+        switch (item->state) {
+            case BATCH_ITEM_DONE:
+                done++;
+                break;
+            case BATCH_ITEM_FAILED:
+                failed++;
+                break;
+            default:
+                cancelled++;
+                break;
+        }
+        tokens += item->chunks;
+        if (item->start_time && item->end_time > item->start_time) {
+            busy_usec += item->end_time - item->start_time;
+        }
+    }
+
+    gdouble elapsed = (g_get_monotonic_time() - run->start_time) / (gdouble)G_USEC_PER_SEC;
+    gdouble busy = busy_usec / (gdouble)G_USEC_PER_SEC;
+    guint started = done + failed;
+
+    gchar *report = g_strdup_printf(
+        _("%u files in %.1f s: %u done, %u failed, %u cancelled.\n"
+          "%" G_GUINT64_FORMAT " tokens, %.1f tokens/s overall, %.1f s per file, %.1f files in flight on average."),
+        run->items->len, elapsed, done, failed, cancelled,
+        tokens, elapsed > 0 ? tokens / elapsed : 0.0,
+        started > 0 ? busy / started : 0.0,
+        elapsed > 0 ? busy / elapsed : 0.0);
+
+    g_print("Batch finished: %s\n", report);
+    gtk_label_set_text(GTK_LABEL(run->summary_label), report);
+    gtk_widget_set_sensitive(run->cancel_all_button, FALSE);
+    g_free(report);
+}
+
+/// @brief Record the final state of a file. Only the first call counts: a
+/// queued file cancelled from the UI may still report from its worker.
+static void batch_item_finish(BatchItem *item, BatchItemState state)
+{
+    BatchRun *run = item->run;
+    if (batch_item_is_finished(item)) {
+        return;
+    }
+
+    item->state = state;
+    run->finished++;
+
+    const gchar *status;
+    switch (state) {
+        case BATCH_ITEM_DONE:
+            status = _("Done");
+            break;
+        case BATCH_ITEM_FAILED:
+            status = item->error ? item->error : _("Failed");
+            break;
+        default:
+            status = _("Cancelled");
+            break;
+    }
+    gtk_label_set_text(GTK_LABEL(item->status_label), status);
+    gtk_widget_set_sensitive(item->cancel_button, FALSE);
+
+    gchar *progress = g_strdup_printf(_("%u / %u files"), run->finished, run->items->len);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(run->progress_bar),
+        (gdouble)run->finished / run->items->len);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(run->progress_bar), progress);
+    g_free(progress);
+
+    if (run->finished == run->items->len) {
+        batch_show_report(run);
+    }
+}
+
+/// @brief Apply a worker update to the batch window (main thread)
+static gboolean batch_update_idle(gpointer user_data)
+{
+    BatchUpdate *update = (BatchUpdate *)user_data;
+    BatchItem *item = update->item;
+    BatchRun *run = item->run;
+
+    if (!run->window_closed && !batch_item_is_finished(item)) {
+        GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(item->text_view));
+        GtkTextIter end_iter;
+
+        switch (update->kind) {
+            case BATCH_UPDATE_STARTED:
+                // A preempted file starts over
+                item->state = BATCH_ITEM_RUNNING;
+                gtk_text_buffer_set_text(buffer, "", -1);
+                gtk_label_set_text(GTK_LABEL(item->status_label), _("Running"));
+                break;
+            case BATCH_UPDATE_TEXT:
+                gtk_text_buffer_get_end_iter(buffer, &end_iter);
+                gtk_text_buffer_insert(buffer, &end_iter, update->text, -1);
+                break;
+            case BATCH_UPDATE_FINISHED:
+                batch_item_finish(item, update->state);
+                break;
+        }
+    }
+
+    batch_run_unref(run);
+    g_free(update->text);
+    g_free(update);
+    return G_SOURCE_REMOVE;
+}
+
+static void batch_post_update(BatchItem *item, BatchUpdateKind kind, BatchItemState state, const gchar *text)
+{
+    BatchUpdate *update = g_new0(BatchUpdate, 1);
+    update->item = item;
+    update->kind = kind;
+    update->state = state;
+    update->text = g_strdup(text);
+    batch_run_ref(item->run);
+    gdk_threads_add_idle(batch_update_idle, update);
+}
+
+static void batch_on_data_received(const gchar *data_chunk, gpointer user_data)
+{
+    BatchItem *item = (BatchItem *)user_data;
+    item->chunks++;
+    batch_post_update(item, BATCH_UPDATE_TEXT, BATCH_ITEM_RUNNING, data_chunk);
+}
+
+static void batch_on_error(const gchar *error_message, gpointer user_data)
+{
+    BatchItem *item = (BatchItem *)user_data;
+    if (!item->error) {
+        item->error = g_strdup(error_message);
+    }
+}
+
+/// @brief Scheduler job processing one file. Runs again after preemption.
+static void batch_item_job(LLMJob *job, gpointer data)
+{
+    BatchItem *item = (BatchItem *)data;
+    BatchRun *run = item->run;
+    gchar *content = NULL;
+    gchar *json_payload = NULL;
+    GError *error = NULL;
+    gint64 trace_start = llm_trace_begin();
+
+    item->chunks = 0;
+    g_clear_pointer(&item->error, g_free);
+    item->start_time = g_get_monotonic_time();
+    item->end_time = 0;
+    batch_post_update(item, BATCH_UPDATE_STARTED, BATCH_ITEM_RUNNING, NULL);
+
+    if (item->content) {
+        content = g_strdup(item->content);
+    } else if (!g_file_get_contents(item->file_name, &content, NULL, &error)) {
+        item->error = g_strdup(error->message);
+        g_error_free(error);
+        goto EXIT;
+    }
+
+    if (!g_utf8_validate(content, -1, NULL)) {
+        item->error = g_strdup(_("Not a UTF-8 text file"));
+        goto EXIT;
+    }
+
+    json_payload = llm_construct_document_json_payload(run->instruction, item->file_name, content, run->args);
+    if (!json_payload) {
+        item->error = g_strdup("Failed to construct JSON payload");
+        goto EXIT;
+    }
+
+    LLMCallbacks callbacks = {
+        .on_data_received = batch_on_data_received,
+        .on_error = batch_on_error,
+        .user_data = item
+    };
+    llm_execute_task_query(run->plugin, LLM_TASK_CHAT, job->priority, "/v1/completions",
+        json_payload, &callbacks, &job->cancel_flag, NULL);
+
+    // A preempted file is requeued and reports once it ran to the end
+    if (job->preempted && !job->cancelled) {
+        goto CLEANUP;
+    }
+
+EXIT:
+    item->end_time = g_get_monotonic_time();
+    batch_post_update(item, BATCH_UPDATE_FINISHED,
+        g_atomic_int_get(&job->cancel_flag) ? BATCH_ITEM_CANCELLED : item->error ? BATCH_ITEM_FAILED : BATCH_ITEM_DONE,
+        NULL);
+
+CLEANUP:
+    g_free(json_payload);
+    g_free(content);
+    llm_trace_end("batch_item", "worker", trace_start);
+}
+
+static void batch_item_job_destroy(gpointer data)
+{
+    BatchItem *item = (BatchItem *)data;
+    batch_run_unref(item->run);
+}
+
+static void batch_cancel_item(BatchItem *item)
+{
+    if (batch_item_is_finished(item)) {
+        return;
+    }
+    BatchItemState state = item->state;
+    if (llm_scheduler_cancel(item->run->plugin->scheduler, item->job_id) &&
+        state == BATCH_ITEM_QUEUED) {
+        // Never started, so no worker will report it
+        batch_item_finish(item, BATCH_ITEM_CANCELLED);
+    }
+}
+
+static void on_batch_item_cancel_clicked(GtkButton *button, gpointer user_data)
+{
+    batch_cancel_item((BatchItem *)user_data);
+}
+
+static void on_batch_cancel_all_clicked(GtkButton *button, gpointer user_data)
+{
+    BatchRun *run = (BatchRun *)user_data;
+    for (guint i = 0; i < run->items->len; i++) {
+        batch_cancel_item(g_ptr_array_index(run->items, i));
+    }
+}
+
+static void on_batch_window_destroy(GtkWidget *widget, gpointer user_data)
+{
+    BatchRun *run = (BatchRun *)user_data;
+
+    on_batch_cancel_all_clicked(NULL, run);
+    run->window_closed = TRUE;
+    g_ptr_array_remove(run->plugin->batch_runs, run);
+    batch_run_unref(run);
+}
+
+/// @brief Notebook page streaming the output of one file
+static GtkWidget *batch_create_item_page(BatchItem *item, GtkWidget **tab_label)
+{
+    GtkWidget *page = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_container_set_border_width(GTK_CONTAINER(page), 5);
+
+    GtkWidget *top_row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    item->status_label = gtk_label_new(_("Queued"));
+    gtk_label_set_ellipsize(GTK_LABEL(item->status_label), PANGO_ELLIPSIZE_END);
+    gtk_box_pack_start(GTK_BOX(top_row), item->status_label, FALSE, FALSE, 0);
+
+    item->cancel_button = gtk_button_new();
+    gtk_button_set_image(GTK_BUTTON(item->cancel_button),
+        gtk_image_new_from_icon_name("process-stop", GTK_ICON_SIZE_BUTTON));
+    gtk_widget_set_tooltip_text(item->cancel_button, _("Cancel this file"));
+    g_signal_connect(item->cancel_button, "clicked", G_CALLBACK(on_batch_item_cancel_clicked), item);
+    gtk_box_pack_end(GTK_BOX(top_row), item->cancel_button, FALSE, FALSE, 0);
+
+    item->text_view = gtk_text_view_new();
+    gtk_text_view_set_wrap_mode(GTK_TEXT_VIEW(item->text_view), GTK_WRAP_WORD);
+    gtk_text_view_set_editable(GTK_TEXT_VIEW(item->text_view), FALSE);
+
+    GtkWidget *scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), item->text_view);
+
+    gtk_box_pack_start(GTK_BOX(page), top_row, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(page), scrolled_window, TRUE, TRUE, 0);
+
+    gchar *base_name = g_path_get_basename(item->file_name);
+    *tab_label = gtk_label_new(base_name);
+    gtk_widget_set_tooltip_text(*tab_label, item->file_name);
+    g_free(base_name);
+
+    return page;
+}
+
+static void batch_create_window(BatchRun *run)
+{
+    run->window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gchar *title = g_strdup_printf(_("Batch: %s"), run->instruction);
+    gtk_window_set_title(GTK_WINDOW(run->window), title);
+    g_free(title);
+    gtk_window_set_transient_for(GTK_WINDOW(run->window),
+        GTK_WINDOW(run->plugin->geany_data->main_widgets->window));
+    gtk_window_set_default_size(GTK_WINDOW(run->window), 700, 500);
+
+    GtkWidget *main_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_container_set_border_width(GTK_CONTAINER(main_box), 5);
+
+    GtkWidget *top_row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    run->progress_bar = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(run->progress_bar), TRUE);
+    gchar *progress = g_strdup_printf(_("0 / %u files"), run->items->len);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(run->progress_bar), progress);
+    g_free(progress);
+    gtk_box_pack_start(GTK_BOX(top_row), run->progress_bar, TRUE, TRUE, 0);
+
+    run->cancel_all_button = gtk_button_new_with_label(_("Cancel all"));
+    g_signal_connect(run->cancel_all_button, "clicked", G_CALLBACK(on_batch_cancel_all_clicked), run);
+    gtk_box_pack_end(GTK_BOX(top_row), run->cancel_all_button, FALSE, FALSE, 0);
+
+    run->summary_label = gtk_label_new(NULL);
+    gtk_label_set_line_wrap(GTK_LABEL(run->summary_label), TRUE);
+    gtk_label_set_xalign(GTK_LABEL(run->summary_label), 0.0);
+
+    GtkWidget *notebook = gtk_notebook_new();
+    gtk_notebook_set_scrollable(GTK_NOTEBOOK(notebook), TRUE);
+    for (guint i = 0; i < run->items->len; i++) {
+        GtkWidget *tab_label = NULL;
+        GtkWidget *page = batch_create_item_page(g_ptr_array_index(run->items, i), &tab_label);
+        gtk_notebook_append_page(GTK_NOTEBOOK(notebook), page, tab_label);
+    }
+
+    gtk_box_pack_start(GTK_BOX(main_box), top_row, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(main_box), run->summary_label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(main_box), notebook, TRUE, TRUE, 0);
+    gtk_container_add(GTK_CONTAINER(run->window), main_box);
+
+    g_signal_connect(run->window, "destroy", G_CALLBACK(on_batch_window_destroy), run);
+    gtk_widget_show_all(run->window);
+}
+
+static void batch_add_item(GPtrArray *items, const gchar *file_name, gchar *content)
+{
+    BatchItem *item = g_new0(BatchItem, 1);
+    item->file_name = g_strdup(file_name);
+    item->content = content;
+    g_ptr_array_add(items, item);
+}
+
+static void batch_add_document(GPtrArray *items, GeanyDocument *doc)
+{
+    if (!doc || !doc->is_valid) {
+        return;
+    }
+    batch_add_item(items, doc->file_name ? doc->file_name : _("(unnamed)"), get_document_text(doc));
+}
+
+static gboolean batch_match_patterns(const gchar *name, gchar **patterns)
+{
+    for (gint i = 0; patterns[i] != NULL; i++) {
+        if (*patterns[i] && g_pattern_match_simple(patterns[i], name)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/// @brief Collect the files below a directory matching one of the patterns, skipping hidden entries
+static void batch_collect_files(GPtrArray *items, const gchar *dir_path, gchar **patterns, gint depth)
+{
+    GDir *dir = g_dir_open(dir_path, 0, NULL);
+    if (!dir) {
+        return;
+    }
+
+    const gchar *name;
+    while ((name = g_dir_read_name(dir)) != NULL && items->len < LLM_BATCH_MAX_FILES) {
+        if (name[0] == '.') {
+            continue;
+        }
+        gchar *path = g_build_filename(dir_path, name, NULL);
+        if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+            if (depth < LLM_BATCH_MAX_DEPTH && !g_file_test(path, G_FILE_TEST_IS_SYMLINK)) {
+                batch_collect_files(items, path, patterns, depth + 1);
+            }
+        } else if (batch_match_patterns(name, patterns)) {
+            batch_add_item(items, path, NULL);
+        }
+        g_free(path);
+    }
+    g_dir_close(dir);
+}
+
+static gint batch_compare_items(gconstpointer a, gconstpointer b)
+{
+    const BatchItem *item_a = *(BatchItem * const *)a;
+    const BatchItem *item_b = *(BatchItem * const *)b;
+    return g_strcmp0(item_a->file_name, item_b->file_name);
+}
+
+/// @brief Directory searched for project files: the project, else the current document's directory
+static gchar *batch_base_dir(LLMPlugin *plugin)
+{
+    GeanyProject *project = plugin->geany_data->app->project;
+    if (project && project->base_path && *project->base_path) {
+        return g_strdup(project->base_path);
+    }
+    GeanyDocument *doc = document_get_current();
+    if (doc && doc->real_path) {
+        return g_path_get_dirname(doc->real_path);
+    }
+    return g_get_current_dir();
+}
+
+static GPtrArray *batch_collect_items(LLMPlugin *plugin, BatchSource source, const gchar *pattern)
+{
+    GPtrArray *items = g_ptr_array_new_with_free_func(batch_item_free);
+
+    if (source == BATCH_SOURCE_SELECTED) {
+        for (guint i = 0; plugin->selected_document_ids && i < plugin->selected_document_ids->len; i++) {
+            batch_add_document(items, g_ptr_array_index(plugin->selected_document_ids, i));
+        }
+    } else if (source == BATCH_SOURCE_OPEN) {
+        for (guint i = 0; i < plugin->geany_data->documents_array->len; i++) {
+            batch_add_document(items, g_ptr_array_index(plugin->geany_data->documents_array, i));
+        }
+    } else {
+        gchar *base_dir = batch_base_dir(plugin);
+        gchar **patterns = g_strsplit_set(pattern, ";, ", -1);
+        batch_collect_files(items, base_dir, patterns, 0);
+        g_ptr_array_sort(items, batch_compare_items);
+        g_strfreev(patterns);
+        g_free(base_dir);
+    }
+
+    return items;
+}
+
+static void batch_start(LLMPlugin *plugin, const gchar *instruction, GPtrArray *items)
+{
+    BatchRun *run = g_new0(BatchRun, 1);
+    run->ref_count = 1; // Held by the window
+    run->plugin = plugin;
+    run->instruction = g_strdup(instruction);
+    run->args = llm_task_args_new(plugin, LLM_TASK_CHAT);
+    run->args->n_candidates = 1;
+    run->items = items;
+    run->start_time = g_get_monotonic_time();
+
+    batch_create_window(run);
+    g_ptr_array_add(plugin->batch_runs, run);
+
+    g_print("Starting batch of %u files\n", items->len);
+    for (guint i = 0; i < items->len; i++) {
+        BatchItem *item = g_ptr_array_index(items, i);
+        item->run = run;
+        batch_run_ref(run);
+        item->job_id = llm_scheduler_submit(plugin->scheduler, LLM_PRIORITY_BATCH,
+            batch_item_job, item, batch_item_job_destroy);
+        if (item->job_id == 0) {
+            batch_item_finish(item, BATCH_ITEM_CANCELLED);
+        }
+    }
+}
+
+static void on_batch_source_toggled(GtkToggleButton *button, gpointer user_data)
+{
+    gtk_widget_set_sensitive(GTK_WIDGET(user_data), gtk_toggle_button_get_active(button));
+}
+
+/// @brief Ask for an instruction and the files, then start a batch run
+void on_batch_clicked(GtkButton *button, gpointer user_data)
+{
+    LLMPlugin *plugin = (LLMPlugin *)user_data;
+    if (!plugin) {
+        return;
+    }
+
+    if (llm_endpoints_count(llm_task_endpoints(plugin, LLM_TASK_CHAT)) == 0) {
+        dialogs_show_msgbox(GTK_MESSAGE_ERROR, _("Server URL is not configured. Please set it in the plugin settings."));
+        return;
+    }
+
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(
+        _("Run Over Files"),
+        GTK_WINDOW(plugin->geany_data->main_widgets->window),
+        GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+        _("Run"), GTK_RESPONSE_ACCEPT,
+        _("Cancel"), GTK_RESPONSE_CANCEL,
+        NULL);
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_container_set_border_width(GTK_CONTAINER(vbox), 10);
+
+    GtkWidget *instruction_label = gtk_label_new(_("Instruction:"));
+    gtk_label_set_xalign(GTK_LABEL(instruction_label), 0.0);
+    GtkWidget *instruction_entry = gtk_entry_new();
+    gtk_entry_set_text(GTK_ENTRY(instruction_entry),
+        gtk_entry_get_text(GTK_ENTRY(plugin->input_text_entry)));
+    gtk_entry_set_activates_default(GTK_ENTRY(instruction_entry), TRUE);
+
+    guint selected_count = plugin->selected_document_ids ? plugin->selected_document_ids->len : 0;
+    gchar *selected_text = g_strdup_printf(_("Selected documents (%u)"), selected_count);
+    GtkWidget *selected_radio = gtk_radio_button_new_with_label(NULL, selected_text);
+    g_free(selected_text);
+    GtkWidget *open_radio = gtk_radio_button_new_with_label_from_widget(
+        GTK_RADIO_BUTTON(selected_radio), _("All open documents"));
+    GtkWidget *project_radio = gtk_radio_button_new_with_label_from_widget(
+        GTK_RADIO_BUTTON(selected_radio), _("Project files matching:"));
+    GtkWidget *pattern_entry = gtk_entry_new();
+    gtk_entry_set_text(GTK_ENTRY(pattern_entry), "*.c;*.h");
+    gtk_widget_set_tooltip_text(pattern_entry, _("Patterns separated by semicolons, searched below the project's base path"));
+    gtk_widget_set_sensitive(pattern_entry, FALSE);
+    g_signal_connect(project_radio, "toggled", G_CALLBACK(on_batch_source_toggled), pattern_entry);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(selected_count > 0 ? selected_radio : open_radio), TRUE);
+
+    gtk_box_pack_start(GTK_BOX(vbox), instruction_label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), instruction_entry, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), selected_radio, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), open_radio, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), project_radio, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), pattern_entry, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(content_area), vbox, TRUE, TRUE, 0);
+
+    gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT);
+    gtk_widget_show_all(dialog);
+
+    while (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+        gchar *instruction = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(instruction_entry))));
+        BatchSource source = BATCH_SOURCE_PROJECT;
+        if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(selected_radio))) {
+            source = BATCH_SOURCE_SELECTED;
+        } else if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(open_radio))) {
+            source = BATCH_SOURCE_OPEN;
+        }
+
+        if (*instruction == '\0') {
+            dialogs_show_msgbox(GTK_MESSAGE_WARNING, _("Please enter an instruction."));
+            g_free(instruction);
+            continue;
+        }
+
+        GPtrArray *items = batch_collect_items(plugin, source,
+            gtk_entry_get_text(GTK_ENTRY(pattern_entry)));
+        if (items->len == 0) {
+            dialogs_show_msgbox(GTK_MESSAGE_WARNING, _("No files to process."));
+            g_ptr_array_free(items, TRUE);
+            g_free(instruction);
+            continue;
+        }
+
+        batch_start(plugin, instruction, items);
+        g_free(instruction);
+        break;
+    }
+
+    gtk_widget_destroy(dialog);
+}
+
+/// @brief Cancel every batch run and close its window
+void llm_batch_close_all(LLMPlugin *plugin)
+{
+    // Destroying a window removes its run from the list
+    while (plugin->batch_runs && plugin->batch_runs->len > 0) {
+        BatchRun *run = g_ptr_array_index(plugin->batch_runs, plugin->batch_runs->len - 1);
+        gtk_widget_destroy(run->window);
+    }
+}
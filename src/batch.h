@@ -0,0 +1,27 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <gtk/gtk.h>
+#include "plugin.h"
+
+/**
+ * Batch runs: one instruction applied to many files, e.g. "add doc comments"
+ * or "list the TODOs". Every file is a scheduler job in the batch class, so
+ * as many files run at once as the server has slots, and chat questions or
+ * completions still preempt them. Each file streams into its own page of the
+ * batch window and can be cancelled on its own.
+ */
+
+/// @brief Upper bound of files collected from a project pattern
+#define LLM_BATCH_MAX_FILES 200
+
+/// @brief Directory depth searched for project files
+#define LLM_BATCH_MAX_DEPTH 8
+
+/// @brief Ask for an instruction and the files, then start a batch run
+void on_batch_clicked(GtkButton *button, gpointer user_data);
+
+/// @brief Cancel every batch run and close its window
+void llm_batch_close_all(LLMPlugin *plugin);
+
+#endif // __BATCH_H__
@@ -0,0 +1,278 @@
+#include "diagnostics.h"
+#include "llm_http.h"
+#include "llm_endpoints.h"
+#include "llm_stats.h"
+#include "llm_trace.h"
+#include "llm_capture.h"
+#include "llm_scheduler.h"
+#include "llm_caps.h"
+#include "llm_retrieval.h"
+#include "ui.h"
+#include "settings.h"
+
+/// @brief Connection test state, owned by the test thread
+typedef struct {
+    GtkWidget *text_view; // Referenced while the test runs
+    gchar **urls;
+    gchar *proxy_url;
+    GString *report;
+} ConnectionTestData;
+
+/// @brief Append the test report to the dialog (main thread)
+static gboolean connection_test_done_idle(gpointer user_data)
+{
+    ConnectionTestData *data = (ConnectionTestData *)user_data;
+
+    // The dialog may have been closed while the test was running
+    if (gtk_widget_get_realized(data->text_view)) {
+        GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(data->text_view));
+        GtkTextIter end_iter;
+        gtk_text_buffer_get_end_iter(buffer, &end_iter);
+        gtk_text_buffer_insert(buffer, &end_iter, data->report->str, -1);
+    }
+
+    g_object_unref(data->text_view);
+    g_strfreev(data->urls);
+    g_free(data->proxy_url);
+    g_string_free(data->report, TRUE);
+    g_free(data);
+    return G_SOURCE_REMOVE;
+}
+
+static gpointer connection_test_thread(gpointer user_data)
+{
+    ConnectionTestData *data = (ConnectionTestData *)user_data;
+    GString *result = g_string_new(NULL);
+
+    g_string_append(data->report, "\nConnection test:\n");
+    for (gint i = 0; data->urls[i] != NULL; i++) {
+        llm_test_connection(data->urls[i], data->proxy_url, result);
+        g_string_append_printf(data->report, "%s\n  %s\n", data->urls[i], result->str);
+    }
+
+    g_string_free(result, TRUE);
+    gdk_threads_add_idle(connection_test_done_idle, data);
+    return NULL;
+}
+
+/// @brief Render the endpoint statistics into the buffer
+static void diagnostics_refresh(LLMPlugin *plugin, GtkWidget *text_view)
+{
+    GString *report = g_string_new("Endpoints:\n");
+    llm_endpoints_describe(plugin->endpoints, report);
+    if (plugin->scheduler) {
+        g_string_append(report, "\nScheduler:\n");
+        llm_scheduler_describe(plugin->scheduler, report);
+    }
+    g_string_append(report, "\nServer capabilities:\n");
+    llm_caps_cache_describe(plugin->caps, report);
+    g_string_append(report, "\nProject index:\n");
+    llm_retrieval_describe(plugin, report);
+
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(text_view));
+    gtk_text_buffer_set_text(buffer, report->str, -1);
+    g_string_free(report, TRUE);
+}
+
+/// @brief Start a connection test of every endpoint in a thread
+static void diagnostics_test_connections(LLMPlugin *plugin, GtkWidget *text_view)
+{
+    ConnectionTestData *data = g_new0(ConnectionTestData, 1);
+    data->text_view = g_object_ref(text_view);
+    data->urls = llm_endpoints_dup_urls(plugin->endpoints);
+    data->proxy_url = g_strdup(plugin->proxy_url);
+    data->report = g_string_new(NULL);
+
+    g_thread_unref(g_thread_new("llm-diagnostics", connection_test_thread, data));
+}
+
+/// @brief Add a read-only monospace report view to a dialog
+static GtkWidget *diagnostics_add_text_view(GtkWidget *dialog)
+{
+    GtkWidget *text_view = gtk_text_view_new();
+    gtk_text_view_set_editable(GTK_TEXT_VIEW(text_view), FALSE);
+    gtk_text_view_set_monospace(GTK_TEXT_VIEW(text_view), TRUE);
+
+    GtkWidget *scrollwin = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrollwin),
+                                 GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(scrollwin), text_view);
+    gtk_widget_set_size_request(scrollwin, 600, 300);
+
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+    gtk_box_pack_start(GTK_BOX(content_area), scrollwin, TRUE, TRUE, 0);
+
+    return text_view;
+}
+
+enum {
+    DIAGNOSTICS_RESPONSE_REFRESH = 1,
+    DIAGNOSTICS_RESPONSE_TEST,
+    DIAGNOSTICS_RESPONSE_SAVE_TRACE,
+    DIAGNOSTICS_RESPONSE_REPLAY
+};
+
+/// @brief Append a line to a report view
+static void diagnostics_append(GtkWidget *text_view, const gchar *text)
+{
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(text_view));
+    GtkTextIter end_iter;
+    gtk_text_buffer_get_end_iter(buffer, &end_iter);
+    gtk_text_buffer_insert(buffer, &end_iter, text, -1);
+}
+
+/// @brief Let the user pick a capture and replay it into the answer view
+static void diagnostics_replay_capture(LLMPlugin *plugin, GtkWidget *dialog, GtkWidget *text_view)
+{
+    GtkWidget *chooser = gtk_file_chooser_dialog_new(_("Replay capture"),
+        GTK_WINDOW(dialog), GTK_FILE_CHOOSER_ACTION_OPEN,
+        _("_Cancel"), GTK_RESPONSE_CANCEL,
+        _("_Replay"), GTK_RESPONSE_ACCEPT,
+        NULL);
+    gchar *dir = llm_plugin_data_dir(plugin, LLM_CAPTURE_DIR);
+    if (dir) {
+        gtk_file_chooser_set_current_folder(GTK_FILE_CHOOSER(chooser), dir);
+        g_free(dir);
+    }
+    GtkWidget *realtime_check = gtk_check_button_new_with_label(_("Keep the original timing"));
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(realtime_check), TRUE);
+    gtk_file_chooser_set_extra_widget(GTK_FILE_CHOOSER(chooser), realtime_check);
+
+    if (gtk_dialog_run(GTK_DIALOG(chooser)) != GTK_RESPONSE_ACCEPT) {
+        gtk_widget_destroy(chooser);
+        return;
+    }
+
+    gchar *path = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(chooser));
+    gboolean realtime = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(realtime_check));
+    gtk_widget_destroy(chooser);
+
+    GError *error = NULL;
+    LLMCapture *capture = llm_capture_load(path, &error);
+    gchar *report;
+    if (!capture) {
+        report = g_strdup_printf("\nCould not replay: %s\n", error->message);
+        g_error_free(error);
+    } else {
+        // The replay job owns the capture once submitted
+        guint chunks = capture->chunks->len;
+        if (llm_replay_capture(plugin, capture, realtime)) {
+            report = g_strdup_printf("\nReplaying %s (%u chunks) into the answer view\n", path, chunks);
+        } else {
+            report = g_strdup("\nCould not replay: an answer is being generated\n");
+            llm_capture_free(capture);
+        }
+    }
+    diagnostics_append(text_view, report);
+    g_free(report);
+    g_free(path);
+}
+
+void on_diagnostics_clicked(GtkButton *button, gpointer user_data)
+{
+    LLMPlugin *plugin = (LLMPlugin *)user_data;
+    if (!plugin || !plugin->endpoints) {
+        return;
+    }
+
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(
+        _("LLM Diagnostics"),
+        GTK_WINDOW(plugin->geany_data->main_widgets->window),
+        GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+        _("Refresh"), DIAGNOSTICS_RESPONSE_REFRESH,
+        _("Test connection"), DIAGNOSTICS_RESPONSE_TEST,
+        _("Replay capture..."), DIAGNOSTICS_RESPONSE_REPLAY,
+        _("Close"), GTK_RESPONSE_CLOSE,
+        NULL);
+
+    GtkWidget *text_view = diagnostics_add_text_view(dialog);
+    diagnostics_refresh(plugin, text_view);
+    gtk_widget_show_all(dialog);
+
+    gint response;
+    while ((response = gtk_dialog_run(GTK_DIALOG(dialog))) > 0) {
+        if (response == DIAGNOSTICS_RESPONSE_REFRESH) {
+            diagnostics_refresh(plugin, text_view);
+        } else if (response == DIAGNOSTICS_RESPONSE_TEST) {
+            diagnostics_test_connections(plugin, text_view);
+        } else if (response == DIAGNOSTICS_RESPONSE_REPLAY) {
+            diagnostics_replay_capture(plugin, dialog, text_view);
+        }
+    }
+
+    gtk_widget_destroy(dialog);
+}
+
+/// @brief Show the request statistics
+static void stats_refresh(LLMPlugin *plugin, GtkWidget *text_view)
+{
+    GString *report = g_string_new(NULL);
+    llm_stats_describe(plugin->stats, report);
+
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(text_view));
+    gtk_text_buffer_set_text(buffer, report->str, -1);
+    g_string_free(report, TRUE);
+}
+
+/// @brief Write the trace recorded so far and report where it went
+static void stats_save_trace(LLMPlugin *plugin, GtkWidget *text_view)
+{
+    GString *report = g_string_new(NULL);
+    gchar *dir = llm_plugin_data_dir(plugin, LLM_TRACE_DIR);
+    GError *error = NULL;
+    gchar *path = dir ? llm_trace_save(dir, &error) : NULL;
+
+    if (path) {
+        g_string_append_printf(report, "\nTrace written to %s\n", path);
+    } else {
+        g_string_append_printf(report, "\nCould not write the trace: %s\n",
+            error ? error->message : "no configuration directory");
+    }
+
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(text_view));
+    GtkTextIter end_iter;
+    gtk_text_buffer_get_end_iter(buffer, &end_iter);
+    gtk_text_buffer_insert(buffer, &end_iter, report->str, -1);
+
+    if (error) {
+        g_error_free(error);
+    }
+    g_free(path);
+    g_free(dir);
+    g_string_free(report, TRUE);
+}
+
+void on_stats_clicked(GtkButton *button, gpointer user_data)
+{
+    LLMPlugin *plugin = (LLMPlugin *)user_data;
+    if (!plugin || !plugin->stats) {
+        return;
+    }
+
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(
+        _("LLM Request Statistics"),
+        GTK_WINDOW(plugin->geany_data->main_widgets->window),
+        GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+        _("Save trace"), DIAGNOSTICS_RESPONSE_SAVE_TRACE,
+        _("Refresh"), DIAGNOSTICS_RESPONSE_REFRESH,
+        _("Close"), GTK_RESPONSE_CLOSE,
+        NULL);
+    gtk_dialog_set_response_sensitive(GTK_DIALOG(dialog), DIAGNOSTICS_RESPONSE_SAVE_TRACE, llm_trace_enabled());
+
+    GtkWidget *text_view = diagnostics_add_text_view(dialog);
+    gtk_widget_set_size_request(gtk_widget_get_parent(text_view), 600, 450);
+    stats_refresh(plugin, text_view);
+    gtk_widget_show_all(dialog);
+
+    gint response;
+    while ((response = gtk_dialog_run(GTK_DIALOG(dialog))) == DIAGNOSTICS_RESPONSE_REFRESH ||
+           response == DIAGNOSTICS_RESPONSE_SAVE_TRACE) {
+        if (response == DIAGNOSTICS_RESPONSE_REFRESH) {
+            stats_refresh(plugin, text_view);
+        } else {
+            stats_save_trace(plugin, text_view);
+        }
+    }
+
+    gtk_widget_destroy(dialog);
+}
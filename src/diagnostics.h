@@ -0,0 +1,19 @@
+#ifndef __DIAGNOSTICS_H__
+#define __DIAGNOSTICS_H__
+
+#include <gtk/gtk.h>
+#include "plugin.h"
+
+/**
+ * Diagnostics dialog: endpoint health and latency statistics, and a
+ * connection test for every configured server. Statistics dialog: latency
+ * and throughput histograms of the recent chat requests.
+ */
+
+/// @brief Open the diagnostics dialog
+void on_diagnostics_clicked(GtkButton *button, gpointer user_data);
+
+/// @brief Open the request statistics dialog
+void on_stats_clicked(GtkButton *button, gpointer user_data);
+
+#endif // __DIAGNOSTICS_H__
@@ -1,4 +1,7 @@
 #include "document_manager.h"
+#include "llm_util.h"
+#include "llm_symbols.h"
+#include "llm_retrieval.h"
 
 void on_select_documents_clicked(GtkButton *button, gpointer user_data) {
     LLMPlugin *llm_plugin = (LLMPlugin *)user_data;
@@ -238,4 +241,91 @@ gchar *get_current_document(gpointer user_data)
     }
 
     return document_content;
-}
\ No newline at end of file
+}
+
+/// @brief Get the whole text of a document.
+/// Remember to g_free() the result when done
+gchar *get_document_text(GeanyDocument *doc)
+{
+    if (!doc || !doc->is_valid) {
+        return NULL;
+    }
+
+    gsize length = scintilla_send_message(doc->editor->sci, SCI_GETTEXTLENGTH, 0, 0);
+    gchar *document_content = g_malloc(length + 1); // +1 for null-terminator
+    scintilla_send_message(doc->editor->sci, SCI_GETTEXT, length + 1, (sptr_t)document_content);
+
+    return document_content;
+}
+
+/// @brief Snapshot the documents attached to a request: the current document
+/// if it is included, or in symbol mode the lines around the cursor and the
+/// definitions they and the query refer to, then the chunks of project code
+/// matching the query, then the selected ones, then the summaries of the
+/// other files of the project.
+/// Must run on the main thread. Free with g_ptr_array_unref()
+GPtrArray *get_context_documents(gpointer user_data, const gchar *query)
+{
+    LLMPlugin *llm_plugin = (LLMPlugin *)user_data;
+    GPtrArray *documents = g_ptr_array_new_with_free_func(llm_document_free);
+    if (!llm_plugin) {
+        return documents;
+    }
+
+    GeanyDocument *current = document_get_current();
+    GeanyDocument *whole = NULL;
+    if (current && llm_plugin->include_current_document &&
+        !(llm_plugin->symbol_context && llm_symbols_collect(llm_plugin, current, query, documents))) {
+        // Also when the tag manager does not know the file type
+        LLMDocument *document = llm_document_new(NULL, get_document_text(current));
+        llm_document_set_source(document, current->real_path, 0, G_MAXUINT);
+        g_ptr_array_add(documents, document);
+        whole = current;
+    }
+
+    llm_retrieval_collect(llm_plugin, query, whole, documents);
+
+    for (guint i = 0; llm_plugin->selected_document_ids && i < llm_plugin->selected_document_ids->len; i++) {
+        GeanyDocument *doc = g_ptr_array_index(llm_plugin->selected_document_ids, i);
+        if (!doc || !doc->is_valid) {
+            continue; // Skip invalid documents
+        }
+        // Skip the current document if it is already included
+        if (llm_plugin->include_current_document && doc == current) {
+            continue;
+        }
+        LLMDocument *document = llm_document_new(doc->file_name ? doc->file_name : "(unnamed)",
+            get_document_text(doc));
+        llm_document_set_source(document, doc->real_path, 0, G_MAXUINT);
+        g_ptr_array_add(documents, document);
+    }
+
+    // Last, they are the first to go when the context is too small
+    llm_retrieval_collect_summaries(llm_plugin, query, documents);
+
+    return documents;
+}
+
+/// @brief Get up to max_length bytes of text after the cursor in the current document.
+/// Remember to g_free() the result when done
+gchar *get_current_document_following_text(gpointer user_data, gint max_length)
+{
+    LLMPlugin *llm_plugin = (LLMPlugin *)user_data;
+    if (!llm_plugin) {
+        return NULL;
+    }
+
+    GeanyDocument *doc = document_get_current();
+    if (!doc) {
+        return NULL;
+    }
+
+    ScintillaObject *sci = doc->editor->sci;
+    gint pos = (gint)scintilla_send_message(sci, SCI_GETCURRENTPOS, 0, 0);
+    gint length = (gint)scintilla_send_message(sci, SCI_GETLENGTH, 0, 0);
+    if (pos >= length) {
+        return g_strdup("");
+    }
+
+    return sci_get_contents_range(sci, pos, MIN(length, pos + max_length));
+}
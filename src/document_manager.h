@@ -14,4 +14,10 @@ void on_document_close(GObject *obj, GeanyDocument *doc, gpointer user_data);
 
 gchar *get_current_document(gpointer user_data);
 
+gchar *get_document_text(GeanyDocument *doc);
+
+GPtrArray *get_context_documents(gpointer user_data, const gchar *query);
+
+gchar *get_current_document_following_text(gpointer user_data, gint max_length);
+
 #endif // __DOCUMENT_MANAGER_H__
\ No newline at end of file
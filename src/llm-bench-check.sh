@@ -0,0 +1,90 @@
+#!/bin/sh
+# Regression check of the request path, run by `make check`: starts
+# llm-mock-server on a free port, runs llm-bench against it with the
+# --max-* limits and benchmarks the stream parser. Fails if a limit is
+# exceeded, a run fails or a chunking changes the parsed text.
+#
+# The limits are loose enough for a busy build machine and can be set in
+# the environment, e.g. LLM_CHECK_MAX_CPU_PER_CHUNK=50 make check.
+# LLM_CHECK_BINDIR is the directory of the programs (default .).
+
+bindir=${LLM_CHECK_BINDIR:-.}
+max_ttft_overhead=${LLM_CHECK_MAX_TTFT_OVERHEAD:-25}
+max_cpu_per_chunk=${LLM_CHECK_MAX_CPU_PER_CHUNK:-300}
+max_allocs_per_chunk=${LLM_CHECK_MAX_ALLOCS_PER_CHUNK:-60}
+max_rss=${LLM_CHECK_MAX_RSS:-96}
+max_ns_per_event=${LLM_CHECK_MAX_NS_PER_EVENT:-20000}
+max_allocs_per_event=${LLM_CHECK_MAX_ALLOCS_PER_EVENT:-40}
+
+log=$(mktemp "${TMPDIR:-/tmp}/llm-mock-server.XXXXXX") || exit 99
+server_pid=
+
+stop_server() {
+    if [ -n "$server_pid" ]; then
+        kill "$server_pid" 2>/dev/null
+        wait "$server_pid" 2>/dev/null
+        server_pid=
+    fi
+}
+
+cleanup() {
+    stop_server
+    rm -f "$log"
+}
+trap cleanup EXIT
+trap 'exit 99' HUP INT TERM
+
+# Start the mock server with the given options, sets $url
+start_server() {
+    : > "$log"
+    "$bindir/llm-mock-server" --port 0 "$@" > "$log" 2>&1 &
+    server_pid=$!
+    url=
+    tries=0
+    while [ -z "$url" ]; do
+        if ! kill -0 "$server_pid" 2>/dev/null; then
+            cat "$log"
+            echo "FAIL llm-mock-server did not start"
+            exit 99
+        fi
+        url=$(sed -n 's/^llm-mock-server listening on //p' "$log")
+        tries=$((tries + 1))
+        if [ -z "$url" ] && [ "$tries" -gt 50 ]; then
+            echo "FAIL llm-mock-server did not report its port"
+            exit 99
+        fi
+        [ -n "$url" ] || sleep 0.1
+    done
+}
+
+status=0
+
+echo "== Paced stream, writes split inside characters"
+start_server --prefill-ms 100 --token-rate 200 --tokens 64 --chunk-bytes 5
+"$bindir/llm-bench" --url "$url" --prompt hi --runs 10 --max-tokens 64 \
+    --max-ttft-overhead "$max_ttft_overhead" \
+    --max-cpu-per-chunk "$max_cpu_per_chunk" \
+    --max-allocs-per-chunk "$max_allocs_per_chunk" \
+    --max-rss "$max_rss" || status=1
+stop_server
+
+echo "== Bursts as fast as possible"
+start_server --token-rate 0 --tokens 256 --burst 16
+"$bindir/llm-bench" --url "$url" --prompt hi --runs 5 --max-tokens 256 \
+    --max-cpu-per-chunk "$max_cpu_per_chunk" \
+    --max-allocs-per-chunk "$max_allocs_per_chunk" \
+    --max-rss "$max_rss" || status=1
+stop_server
+
+echo "== Server errors and dropped connections"
+start_server --token-rate 0 --tokens 64 --fail-every 2 --disconnect-after 20
+"$bindir/llm-bench" --url "$url" --prompt hi --runs 4 --max-tokens 64 \
+    --allow-failures --max-rss "$max_rss" || status=1
+stop_server
+
+echo "== Stream parser"
+"$bindir/llm-bench" --parse --parse-iterations 5 \
+    --max-ns-per-event "$max_ns_per_event" \
+    --max-allocs-per-event "$max_allocs_per_event" || status=1
+
+exit $status
@@ -9,14 +9,397 @@
 #include "llm_http.h"
 #include "llm_json.h"
 #include "llm_util.h"
+#include "llm_endpoints.h"
+#include "llm_hedge.h"
+#include "llm_profiles.h"
+#include "llm_mapreduce.h"
+#include "llm_trace.h"
+#include "llm_capture.h"
+#include "llm_stop.h"
+#include "llm_semantic.h"
 
-/// @brief Thread function to handle LLM queries
-gpointer llm_thread_func(gpointer data)
+/// @brief Callbacks that hold errors back until the first token is streamed,
+/// so a failing endpoint can still be replaced by the next one.
+typedef struct {
+    LLMCallbacks callbacks; // Handed to the transport, user_data points to this struct
+    LLMCallbacks *target;
+    gboolean streaming;     // Output reached the target, failover is no longer possible
+    gchar *error;           // Last error held back
+} FailoverCallbacks;
+
+static void failover_on_data_received(const gchar *data_chunk, gpointer user_data)
+{
+    FailoverCallbacks *failover = (FailoverCallbacks *)user_data;
+    failover->streaming = TRUE;
+    if (failover->target->on_data_received) {
+        failover->target->on_data_received(data_chunk, failover->target->user_data);
+    }
+}
+
+static void failover_on_candidate_received(const LLMResponse *response, gpointer user_data)
+{
+    FailoverCallbacks *failover = (FailoverCallbacks *)user_data;
+    if (response->response_text) {
+        failover->streaming = TRUE;
+    }
+    if (failover->target->on_candidate_received) {
+        failover->target->on_candidate_received(response, failover->target->user_data);
+    }
+}
+
+static void failover_on_progress(const LLMPromptProgress *progress, gpointer user_data)
+{
+    FailoverCallbacks *failover = (FailoverCallbacks *)user_data;
+    if (failover->target->on_progress) {
+        failover->target->on_progress(progress, failover->target->user_data);
+    }
+}
+
+static void failover_on_error(const gchar *error_message, gpointer user_data)
+{
+    FailoverCallbacks *failover = (FailoverCallbacks *)user_data;
+    if (failover->streaming) {
+        if (failover->target->on_error) {
+            failover->target->on_error(error_message, failover->target->user_data);
+        }
+        return;
+    }
+    g_free(failover->error);
+    failover->error = g_strdup(error_message);
+}
+
+static void failover_on_complete(gpointer user_data)
+{
+    FailoverCallbacks *failover = (FailoverCallbacks *)user_data;
+    if (failover->target->on_complete) {
+        failover->target->on_complete(failover->target->user_data);
+    }
+}
+
+/// @brief Send the payload to the best endpoint, failing over to the next
+/// ones as long as nothing has been streamed yet.
+static void llm_execute_routed_query(LLMPlugin *plugin, LLMEndpointSet *endpoints,
+    const gchar *path, const gchar *json_payload, LLMCallbacks *callbacks, gboolean *cancel_flag,
+    LLMTransfer *transfer_out)
+{
+    FailoverCallbacks failover = {
+        .callbacks = {
+            .on_data_received = failover_on_data_received,
+            .on_error = failover_on_error,
+            .on_complete = failover_on_complete,
+            .on_candidate_received = callbacks->on_candidate_received ? failover_on_candidate_received : NULL,
+            .on_progress = callbacks->on_progress ? failover_on_progress : NULL,
+            .user_data = &failover
+        },
+        .target = callbacks
+    };
+
+    guint endpoint_count = llm_endpoints_count(endpoints);
+    GPtrArray *tried = g_ptr_array_new_with_free_func((GDestroyNotify)llm_endpoint_unref);
+    LLMEndpoint *endpoint = NULL;
+
+    while ((endpoint = llm_endpoints_acquire(endpoints, tried)) != NULL) {
+        g_ptr_array_add(tried, llm_endpoint_ref(endpoint));
+        gboolean last = tried->len >= endpoint_count;
+
+        gchar *server_uri = llm_construct_server_uri_string(endpoint->url, path);
+        if (!server_uri) {
+            llm_endpoint_release(endpoints, endpoint, NULL, "Failed to construct server URI");
+            continue;
+        }
+
+        // Retrying transient errors on the same server only pays off on the last one
+        LLMTransfer transfer = { .max_attempts = last ? 0 : 1 };
+        g_clear_pointer(&failover.error, g_free);
+        gboolean ok = llm_execute_query(server_uri, plugin->proxy_url, plugin->api_key, json_payload,
+            &failover.callbacks, cancel_flag, &transfer);
+        g_free(server_uri);
+        if (transfer_out) {
+            *transfer_out = transfer;
+        }
+
+        if (LLM_CANCELLED(cancel_flag)) {
+            llm_endpoint_release(endpoints, endpoint, NULL, NULL);
+            break;
+        }
+        if (failover.streaming) {
+            // Errors after the first token were already reported
+            llm_endpoint_release(endpoints, endpoint, &transfer,
+                ok ? NULL : "Stream interrupted");
+            break;
+        }
+        if (ok && !failover.error) {
+            llm_endpoint_release(endpoints, endpoint, &transfer, NULL);
+            break;
+        }
+
+        llm_endpoint_release(endpoints, endpoint, &transfer,
+            failover.error ? failover.error : "Request failed");
+        if (!last) {
+            g_print("Endpoint %s failed before the first token, failing over\n", endpoint->url);
+        }
+    }
+
+    if (!failover.streaming && failover.error && !LLM_CANCELLED(cancel_flag) && callbacks->on_error) {
+        callbacks->on_error(failover.error, callbacks->user_data);
+    }
+
+    g_free(failover.error);
+    g_ptr_array_free(tried, TRUE);
+}
+
+/// @brief Send a payload to the endpoints of a task
+void llm_execute_task_query(LLMPlugin *plugin, LLMTask task, LLMPriority priority,
+    const gchar *path, const gchar *json_payload, LLMCallbacks *callbacks, gboolean *cancel_flag,
+    LLMTransfer *transfer)
+{
+    LLMEndpointSet *endpoints = llm_task_endpoints(plugin, task);
+
+    // Execute the query on the best endpoint. Interactive answers may race a
+    // second endpoint, where tail latency matters more than server load.
+    if (priority == LLM_PRIORITY_INTERACTIVE && plugin->hedge_enabled &&
+        llm_endpoints_count(endpoints) > 1) {
+        llm_execute_hedged_query(plugin, endpoints, path, json_payload, callbacks, cancel_flag, transfer);
+    } else {
+        llm_execute_routed_query(plugin, endpoints, path, json_payload, callbacks, cancel_flag, transfer);
+    }
+}
+
+/// @brief Callbacks that collect the streamed answer and hold its end back,
+/// so that a truncated or interrupted answer can still be continued in place.
+/// They also apply the client-side stop rules.
+typedef struct {
+    LLMCallbacks callbacks; // Handed to the endpoints, user_data points to this struct
+    LLMCallbacks *target;
+    GString *text;          // Answer streamed so far, all rounds
+    gboolean completed;     // The current round reached the end of its stream
+    gchar *error;           // Last error of the current round held back
+    LLMStopMatcher *stop;   // NULL without stop rules
+    gboolean stopped;       // A stop rule ended the answer
+    gboolean *cancel_flag;  // Of the job, ends the transfer
+} ContinuationCallbacks;
+
+static void continuation_on_data_received(const gchar *data_chunk, gpointer user_data)
+{
+    ContinuationCallbacks *continuation = (ContinuationCallbacks *)user_data;
+    if (continuation->stopped) {
+        // Rest of the network chunk that was being parsed
+        return;
+    }
+
+    gsize length = strlen(data_chunk);
+    gsize keep = llm_stop_matcher_feed(continuation->stop, data_chunk, length);
+    if (keep > 0) {
+        gchar *kept = keep < length ? g_strndup(data_chunk, keep) : NULL;
+        const gchar *chunk = kept ? kept : data_chunk;
+        g_string_append(continuation->text, chunk);
+        if (continuation->target->on_data_received) {
+            continuation->target->on_data_received(chunk, continuation->target->user_data);
+        }
+        g_free(kept);
+    }
+
+    const gchar *reason = llm_stop_matcher_reason(continuation->stop);
+    if (reason) {
+        g_print("Ending the answer early: %s\n", reason);
+        continuation->stopped = TRUE;
+        // Aborts the transfer and frees the server slot, the answer still completes
+        g_atomic_int_set(continuation->cancel_flag, TRUE);
+    }
+}
+
+static void continuation_on_candidate_received(const LLMResponse *response, gpointer user_data)
+{
+    ContinuationCallbacks *continuation = (ContinuationCallbacks *)user_data;
+    if (continuation->target->on_candidate_received) {
+        continuation->target->on_candidate_received(response, continuation->target->user_data);
+    }
+}
+
+static void continuation_on_progress(const LLMPromptProgress *progress, gpointer user_data)
+{
+    ContinuationCallbacks *continuation = (ContinuationCallbacks *)user_data;
+    if (continuation->target->on_progress) {
+        continuation->target->on_progress(progress, continuation->target->user_data);
+    }
+}
+
+static void continuation_on_error(const gchar *error_message, gpointer user_data)
+{
+    ContinuationCallbacks *continuation = (ContinuationCallbacks *)user_data;
+    // Before the first token there is nothing to continue
+    if (continuation->text->len == 0) {
+        if (continuation->target->on_error) {
+            continuation->target->on_error(error_message, continuation->target->user_data);
+        }
+        return;
+    }
+    g_free(continuation->error);
+    continuation->error = g_strdup(error_message);
+}
+
+static void continuation_on_complete(gpointer user_data)
+{
+    ContinuationCallbacks *continuation = (ContinuationCallbacks *)user_data;
+    continuation->completed = TRUE;
+}
+
+/// @brief Add the timings of a continuation round to those of the answer
+static void llm_transfer_merge(LLMTransfer *total, const LLMTransfer *round)
+{
+    if (round->first_token_time && !total->first_token_time) {
+        total->first_token_time = round->first_token_time;
+    }
+    if (round->last_token_time) {
+        total->last_token_time = round->last_token_time;
+    }
+    total->end_time = round->end_time;
+    total->chunks += round->chunks;
+    total->text_received |= round->text_received;
+    total->http_code = round->http_code;
+    total->finish_reason = round->finish_reason;
+    if (round->server.valid) {
+        total->server = round->server;
+    }
+}
+
+/// @brief Send the chat prompt and continue the answer while it stops short:
+/// at max_tokens, or because the stream broke off. Each continuation sends
+/// the prompt followed by the answer so far with cache_prompt, so the server
+/// only evaluates what is not in its KV cache yet, and streams on where the
+/// answer stopped.
+/// @return TRUE if a stop rule ended the answer through the job's cancel flag
+static gboolean llm_execute_chat_query(LLMPlugin *plugin, LLMJob *job, ThreadData *thread_data,
+    const gchar *prompt, LLMTransfer *transfer_out)
+{
+    LLMCallbacks *callbacks = thread_data->callbacks;
+    const LLMArgs *args = thread_data->args;
+    ContinuationCallbacks continuation = {
+        .callbacks = {
+            .on_data_received = continuation_on_data_received,
+            .on_error = continuation_on_error,
+            .on_complete = continuation_on_complete,
+            .on_candidate_received = callbacks->on_candidate_received ? continuation_on_candidate_received : NULL,
+            .on_progress = callbacks->on_progress ? continuation_on_progress : NULL,
+            .user_data = &continuation
+        },
+        .target = callbacks,
+        .text = g_string_new(NULL),
+        .cancel_flag = thread_data->cancel_flag
+    };
+    // Several candidates cannot be continued or cut as one answer
+    gboolean single = args->n_candidates <= 1;
+    guint max_rounds = plugin->continue_enabled && single ? LLM_CONTINUE_MAX_ROUNDS : 0;
+    continuation.stop = single ? llm_stop_matcher_new(&args->stop_rules) : NULL;
+    gsize prompt_len = strlen(prompt);
+    LLMArgs round_args = *args;
+    LLMTransfer total = {0};
+
+    for (guint round = 0; ; round++) {
+        gchar *json_payload;
+        if (round == 0) {
+            json_payload = llm_construct_prompt_json_payload(prompt, &round_args);
+        } else {
+            gchar *continued = g_strconcat(prompt, continuation.text->str, NULL);
+            json_payload = llm_construct_prompt_json_payload(continued, &round_args);
+            g_free(continued);
+        }
+
+        // Give the UI the prompt size to estimate the prefill from, in case the
+        // server does not report its progress. Continuations come from the cache.
+        if (round == 0 && callbacks->on_progress) {
+            LLMPromptProgress estimate = {
+                .estimated = TRUE,
+                .total = (gint)MIN(prompt_len / LLM_BYTES_PER_TOKEN, G_MAXINT)
+            };
+            callbacks->on_progress(&estimate, callbacks->user_data);
+        }
+
+        gsize round_start = continuation.text->len;
+        LLMTransfer transfer = {0};
+        continuation.completed = FALSE;
+        g_clear_pointer(&continuation.error, g_free);
+        llm_execute_task_query(plugin, thread_data->task, job->priority, "/v1/completions", json_payload,
+            &continuation.callbacks, thread_data->cancel_flag, &transfer);
+        g_free(json_payload);
+        if (round == 0) {
+            total = transfer;
+        } else {
+            llm_transfer_merge(&total, &transfer);
+        }
+
+        if (continuation.stopped) {
+            // Cut short on purpose, the answer is complete
+            if (callbacks->on_complete) {
+                callbacks->on_complete(callbacks->user_data);
+            }
+            break;
+        }
+        // The job reports a cancellation itself
+        if (g_atomic_int_get(&job->cancel_flag)) {
+            break;
+        }
+
+        gboolean truncated = transfer.finish_reason == LLM_FINISH_LENGTH;
+        gboolean interrupted = !continuation.completed && transfer.finish_reason == LLM_FINISH_NONE;
+        // Tokens left of the user's budget; a truncated answer gets a new one
+        round_args.max_tokens = truncated ? args->max_tokens :
+            round_args.max_tokens - MIN(transfer.chunks, round_args.max_tokens);
+        gboolean fits = args->context_size == 0 || (prompt_len + continuation.text->len) / LLM_BYTES_PER_TOKEN +
+            round_args.max_tokens < args->context_size;
+
+        if (round < max_rounds && continuation.text->len > round_start &&
+            (truncated || interrupted) && round_args.max_tokens > 0 && fits) {
+            g_print("Continuing %s answer after %" G_GSIZE_FORMAT " bytes%s%s\n",
+                truncated ? "truncated" : "interrupted", continuation.text->len,
+                continuation.error ? ": " : "", continuation.error ? continuation.error : "");
+            if (callbacks->on_status) {
+                callbacks->on_status(truncated ? "Answer reached the token limit, continuing..." :
+                    "Stream interrupted, continuing...", callbacks->user_data);
+            }
+            round_args.cache_prompt = TRUE;
+            continue;
+        }
+
+        // Final round, release what was held back
+        if (continuation.error && callbacks->on_error) {
+            callbacks->on_error(continuation.error, callbacks->user_data);
+        }
+        if (continuation.completed && callbacks->on_complete) {
+            callbacks->on_complete(callbacks->user_data);
+        }
+        break;
+    }
+
+    if (transfer_out) {
+        *transfer_out = total;
+    }
+    llm_stop_matcher_free(continuation.stop);
+    g_free(continuation.error);
+    g_string_free(continuation.text, TRUE);
+    return continuation.stopped;
+}
+
+/// @brief Release the job's hold on the request's arena
+void llm_thread_data_free(gpointer data)
+{
+    ThreadData *thread_data = (ThreadData *)data;
+    if (!thread_data) {
+        return;
+    }
+
+    // Released for good once the queued UI updates have run as well
+    llm_arena_unref(thread_data->arena);
+}
+
+/// @brief Scheduler job handling an LLM query.
+/// May run again after preemption, so it must not consume thread_data.
+void llm_thread_func(LLMJob *job, gpointer data)
 {
     ThreadData *thread_data = (ThreadData *)data;
     if (!thread_data) {
         g_warning("NULL thread_data received\n");
-        return NULL;
+        return;
     }
 
     LLMPlugin *plugin = thread_data->llm_plugin;
@@ -27,61 +410,132 @@ gpointer llm_thread_func(gpointer data)
         if (callbacks && callbacks->on_error) {
             callbacks->on_error("Invalid plugin configuration", callbacks->user_data);
         }
-        
-        g_free(thread_data->query);
-        g_free(thread_data->current_document);
-        g_free(callbacks);
-        g_free(thread_data);
-        return NULL;
+        return;
     }
 
     gchar *query = thread_data->query;
-    gchar *current_document = thread_data->current_document;
-    LLMArgs *args = plugin->llm_args;
+    LLMArgs *args = thread_data->args;
+    LLMEndpointSet *endpoints = llm_task_endpoints(plugin, thread_data->task);
+
+    GPtrArray *context = thread_data->documents;
+    GPtrArray *similar = NULL;
+    GPtrArray *documents = NULL;
+    gchar *prompt = NULL;
+    gint64 trace_start = llm_trace_begin();
 
-    const gchar *path = "/v1/completions";
-    gchar *json_payload = NULL;
+    thread_data->cancel_flag = &job->cancel_flag;
     
     // Validate server URL before attempting to construct the URI
-    if (!plugin->llm_server_url || plugin->llm_server_url[0] == '\0') {
+    if (llm_endpoints_count(endpoints) == 0) {
         if (callbacks && callbacks->on_error) {
             callbacks->on_error("Server URL is not configured. Please set it in the plugin settings.", callbacks->user_data);
         }
         goto EXIT;
     }
-    
-    gchar *server_uri = llm_construct_server_uri_string(plugin->llm_server_url, path);
 
-    if (!server_uri) {
-        if (callbacks && callbacks->on_error) {
-            callbacks->on_error("Failed to construct server URI", callbacks->user_data);
+    gint64 step_start;
+    if (thread_data->semantic) {
+        // Found again when a preempted job runs again, the documents stay as they were
+        step_start = llm_trace_begin();
+        similar = llm_semantic_collect(thread_data->semantic, query, thread_data->documents,
+            thread_data->semantic_chunks, thread_data->cancel_flag);
+        llm_trace_end("semantic_search", "worker", step_start);
+        if (similar->len > 0) {
+            context = g_ptr_array_sized_new(thread_data->documents->len + similar->len);
+            for (guint i = 0; i < thread_data->documents->len; i++) {
+                g_ptr_array_add(context, g_ptr_array_index(thread_data->documents, i));
+            }
+            for (guint i = 0; i < similar->len; i++) {
+                g_ptr_array_add(context, g_ptr_array_index(similar, i));
+            }
         }
-        goto EXIT;
     }
 
-    json_payload = llm_construct_completion_json_payload(query, current_document, args);
-    if (!json_payload) {
-        if (callbacks && callbacks->on_error) {
-            callbacks->on_error("Failed to construct JSON payload", callbacks->user_data);
+    // Documents larger than the context window are summarized first
+    step_start = llm_trace_begin();
+    documents = llm_mapreduce_documents(plugin, thread_data->task, context,
+        query, args, callbacks, thread_data->cancel_flag);
+    llm_trace_end("mapreduce", "worker", step_start);
+    if (documents) {
+        step_start = llm_trace_begin();
+        prompt = llm_construct_completion_prompt(query, documents, args);
+        llm_trace_end("build_payload", "worker", step_start);
+
+        LLMRequestMetrics *metrics = thread_data->metrics;
+        if (metrics) {
+            metrics->payload_time = g_get_monotonic_time();
+        }
+
+        gboolean stopped = llm_execute_chat_query(plugin, job, thread_data, prompt,
+            metrics ? &metrics->transfer : NULL);
+
+        // Only complete answers are worth comparing, those cut by a stop rule are
+        if (metrics && (!g_atomic_int_get(&job->cancel_flag) || stopped) && metrics->transfer.first_token_time &&
+            callbacks && callbacks->on_metrics) {
+            callbacks->on_metrics(metrics, callbacks->user_data);
         }
-        goto EXIT;
     }
 
-    // Execute the query with callbacks
-    llm_execute_query(server_uri, plugin->proxy_url, json_payload, callbacks, thread_data->cancel_flag);
+    // A preempted job is requeued by the scheduler and reports nothing yet.
+    // A user cancellation still has to reset the UI.
+    if (g_atomic_int_get(&job->cancel_flag) && !job->preempted) {
+        if (callbacks && callbacks->on_complete) {
+            callbacks->on_complete(callbacks->user_data);
+        }
+    }
     
 EXIT:
-    g_free(json_payload);
-    g_free(server_uri);
-    g_free(query);
-    g_free(current_document);
-    g_free(thread_data);
-    // Don't free callbacks here as they might still be used in async operations
-    
-    // Free callbacks at the end
-    if (callbacks) {
-        g_free(callbacks);
+    if (documents) {
+        g_ptr_array_unref(documents);
     }
+    if (context != thread_data->documents) {
+        g_ptr_array_free(context, TRUE);
+    }
+    if (similar) {
+        g_ptr_array_unref(similar);
+    }
+    g_free(prompt);
+    llm_trace_end("chat_job", "worker", trace_start);
+}
 
-    return NULL;
+void llm_replay_data_free(gpointer data)
+{
+    LLMReplayData *replay = (LLMReplayData *)data;
+    if (!replay) {
+        return;
+    }
+
+    llm_arena_unref(replay->arena);
+}
+
+/// @brief Scheduler job feeding a capture to the chat callbacks in place of a server.
+/// May run again after preemption, the capture is only read.
+void llm_replay_thread_func(LLMJob *job, gpointer data)
+{
+    LLMReplayData *replay = (LLMReplayData *)data;
+    if (!replay || !replay->capture) {
+        g_warning("NULL replay data received\n");
+        return;
+    }
+
+    LLMCallbacks *callbacks = replay->callbacks;
+    LLMRequestMetrics *metrics = replay->metrics;
+    gint64 trace_start = llm_trace_begin();
+    if (metrics) {
+        metrics->payload_time = g_get_monotonic_time();
+    }
+
+    llm_capture_replay(replay->capture, replay->realtime, callbacks, &job->cancel_flag,
+        metrics ? &metrics->transfer : NULL);
+
+    if (metrics && !g_atomic_int_get(&job->cancel_flag) && metrics->transfer.first_token_time &&
+        callbacks && callbacks->on_metrics) {
+        callbacks->on_metrics(metrics, callbacks->user_data);
+    }
+    if (g_atomic_int_get(&job->cancel_flag) && !job->preempted) {
+        if (callbacks && callbacks->on_complete) {
+            callbacks->on_complete(callbacks->user_data);
+        }
+    }
+    llm_trace_end("replay_job", "worker", trace_start);
 }
@@ -2,11 +2,15 @@
 #define __LLM_H__
 
 #include "types.h"
+#include "llm_scheduler.h"
 
 /**
  * Functions interfacing with the LLM via the OpenAI API (libcurl).
  */
 
+/// @brief Times a chat answer that stopped short is continued
+#define LLM_CONTINUE_MAX_ROUNDS 3
+
 /// @brief Pass the LLM completions endpoint the specified query and return the response.
 /// @param LLMPlugin *plugin
 /// @param const gchar *query
@@ -29,7 +33,24 @@ void llm_free_response(LLMResponse *response);
 /// @brief Function to update the UI (runs on the main thread)
 gboolean llm_update_ui(LLMResponse *response);
 
-/// @brief Worker thread function
-gpointer llm_thread_func(gpointer data);
+/// @brief Send a payload to the endpoints of a task with failover. Interactive
+/// requests are hedged when enabled. Errors are reported through callbacks;
+/// a cancelled query returns silently.
+/// @param transfer optional, receives the timings of the transfer that answered
+void llm_execute_task_query(LLMPlugin *plugin, LLMTask task, LLMPriority priority,
+    const gchar *path, const gchar *json_payload, LLMCallbacks *callbacks, gboolean *cancel_flag,
+    LLMTransfer *transfer);
+
+/// @brief Scheduler job running a chat query; data is a ThreadData
+void llm_thread_func(LLMJob *job, gpointer data);
+
+/// @brief Release a ThreadData once its job is finished
+void llm_thread_data_free(gpointer data);
+
+/// @brief Scheduler job replaying a capture into the chat callbacks; data is an LLMReplayData
+void llm_replay_thread_func(LLMJob *job, gpointer data);
+
+/// @brief Release an LLMReplayData once its job is finished
+void llm_replay_data_free(gpointer data);
 
 #endif // __LLM_H__
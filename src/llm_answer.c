@@ -0,0 +1,147 @@
+#include "llm_answer.h"
+#include "llm_candidates.h"
+
+LLMAnswer *llm_answer_begin(LLMPlugin *plugin, LLMCandidateSet *candidates)
+{
+    guint state = (guint)g_atomic_int_get(&plugin->answer_state);
+    if (state & LLM_ANSWER_RUNNING) {
+        llm_candidates_free(candidates);
+        return NULL;
+    }
+
+    LLMArena *arena = llm_arena_new();
+    LLMAnswer *answer = llm_arena_new0(arena, LLMAnswer);
+    answer->plugin = plugin;
+    answer->arena = arena;
+    answer->generation = LLM_ANSWER_GENERATION(state) + 1;
+    answer->candidates = llm_arena_own(arena, candidates, (GDestroyNotify)llm_candidates_free);
+
+    // Only the main thread leaves the idle state, nobody else writes it now
+    g_atomic_int_set(&plugin->answer_state, (gint)(answer->generation << 1 | LLM_ANSWER_RUNNING));
+
+    // The last answer stays around for its candidates, its workers hold their own references
+    llm_answer_release(plugin);
+    plugin->answer = answer;
+    plugin->candidates = answer->candidates;
+    llm_arena_ref(arena);
+    return answer;
+}
+
+gboolean llm_answer_running(LLMPlugin *plugin)
+{
+    return ((guint)g_atomic_int_get(&plugin->answer_state) & LLM_ANSWER_RUNNING) != 0;
+}
+
+gboolean llm_answer_is_current(const LLMAnswer *answer)
+{
+    return LLM_ANSWER_GENERATION(g_atomic_int_get(&answer->plugin->answer_state)) == answer->generation;
+}
+
+gboolean llm_answer_finish(LLMAnswer *answer)
+{
+    gint running = (gint)(answer->generation << 1 | LLM_ANSWER_RUNNING);
+    return g_atomic_int_compare_and_exchange(&answer->plugin->answer_state, running,
+        (gint)(answer->generation << 1));
+}
+
+gboolean llm_answer_stop(LLMPlugin *plugin)
+{
+    guint state;
+    do {
+        state = (guint)g_atomic_int_get(&plugin->answer_state);
+        if (!(state & LLM_ANSWER_RUNNING)) {
+            return FALSE;
+        }
+        // A worker finishing at the same time makes the exchange fail
+    } while (!g_atomic_int_compare_and_exchange(&plugin->answer_state, (gint)state,
+        (gint)((LLM_ANSWER_GENERATION(state) + 1) << 1)));
+    return TRUE;
+}
+
+void llm_answer_release(LLMPlugin *plugin)
+{
+    if (plugin->answer) {
+        plugin->candidates = NULL;
+        llm_arena_unref(plugin->answer->arena);
+        plugin->answer = NULL;
+    }
+}
+
+/// @brief A tracked source, allocated in its answer's arena
+typedef struct {
+    LLMAnswer *answer;
+    GSourceFunc func;
+    gpointer data;
+    guint id;
+} LLMAnswerSource;
+
+void llm_answer_init(LLMPlugin *plugin)
+{
+    g_mutex_init(&plugin->answer_sources_lock);
+    plugin->answer_sources = g_hash_table_new(g_direct_hash, g_direct_equal);
+}
+
+static gboolean llm_answer_source_dispatch(gpointer user_data)
+{
+    LLMAnswerSource *source = (LLMAnswerSource *)user_data;
+    return source->func(source->data);
+}
+
+/// @brief Untrack a source that was removed and drop its arena reference (main thread)
+static void llm_answer_source_release(gpointer user_data)
+{
+    LLMAnswerSource *source = (LLMAnswerSource *)user_data;
+    LLMPlugin *plugin = source->answer->plugin;
+
+    g_mutex_lock(&plugin->answer_sources_lock);
+    g_hash_table_remove(plugin->answer_sources, source);
+    g_mutex_unlock(&plugin->answer_sources_lock);
+    llm_arena_unref(source->answer->arena);
+}
+
+void llm_answer_add_source(LLMAnswer *answer, guint interval_ms, GSourceFunc func, gpointer data)
+{
+    LLMPlugin *plugin = answer->plugin;
+    LLMAnswerSource *source = llm_arena_new0(answer->arena, LLMAnswerSource);
+    source->answer = answer;
+    source->func = func;
+    source->data = data;
+    llm_arena_ref(answer->arena);
+
+    // Held while adding, so the release of a source that runs at once waits until it is tracked
+    g_mutex_lock(&plugin->answer_sources_lock);
+    if (interval_ms > 0) {
+        source->id = gdk_threads_add_timeout_full(G_PRIORITY_DEFAULT, interval_ms,
+            llm_answer_source_dispatch, source, llm_answer_source_release);
+    } else {
+        source->id = gdk_threads_add_idle_full(G_PRIORITY_DEFAULT_IDLE,
+            llm_answer_source_dispatch, source, llm_answer_source_release);
+    }
+    g_hash_table_add(plugin->answer_sources, source);
+    g_mutex_unlock(&plugin->answer_sources_lock);
+}
+
+void llm_answer_close(LLMPlugin *plugin)
+{
+    llm_answer_stop(plugin);
+
+    // Removing a source releases it, which takes the lock
+    GArray *ids = g_array_new(FALSE, FALSE, sizeof(guint));
+    g_mutex_lock(&plugin->answer_sources_lock);
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, plugin->answer_sources);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        g_array_append_val(ids, ((LLMAnswerSource *)key)->id);
+    }
+    g_mutex_unlock(&plugin->answer_sources_lock);
+    for (guint i = 0; i < ids->len; i++) {
+        g_source_remove(g_array_index(ids, guint, i));
+    }
+    g_array_free(ids, TRUE);
+
+    g_hash_table_destroy(plugin->answer_sources);
+    plugin->answer_sources = NULL;
+    g_mutex_clear(&plugin->answer_sources_lock);
+    llm_answer_release(plugin);
+}
@@ -0,0 +1,62 @@
+#ifndef __LLM_ANSWER_H__
+#define __LLM_ANSWER_H__
+
+#include "plugin.h"
+
+/**
+ * State of the chat answer. LLMPlugin.answer_state packs the generation of
+ * the current answer and whether it is still running into one atomic int,
+ * so that every transition is a single atomic operation:
+ *
+ *     idle --begin--> running --finish--> idle
+ *                        |
+ *                        +--stop--> idle, next generation
+ *
+ * Begin and stop happen on the main thread, finish on whichever thread
+ * reports the end. Every callback and idle item carries the LLMAnswer it
+ * belongs to and does nothing once its generation is no longer current,
+ * so a stopped answer cannot write into the next one. Stop does not wait
+ * for the worker, a new answer can be started right away.
+ *
+ * The idle and timeout sources of every answer are tracked on the plugin,
+ * so that unloading it can remove them before they run against freed state.
+ */
+
+#define LLM_ANSWER_RUNNING 1u
+#define LLM_ANSWER_GENERATION(state) ((guint)(state) >> 1)
+
+/// @brief Start a new answer if none is running (main thread). Takes
+/// ownership of the candidates and replaces the plugin's last answer.
+/// @return the answer with one arena reference for the job, NULL if one is running
+LLMAnswer *llm_answer_begin(LLMPlugin *plugin, LLMCandidateSet *candidates);
+
+/// @brief TRUE while the current answer is running
+gboolean llm_answer_running(LLMPlugin *plugin);
+
+/// @brief TRUE unless the answer was stopped or a newer one started
+gboolean llm_answer_is_current(const LLMAnswer *answer);
+
+/// @brief Mark the answer as done, from any thread
+/// @return TRUE for the one caller that made the transition, which updates the UI
+gboolean llm_answer_finish(LLMAnswer *answer);
+
+/// @brief Stop the running answer and make its pending work stale (main thread)
+/// @return FALSE if no answer was running
+gboolean llm_answer_stop(LLMPlugin *plugin);
+
+/// @brief Drop the plugin's reference to its last answer (main thread)
+void llm_answer_release(LLMPlugin *plugin);
+
+/// @brief Set up the tracking of the answers' sources (main thread)
+void llm_answer_init(LLMPlugin *plugin);
+
+/// @brief Call func(data) on the main thread, from any thread. The source
+/// holds a reference to the answer's arena until it is removed.
+/// @param interval_ms 0 for an idle callback, else a repeating timeout
+void llm_answer_add_source(LLMAnswer *answer, guint interval_ms, GSourceFunc func, gpointer data);
+
+/// @brief Stop the running answer, remove the pending sources of all
+/// answers and drop the last one. Call once no worker reports any more (main thread)
+void llm_answer_close(LLMPlugin *plugin);
+
+#endif // __LLM_ANSWER_H__
@@ -0,0 +1,193 @@
+#include <string.h>
+
+#include "llm_arena.h"
+
+#define LLM_ARENA_ALIGN 16
+#define LLM_ARENA_ALIGN_UP(n) (((n) + LLM_ARENA_ALIGN - 1) & ~(gsize)(LLM_ARENA_ALIGN - 1))
+
+typedef struct LLMArenaBlock {
+    struct LLMArenaBlock *next;
+    gsize size;         // Usable bytes after the header
+    gsize used;
+} LLMArenaBlock;
+
+/// @brief Header is padded so that the data following it stays aligned
+#define LLM_ARENA_HEADER_SIZE LLM_ARENA_ALIGN_UP(sizeof(LLMArenaBlock))
+#define LLM_ARENA_BLOCK_DATA(block) ((gchar *)(block) + LLM_ARENA_HEADER_SIZE)
+
+typedef struct LLMArenaCleanup {
+    GDestroyNotify destroy;
+    gpointer data;
+    struct LLMArenaCleanup *next;
+} LLMArenaCleanup;
+
+/// @brief Lives at the start of its first block
+struct LLMArena {
+    gint ref_count;
+    GMutex lock;
+    LLMArenaBlock *blocks;      // Current block first
+    LLMArenaCleanup *cleanups;  // Last registered first
+    gsize used;
+};
+
+static GMutex llm_arena_cache_lock;
+static LLMArenaBlock *llm_arena_cache = NULL;
+static guint llm_arena_cache_count = 0;
+
+/// @brief Take a block of the standard size from the cache or the heap
+static LLMArenaBlock *llm_arena_block_take(void)
+{
+    g_mutex_lock(&llm_arena_cache_lock);
+    LLMArenaBlock *block = llm_arena_cache;
+    if (block) {
+        llm_arena_cache = block->next;
+        llm_arena_cache_count--;
+    }
+    g_mutex_unlock(&llm_arena_cache_lock);
+
+    if (!block) {
+        block = g_malloc(LLM_ARENA_HEADER_SIZE + LLM_ARENA_BLOCK_SIZE);
+        block->size = LLM_ARENA_BLOCK_SIZE;
+    }
+    block->next = NULL;
+    block->used = 0;
+    return block;
+}
+
+/// @brief Return a block to the cache, oversized ones and the surplus go back to the heap
+static void llm_arena_block_give(LLMArenaBlock *block)
+{
+    if (block->size == LLM_ARENA_BLOCK_SIZE) {
+        g_mutex_lock(&llm_arena_cache_lock);
+        if (llm_arena_cache_count < LLM_ARENA_CACHED_BLOCKS) {
+            block->next = llm_arena_cache;
+            llm_arena_cache = block;
+            llm_arena_cache_count++;
+            block = NULL;
+        }
+        g_mutex_unlock(&llm_arena_cache_lock);
+    }
+    g_free(block);
+}
+
+LLMArena *llm_arena_new(void)
+{
+    LLMArenaBlock *block = llm_arena_block_take();
+    LLMArena *arena = (LLMArena *)LLM_ARENA_BLOCK_DATA(block);
+    block->used = LLM_ARENA_ALIGN_UP(sizeof(LLMArena));
+
+    arena->ref_count = 1;
+    g_mutex_init(&arena->lock);
+    arena->blocks = block;
+    arena->cleanups = NULL;
+    arena->used = 0;
+    return arena;
+}
+
+LLMArena *llm_arena_ref(LLMArena *arena)
+{
+    g_atomic_int_inc(&arena->ref_count);
+    return arena;
+}
+
+void llm_arena_unref(LLMArena *arena)
+{
+    if (!arena || !g_atomic_int_dec_and_test(&arena->ref_count)) {
+        return;
+    }
+
+    // Nobody else holds the arena any more, no locking needed
+    for (LLMArenaCleanup *cleanup = arena->cleanups; cleanup; cleanup = cleanup->next) {
+        cleanup->destroy(cleanup->data);
+    }
+    g_mutex_clear(&arena->lock);
+
+    // The arena itself lives in the last block
+    LLMArenaBlock *block = arena->blocks;
+    while (block) {
+        LLMArenaBlock *next = block->next;
+        llm_arena_block_give(block);
+        block = next;
+    }
+}
+
+gpointer llm_arena_alloc(LLMArena *arena, gsize size)
+{
+    size = LLM_ARENA_ALIGN_UP(MAX(size, 1));
+
+    g_mutex_lock(&arena->lock);
+    LLMArenaBlock *block = arena->blocks;
+    if (block->size - block->used < size) {
+        if (size > LLM_ARENA_BLOCK_SIZE / 4) {
+            // Large allocations get a block of their own behind the current one,
+            // which keeps its free space for the small ones
+            LLMArenaBlock *large = g_malloc(LLM_ARENA_HEADER_SIZE + size);
+            large->size = large->used = size;
+            large->next = block->next;
+            block->next = large;
+            arena->used += size;
+            g_mutex_unlock(&arena->lock);
+            return LLM_ARENA_BLOCK_DATA(large);
+        }
+        block = llm_arena_block_take();
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+
+    gpointer memory = LLM_ARENA_BLOCK_DATA(block) + block->used;
+    block->used += size;
+    arena->used += size;
+    g_mutex_unlock(&arena->lock);
+    return memory;
+}
+
+gpointer llm_arena_alloc0(LLMArena *arena, gsize size)
+{
+    gpointer memory = llm_arena_alloc(arena, size);
+    memset(memory, 0, size);
+    return memory;
+}
+
+gchar *llm_arena_strdup(LLMArena *arena, const gchar *str)
+{
+    return str ? llm_arena_strndup(arena, str, strlen(str)) : NULL;
+}
+
+gchar *llm_arena_strndup(LLMArena *arena, const gchar *str, gsize n)
+{
+    if (!str) {
+        return NULL;
+    }
+
+    const gchar *end = memchr(str, '\0', n);
+    gsize length = end ? (gsize)(end - str) : n;
+    gchar *copy = llm_arena_alloc(arena, length + 1);
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+gpointer llm_arena_own(LLMArena *arena, gpointer data, GDestroyNotify destroy)
+{
+    if (!data) {
+        return NULL;
+    }
+
+    LLMArenaCleanup *cleanup = llm_arena_alloc(arena, sizeof(LLMArenaCleanup));
+    cleanup->destroy = destroy;
+    cleanup->data = data;
+
+    g_mutex_lock(&arena->lock);
+    cleanup->next = arena->cleanups;
+    arena->cleanups = cleanup;
+    g_mutex_unlock(&arena->lock);
+    return data;
+}
+
+gsize llm_arena_used(LLMArena *arena)
+{
+    g_mutex_lock(&arena->lock);
+    gsize used = arena->used;
+    g_mutex_unlock(&arena->lock);
+    return used;
+}
@@ -0,0 +1,58 @@
+#ifndef __LLM_ARENA_H__
+#define __LLM_ARENA_H__
+
+#include <glib.h>
+
+/**
+ * Request-scoped memory. Everything one request allocates between the send
+ * click and its last UI update comes from its arena and is released at
+ * once when the last reference is dropped: the job holds one, every queued
+ * idle callback holds one. Nothing in an arena is freed on its own.
+ *
+ * Allocation bumps a pointer in a block of LLM_ARENA_BLOCK_SIZE bytes.
+ * Released blocks are kept for the next requests, so a steady stream of
+ * requests does not go back to malloc. Heap objects built by other code
+ * (GPtrArrays, LLMArgs) are tied to the arena with llm_arena_own().
+ *
+ * Arenas may be used from several threads at once.
+ */
+
+typedef struct LLMArena LLMArena;
+
+#define LLM_ARENA_BLOCK_SIZE 8192
+/// @brief Released blocks kept for reuse, process-wide
+#define LLM_ARENA_CACHED_BLOCKS 32
+
+/// @brief Create an arena with one reference
+LLMArena *llm_arena_new(void);
+
+/// @brief Take a reference
+LLMArena *llm_arena_ref(LLMArena *arena);
+
+/// @brief Drop a reference. The last one runs the destroy functions given to
+/// llm_arena_own() in reverse order and releases all memory.
+void llm_arena_unref(LLMArena *arena);
+
+/// @brief Allocate size bytes aligned for any type, uninitialized
+gpointer llm_arena_alloc(LLMArena *arena, gsize size);
+
+/// @brief Allocate size zeroed bytes
+gpointer llm_arena_alloc0(LLMArena *arena, gsize size);
+
+/// @brief Allocate a zeroed struct
+#define llm_arena_new0(arena, type) ((type *)llm_arena_alloc0((arena), sizeof(type)))
+
+/// @brief Copy a string into the arena, NULL stays NULL
+gchar *llm_arena_strdup(LLMArena *arena, const gchar *str);
+
+/// @brief Copy at most n bytes of a string into the arena, NUL-terminated
+gchar *llm_arena_strndup(LLMArena *arena, const gchar *str, gsize n);
+
+/// @brief Free data with destroy when the arena is released. Does nothing if data is NULL.
+/// @return data
+gpointer llm_arena_own(LLMArena *arena, gpointer data, GDestroyNotify destroy);
+
+/// @brief Bytes handed out so far
+gsize llm_arena_used(LLMArena *arena);
+
+#endif // __LLM_ARENA_H__
@@ -0,0 +1,495 @@
+/**
+ * llm-bench: run prompts against a server through the plugin's core library
+ * and report where the time goes, without starting Geany.
+ *
+ *     llm-bench --url http://localhost:8080 --prompt "Explain this" --file main.c --runs 10
+ *
+ * Every run builds the payload, streams the answer and parses it exactly like
+ * the plugin does. The client side cost (CPU time and, with glibc, heap
+ * allocations) is measured per run, so regressions of the hot path show up
+ * as more microseconds or allocations per streamed chunk.
+ *
+ * The --max-* options turn a run into a pass/fail regression check, best
+ * against llm-mock-server so that the server's pace is known:
+ *
+ *     llm-bench --url http://127.0.0.1:8089 --prompt hi --runs 20 \
+ *         --max-ttft-overhead 5 --max-cpu-per-chunk 100 --max-allocs-per-chunk 40 --max-rss 64
+ *
+ * With --capture every transfer is recorded, and --replay feeds such a
+ * recording (or one written by the plugin) back through the same parser at
+ * the recorded pace, or at once with --replay-fast, without any server:
+ *
+ *     llm-bench --replay capture-20261019-101500-1.txt --runs 3
+ *
+ * With --parse it benchmarks the stream parser on its own instead, see
+ * llm_bench_parse.c.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <curl/curl.h>
+
+#include "llm_types.h"
+#include "llm_http.h"
+#include "llm_json.h"
+#include "llm_util.h"
+#include "llm_stats.h"
+#include "llm_trace.h"
+#include "llm_capture.h"
+#include "llm_bench.h"
+
+#define LLM_BENCH_DEFAULT_PATH "/v1/completions"
+
+#ifdef LLM_BENCH_COUNT_ALLOCS
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static gint llm_bench_alloc_count = 0;
+static gint64 llm_bench_alloc_bytes = 0;
+
+/// @brief Count the allocations of this process, GLib, json-c and curl included
+static void llm_bench_count_alloc(size_t size)
+{
+    g_atomic_int_inc(&llm_bench_alloc_count);
+    __atomic_fetch_add(&llm_bench_alloc_bytes, (gint64)size, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size)
+{
+    llm_bench_count_alloc(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    llm_bench_count_alloc(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    llm_bench_count_alloc(size);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+#endif
+
+/// @brief Result of one run
+typedef struct {
+    LLMRequestMetrics metrics;
+    BenchUsage usage;
+    gsize bytes;          // Streamed answer text
+    gboolean ok;
+} BenchRun;
+
+static gchar *opt_url = NULL;
+static gchar *opt_path = NULL;
+static gchar *opt_prompt = NULL;
+static gchar *opt_prompt_file = NULL;
+static gchar **opt_files = NULL;
+static gchar *opt_model = NULL;
+static gchar *opt_api_key = NULL;
+static gchar *opt_proxy = NULL;
+static gchar *opt_trace_dir = NULL;
+static gchar *opt_capture_dir = NULL;
+static gchar *opt_replay = NULL;
+static gboolean opt_replay_fast = FALSE;
+static gint opt_runs = 5;
+static gint opt_warmup = 1;
+static gint opt_max_tokens = 256;
+static gdouble opt_temperature = 0.0;
+static gboolean opt_print = FALSE;
+static gboolean opt_allow_failures = FALSE;
+static gdouble opt_max_ttft_overhead = 0;
+static gdouble opt_max_cpu_per_chunk = 0;
+static gdouble opt_max_allocs_per_chunk = 0;
+static gint opt_max_rss = 0;
+static gboolean opt_parse = FALSE;
+static BenchParseOptions parse_options = { .events = 2000, .iterations = 20 };
+
+static GOptionEntry llm_bench_options[] = {
+    { "url", 'u', 0, G_OPTION_ARG_STRING, &opt_url, "Server base URL", "URL" },
+    { "path", 0, 0, G_OPTION_ARG_STRING, &opt_path, "Endpoint path (default " LLM_BENCH_DEFAULT_PATH ")", "PATH" },
+    { "prompt", 'p', 0, G_OPTION_ARG_STRING, &opt_prompt, "Question to ask", "TEXT" },
+    { "prompt-file", 0, 0, G_OPTION_ARG_FILENAME, &opt_prompt_file, "Read the question from a file", "FILE" },
+    { "file", 'f', 0, G_OPTION_ARG_FILENAME_ARRAY, &opt_files, "Attach a document, may be repeated", "FILE" },
+    { "runs", 'n', 0, G_OPTION_ARG_INT, &opt_runs, "Measured runs (default 5)", "N" },
+    { "warmup", 'w', 0, G_OPTION_ARG_INT, &opt_warmup, "Unmeasured runs first (default 1)", "N" },
+    { "max-tokens", 0, 0, G_OPTION_ARG_INT, &opt_max_tokens, "Tokens to generate (default 256)", "N" },
+    { "temperature", 't', 0, G_OPTION_ARG_DOUBLE, &opt_temperature, "Sampling temperature (default 0)", "T" },
+    { "model", 'm', 0, G_OPTION_ARG_STRING, &opt_model, "Model name", "NAME" },
+    { "api-key", 0, 0, G_OPTION_ARG_STRING, &opt_api_key, "Bearer token, defaults to $OPENAI_API_KEY", "KEY" },
+    { "proxy", 0, 0, G_OPTION_ARG_STRING, &opt_proxy, "Proxy URL", "URL" },
+    { "trace", 0, 0, G_OPTION_ARG_FILENAME, &opt_trace_dir, "Write a Chrome trace of all runs to DIR", "DIR" },
+    { "capture", 0, 0, G_OPTION_ARG_FILENAME, &opt_capture_dir, "Record every transfer to a capture file in DIR", "DIR" },
+    { "replay", 'r', 0, G_OPTION_ARG_FILENAME, &opt_replay, "Replay a capture instead of asking a server", "FILE" },
+    { "replay-fast", 0, 0, G_OPTION_ARG_NONE, &opt_replay_fast, "Replay as fast as possible instead of at the recorded pace", NULL },
+    { "print", 0, 0, G_OPTION_ARG_NONE, &opt_print, "Print the answers", NULL },
+    { "allow-failures", 0, 0, G_OPTION_ARG_NONE, &opt_allow_failures, "Failed runs do not fail the benchmark", NULL },
+    { "max-ttft-overhead", 0, 0, G_OPTION_ARG_DOUBLE, &opt_max_ttft_overhead,
+        "Fail if the median TTFT exceeds the server's prompt time by more than MS", "MS" },
+    { "max-cpu-per-chunk", 0, 0, G_OPTION_ARG_DOUBLE, &opt_max_cpu_per_chunk,
+        "Fail if the client needs more CPU time per streamed chunk", "US" },
+    { "max-allocs-per-chunk", 0, 0, G_OPTION_ARG_DOUBLE, &opt_max_allocs_per_chunk,
+        "Fail if the client allocates more often per streamed chunk (glibc only)", "N" },
+    { "max-rss", 0, 0, G_OPTION_ARG_INT, &opt_max_rss, "Fail if the peak resident memory exceeds MB", "MB" },
+    { NULL }
+};
+
+static GOptionEntry llm_bench_parse_options[] = {
+    { "parse", 0, 0, G_OPTION_ARG_NONE, &opt_parse, "Benchmark the stream parser instead of a server", NULL },
+    { "parse-events", 0, 0, G_OPTION_ARG_INT, &parse_options.events, "Events of each synthetic stream (default 2000)", "N" },
+    { "parse-iterations", 0, 0, G_OPTION_ARG_INT, &parse_options.iterations, "Passes over each stream (default 20)", "N" },
+    { "stream", 's', 0, G_OPTION_ARG_FILENAME_ARRAY, &parse_options.stream_files, "Also replay a raw SSE capture, may be repeated", "FILE" },
+    { "max-ns-per-event", 0, 0, G_OPTION_ARG_DOUBLE, &parse_options.max_ns_per_event, "Fail if an event takes longer to parse", "NS" },
+    { "max-allocs-per-event", 0, 0, G_OPTION_ARG_DOUBLE, &parse_options.max_allocs_per_event,
+        "Fail if an event needs more allocations (glibc only)", "N" },
+    { NULL }
+};
+
+void llm_bench_usage(BenchUsage *usage)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    usage->cpu_usec = (gint64)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * G_USEC_PER_SEC +
+        ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+#ifdef LLM_BENCH_COUNT_ALLOCS
+    usage->allocs = g_atomic_int_get(&llm_bench_alloc_count);
+    usage->alloc_bytes = __atomic_load_n(&llm_bench_alloc_bytes, __ATOMIC_RELAXED);
+#else
+    usage->allocs = 0;
+    usage->alloc_bytes = 0;
+#endif
+}
+
+static void llm_bench_on_data_received(const gchar *data_chunk, gpointer user_data)
+{
+    BenchRun *run = (BenchRun *)user_data;
+    run->bytes += strlen(data_chunk);
+    if (opt_print) {
+        fputs(data_chunk, stdout);
+        fflush(stdout);
+    }
+}
+
+static void llm_bench_on_error(const gchar *error_message, gpointer user_data)
+{
+    g_printerr("Error: %s\n", error_message);
+}
+
+static void llm_bench_on_complete(gpointer user_data)
+{
+    if (opt_print) {
+        fputc('\n', stdout);
+    }
+}
+
+/// @brief Build the payload and stream one answer, like a chat request of the plugin.
+/// With a capture the recorded answer is streamed instead.
+static void llm_bench_run(BenchRun *run, const gchar *server_uri, const gchar *prompt,
+    const GPtrArray *documents, const LLMArgs *args, const LLMCapture *capture)
+{
+    BenchUsage before, after;
+    LLMCallbacks callbacks = {
+        .on_data_received = llm_bench_on_data_received,
+        .on_error = llm_bench_on_error,
+        .on_complete = llm_bench_on_complete,
+        .user_data = run
+    };
+
+    memset(run, 0, sizeof(BenchRun));
+    llm_bench_usage(&before);
+    run->metrics.submit_time = run->metrics.snapshot_time = g_get_monotonic_time();
+
+    gchar *json_payload = capture ? NULL : llm_construct_completion_json_payload(prompt, documents, args);
+    run->metrics.payload_time = g_get_monotonic_time();
+    if (capture) {
+        run->ok = llm_capture_replay(capture, !opt_replay_fast, &callbacks, NULL, &run->metrics.transfer);
+    } else if (json_payload) {
+        run->ok = llm_execute_query(server_uri, opt_proxy, opt_api_key, json_payload,
+            &callbacks, NULL, &run->metrics.transfer);
+    }
+    // Nothing to show, the answer is complete once the transfer is
+    run->metrics.ui_flush_time = g_get_monotonic_time();
+    g_free(json_payload);
+
+    llm_bench_usage(&after);
+    run->usage.cpu_usec = after.cpu_usec - before.cpu_usec;
+    run->usage.allocs = after.allocs - before.allocs;
+    run->usage.alloc_bytes = after.alloc_bytes - before.alloc_bytes;
+}
+
+static void llm_bench_print_run(gint index, const BenchRun *run)
+{
+    const LLMTransfer *transfer = &run->metrics.transfer;
+    gchar *readout = llm_stats_readout(&run->metrics);
+    guint chunks = MAX(transfer->chunks, 1);
+
+    g_print("run %d: %s, HTTP %ld, %u chunks, %" G_GSIZE_FORMAT " bytes, %s\n",
+        index, run->ok ? "ok" : "failed", transfer->http_code, transfer->chunks, run->bytes,
+        *readout ? readout : "no tokens");
+    g_print("    client: %.2f ms CPU (%.1f us/chunk)", run->usage.cpu_usec / 1000.0,
+        (gdouble)run->usage.cpu_usec / chunks);
+#ifdef LLM_BENCH_COUNT_ALLOCS
+    g_print(", %d allocations (%.1f/chunk), %.1f KiB", run->usage.allocs,
+        (gdouble)run->usage.allocs / chunks, run->usage.alloc_bytes / 1024.0);
+#endif
+    g_print("\n");
+    g_free(readout);
+}
+
+static void llm_bench_print_summary(LLMStats *stats, const BenchRun *runs, gint count)
+{
+    GString *report = g_string_new(NULL);
+    gint64 cpu_usec = 0, allocs = 0, alloc_bytes = 0;
+    guint chunks = 0;
+
+    llm_stats_describe(stats, report);
+    g_print("\n%s", report->str);
+    g_string_free(report, TRUE);
+
+    for (gint i = 0; i < count; i++) {
+        cpu_usec += runs[i].usage.cpu_usec;
+        allocs += runs[i].usage.allocs;
+        alloc_bytes += runs[i].usage.alloc_bytes;
+        chunks += runs[i].metrics.transfer.chunks;
+    }
+    chunks = MAX(chunks, 1);
+    g_print("Client per chunk: %.1f us CPU", (gdouble)cpu_usec / chunks);
+#ifdef LLM_BENCH_COUNT_ALLOCS
+    g_print(", %.1f allocations, %.0f bytes", (gdouble)allocs / chunks, (gdouble)alloc_bytes / chunks);
+#endif
+    g_print("\n");
+}
+
+static int llm_bench_compare_doubles(const void *a, const void *b)
+{
+    gdouble x = *(const gdouble *)a, y = *(const gdouble *)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/// @brief Median TTFT minus the prompt time the server reported
+/// @return FALSE if no run has server timings to compare with
+static gboolean llm_bench_ttft_overhead(const BenchRun *runs, gint count, gdouble *median)
+{
+    gdouble *overheads = g_new(gdouble, count);
+    gint n = 0;
+
+    for (gint i = 0; i < count; i++) {
+        const LLMTransfer *transfer = &runs[i].metrics.transfer;
+        if (runs[i].ok && transfer->first_token_time && transfer->server.valid) {
+            overheads[n++] = (transfer->first_token_time - runs[i].metrics.submit_time) / 1000.0 -
+                transfer->server.prompt_ms;
+        }
+    }
+    if (n > 0) {
+        qsort(overheads, n, sizeof(gdouble), llm_bench_compare_doubles);
+        *median = overheads[n / 2];
+    }
+    g_free(overheads);
+    return n > 0;
+}
+
+/// @brief Report one limit
+/// @return FALSE if it was exceeded
+static gboolean llm_bench_check(const gchar *name, gdouble value, gdouble limit, const gchar *unit)
+{
+    gboolean ok = value <= limit;
+    g_print("%s %s: %.1f %s (limit %.1f)\n", ok ? "PASS" : "FAIL", name, value, unit, limit);
+    return ok;
+}
+
+/// @brief Compare the runs with the --max-* limits
+/// @return FALSE if any limit was exceeded
+static gboolean llm_bench_check_limits(const BenchRun *runs, gint count)
+{
+    gboolean ok = TRUE;
+    gint64 cpu_usec = 0, allocs = 0;
+    guint chunks = 0;
+
+    for (gint i = 0; i < count; i++) {
+        cpu_usec += runs[i].usage.cpu_usec;
+        allocs += runs[i].usage.allocs;
+        chunks += runs[i].metrics.transfer.chunks;
+    }
+    chunks = MAX(chunks, 1);
+
+    if (opt_max_ttft_overhead > 0) {
+        gdouble overhead;
+        if (llm_bench_ttft_overhead(runs, count, &overhead)) {
+            ok &= llm_bench_check("TTFT overhead", overhead, opt_max_ttft_overhead, "ms");
+        } else {
+            g_print("FAIL TTFT overhead: the server reported no timings\n");
+            ok = FALSE;
+        }
+    }
+    if (opt_max_cpu_per_chunk > 0) {
+        ok &= llm_bench_check("CPU per chunk", (gdouble)cpu_usec / chunks, opt_max_cpu_per_chunk, "us");
+    }
+    if (opt_max_allocs_per_chunk > 0) {
+#ifdef LLM_BENCH_COUNT_ALLOCS
+        ok &= llm_bench_check("Allocations per chunk", (gdouble)allocs / chunks, opt_max_allocs_per_chunk, "");
+#else
+        g_print("SKIP Allocations per chunk: not counted on this platform\n");
+#endif
+    }
+    if (opt_max_rss > 0) {
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        // Linux reports kilobytes
+        ok &= llm_bench_check("Peak RSS", ru.ru_maxrss / 1024.0, opt_max_rss, "MB");
+    }
+    return ok;
+}
+
+/// @brief Read the attached documents, like the snapshot the plugin takes
+static GPtrArray *llm_bench_load_documents(GError **error)
+{
+    GPtrArray *documents = g_ptr_array_new_with_free_func(llm_document_free);
+
+    for (gint i = 0; opt_files && opt_files[i]; i++) {
+        gchar *text = NULL;
+        if (!g_file_get_contents(opt_files[i], &text, NULL, error)) {
+            g_ptr_array_unref(documents);
+            return NULL;
+        }
+        g_ptr_array_add(documents, llm_document_new(opt_files[i], text));
+    }
+    return documents;
+}
+
+int main(int argc, char **argv)
+{
+    GError *error = NULL;
+    GOptionContext *context = g_option_context_new("- benchmark an LLM server through the plugin's request path");
+    g_option_context_add_main_entries(context, llm_bench_options, NULL);
+    GOptionGroup *parse_group = g_option_group_new("parse", "Stream parser microbenchmark:",
+        "Show the parser microbenchmark options", NULL, NULL);
+    g_option_group_add_entries(parse_group, llm_bench_parse_options);
+    g_option_context_add_group(context, parse_group);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 2;
+    }
+    g_option_context_free(context);
+
+    if (opt_parse) {
+        parse_options.events = MAX(parse_options.events, 1);
+        parse_options.iterations = MAX(parse_options.iterations, 1);
+        return llm_bench_parse(&parse_options) ? 0 : 1;
+    }
+
+    LLMCapture *capture = NULL;
+    if (opt_replay) {
+        capture = llm_capture_load(opt_replay, &error);
+        if (!capture) {
+            g_printerr("%s\n", error->message);
+            g_error_free(error);
+            return 2;
+        }
+        g_print("Replaying %u chunks recorded from %s\n", capture->chunks->len,
+            capture->url ? capture->url : "an unknown server");
+    } else if (!opt_url || (!opt_prompt && !opt_prompt_file)) {
+        g_printerr("Usage: llm-bench (--url URL (--prompt TEXT | --prompt-file FILE) | --replay FILE) [--runs N], see --help\n");
+        return 2;
+    }
+    if (opt_runs < 1) {
+        g_printerr("--runs must be at least 1\n");
+        llm_capture_free(capture);
+        return 2;
+    }
+
+    gchar *prompt = NULL;
+    if (opt_prompt_file && !g_file_get_contents(opt_prompt_file, &prompt, NULL, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return 2;
+    }
+    if (!prompt) {
+        prompt = g_strdup(opt_prompt);
+    }
+
+    GPtrArray *documents = llm_bench_load_documents(&error);
+    if (!documents) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_free(prompt);
+        return 2;
+    }
+
+    if (!opt_api_key) {
+        opt_api_key = g_strdup(g_getenv("OPENAI_API_KEY"));
+    }
+
+    LLMArgs args = {
+        .model = opt_model ? opt_model : "",
+        .max_tokens = opt_max_tokens,
+        .temperature = opt_temperature,
+        .n_candidates = 1
+    };
+    gchar *server_uri = capture ? NULL : llm_construct_server_uri_string(opt_url, opt_path ? opt_path : LLM_BENCH_DEFAULT_PATH);
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    if (opt_trace_dir) {
+        llm_trace_start();
+    }
+    if (opt_capture_dir) {
+        llm_capture_set_dir(opt_capture_dir);
+    }
+
+    BenchRun warmup;
+    for (gint i = 0; i < opt_warmup; i++) {
+        llm_bench_run(&warmup, server_uri, prompt, documents, &args, capture);
+        g_print("warm-up %d: %s\n", i + 1, warmup.ok ? "ok" : "failed");
+    }
+
+    LLMStats *stats = llm_stats_new();
+    BenchRun *runs = g_new0(BenchRun, opt_runs);
+    gint failed = 0;
+    for (gint i = 0; i < opt_runs; i++) {
+        llm_bench_run(&runs[i], server_uri, prompt, documents, &args, capture);
+        llm_bench_print_run(i + 1, &runs[i]);
+        if (runs[i].ok) {
+            llm_stats_record(stats, &runs[i].metrics);
+        } else {
+            failed++;
+        }
+    }
+    llm_bench_print_summary(stats, runs, opt_runs);
+    gboolean within_limits = llm_bench_check_limits(runs, opt_runs);
+
+    if (opt_trace_dir) {
+        llm_trace_stop();
+        gchar *path = llm_trace_save(opt_trace_dir, &error);
+        if (!path) {
+            g_printerr("%s\n", error->message);
+            g_clear_error(&error);
+        }
+        g_free(path);
+        llm_trace_free();
+    }
+
+    llm_capture_set_dir(NULL);
+    llm_capture_free(capture);
+    llm_stats_free(stats);
+    g_free(runs);
+    g_free(server_uri);
+    g_ptr_array_unref(documents);
+    g_free(prompt);
+    curl_global_cleanup();
+
+    if (failed > 0 && !opt_allow_failures) {
+        g_print("FAIL %d of %d runs failed\n", failed, opt_runs);
+        return 1;
+    }
+    return within_limits ? 0 : 1;
+}
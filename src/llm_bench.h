@@ -0,0 +1,37 @@
+#ifndef __LLM_BENCH_H__
+#define __LLM_BENCH_H__
+
+#include "llm_types.h"
+
+/**
+ * Shared parts of the llm-bench modes.
+ */
+
+#if defined(__GLIBC__) && !defined(LLM_BENCH_NO_MALLOC_COUNT)
+/// @brief Heap allocations are counted by wrapping malloc
+#define LLM_BENCH_COUNT_ALLOCS 1
+#endif
+
+/// @brief Client side resources used so far
+typedef struct {
+    gint64 cpu_usec;      // User and system time of the process
+    gint allocs;
+    gint64 alloc_bytes;
+} BenchUsage;
+
+/// @brief Options of the parser microbenchmark
+typedef struct {
+    gint events;                // Events of each synthetic stream
+    gint iterations;            // Measured passes over each stream and chunking
+    gchar **stream_files;       // Raw SSE captures to replay besides the synthetic streams
+    gdouble max_ns_per_event;   // Fail above this, 0 for no limit
+    gdouble max_allocs_per_event;
+} BenchParseOptions;
+
+void llm_bench_usage(BenchUsage *usage);
+
+/// @brief Feed recorded streams through the SSE framing and JSON parsing
+/// @return FALSE if a chunking changed the parsed text or a limit was exceeded
+gboolean llm_bench_parse(const BenchParseOptions *options);
+
+#endif // __LLM_BENCH_H__
@@ -0,0 +1,422 @@
+/**
+ * Parser microbenchmark of llm-bench: feeds recorded streams through
+ * llm_write_callback() (SSE framing) and llm_json_to_response() (JSON deltas)
+ * without a network, cut into chunks the way a slow or odd connection would
+ * deliver them. Every chunking must produce the same text as one chunk per
+ * event, so the run doubles as a correctness check of the framing.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <json-c/json.h>
+
+#include "llm_bench.h"
+#include "llm_http.h"
+#include "llm_json.h"
+
+#define LLM_BENCH_BURST_BYTES (64 * 1024)
+
+/// @brief Ways to cut a stream into the chunks curl hands to the write callback
+typedef enum {
+    BENCH_CHUNK_EVENT,      // One chunk per event, the common case
+    BENCH_CHUNK_BYTE,       // One byte at a time
+    BENCH_CHUNK_MID_UTF8,   // Cut inside every multi-byte character and event terminator
+    BENCH_CHUNK_BURST,      // 64 KB at a time, many events per chunk
+    BENCH_CHUNK_COUNT
+} BenchChunking;
+
+static const gchar *bench_chunking_names[BENCH_CHUNK_COUNT] = {
+    "per event",
+    "1 byte",
+    "mid UTF-8",
+    "64 KB bursts"
+};
+
+/// @brief A stream to replay
+typedef struct {
+    gchar *name;
+    GString *data;          // Raw SSE bytes as received from the server
+    guint events;
+} BenchStream;
+
+/// @brief Receives what the parser extracts
+typedef struct {
+    GString *text;          // NULL while measuring
+    guint chunks;
+    guint errors;
+    gboolean complete;
+} BenchSink;
+
+static const gchar *bench_vocabulary[] = {
+    " the", " quick", " brown", " fox", "(", "x", ")", " {", "\n", "    return",
+    " caf\xc3\xa9", " \xe2\x86\x92", " \xe6\x97\xa5\xe6\x9c\xac", " \"quoted\"", "\t", " \xf0\x9f\x98\x80",
+    " jumps", " over", ";", "\n}"
+};
+
+static void bench_silent_print(const gchar *string)
+{
+}
+
+static void bench_string_free(gpointer data)
+{
+    g_string_free((GString *)data, TRUE);
+}
+
+static void bench_on_data_received(const gchar *data_chunk, gpointer user_data)
+{
+    BenchSink *sink = (BenchSink *)user_data;
+    sink->chunks++;
+    if (sink->text) {
+        g_string_append(sink->text, data_chunk);
+    }
+}
+
+static void bench_on_error(const gchar *error_message, gpointer user_data)
+{
+    BenchSink *sink = (BenchSink *)user_data;
+    sink->errors++;
+}
+
+static void bench_on_complete(gpointer user_data)
+{
+    BenchSink *sink = (BenchSink *)user_data;
+    sink->complete = TRUE;
+}
+
+static void bench_append_event(BenchStream *stream, struct json_object *event)
+{
+    g_string_append(stream->data, "data: ");
+    g_string_append(stream->data, json_object_to_json_string_ext(event, JSON_C_TO_STRING_PLAIN));
+    g_string_append(stream->data, "\n\n");
+    json_object_put(event);
+    stream->events++;
+}
+
+/// @brief Stream in the format of llama-server's /v1/completions, timings in the last event
+static BenchStream *bench_llama_stream(gint events)
+{
+    BenchStream *stream = g_new0(BenchStream, 1);
+    stream->name = g_strdup("llama.cpp completions");
+    stream->data = g_string_new(NULL);
+
+    for (gint i = 0; i <= events; i++) {
+        gboolean last = i == events;
+        struct json_object *root = json_object_new_object();
+        struct json_object *choices = json_object_new_array();
+        struct json_object *choice = json_object_new_object();
+        json_object_object_add(choice, "text", json_object_new_string(
+            last ? "" : bench_vocabulary[i % G_N_ELEMENTS(bench_vocabulary)]));
+        json_object_object_add(choice, "index", json_object_new_int(0));
+        json_object_object_add(choice, "logprobs", NULL);
+        json_object_object_add(choice, "finish_reason", last ? json_object_new_string("length") : NULL);
+        json_object_array_add(choices, choice);
+        json_object_object_add(root, "choices", choices);
+        json_object_object_add(root, "created", json_object_new_int(1745789013));
+        json_object_object_add(root, "model", json_object_new_string("qwen-coder-2.5"));
+        json_object_object_add(root, "system_fingerprint", json_object_new_string("b5142-80f19b41"));
+        json_object_object_add(root, "object", json_object_new_string("text_completion"));
+        json_object_object_add(root, "id", json_object_new_string("chatcmpl-bU4YfE6u2KzMghB7xhoWScfbcFfHwdXi"));
+        if (last) {
+            struct json_object *timings = json_object_new_object();
+            json_object_object_add(timings, "prompt_n", json_object_new_int(8));
+            json_object_object_add(timings, "prompt_ms", json_object_new_double(1968.901));
+            json_object_object_add(timings, "predicted_n", json_object_new_int(events));
+            json_object_object_add(timings, "predicted_ms", json_object_new_double(events * 20.0));
+            json_object_object_add(timings, "predicted_per_second", json_object_new_double(50.0));
+            json_object_object_add(root, "timings", timings);
+        }
+        bench_append_event(stream, root);
+    }
+    g_string_append(stream->data, "data: [DONE]\n\n");
+    stream->events++;
+    return stream;
+}
+
+/// @brief Stream in the format of OpenAI's /v1/chat/completions
+static BenchStream *bench_openai_stream(gint events)
+{
+    BenchStream *stream = g_new0(BenchStream, 1);
+    stream->name = g_strdup("OpenAI chat");
+    stream->data = g_string_new(NULL);
+
+    for (gint i = 0; i < events; i++) {
+        struct json_object *root = json_object_new_object();
+        struct json_object *choices = json_object_new_array();
+        struct json_object *choice = json_object_new_object();
+        struct json_object *delta = json_object_new_object();
+        json_object_object_add(root, "id", json_object_new_string("chatcmpl-AbCdEfGhIjKlMnOpQrStUvWxYz012"));
+        json_object_object_add(root, "object", json_object_new_string("chat.completion.chunk"));
+        json_object_object_add(root, "created", json_object_new_int(1745789013));
+        json_object_object_add(root, "model", json_object_new_string("gpt-4o-mini-2024-07-18"));
+        json_object_object_add(root, "system_fingerprint", json_object_new_string("fp_0ba0d124f1"));
+        json_object_object_add(delta, "content", json_object_new_string(bench_vocabulary[i % G_N_ELEMENTS(bench_vocabulary)]));
+        json_object_object_add(choice, "index", json_object_new_int(0));
+        json_object_object_add(choice, "delta", delta);
+        json_object_object_add(choice, "logprobs", NULL);
+        json_object_object_add(choice, "finish_reason", NULL);
+        json_object_array_add(choices, choice);
+        json_object_object_add(root, "choices", choices);
+        bench_append_event(stream, root);
+    }
+
+    // The last event carries the finish reason and an empty delta
+    struct json_object *root = json_object_new_object();
+    struct json_object *choices = json_object_new_array();
+    struct json_object *choice = json_object_new_object();
+    json_object_object_add(root, "id", json_object_new_string("chatcmpl-AbCdEfGhIjKlMnOpQrStUvWxYz012"));
+    json_object_object_add(root, "object", json_object_new_string("chat.completion.chunk"));
+    json_object_object_add(choice, "index", json_object_new_int(0));
+    json_object_object_add(choice, "delta", json_object_new_object());
+    json_object_object_add(choice, "finish_reason", json_object_new_string("stop"));
+    json_object_array_add(choices, choice);
+    json_object_object_add(root, "choices", choices);
+    bench_append_event(stream, root);
+
+    g_string_append(stream->data, "data: [DONE]\n\n");
+    stream->events++;
+    return stream;
+}
+
+/// @brief Stream from a raw capture, e.g. written by curl --no-buffer
+static BenchStream *bench_file_stream(const gchar *file_name, GError **error)
+{
+    gchar *contents = NULL;
+    gsize length = 0;
+    if (!g_file_get_contents(file_name, &contents, &length, error)) {
+        return NULL;
+    }
+
+    BenchStream *stream = g_new0(BenchStream, 1);
+    stream->name = g_path_get_basename(file_name);
+    stream->data = g_string_new_len(contents, length);
+    g_free(contents);
+    for (const gchar *p = stream->data->str; (p = strstr(p, "\n\n")) != NULL; p += 2) {
+        stream->events++;
+    }
+    return stream;
+}
+
+static void bench_stream_free(BenchStream *stream)
+{
+    g_free(stream->name);
+    g_string_free(stream->data, TRUE);
+    g_free(stream);
+}
+
+/// @brief Lengths of the chunks a stream is cut into
+static GArray *bench_chunk_lengths(const GString *data, BenchChunking chunking)
+{
+    GArray *lengths = g_array_new(FALSE, FALSE, sizeof(gsize));
+    gsize start = 0;
+
+    for (gsize i = 0; i < data->len; i++) {
+        guchar c = (guchar)data->str[i];
+        gboolean cut;
+        switch (chunking) {
+            case BENCH_CHUNK_BYTE:
+                cut = TRUE;
+                break;
+            case BENCH_CHUNK_MID_UTF8:
+                // After the lead byte of a multi-byte character, and between the two newlines
+                cut = c >= 0xC0 || (c == '\n' && i + 1 < data->len && data->str[i + 1] == '\n');
+                break;
+            case BENCH_CHUNK_BURST:
+                cut = i + 1 - start == LLM_BENCH_BURST_BYTES;
+                break;
+            case BENCH_CHUNK_EVENT:
+            default:
+                cut = c == '\n' && i > 0 && data->str[i - 1] == '\n';
+                break;
+        }
+        if (cut) {
+            gsize length = i + 1 - start;
+            g_array_append_val(lengths, length);
+            start = i + 1;
+        }
+    }
+    if (start < data->len) {
+        gsize length = data->len - start;
+        g_array_append_val(lengths, length);
+    }
+    return lengths;
+}
+
+/// @brief Replay a stream through the write callback once
+static void bench_feed(const GString *data, const GArray *lengths, BenchSink *sink)
+{
+    LLMCallbacks callbacks = {
+        .on_data_received = bench_on_data_received,
+        .on_error = bench_on_error,
+        .on_complete = bench_on_complete,
+        .user_data = sink
+    };
+    LLMTransfer transfer = {0};
+    WriteCallbackData callback_data = {
+        .accumulator = g_string_new(NULL),
+        .callbacks = &callbacks,
+        .cancel_flag = NULL,
+        .transfer = &transfer
+    };
+
+    gsize offset = 0;
+    for (guint i = 0; i < lengths->len; i++) {
+        gsize length = g_array_index(lengths, gsize, i);
+        llm_write_callback(data->str + offset, 1, length, &callback_data);
+        offset += length;
+    }
+    g_string_free(callback_data.accumulator, TRUE);
+}
+
+static void bench_report(const gchar *stream, const gchar *mode, guint events, gsize bytes,
+    gint iterations, gint64 usec, const BenchUsage *before, const BenchUsage *after)
+{
+    guint64 total_events = MAX((guint64)events * iterations, 1);
+    gdouble ns_per_event = usec * 1000.0 / total_events;
+    gdouble mb_per_s = usec > 0 ? (gdouble)bytes * iterations / usec : 0;
+
+    printf("%-24s %-14s %10.0f ns/event %9.1f MB/s", stream, mode, ns_per_event, mb_per_s);
+#ifdef LLM_BENCH_COUNT_ALLOCS
+    printf(" %8.1f allocs/event", (gdouble)(after->allocs - before->allocs) / total_events);
+#endif
+    printf("\n");
+}
+
+/// @brief Check a measurement against the limits
+static gboolean bench_within_limits(const BenchParseOptions *options, guint events, gint iterations,
+    gint64 usec, const BenchUsage *before, const BenchUsage *after)
+{
+    guint64 total_events = MAX((guint64)events * iterations, 1);
+    gboolean ok = TRUE;
+
+    if (options->max_ns_per_event > 0 && usec * 1000.0 / total_events > options->max_ns_per_event) {
+        ok = FALSE;
+    }
+#ifdef LLM_BENCH_COUNT_ALLOCS
+    if (options->max_allocs_per_event > 0 &&
+        (gdouble)(after->allocs - before->allocs) / total_events > options->max_allocs_per_event) {
+        ok = FALSE;
+    }
+#endif
+    if (!ok) {
+        printf("FAIL above the --max-*-per-event limits\n");
+    }
+    return ok;
+}
+
+/// @brief Time the framing and parsing of one stream under every chunking
+static gboolean bench_stream(const BenchParseOptions *options, const BenchStream *stream)
+{
+    BenchSink reference = { .text = g_string_new(NULL) };
+    GArray *lengths = bench_chunk_lengths(stream->data, BENCH_CHUNK_EVENT);
+    gboolean ok = TRUE;
+
+    bench_feed(stream->data, lengths, &reference);
+    g_array_unref(lengths);
+
+    for (gint chunking = 0; chunking < BENCH_CHUNK_COUNT; chunking++) {
+        lengths = bench_chunk_lengths(stream->data, chunking);
+
+        // Unmeasured pass: the text must not depend on how the bytes arrived
+        BenchSink check = { .text = g_string_new(NULL) };
+        bench_feed(stream->data, lengths, &check);
+        if (!g_string_equal(check.text, reference.text) || check.errors != reference.errors) {
+            printf("FAIL %s, %s: %" G_GSIZE_FORMAT " bytes of text and %u errors, expected %"
+                G_GSIZE_FORMAT " and %u\n", stream->name, bench_chunking_names[chunking],
+                check.text->len, check.errors, reference.text->len, reference.errors);
+            ok = FALSE;
+        }
+        g_string_free(check.text, TRUE);
+
+        BenchUsage before, after;
+        BenchSink sink = {0};
+        llm_bench_usage(&before);
+        gint64 start = g_get_monotonic_time();
+        for (gint i = 0; i < options->iterations; i++) {
+            bench_feed(stream->data, lengths, &sink);
+        }
+        gint64 usec = g_get_monotonic_time() - start;
+        llm_bench_usage(&after);
+        g_array_unref(lengths);
+
+        bench_report(stream->name, bench_chunking_names[chunking], stream->events, stream->data->len,
+            options->iterations, usec, &before, &after);
+        ok &= bench_within_limits(options, stream->events, options->iterations, usec, &before, &after);
+    }
+
+    if (reference.errors > 0) {
+        printf("%-24s %u events were reported as errors\n", stream->name, reference.errors);
+    }
+    g_string_free(reference.text, TRUE);
+    return ok;
+}
+
+/// @brief Time llm_json_to_response() alone on the events of a stream
+static void bench_json(const BenchParseOptions *options, const BenchStream *stream)
+{
+    GPtrArray *events = g_ptr_array_new_with_free_func(bench_string_free);
+    const gchar *p = stream->data->str;
+    const gchar *end;
+    gsize bytes = 0;
+
+    while ((end = strstr(p, "\n\n")) != NULL) {
+        if (g_str_has_prefix(p, "data: {")) {
+            GString *json = g_string_new_len(p + 6, end - p - 6);
+            bytes += json->len;
+            g_ptr_array_add(events, json);
+        }
+        p = end + 2;
+    }
+
+    BenchUsage before, after;
+    llm_bench_usage(&before);
+    gint64 start = g_get_monotonic_time();
+    for (gint i = 0; i < options->iterations; i++) {
+        for (guint j = 0; j < events->len; j++) {
+            LLMResponse response;
+            if (llm_json_to_response(&response, g_ptr_array_index(events, j), NULL)) {
+                g_free(response.response_text);
+                g_free(response.error);
+            }
+        }
+    }
+    gint64 usec = g_get_monotonic_time() - start;
+    llm_bench_usage(&after);
+
+    bench_report(stream->name, "JSON only", events->len, bytes, options->iterations, usec, &before, &after);
+    g_ptr_array_unref(events);
+}
+
+gboolean llm_bench_parse(const BenchParseOptions *options)
+{
+    GPtrArray *streams = g_ptr_array_new_with_free_func((GDestroyNotify)bench_stream_free);
+    gboolean ok = TRUE;
+
+    g_ptr_array_add(streams, bench_llama_stream(options->events));
+    g_ptr_array_add(streams, bench_openai_stream(options->events));
+    for (gint i = 0; options->stream_files && options->stream_files[i]; i++) {
+        GError *error = NULL;
+        BenchStream *stream = bench_file_stream(options->stream_files[i], &error);
+        if (!stream) {
+            g_printerr("%s\n", error->message);
+            g_error_free(error);
+            ok = FALSE;
+            continue;
+        }
+        g_ptr_array_add(streams, stream);
+    }
+
+    // The write callback reports every finished stream through g_print(),
+    // the results are printed to stdout directly
+    GPrintFunc print = g_set_print_handler(bench_silent_print);
+    for (guint i = 0; i < streams->len; i++) {
+        BenchStream *stream = g_ptr_array_index(streams, i);
+        printf("%s: %u events, %" G_GSIZE_FORMAT " bytes, %d iterations\n",
+            stream->name, stream->events, stream->data->len, options->iterations);
+        ok &= bench_stream(options, stream);
+        bench_json(options, stream);
+        printf("\n");
+    }
+    g_set_print_handler(print);
+
+    g_ptr_array_unref(streams);
+    return ok;
+}
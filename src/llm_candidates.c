@@ -0,0 +1,174 @@
+#include <string.h>
+
+#include "llm_candidates.h"
+
+static void llm_candidate_free(gpointer data)
+{
+    LLMCandidate *candidate = (LLMCandidate *)data;
+    if (!candidate) {
+        return;
+    }
+    g_string_free(candidate->text, TRUE);
+    g_free(candidate);
+}
+
+/// @brief Length of the longest suffix of candidate that is a prefix of following_text.
+/// Leading whitespace of the following text is ignored, so a candidate that
+/// completes right up to the next statement scores the same as one that
+/// includes the indentation.
+static gsize llm_candidates_agreement(const gchar *candidate, const gchar *following_text)
+{
+    if (IS_NULL_OR_EMPTY(candidate) || IS_NULL_OR_EMPTY(following_text)) {
+        return 0;
+    }
+
+    while (*following_text && g_ascii_isspace(*following_text)) {
+        following_text++;
+    }
+
+    gsize candidate_len = strlen(candidate);
+    while (candidate_len > 0 && g_ascii_isspace(candidate[candidate_len - 1])) {
+        candidate_len--;
+    }
+
+    gsize window = strnlen(following_text, LLM_CANDIDATE_AGREEMENT_WINDOW);
+    gsize max_overlap = MIN(window, candidate_len);
+
+    for (gsize k = max_overlap; k > 0; k--) {
+        if (memcmp(candidate + candidate_len - k, following_text, k) == 0) {
+            return k;
+        }
+    }
+    return 0;
+}
+
+static gint llm_candidates_compare(gconstpointer a, gconstpointer b)
+{
+    const LLMCandidate *ca = *(const LLMCandidate * const *)a;
+    const LLMCandidate *cb = *(const LLMCandidate * const *)b;
+
+    if (ca->score > cb->score) {
+        return -1;
+    }
+    if (ca->score < cb->score) {
+        return 1;
+    }
+    return 0;
+}
+
+LLMCandidateSet *llm_candidates_new(const gchar *following_text)
+{
+    LLMCandidateSet *set = g_new0(LLMCandidateSet, 1);
+    g_mutex_init(&set->lock);
+    set->items = g_ptr_array_new_with_free_func(llm_candidate_free);
+    set->following_text = g_strdup(following_text);
+    return set;
+}
+
+void llm_candidates_free(LLMCandidateSet *set)
+{
+    if (!set) {
+        return;
+    }
+    g_ptr_array_free(set->items, TRUE);
+    g_free(set->following_text);
+    g_mutex_clear(&set->lock);
+    g_free(set);
+}
+
+void llm_candidates_append(LLMCandidateSet *set, guint index, const gchar *text,
+    gdouble logprob, gboolean has_logprob)
+{
+    if (!set) {
+        return;
+    }
+
+    g_mutex_lock(&set->lock);
+    if (set->ranked) {
+        // Late chunk after ranking, indices no longer map to choices
+        g_mutex_unlock(&set->lock);
+        return;
+    }
+
+    while (set->items->len <= index) {
+        LLMCandidate *candidate = g_new0(LLMCandidate, 1);
+        candidate->text = g_string_new(NULL);
+        g_ptr_array_add(set->items, candidate);
+    }
+
+    LLMCandidate *candidate = g_ptr_array_index(set->items, index);
+    if (text) {
+        g_string_append(candidate->text, text);
+    }
+    if (has_logprob) {
+        candidate->logprob += logprob;
+        candidate->n_logprobs++;
+    }
+    g_mutex_unlock(&set->lock);
+}
+
+guint llm_candidates_count(LLMCandidateSet *set)
+{
+    if (!set) {
+        return 0;
+    }
+
+    g_mutex_lock(&set->lock);
+    guint count = set->items->len;
+    g_mutex_unlock(&set->lock);
+    return count;
+}
+
+void llm_candidates_rank(LLMCandidateSet *set)
+{
+    if (!set) {
+        return;
+    }
+
+    g_mutex_lock(&set->lock);
+    for (guint i = 0; i < set->items->len; i++) {
+        LLMCandidate *candidate = g_ptr_array_index(set->items, i);
+        gsize agreement = llm_candidates_agreement(candidate->text->str, set->following_text);
+
+        candidate->score = candidate->logprob + LLM_CANDIDATE_AGREEMENT_WEIGHT * (gdouble)agreement;
+        // Empty candidates are useless regardless of their probability
+        if (candidate->text->len == 0) {
+            candidate->score = -G_MAXDOUBLE;
+        }
+    }
+    // Stable sort: equal scores keep the server's choice order
+    g_ptr_array_sort(set->items, llm_candidates_compare);
+    set->current = 0;
+    set->ranked = TRUE;
+    g_mutex_unlock(&set->lock);
+}
+
+const gchar *llm_candidates_current(LLMCandidateSet *set)
+{
+    if (!set) {
+        return NULL;
+    }
+
+    g_mutex_lock(&set->lock);
+    const gchar *text = NULL;
+    if (set->current < set->items->len) {
+        LLMCandidate *candidate = g_ptr_array_index(set->items, set->current);
+        text = candidate->text->str;
+    }
+    g_mutex_unlock(&set->lock);
+    return text;
+}
+
+const gchar *llm_candidates_cycle(LLMCandidateSet *set)
+{
+    if (!set) {
+        return NULL;
+    }
+
+    g_mutex_lock(&set->lock);
+    if (set->items->len > 0) {
+        set->current = (set->current + 1) % set->items->len;
+    }
+    g_mutex_unlock(&set->lock);
+    return llm_candidates_current(set);
+}
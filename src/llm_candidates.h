@@ -0,0 +1,59 @@
+#ifndef __LLM_CANDIDATES_H__
+#define __LLM_CANDIDATES_H__
+
+#include "plugin.h" // LLMCandidateSet
+
+/**
+ * Alternative completions returned by one request (OpenAI "n" / llama.cpp
+ * parallel sequences), ranked locally so the user can cycle through them
+ * without another round-trip.
+ */
+
+/// @brief Upper bound for the number of candidates per request
+#define LLM_MAX_CANDIDATES 8
+/// @brief Weight of one character of agreement with the text after the cursor, in logprob units.
+#define LLM_CANDIDATE_AGREEMENT_WEIGHT 0.25
+/// @brief Only this many characters of the following text are compared.
+#define LLM_CANDIDATE_AGREEMENT_WINDOW 256
+
+/// @brief A single candidate answer
+typedef struct {
+    GString *text;
+    gdouble logprob;   // Cumulative logprob of the received tokens
+    guint n_logprobs;  // Number of tokens that carried a logprob
+    gdouble score;     // Ranking score, valid after llm_candidates_rank()
+} LLMCandidate;
+
+/// @brief Candidates of one request. Filled from the worker thread, read on the UI thread.
+struct LLMCandidateSet {
+    GMutex lock;
+    GPtrArray *items;       // LLMCandidate*, indexed by choice index until ranked
+    gchar *following_text;  // Document text after the cursor at request time
+    guint current;          // Candidate currently shown
+    gboolean ranked;
+};
+
+/// @brief Create an empty candidate set
+/// @param following_text text after the cursor, may be NULL
+LLMCandidateSet *llm_candidates_new(const gchar *following_text);
+
+/// @brief Free the candidate set
+void llm_candidates_free(LLMCandidateSet *set);
+
+/// @brief Append a streamed chunk to the candidate with the given choice index (thread safe).
+void llm_candidates_append(LLMCandidateSet *set, guint index, const gchar *text,
+    gdouble logprob, gboolean has_logprob);
+
+/// @brief Number of candidates received so far
+guint llm_candidates_count(LLMCandidateSet *set);
+
+/// @brief Sort the candidates by cumulative logprob and agreement with the following text.
+void llm_candidates_rank(LLMCandidateSet *set);
+
+/// @brief Text of the candidate currently shown, NULL if there is none.
+const gchar *llm_candidates_current(LLMCandidateSet *set);
+
+/// @brief Advance to the next candidate (wrapping) and return its text.
+const gchar *llm_candidates_cycle(LLMCandidateSet *set);
+
+#endif // __LLM_CANDIDATES_H__
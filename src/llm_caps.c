@@ -0,0 +1,361 @@
+#include <json-c/json.h>
+
+#include "llm_caps.h"
+#include "llm_http.h"
+#include "llm_util.h"
+
+/// @brief Smallest request /infill answers without generating anything
+#define LLM_CAPS_INFILL_PROBE "{\"input_prefix\": \"\", \"input_suffix\": \"\", \"n_predict\": 0}"
+
+struct LLMCapsCache {
+    GMutex lock;
+    GHashTable *entries;    // URL -> LLMServerCaps*
+    GHashTable *probing;    // URLs with a probe running
+    gchar *path;
+};
+
+static LLMServerCaps *llm_server_caps_new(const gchar *url)
+{
+    LLMServerCaps *caps = g_new0(LLMServerCaps, 1);
+    caps->ref_count = 1;
+    caps->url = g_strdup(url);
+    return caps;
+}
+
+LLMServerCaps *llm_server_caps_ref(LLMServerCaps *caps)
+{
+    g_atomic_int_inc(&caps->ref_count);
+    return caps;
+}
+
+void llm_server_caps_unref(LLMServerCaps *caps)
+{
+    if (caps && g_atomic_int_dec_and_test(&caps->ref_count)) {
+        g_free(caps->url);
+        g_free(caps->model);
+        g_free(caps->chat_template);
+        g_free(caps);
+    }
+}
+
+gboolean llm_server_caps_stale(const LLMServerCaps *caps)
+{
+    gint64 max_age = caps->reachable ? LLM_CAPS_MAX_AGE_USEC : LLM_CAPS_RETRY_AGE_USEC;
+    gint64 age = g_get_real_time() - caps->probe_time;
+    // A clock set back makes the age negative
+    return age < 0 || age >= max_age;
+}
+
+/// @brief GET or POST a path of the server and parse the JSON answer
+/// @return the HTTP status, 0 if there was no response
+static glong llm_caps_fetch_json(const gchar *url, const gchar *path, const gchar *proxy_url,
+    const gchar *api_key, const gchar *json_payload, gboolean *cancel_flag, struct json_object **root)
+{
+    gchar *uri = llm_construct_server_uri_string(url, path);
+    if (!uri) {
+        return 0;
+    }
+
+    GString *body = g_string_new(NULL);
+    glong http_code = llm_http_fetch(uri, proxy_url, api_key, json_payload, cancel_flag, body);
+    *root = http_code >= 200 && http_code < 300 ? json_tokener_parse(body->str) : NULL;
+    g_string_free(body, TRUE);
+    g_free(uri);
+    return http_code;
+}
+
+static guint llm_caps_get_uint(struct json_object *obj, const gchar *key)
+{
+    struct json_object *value = NULL;
+    if (json_object_object_get_ex(obj, key, &value) && json_object_is_type(value, json_type_int)) {
+        gint64 number = json_object_get_int64(value);
+        return number > 0 && number <= G_MAXUINT ? (guint)number : 0;
+    }
+    return 0;
+}
+
+static gchar *llm_caps_get_string(struct json_object *obj, const gchar *key)
+{
+    struct json_object *value = NULL;
+    if (json_object_object_get_ex(obj, key, &value) && json_object_is_type(value, json_type_string) &&
+        json_object_get_string_len(value) > 0) {
+        return g_strdup(json_object_get_string(value));
+    }
+    return NULL;
+}
+
+/// @brief Read llama.cpp's /props
+static void llm_caps_parse_props(LLMServerCaps *caps, struct json_object *root)
+{
+    struct json_object *settings = NULL;
+    if (json_object_object_get_ex(root, "default_generation_settings", &settings)) {
+        caps->context_size = llm_caps_get_uint(settings, "n_ctx");
+    }
+    if (caps->context_size == 0) {
+        // Older servers have it at the top
+        caps->context_size = llm_caps_get_uint(root, "n_ctx");
+    }
+    caps->slots = llm_caps_get_uint(root, "total_slots");
+    caps->chat_template = llm_caps_get_string(root, "chat_template");
+
+    gchar *model_path = llm_caps_get_string(root, "model_path");
+    if (model_path) {
+        caps->model = g_path_get_basename(model_path);
+        g_free(model_path);
+    }
+}
+
+/// @brief Read llama.cpp's /slots, only where /props left a gap
+static void llm_caps_parse_slots(LLMServerCaps *caps, struct json_object *root)
+{
+    if (!json_object_is_type(root, json_type_array) || json_object_array_length(root) == 0) {
+        return;
+    }
+    if (caps->slots == 0) {
+        caps->slots = (guint)json_object_array_length(root);
+    }
+    if (caps->context_size == 0) {
+        caps->context_size = llm_caps_get_uint(json_object_array_get_idx(root, 0), "n_ctx");
+    }
+}
+
+/// @brief Read the OpenAI compatible model list, the first model is the one served
+static void llm_caps_parse_models(LLMServerCaps *caps, struct json_object *root)
+{
+    struct json_object *data = NULL;
+    if (!json_object_object_get_ex(root, "data", &data) || !json_object_is_type(data, json_type_array) ||
+        json_object_array_length(data) == 0) {
+        return;
+    }
+
+    gchar *model = llm_caps_get_string(json_object_array_get_idx(data, 0), "id");
+    if (model) {
+        g_free(caps->model);
+        caps->model = model;
+    }
+}
+
+LLMServerCaps *llm_caps_probe(const gchar *url, const gchar *proxy_url, const gchar *api_key,
+    gboolean *cancel_flag)
+{
+    g_return_val_if_fail(url, NULL);
+
+    LLMServerCaps *caps = llm_server_caps_new(url);
+    struct json_object *root = NULL;
+
+    // 503 while llama-server loads the model, 404 on servers without it
+    glong health = llm_caps_fetch_json(url, "/health", proxy_url, api_key, NULL, cancel_flag, &root);
+    g_clear_pointer(&root, json_object_put);
+    caps->reachable = health > 0;
+
+    if (caps->reachable && llm_caps_fetch_json(url, "/props", proxy_url, api_key, NULL, cancel_flag, &root) == 200 && root) {
+        caps->llama_server = TRUE;
+        llm_caps_parse_props(caps, root);
+    }
+    g_clear_pointer(&root, json_object_put);
+
+    // Disabled unless llama-server runs with --slots
+    if (caps->llama_server && llm_caps_fetch_json(url, "/slots", proxy_url, api_key, NULL, cancel_flag, &root) == 200 && root) {
+        llm_caps_parse_slots(caps, root);
+    }
+    g_clear_pointer(&root, json_object_put);
+
+    glong models = caps->reachable ?
+        llm_caps_fetch_json(url, "/v1/models", proxy_url, api_key, NULL, cancel_flag, &root) : 0;
+    if (models == 200 && root) {
+        llm_caps_parse_models(caps, root);
+    }
+    g_clear_pointer(&root, json_object_put);
+    caps->healthy = health == 200 || (health == 404 && models == 200);
+
+    // Refused right away when the model has no FIM tokens
+    if (caps->llama_server && caps->healthy) {
+        caps->infill = llm_caps_fetch_json(url, "/infill", proxy_url, api_key, LLM_CAPS_INFILL_PROBE,
+            cancel_flag, &root) == 200;
+        g_clear_pointer(&root, json_object_put);
+    }
+
+    if (LLM_CANCELLED(cancel_flag)) {
+        llm_server_caps_unref(caps);
+        return NULL;
+    }
+    caps->probe_time = g_get_real_time();
+    return caps;
+}
+
+/// @brief Read the entries of the cache file, the lock is not needed yet
+static void llm_caps_cache_load(LLMCapsCache *cache)
+{
+    GKeyFile *key_file = g_key_file_new();
+    GError *error = NULL;
+
+    if (!g_key_file_load_from_file(key_file, cache->path, G_KEY_FILE_NONE, &error)) {
+        if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            g_print("Could not load %s: %s\n", cache->path, error->message);
+        }
+        g_error_free(error);
+        g_key_file_free(key_file);
+        return;
+    }
+
+    // One group per server, missing keys read as unknown
+    gchar **urls = g_key_file_get_groups(key_file, NULL);
+    for (gint i = 0; urls[i] != NULL; i++) {
+        LLMServerCaps *caps = llm_server_caps_new(urls[i]);
+        caps->probe_time = g_key_file_get_int64(key_file, urls[i], "probe_time", NULL);
+        caps->reachable = g_key_file_get_boolean(key_file, urls[i], "reachable", NULL);
+        caps->healthy = g_key_file_get_boolean(key_file, urls[i], "healthy", NULL);
+        caps->llama_server = g_key_file_get_boolean(key_file, urls[i], "llama_server", NULL);
+        caps->context_size = (guint)MAX(g_key_file_get_integer(key_file, urls[i], "context_size", NULL), 0);
+        caps->slots = (guint)MAX(g_key_file_get_integer(key_file, urls[i], "slots", NULL), 0);
+        caps->infill = g_key_file_get_boolean(key_file, urls[i], "infill", NULL);
+        caps->model = g_key_file_get_string(key_file, urls[i], "model", NULL);
+        caps->chat_template = g_key_file_get_string(key_file, urls[i], "chat_template", NULL);
+        g_hash_table_replace(cache->entries, caps->url, caps);
+    }
+
+    g_strfreev(urls);
+    g_key_file_free(key_file);
+}
+
+/// @brief Write all entries to the cache file, called with the lock held
+static void llm_caps_cache_save_locked(LLMCapsCache *cache)
+{
+    if (!cache->path) {
+        return;
+    }
+
+    GKeyFile *key_file = g_key_file_new();
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, cache->entries);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        const LLMServerCaps *caps = (const LLMServerCaps *)value;
+        g_key_file_set_int64(key_file, caps->url, "probe_time", caps->probe_time);
+        g_key_file_set_boolean(key_file, caps->url, "reachable", caps->reachable);
+        g_key_file_set_boolean(key_file, caps->url, "healthy", caps->healthy);
+        g_key_file_set_boolean(key_file, caps->url, "llama_server", caps->llama_server);
+        g_key_file_set_integer(key_file, caps->url, "context_size", (gint)caps->context_size);
+        g_key_file_set_integer(key_file, caps->url, "slots", (gint)caps->slots);
+        g_key_file_set_boolean(key_file, caps->url, "infill", caps->infill);
+        if (caps->model) {
+            g_key_file_set_string(key_file, caps->url, "model", caps->model);
+        }
+        if (caps->chat_template) {
+            g_key_file_set_string(key_file, caps->url, "chat_template", caps->chat_template);
+        }
+    }
+
+    GError *error = NULL;
+    if (!g_key_file_save_to_file(key_file, cache->path, &error)) {
+        g_print("Could not save %s: %s\n", cache->path, error->message);
+        g_error_free(error);
+    }
+    g_key_file_free(key_file);
+}
+
+LLMCapsCache *llm_caps_cache_new(const gchar *path)
+{
+    LLMCapsCache *cache = g_new0(LLMCapsCache, 1);
+    g_mutex_init(&cache->lock);
+    // Keys are owned by the entries
+    cache->entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+        (GDestroyNotify)llm_server_caps_unref);
+    cache->probing = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    cache->path = g_strdup(path);
+    if (cache->path) {
+        llm_caps_cache_load(cache);
+    }
+    return cache;
+}
+
+void llm_caps_cache_free(LLMCapsCache *cache)
+{
+    if (!cache) {
+        return;
+    }
+
+    g_hash_table_destroy(cache->entries);
+    g_hash_table_destroy(cache->probing);
+    g_free(cache->path);
+    g_mutex_clear(&cache->lock);
+    g_free(cache);
+}
+
+LLMServerCaps *llm_caps_cache_lookup(LLMCapsCache *cache, const gchar *url)
+{
+    if (!cache || !url) {
+        return NULL;
+    }
+
+    g_mutex_lock(&cache->lock);
+    LLMServerCaps *caps = g_hash_table_lookup(cache->entries, url);
+    if (caps) {
+        llm_server_caps_ref(caps);
+    }
+    g_mutex_unlock(&cache->lock);
+    return caps;
+}
+
+void llm_caps_cache_store(LLMCapsCache *cache, LLMServerCaps *caps)
+{
+    g_return_if_fail(cache && caps);
+
+    g_mutex_lock(&cache->lock);
+    g_hash_table_replace(cache->entries, caps->url, llm_server_caps_ref(caps));
+    llm_caps_cache_save_locked(cache);
+    g_mutex_unlock(&cache->lock);
+}
+
+gboolean llm_caps_cache_begin_probe(LLMCapsCache *cache, const gchar *url)
+{
+    g_return_val_if_fail(cache && url, FALSE);
+
+    g_mutex_lock(&cache->lock);
+    gboolean claimed = !g_hash_table_contains(cache->probing, url);
+    if (claimed) {
+        g_hash_table_add(cache->probing, g_strdup(url));
+    }
+    g_mutex_unlock(&cache->lock);
+    return claimed;
+}
+
+void llm_caps_cache_end_probe(LLMCapsCache *cache, const gchar *url)
+{
+    g_return_if_fail(cache && url);
+
+    g_mutex_lock(&cache->lock);
+    g_hash_table_remove(cache->probing, url);
+    g_mutex_unlock(&cache->lock);
+}
+
+void llm_caps_cache_describe(LLMCapsCache *cache, GString *out)
+{
+    if (!cache || !out) {
+        return;
+    }
+
+    gint64 now = g_get_real_time();
+
+    g_mutex_lock(&cache->lock);
+    if (g_hash_table_size(cache->entries) == 0) {
+        g_string_append(out, "No server probed yet.\n");
+    }
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, cache->entries);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        const LLMServerCaps *caps = (const LLMServerCaps *)value;
+        const gchar *status = !caps->reachable ? "unreachable" : (caps->healthy ? "ready" : "not ready");
+        const gchar *probing = g_hash_table_contains(cache->probing, caps->url) ? ", probing" : "";
+
+        g_string_append_printf(out, "%s\n  %s, probed %" G_GINT64_FORMAT " min ago%s\n", caps->url, status,
+            (now - caps->probe_time) / (60 * G_USEC_PER_SEC), probing);
+        if (caps->reachable) {
+            g_string_append_printf(out, "  model: %s, context: %u tokens per slot, slots: %u, FIM: %s, chat template: %s\n",
+                caps->model ? caps->model : "unknown", caps->context_size, caps->slots,
+                caps->infill ? "yes" : "no", caps->chat_template ? "yes" : "no");
+        }
+    }
+    g_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,77 @@
+#ifndef __LLM_CAPS_H__
+#define __LLM_CAPS_H__
+
+#include "llm_types.h"
+
+/**
+ * Server capabilities. A probe asks a server what it offers: /health for
+ * readiness, /props and /slots (llama.cpp) for the context size, the slot
+ * count and the chat template, /v1/models for the model served and a
+ * minimal /infill request for FIM support. Servers without an endpoint
+ * simply leave its fields unknown.
+ *
+ * The results are kept in a cache shared by the UI and worker threads and
+ * written to a file, so a session starts with the capabilities of the last
+ * one and lookups never wait for the network. Entries older than
+ * LLM_CAPS_MAX_AGE_USEC are stale; the caller decides when to probe again.
+ */
+
+/// @brief Capabilities are probed again after this long
+#define LLM_CAPS_MAX_AGE_USEC (G_GINT64_CONSTANT(60 * 60) * G_USEC_PER_SEC)
+/// @brief A server that did not answer is probed again sooner
+#define LLM_CAPS_RETRY_AGE_USEC (60 * G_USEC_PER_SEC)
+
+/// @brief What a server reported, immutable once probed
+typedef struct {
+    gint ref_count;
+    gchar *url;
+    gint64 probe_time;      // Real time (us) of the probe, the cache outlives the session
+    gboolean reachable;     // The server answered at all
+    gboolean healthy;       // /health reported it ready, or a server without /health answered
+    gboolean llama_server;  // /props answered, the llama.cpp extensions are available
+    guint context_size;     // Tokens per slot, 0 if unknown
+    guint slots;            // Requests served in parallel, 0 if unknown
+    gboolean infill;        // /infill accepts requests, the model has FIM tokens
+    gchar *model;           // Model served, NULL if unknown
+    gchar *chat_template;   // Jinja chat template, NULL if unknown
+} LLMServerCaps;
+
+typedef struct LLMCapsCache LLMCapsCache;
+
+/// @brief Ask a server for its capabilities, blocking (worker thread)
+/// @param cancel_flag aborts the probe when set, may be NULL
+/// @return new capabilities, NULL if cancelled
+LLMServerCaps *llm_caps_probe(const gchar *url, const gchar *proxy_url, const gchar *api_key,
+    gboolean *cancel_flag);
+
+LLMServerCaps *llm_server_caps_ref(LLMServerCaps *caps);
+
+void llm_server_caps_unref(LLMServerCaps *caps);
+
+/// @brief TRUE if the capabilities should be probed again
+gboolean llm_server_caps_stale(const LLMServerCaps *caps);
+
+/// @brief Create a cache backed by a file
+/// @param path file read now and written on every update, NULL to keep it in memory
+LLMCapsCache *llm_caps_cache_new(const gchar *path);
+
+void llm_caps_cache_free(LLMCapsCache *cache);
+
+/// @brief Capabilities of a server, stale ones included
+/// @return a new reference, NULL if the server was never probed
+LLMServerCaps *llm_caps_cache_lookup(LLMCapsCache *cache, const gchar *url);
+
+/// @brief Replace the capabilities of caps->url and write the cache file
+void llm_caps_cache_store(LLMCapsCache *cache, LLMServerCaps *caps);
+
+/// @brief Claim the probe of a server, so only one runs at a time
+/// @return TRUE if the caller should probe, FALSE if a probe is running already
+gboolean llm_caps_cache_begin_probe(LLMCapsCache *cache, const gchar *url);
+
+/// @brief Release a claim of llm_caps_cache_begin_probe()
+void llm_caps_cache_end_probe(LLMCapsCache *cache, const gchar *url);
+
+/// @brief Append a human readable paragraph per server to out
+void llm_caps_cache_describe(LLMCapsCache *cache, GString *out);
+
+#endif // __LLM_CAPS_H__
@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <glib/gstdio.h>
+
+#include "llm_capture.h"
+#include "llm_http.h"
+
+#define LLM_CAPTURE_MAGIC "geany-llm-capture 1"
+/// @brief Longest sleep of a realtime replay before the cancel flag is checked again
+#define LLM_CAPTURE_WAIT_SLICE_US 50000
+
+struct LLMCaptureWriter {
+    FILE *file;
+    gchar *path;
+    gint64 start_time;  // Monotonic time (us) the request was sent
+};
+
+static GMutex llm_capture_lock;     // Protects llm_capture_dir
+static gchar *llm_capture_dir = NULL;
+static gint llm_capture_active = 0;
+static gint llm_capture_sequence = 0;
+
+void llm_capture_set_dir(const gchar *dir)
+{
+    g_mutex_lock(&llm_capture_lock);
+    g_free(llm_capture_dir);
+    llm_capture_dir = g_strdup(dir);
+    g_atomic_int_set(&llm_capture_active, dir != NULL);
+    g_mutex_unlock(&llm_capture_lock);
+}
+
+gboolean llm_capture_enabled(void)
+{
+    return g_atomic_int_get(&llm_capture_active);
+}
+
+LLMCaptureWriter *llm_capture_writer_new(const gchar *url, const gchar *request)
+{
+    if (!g_atomic_int_get(&llm_capture_active) || !url || !request) {
+        return NULL;
+    }
+
+    GDateTime *now = g_date_time_new_now_local();
+    gchar *stamp = g_date_time_format(now, "%Y%m%d-%H%M%S");
+    gchar *file_name = g_strdup_printf("capture-%s-%d.txt", stamp,
+        g_atomic_int_add(&llm_capture_sequence, 1) + 1);
+    g_free(stamp);
+    g_date_time_unref(now);
+
+    g_mutex_lock(&llm_capture_lock);
+    gchar *path = llm_capture_dir ? g_build_filename(llm_capture_dir, file_name, NULL) : NULL;
+    g_mutex_unlock(&llm_capture_lock);
+    g_free(file_name);
+    if (!path) {
+        return NULL;
+    }
+
+    FILE *file = g_fopen(path, "wb");
+    if (!file) {
+        g_print("Could not write capture %s: %s\n", path, g_strerror(errno));
+        g_free(path);
+        return NULL;
+    }
+
+    gsize request_length = strlen(request);
+    fprintf(file, LLM_CAPTURE_MAGIC "\nurl %s\nrequest %" G_GSIZE_FORMAT "\n", url, request_length);
+    fwrite(request, 1, request_length, file);
+    fputc('\n', file);
+
+    LLMCaptureWriter *writer = g_new0(LLMCaptureWriter, 1);
+    writer->file = file;
+    writer->path = path;
+    writer->start_time = g_get_monotonic_time();
+    return writer;
+}
+
+void llm_capture_writer_append(LLMCaptureWriter *writer, const gchar *data, gsize length)
+{
+    if (!writer || length == 0) {
+        return;
+    }
+
+    fprintf(writer->file, "chunk %" G_GINT64_FORMAT " %" G_GSIZE_FORMAT "\n",
+        g_get_monotonic_time() - writer->start_time, length);
+    fwrite(data, 1, length, writer->file);
+    fputc('\n', writer->file);
+    // The capture is most useful when the editor hangs and gets killed
+    fflush(writer->file);
+}
+
+void llm_capture_writer_finish(LLMCaptureWriter *writer, glong http_code, const gchar *result)
+{
+    if (!writer) {
+        return;
+    }
+
+    fprintf(writer->file, "end %" G_GINT64_FORMAT " %ld %s\n",
+        g_get_monotonic_time() - writer->start_time, http_code, result ? result : "OK");
+    gboolean failed = ferror(writer->file) != 0;
+    if (fclose(writer->file) != 0) {
+        failed = TRUE;
+    }
+    if (failed) {
+        g_print("Error writing capture %s: %s\n", writer->path, g_strerror(errno));
+    } else {
+        g_print("Wrote capture %s\n", writer->path);
+    }
+    g_free(writer->path);
+    g_free(writer);
+}
+
+static void llm_capture_chunk_clear(gpointer data)
+{
+    LLMCaptureChunk *chunk = (LLMCaptureChunk *)data;
+    g_free(chunk->data);
+}
+
+/// @brief Take the payload of length bytes following the current line
+static gchar *llm_capture_read_payload(const gchar **pos, const gchar *end, gint64 length)
+{
+    if (length < 0 || end - *pos < length + 1 || (*pos)[length] != '\n') {
+        return NULL;
+    }
+    gchar *payload = g_strndup(*pos, length);
+    *pos += length + 1;
+    return payload;
+}
+
+LLMCapture *llm_capture_load(const gchar *path, GError **error)
+{
+    gchar *contents = NULL;
+    gsize length = 0;
+    if (!g_file_get_contents(path, &contents, &length, error)) {
+        return NULL;
+    }
+
+    LLMCapture *capture = g_new0(LLMCapture, 1);
+    capture->chunks = g_array_new(FALSE, FALSE, sizeof(LLMCaptureChunk));
+    g_array_set_clear_func(capture->chunks, llm_capture_chunk_clear);
+
+    const gchar *pos = contents;
+    const gchar *end = contents + length;
+    gboolean valid = g_str_has_prefix(contents, LLM_CAPTURE_MAGIC "\n");
+    guint line_number = 0;
+
+    while (valid && pos < end) {
+        const gchar *line_end = memchr(pos, '\n', end - pos);
+        if (!line_end) {
+            // Recording stopped in the middle of a line, keep what is complete
+            break;
+        }
+        gchar *line = g_strndup(pos, line_end - pos);
+        pos = line_end + 1;
+        line_number++;
+
+        if (line_number == 1) {
+            // Magic, checked above
+        } else if (g_str_has_prefix(line, "url ")) {
+            g_free(capture->url);
+            capture->url = g_strdup(line + 4);
+        } else if (g_str_has_prefix(line, "request ")) {
+            g_free(capture->request);
+            capture->request = llm_capture_read_payload(&pos, end, g_ascii_strtoll(line + 8, NULL, 10));
+            valid = capture->request != NULL;
+        } else if (g_str_has_prefix(line, "chunk ")) {
+            gchar *next = NULL;
+            LLMCaptureChunk chunk;
+            chunk.offset = g_ascii_strtoll(line + 6, &next, 10);
+            gint64 chunk_length = g_ascii_strtoll(next, NULL, 10);
+            chunk.data = llm_capture_read_payload(&pos, end, chunk_length);
+            if (!chunk.data) {
+                // Cut off while writing the last chunk
+                g_free(line);
+                break;
+            }
+            chunk.length = chunk_length;
+            g_array_append_val(capture->chunks, chunk);
+        } else if (g_str_has_prefix(line, "end ")) {
+            gchar *next = NULL;
+            capture->end_offset = MAX(g_ascii_strtoll(line + 4, &next, 10), 1);
+            capture->http_code = g_ascii_strtoll(next, &next, 10);
+            capture->result = g_strdup(g_strstrip(next));
+        } else {
+            valid = FALSE;
+        }
+        g_free(line);
+    }
+    g_free(contents);
+
+    if (!valid || !capture->request) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+            "%s is not a valid capture (line %u)", path, line_number);
+        llm_capture_free(capture);
+        return NULL;
+    }
+    return capture;
+}
+
+void llm_capture_free(LLMCapture *capture)
+{
+    if (!capture) {
+        return;
+    }
+    g_free(capture->url);
+    g_free(capture->request);
+    g_array_free(capture->chunks, TRUE);
+    g_free(capture->result);
+    g_free(capture);
+}
+
+/// @brief Sleep until the monotonic time target
+/// @return FALSE if cancelled meanwhile
+static gboolean llm_capture_wait(gint64 target, gboolean *cancel_flag)
+{
+    gint64 now;
+    while ((now = g_get_monotonic_time()) < target) {
+        if (LLM_CANCELLED(cancel_flag)) {
+            return FALSE;
+        }
+        g_usleep(MIN(target - now, LLM_CAPTURE_WAIT_SLICE_US));
+    }
+    return !LLM_CANCELLED(cancel_flag);
+}
+
+gboolean llm_capture_replay(const LLMCapture *capture, gboolean realtime,
+    LLMCallbacks *callbacks, gboolean *cancel_flag, LLMTransfer *transfer)
+{
+    LLMTransfer local_transfer = {0};
+    if (!transfer) {
+        transfer = &local_transfer;
+    }
+
+    GString *accumulator = g_string_new(NULL);
+    WriteCallbackData callback_data = {
+        .accumulator = accumulator,
+        .callbacks = callbacks,
+        .cancel_flag = cancel_flag,
+        .transfer = transfer
+    };
+    transfer->start_time = g_get_monotonic_time();
+    transfer->connect_time = 0;
+    transfer->first_byte_time = 0;
+    transfer->first_token_time = 0;
+    transfer->last_token_time = 0;
+    transfer->chunks = 0;
+    transfer->text_received = FALSE;
+    memset(&transfer->server, 0, sizeof(transfer->server));
+
+    gboolean cancelled = FALSE;
+    for (guint i = 0; i < capture->chunks->len && !cancelled; i++) {
+        LLMCaptureChunk *chunk = &g_array_index(capture->chunks, LLMCaptureChunk, i);
+        if (realtime && !llm_capture_wait(transfer->start_time + chunk->offset, cancel_flag)) {
+            cancelled = TRUE;
+        } else if (llm_write_callback(chunk->data, 1, chunk->length, &callback_data) != chunk->length) {
+            cancelled = TRUE;
+        }
+    }
+    if (!cancelled && realtime && capture->end_offset > 0) {
+        cancelled = !llm_capture_wait(transfer->start_time + capture->end_offset, cancel_flag);
+    }
+    transfer->end_time = g_get_monotonic_time();
+    transfer->http_code = capture->http_code;
+    g_string_free(accumulator, TRUE);
+
+    if (cancelled) {
+        return FALSE;
+    }
+
+    gchar *error_msg = NULL;
+    if (capture->end_offset == 0) {
+        error_msg = g_strdup("The capture ends before the transfer did");
+    } else if (capture->http_code >= 400 || g_strcmp0(capture->result, "OK") != 0) {
+        error_msg = g_strdup_printf("Captured transfer failed: %s (HTTP %ld)",
+            capture->result ? capture->result : "unknown error", capture->http_code);
+    }
+    if (error_msg && callbacks && callbacks->on_error) {
+        callbacks->on_error(error_msg, callbacks->user_data);
+    }
+    gboolean success = error_msg == NULL;
+    g_free(error_msg);
+    return success;
+}
@@ -0,0 +1,81 @@
+#ifndef __LLM_CAPTURE_H__
+#define __LLM_CAPTURE_H__
+
+#include "llm_types.h"
+
+/**
+ * Record and replay of streamed transfers.
+ *
+ * While a capture directory is set, llm_execute_query() writes every attempt
+ * to a new file there: the URL, the exact request body and each chunk of
+ * raw response bytes with its time since the request was sent. The API key
+ * is not written. A capture is replayed through llm_write_callback(), so the
+ * parser, the callbacks and the UI see the same bytes in the same pieces as
+ * during the original transfer, either at the original pace or as fast as
+ * possible.
+ *
+ * The file is text with binary payloads, every payload preceded by its size:
+ *
+ *     geany-llm-capture 1
+ *     url http://localhost:8080/v1/completions
+ *     request 123
+ *     {...}
+ *     chunk 152034 87
+ *     data: {...}
+ *
+ *     end 2480112 200 OK
+ */
+
+/// @brief Directory below the plugin's config directory holding the captures
+#define LLM_CAPTURE_DIR "captures"
+
+/// @brief Chunk of response bytes as curl delivered it
+typedef struct {
+    gint64 offset;      // Microseconds since the request was sent
+    gsize length;
+    gchar *data;
+} LLMCaptureChunk;
+
+/// @brief A capture loaded from a file
+struct LLMCapture {
+    gchar *url;
+    gchar *request;
+    GArray *chunks;     // LLMCaptureChunk
+    gint64 end_offset;  // Microseconds until the transfer ended, 0 if it did not
+    glong http_code;
+    gchar *result;      // Outcome of the transfer, "OK" or the curl error
+};
+
+/// @brief Record the transfers into dir from now on, NULL to stop recording
+void llm_capture_set_dir(const gchar *dir);
+
+/// @brief TRUE while transfers are recorded
+gboolean llm_capture_enabled(void);
+
+/// @brief Start recording a transfer, call right before sending it
+/// @return the recording, NULL when not recording or the file could not be created
+LLMCaptureWriter *llm_capture_writer_new(const gchar *url, const gchar *request);
+
+/// @brief Record response bytes as they arrive. Does nothing if writer is NULL.
+void llm_capture_writer_append(LLMCaptureWriter *writer, const gchar *data, gsize length);
+
+/// @brief Record the outcome, close the file and free the writer. Does nothing if writer is NULL.
+void llm_capture_writer_finish(LLMCaptureWriter *writer, glong http_code, const gchar *result);
+
+/// @brief Read a capture file
+/// @return the capture, NULL on error
+LLMCapture *llm_capture_load(const gchar *path, GError **error);
+
+/// @brief Free a capture
+void llm_capture_free(LLMCapture *capture);
+
+/// @brief Feed a capture through the stream parser and callbacks in place of
+/// llm_execute_query(). With realtime the chunks are delivered at their
+/// recorded times, otherwise back to back. A failed transfer is reported
+/// through on_error like the original one was.
+/// @param transfer optional, receives the timings of the replay
+/// @return TRUE if the recorded transfer succeeded and the replay was not cancelled
+gboolean llm_capture_replay(const LLMCapture *capture, gboolean realtime,
+    LLMCallbacks *callbacks, gboolean *cancel_flag, LLMTransfer *transfer);
+
+#endif // __LLM_CAPTURE_H__
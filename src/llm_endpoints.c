@@ -0,0 +1,270 @@
+#include <string.h>
+
+#include "llm_endpoints.h"
+
+static LLMEndpoint *llm_endpoint_new(const gchar *url)
+{
+    LLMEndpoint *endpoint = g_new0(LLMEndpoint, 1);
+    endpoint->ref_count = 1;
+    endpoint->url = g_strdup(url);
+    endpoint->healthy = TRUE;
+    return endpoint;
+}
+
+LLMEndpoint *llm_endpoint_ref(LLMEndpoint *endpoint)
+{
+    if (endpoint) {
+        g_atomic_int_inc(&endpoint->ref_count);
+    }
+    return endpoint;
+}
+
+void llm_endpoint_unref(LLMEndpoint *endpoint)
+{
+    if (!endpoint || !g_atomic_int_dec_and_test(&endpoint->ref_count)) {
+        return;
+    }
+    g_free(endpoint->url);
+    g_free(endpoint->last_error);
+    g_free(endpoint);
+}
+
+static void llm_endpoint_unref_cb(gpointer data)
+{
+    llm_endpoint_unref((LLMEndpoint *)data);
+}
+
+LLMEndpointSet *llm_endpoints_new(void)
+{
+    LLMEndpointSet *set = g_new0(LLMEndpointSet, 1);
+    g_mutex_init(&set->lock);
+    set->endpoints = g_ptr_array_new_with_free_func(llm_endpoint_unref_cb);
+    return set;
+}
+
+void llm_endpoints_free(LLMEndpointSet *set)
+{
+    if (!set) {
+        return;
+    }
+    g_ptr_array_free(set->endpoints, TRUE);
+    g_mutex_clear(&set->lock);
+    g_free(set);
+}
+
+static LLMEndpoint *llm_endpoints_find_locked(GPtrArray *endpoints, const gchar *url)
+{
+    for (guint i = 0; i < endpoints->len; i++) {
+        LLMEndpoint *endpoint = g_ptr_array_index(endpoints, i);
+        if (g_strcmp0(endpoint->url, url) == 0) {
+            return endpoint;
+        }
+    }
+    return NULL;
+}
+
+/// @brief Add url to the new list, reusing the old endpoint (and its statistics) if there is one
+static void llm_endpoints_add_url(GPtrArray *old_endpoints, GPtrArray *new_endpoints, const gchar *url)
+{
+    gchar *stripped = g_strstrip(g_strdup(url));
+
+    if (!IS_NULL_OR_EMPTY(stripped) && !llm_endpoints_find_locked(new_endpoints, stripped)) {
+        LLMEndpoint *endpoint = llm_endpoints_find_locked(old_endpoints, stripped);
+        g_ptr_array_add(new_endpoints, endpoint ? llm_endpoint_ref(endpoint) : llm_endpoint_new(stripped));
+    }
+    g_free(stripped);
+}
+
+void llm_endpoints_set_urls(LLMEndpointSet *set, const gchar *primary_url, const gchar *extra_urls)
+{
+    if (!set) {
+        return;
+    }
+
+    g_mutex_lock(&set->lock);
+    GPtrArray *new_endpoints = g_ptr_array_new_with_free_func(llm_endpoint_unref_cb);
+
+    if (primary_url) {
+        llm_endpoints_add_url(set->endpoints, new_endpoints, primary_url);
+    }
+    if (extra_urls) {
+        gchar **urls = g_strsplit_set(extra_urls, ", \t\n", -1);
+        for (gint i = 0; urls[i] != NULL; i++) {
+            llm_endpoints_add_url(set->endpoints, new_endpoints, urls[i]);
+        }
+        g_strfreev(urls);
+    }
+
+    g_ptr_array_free(set->endpoints, TRUE);
+    set->endpoints = new_endpoints;
+    g_mutex_unlock(&set->lock);
+}
+
+guint llm_endpoints_count(LLMEndpointSet *set)
+{
+    if (!set) {
+        return 0;
+    }
+
+    g_mutex_lock(&set->lock);
+    guint count = set->endpoints->len;
+    g_mutex_unlock(&set->lock);
+    return count;
+}
+
+gchar **llm_endpoints_dup_urls(LLMEndpointSet *set)
+{
+    GPtrArray *urls = g_ptr_array_new();
+
+    if (set) {
+        g_mutex_lock(&set->lock);
+        for (guint i = 0; i < set->endpoints->len; i++) {
+            LLMEndpoint *endpoint = g_ptr_array_index(set->endpoints, i);
+            g_ptr_array_add(urls, g_strdup(endpoint->url));
+        }
+        g_mutex_unlock(&set->lock);
+    }
+    g_ptr_array_add(urls, NULL);
+    return (gchar **)g_ptr_array_free(urls, FALSE);
+}
+
+/// @brief Expected wait for a new request on this endpoint, lower is better.
+/// Unmeasured endpoints score zero so they get explored.
+static gdouble llm_endpoint_score(const LLMEndpoint *endpoint)
+{
+    return endpoint->ttft_ewma_ms * (1 + endpoint->in_flight) +
+           endpoint->in_flight * LLM_ENDPOINT_BUSY_PENALTY_MS;
+}
+
+static gboolean llm_endpoint_excluded(GPtrArray *exclude, LLMEndpoint *endpoint)
+{
+    if (!exclude) {
+        return FALSE;
+    }
+    for (guint i = 0; i < exclude->len; i++) {
+        if (g_ptr_array_index(exclude, i) == endpoint) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+LLMEndpoint *llm_endpoints_acquire(LLMEndpointSet *set, GPtrArray *exclude)
+{
+    if (!set) {
+        return NULL;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    LLMEndpoint *best = NULL;
+    LLMEndpoint *fallback = NULL; // Best endpoint still in cooldown
+
+    g_mutex_lock(&set->lock);
+    for (guint i = 0; i < set->endpoints->len; i++) {
+        LLMEndpoint *endpoint = g_ptr_array_index(set->endpoints, i);
+        if (llm_endpoint_excluded(exclude, endpoint)) {
+            continue;
+        }
+
+        if (!endpoint->healthy && now < endpoint->unhealthy_until) {
+            if (!fallback || endpoint->unhealthy_until < fallback->unhealthy_until) {
+                fallback = endpoint;
+            }
+            continue;
+        }
+        // Ties keep the configuration order, so the primary wins by default
+        if (!best || llm_endpoint_score(endpoint) < llm_endpoint_score(best)) {
+            best = endpoint;
+        }
+    }
+
+    if (!best) {
+        best = fallback;
+    }
+    if (best) {
+        best->in_flight++;
+        best->requests++;
+        llm_endpoint_ref(best);
+    }
+    g_mutex_unlock(&set->lock);
+
+    return best;
+}
+
+static gdouble llm_ewma(gdouble average, gdouble sample)
+{
+    // The first sample seeds the average
+    if (average <= 0.0) {
+        return sample;
+    }
+    return LLM_ENDPOINT_EWMA_ALPHA * sample + (1.0 - LLM_ENDPOINT_EWMA_ALPHA) * average;
+}
+
+void llm_endpoint_release(LLMEndpointSet *set, LLMEndpoint *endpoint,
+    const LLMTransfer *transfer, const gchar *error)
+{
+    if (!set || !endpoint) {
+        return;
+    }
+
+    g_mutex_lock(&set->lock);
+    if (endpoint->in_flight > 0) {
+        endpoint->in_flight--;
+    }
+
+    if (error) {
+        endpoint->failures++;
+        endpoint->healthy = FALSE;
+        endpoint->unhealthy_until = g_get_monotonic_time() + LLM_ENDPOINT_COOLDOWN_USEC;
+        g_free(endpoint->last_error);
+        endpoint->last_error = g_strdup(error);
+    } else if (transfer && transfer->first_token_time > 0) {
+        endpoint->healthy = TRUE;
+        endpoint->unhealthy_until = 0;
+
+        gdouble ttft_ms = (transfer->first_token_time - transfer->start_time) / 1000.0;
+        endpoint->ttft_ewma_ms = llm_ewma(endpoint->ttft_ewma_ms, ttft_ms);
+
+        // The first chunk marks the start of decoding, count the ones after it
+        gdouble decode_sec = (transfer->end_time - transfer->first_token_time) / (gdouble)G_USEC_PER_SEC;
+        if (transfer->chunks > 1 && decode_sec > 0.0) {
+            endpoint->tokens_per_sec_ewma = llm_ewma(endpoint->tokens_per_sec_ewma,
+                (transfer->chunks - 1) / decode_sec);
+        }
+    }
+    g_mutex_unlock(&set->lock);
+
+    llm_endpoint_unref(endpoint);
+}
+
+void llm_endpoints_describe(LLMEndpointSet *set, GString *out)
+{
+    if (!set || !out) {
+        return;
+    }
+
+    gint64 now = g_get_monotonic_time();
+
+    g_mutex_lock(&set->lock);
+    if (set->endpoints->len == 0) {
+        g_string_append(out, "No server configured.\n");
+    }
+    for (guint i = 0; i < set->endpoints->len; i++) {
+        LLMEndpoint *endpoint = g_ptr_array_index(set->endpoints, i);
+        const gchar *status = endpoint->healthy ? "healthy" :
+            (now < endpoint->unhealthy_until ? "failing" : "retrying");
+
+        g_string_append_printf(out, "%s\n  status: %s, in flight: %u, requests: %u, failures: %u\n",
+            endpoint->url, status, endpoint->in_flight, endpoint->requests, endpoint->failures);
+        if (endpoint->ttft_ewma_ms > 0.0) {
+            g_string_append_printf(out, "  TTFT (EWMA): %.0f ms, decode (EWMA): %.1f tok/s\n",
+                endpoint->ttft_ewma_ms, endpoint->tokens_per_sec_ewma);
+        } else {
+            g_string_append(out, "  no measurements yet\n");
+        }
+        if (endpoint->last_error) {
+            g_string_append_printf(out, "  last error: %s\n", endpoint->last_error);
+        }
+    }
+    g_mutex_unlock(&set->lock);
+}
@@ -0,0 +1,74 @@
+#ifndef __LLM_ENDPOINTS_H__
+#define __LLM_ENDPOINTS_H__
+
+#include "plugin.h" // LLMTransfer
+
+/**
+ * Server endpoints with health state and latency statistics measured
+ * from real traffic. Requests are routed to the endpoint with the lowest
+ * expected time to first token, and fail over to the next one when an
+ * endpoint errors before streaming anything.
+ */
+
+/// @brief Smoothing factor of the exponentially weighted moving averages
+#define LLM_ENDPOINT_EWMA_ALPHA 0.3
+/// @brief How long a failed endpoint is skipped before real traffic probes it again
+#define LLM_ENDPOINT_COOLDOWN_USEC (30 * G_USEC_PER_SEC)
+/// @brief Assumed extra wait per request already running on an endpoint
+#define LLM_ENDPOINT_BUSY_PENALTY_MS 250.0
+
+typedef struct {
+    gint ref_count;
+    gchar *url;
+    gboolean healthy;
+    gint64 unhealthy_until;   // Monotonic time until which the endpoint is skipped
+    gdouble ttft_ewma_ms;     // Time to first token, 0 until measured
+    gdouble tokens_per_sec_ewma;
+    guint requests;
+    guint failures;
+    guint in_flight;
+    gchar *last_error;
+} LLMEndpoint;
+
+/// @brief Endpoint list shared by the UI and worker threads
+struct LLMEndpointSet {
+    GMutex lock;
+    GPtrArray *endpoints; // LLMEndpoint*, in configuration order
+};
+
+LLMEndpointSet *llm_endpoints_new(void);
+
+void llm_endpoints_free(LLMEndpointSet *set);
+
+/// @brief Replace the endpoint list, keeping the statistics of URLs that stay.
+/// @param primary_url the main server URL
+/// @param extra_urls comma or whitespace separated additional server URLs, may be NULL
+void llm_endpoints_set_urls(LLMEndpointSet *set, const gchar *primary_url, const gchar *extra_urls);
+
+/// @brief Number of configured endpoints
+guint llm_endpoints_count(LLMEndpointSet *set);
+
+/// @brief URLs of the endpoints in configuration order
+/// @return a NULL terminated array, free with g_strfreev()
+gchar **llm_endpoints_dup_urls(LLMEndpointSet *set);
+
+/// @brief Pick the best endpoint not in exclude and mark it in flight.
+/// Endpoints in cooldown are only used when nothing else is left.
+/// @param exclude endpoints already tried by this request, may be NULL
+/// @return a new reference, release with llm_endpoint_release(); NULL if none is left
+LLMEndpoint *llm_endpoints_acquire(LLMEndpointSet *set, GPtrArray *exclude);
+
+/// @brief Record the outcome of a transfer and drop the in-flight mark and the reference.
+/// @param transfer timings of the transfer, NULL if it never started
+/// @param error error message if the endpoint failed before streaming, NULL on success
+void llm_endpoint_release(LLMEndpointSet *set, LLMEndpoint *endpoint,
+    const LLMTransfer *transfer, const gchar *error);
+
+LLMEndpoint *llm_endpoint_ref(LLMEndpoint *endpoint);
+
+void llm_endpoint_unref(LLMEndpoint *endpoint);
+
+/// @brief Append a human readable line per endpoint to out
+void llm_endpoints_describe(LLMEndpointSet *set, GString *out);
+
+#endif // __LLM_ENDPOINTS_H__
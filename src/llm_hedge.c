@@ -0,0 +1,301 @@
+#include "llm_hedge.h"
+#include "llm_http.h"
+#include "llm_util.h"
+#include "llm_endpoints.h"
+
+#define LLM_HEDGE_NO_WINNER -1
+
+typedef struct HedgeState HedgeState;
+
+/// @brief One of the two racing transfers
+typedef struct {
+    LLMCallbacks callbacks;   // Handed to the transport, user_data points to this leg
+    HedgeState *state;
+    gint index;
+    LLMEndpoint *endpoint;
+    gchar *server_uri;
+    gint cancel;              // Atomic, set when the leg loses or the request is cancelled
+    gboolean started;
+    gboolean finished;
+    gboolean ok;
+    gchar *error;
+    LLMTransfer transfer;
+    GThread *thread;
+} HedgeLeg;
+
+struct HedgeState {
+    GMutex lock;
+    GCond cond;
+    gint winner;              // Index of the leg that streamed first
+    HedgeLeg legs[2];
+    LLMCallbacks *target;
+    const gchar *proxy_url;
+    const gchar *api_key;
+    const gchar *json_payload;
+};
+
+/// @brief Claim the race for this leg. Returns TRUE if the leg is (now) the winner.
+static gboolean hedge_claim(HedgeLeg *leg)
+{
+    HedgeState *state = leg->state;
+    gboolean won;
+
+    g_mutex_lock(&state->lock);
+    if (state->winner == LLM_HEDGE_NO_WINNER) {
+        state->winner = leg->index;
+        // The other leg lost, free its server slot right away
+        g_atomic_int_set(&state->legs[1 - leg->index].cancel, TRUE);
+        g_cond_broadcast(&state->cond);
+        if (leg->index == 1) {
+            g_print("Hedged request won by the secondary endpoint %s\n", leg->endpoint->url);
+        }
+    }
+    won = state->winner == leg->index;
+    g_mutex_unlock(&state->lock);
+
+    return won;
+}
+
+static void hedge_on_data_received(const gchar *data_chunk, gpointer user_data)
+{
+    HedgeLeg *leg = (HedgeLeg *)user_data;
+    LLMCallbacks *target = leg->state->target;
+
+    if (hedge_claim(leg) && target->on_data_received) {
+        target->on_data_received(data_chunk, target->user_data);
+    }
+}
+
+static void hedge_on_candidate_received(const LLMResponse *response, gpointer user_data)
+{
+    HedgeLeg *leg = (HedgeLeg *)user_data;
+    LLMCallbacks *target = leg->state->target;
+
+    if (response->response_text && hedge_claim(leg) && target->on_candidate_received) {
+        target->on_candidate_received(response, target->user_data);
+    }
+}
+
+static void hedge_on_progress(const LLMPromptProgress *progress, gpointer user_data)
+{
+    HedgeLeg *leg = (HedgeLeg *)user_data;
+    HedgeState *state = leg->state;
+
+    // Until a leg wins, the progress of the primary one is shown
+    g_mutex_lock(&state->lock);
+    gboolean shown = state->winner == leg->index ||
+        (state->winner == LLM_HEDGE_NO_WINNER && leg->index == 0);
+    g_mutex_unlock(&state->lock);
+
+    if (shown && state->target->on_progress) {
+        state->target->on_progress(progress, state->target->user_data);
+    }
+}
+
+static void hedge_on_error(const gchar *error_message, gpointer user_data)
+{
+    HedgeLeg *leg = (HedgeLeg *)user_data;
+    HedgeState *state = leg->state;
+    gboolean winner;
+
+    g_mutex_lock(&state->lock);
+    winner = state->winner == leg->index;
+    if (!winner) {
+        // Before the first token an error only disqualifies this leg
+        g_free(leg->error);
+        leg->error = g_strdup(error_message);
+    }
+    g_mutex_unlock(&state->lock);
+
+    if (winner && state->target->on_error) {
+        state->target->on_error(error_message, state->target->user_data);
+    }
+}
+
+static void hedge_on_complete(gpointer user_data)
+{
+    HedgeLeg *leg = (HedgeLeg *)user_data;
+    LLMCallbacks *target = leg->state->target;
+
+    // An empty answer that finishes first still wins
+    if (hedge_claim(leg) && target->on_complete) {
+        target->on_complete(target->user_data);
+    }
+}
+
+static gpointer hedge_leg_thread(gpointer data)
+{
+    HedgeLeg *leg = (HedgeLeg *)data;
+    HedgeState *state = leg->state;
+
+    gboolean ok = llm_execute_query(leg->server_uri, state->proxy_url, state->api_key, state->json_payload,
+        &leg->callbacks, &leg->cancel, &leg->transfer);
+
+    g_mutex_lock(&state->lock);
+    leg->ok = ok;
+    leg->finished = TRUE;
+    g_cond_broadcast(&state->cond);
+    g_mutex_unlock(&state->lock);
+
+    return NULL;
+}
+
+/// @brief Start a leg on the given endpoint, consuming the endpoint reference
+static gboolean hedge_start_leg(HedgeState *state, gint index, LLMEndpoint *endpoint, const gchar *path)
+{
+    HedgeLeg *leg = &state->legs[index];
+
+    leg->endpoint = endpoint;
+    leg->server_uri = llm_construct_server_uri_string(endpoint->url, path);
+    if (!leg->server_uri) {
+        leg->error = g_strdup("Failed to construct server URI");
+        leg->finished = TRUE;
+        return FALSE;
+    }
+
+    // No same-server retries, the other leg is the retry
+    leg->transfer.max_attempts = 1;
+    leg->started = TRUE;
+    leg->thread = g_thread_new("llm-hedge", hedge_leg_thread, leg);
+    return TRUE;
+}
+
+/// @brief Wait until the condition holds, the deadline passes or the request is cancelled.
+/// Propagates an outer cancellation to both legs. Call with the lock held.
+static void hedge_wait_locked(HedgeState *state, gboolean *cancel_flag, gint64 deadline,
+    gboolean (*done)(HedgeState *state))
+{
+    while (!done(state)) {
+        if (LLM_CANCELLED(cancel_flag)) {
+            g_atomic_int_set(&state->legs[0].cancel, TRUE);
+            g_atomic_int_set(&state->legs[1].cancel, TRUE);
+        }
+
+        gint64 now = g_get_monotonic_time();
+        if (now >= deadline) {
+            break;
+        }
+        g_cond_wait_until(&state->cond, &state->lock, MIN(deadline, now + LLM_HEDGE_POLL_USEC));
+    }
+}
+
+/// @brief The primary streamed, finished or the request was cancelled
+static gboolean hedge_primary_settled(HedgeState *state)
+{
+    return state->winner != LLM_HEDGE_NO_WINNER || state->legs[0].finished ||
+           g_atomic_int_get(&state->legs[0].cancel);
+}
+
+static gboolean hedge_all_finished(HedgeState *state)
+{
+    return (!state->legs[0].started || state->legs[0].finished) &&
+           (!state->legs[1].started || state->legs[1].finished);
+}
+
+void llm_execute_hedged_query(LLMPlugin *plugin, LLMEndpointSet *endpoints, const gchar *path,
+    const gchar *json_payload, LLMCallbacks *callbacks, gboolean *cancel_flag,
+    LLMTransfer *transfer_out)
+{
+    HedgeState state = {
+        .winner = LLM_HEDGE_NO_WINNER,
+        .target = callbacks,
+        .proxy_url = plugin->proxy_url,
+        .api_key = plugin->api_key,
+        .json_payload = json_payload
+    };
+    g_mutex_init(&state.lock);
+    g_cond_init(&state.cond);
+
+    for (gint i = 0; i < 2; i++) {
+        HedgeLeg *leg = &state.legs[i];
+        leg->state = &state;
+        leg->index = i;
+        leg->callbacks.on_data_received = hedge_on_data_received;
+        leg->callbacks.on_error = hedge_on_error;
+        leg->callbacks.on_complete = hedge_on_complete;
+        leg->callbacks.on_candidate_received = callbacks->on_candidate_received ? hedge_on_candidate_received : NULL;
+        leg->callbacks.on_progress = callbacks->on_progress ? hedge_on_progress : NULL;
+        leg->callbacks.user_data = leg;
+    }
+
+    GPtrArray *tried = g_ptr_array_new_with_free_func((GDestroyNotify)llm_endpoint_unref);
+    LLMEndpoint *primary = llm_endpoints_acquire(endpoints, NULL);
+    if (!primary) {
+        if (callbacks->on_error) {
+            callbacks->on_error("Server URL is not configured. Please set it in the plugin settings.", callbacks->user_data);
+        }
+        goto EXIT;
+    }
+    g_ptr_array_add(tried, llm_endpoint_ref(primary));
+    hedge_start_leg(&state, 0, primary, path);
+
+    // Give the primary the hedge delay to produce its first token. A primary
+    // that fails early is replaced at once, which makes this a failover too.
+    g_mutex_lock(&state.lock);
+    hedge_wait_locked(&state, cancel_flag,
+        g_get_monotonic_time() + (gint64)plugin->hedge_delay_ms * 1000, hedge_primary_settled);
+    gboolean hedge = state.winner == LLM_HEDGE_NO_WINNER && !g_atomic_int_get(&state.legs[0].cancel);
+    g_mutex_unlock(&state.lock);
+
+    if (hedge) {
+        LLMEndpoint *secondary = llm_endpoints_acquire(endpoints, tried);
+        if (secondary) {
+            g_print("No first token from %s after %u ms, hedging to %s\n",
+                primary->url, plugin->hedge_delay_ms, secondary->url);
+            g_ptr_array_add(tried, llm_endpoint_ref(secondary));
+            g_mutex_lock(&state.lock);
+            // The primary may have streamed in the meantime
+            if (state.winner == LLM_HEDGE_NO_WINNER && !g_atomic_int_get(&state.legs[1].cancel)) {
+                hedge_start_leg(&state, 1, secondary, path);
+                secondary = NULL;
+            }
+            g_mutex_unlock(&state.lock);
+            if (secondary) {
+                llm_endpoint_release(endpoints, secondary, NULL, NULL);
+            }
+        }
+    }
+
+    g_mutex_lock(&state.lock);
+    hedge_wait_locked(&state, cancel_flag, G_MAXINT64, hedge_all_finished);
+    g_mutex_unlock(&state.lock);
+
+    for (gint i = 0; i < 2; i++) {
+        HedgeLeg *leg = &state.legs[i];
+        if (leg->thread) {
+            g_thread_join(leg->thread);
+        }
+        if (!leg->endpoint) {
+            continue;
+        }
+
+        if (state.winner == i && transfer_out) {
+            *transfer_out = leg->transfer;
+        }
+        if (LLM_CANCELLED(cancel_flag) || g_atomic_int_get(&leg->cancel)) {
+            // Stopped, by the user or a stop rule, or lost the race: says nothing about the endpoint
+            llm_endpoint_release(endpoints, leg->endpoint, NULL, NULL);
+        } else if (state.winner == i) {
+            llm_endpoint_release(endpoints, leg->endpoint, &leg->transfer,
+                leg->ok ? NULL : "Stream interrupted");
+        } else {
+            llm_endpoint_release(endpoints, leg->endpoint, &leg->transfer,
+                leg->error ? leg->error : "Request failed");
+        }
+    }
+
+    // Nobody streamed: report the most relevant error
+    if (state.winner == LLM_HEDGE_NO_WINNER && !LLM_CANCELLED(cancel_flag) && callbacks->on_error) {
+        const gchar *error = state.legs[1].error ? state.legs[1].error : state.legs[0].error;
+        callbacks->on_error(error ? error : "Request failed", callbacks->user_data);
+    }
+
+EXIT:
+    for (gint i = 0; i < 2; i++) {
+        g_free(state.legs[i].server_uri);
+        g_free(state.legs[i].error);
+    }
+    g_ptr_array_free(tried, TRUE);
+    g_cond_clear(&state.cond);
+    g_mutex_clear(&state.lock);
+}
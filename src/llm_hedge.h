@@ -0,0 +1,23 @@
+#ifndef __LLM_HEDGE_H__
+#define __LLM_HEDGE_H__
+
+#include "plugin.h"
+
+/**
+ * Hedged requests: when the primary endpoint has not streamed a token
+ * after a delay, the same request is also sent to a second endpoint.
+ * The first one to stream wins and the other is cancelled at once.
+ */
+
+#define LLM_HEDGE_DEFAULT_DELAY_MS 1500
+/// @brief How often the outer cancel flag is checked while legs run
+#define LLM_HEDGE_POLL_USEC (50 * 1000)
+
+/// @brief Execute a query as a hedged request over the given endpoints.
+/// Behaves like a single request when only one endpoint is usable.
+/// @param transfer_out optional, receives the timings of the winning leg
+void llm_execute_hedged_query(LLMPlugin *plugin, LLMEndpointSet *endpoints, const gchar *path,
+    const gchar *json_payload, LLMCallbacks *callbacks, gboolean *cancel_flag,
+    LLMTransfer *transfer_out);
+
+#endif // __LLM_HEDGE_H__
@@ -1,41 +1,15 @@
+#include <string.h>
 #include <curl/curl.h>
 #include "llm_http.h"
 #include "llm_json.h"
 #include "llm_util.h"
+#include "llm_trace.h"
+#include "llm_capture.h"
 #include <unistd.h> // for sleep
 
 #define LLM_MAX_RETRIES 3
 #define LLM_RETRY_DELAY_SEC 2
 
-// Add this helper function
-
-
-gboolean llm_append_to_output_buffer(gpointer user_data) {
-    // The user_data is the string duplicated in data_received callback
-    gchar *text_to_append = (gchar *)user_data;
-
-    if (!text_to_append || !llm_plugin || !llm_plugin->output_text_view) {
-        g_warning("Invalid text or plugin state.");
-        g_free(text_to_append);
-        return FALSE;          
-    }
-
-    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(llm_plugin->output_text_view));
-    if (buffer) {
-        GtkTextIter end_iter;
-        gtk_text_buffer_get_end_iter(buffer, &end_iter);
-        // Insert the text chunk
-        gtk_text_buffer_insert(buffer, &end_iter, text_to_append, -1);
-    } else {
-        g_warning("Failed to get text buffer.");
-    }
-
-    // Free the duplicated string passed via user_data
-    g_free(text_to_append);
-
-    return FALSE; // Remove the idle source
-}
-
 size_t llm_write_callback(void *contents, size_t size, size_t nmemb, void *userp)
 {
     size_t total_size = size * nmemb;
@@ -50,16 +24,20 @@ size_t llm_write_callback(void *contents, size_t size, size_t nmemb, void *userp
     LLMCallbacks *callbacks = callback_data->callbacks;
     gboolean *cancel_flag = callback_data->cancel_flag;
 
-    // Check if cancellation is requested
-    if (cancel_flag && *cancel_flag) {
-        // Signal completion to clean up UI
-        if (callbacks && callbacks->on_complete) {
-            callbacks->on_complete(callbacks->user_data);
-        }
+    // Check if cancellation is requested. The job that started the
+    // transfer reports the cancellation once curl returns.
+    if (LLM_CANCELLED(cancel_flag)) {
         // Return 0 to make curl abort the transfer
         return 0;
     }
 
+    if (callback_data->transfer && callback_data->transfer->first_byte_time == 0) {
+        callback_data->transfer->first_byte_time = g_get_monotonic_time();
+    }
+
+    gint64 trace_start = llm_trace_begin();
+    llm_capture_writer_append(callback_data->capture, (const gchar *)contents, total_size);
+
     // Append the raw chunk received from curl directly
     g_string_append_len(json_accumulator, (const gchar *)contents, total_size);
 
@@ -93,6 +71,7 @@ size_t llm_write_callback(void *contents, size_t size, size_t nmemb, void *userp
                     g_free(message);
                     
                     // Indicate processing success for the whole chunk containing [DONE]
+                    llm_trace_end("sse_chunk", "network", trace_start);
                     return total_size;
                 } else {
                     // Append JSON part of this line to the current message's JSON buffer
@@ -108,8 +87,52 @@ size_t llm_write_callback(void *contents, size_t size, size_t nmemb, void *userp
             LLMResponse response = {0}; // Stack variable for this message
 
             // Use the json_data_part GString which contains only this message's data
-            if (llm_json_to_response(&response, json_data_part, &error)) {
-                if (response.response_text && callbacks && callbacks->on_data_received) {
+            gint64 parse_start = llm_trace_begin();
+            gboolean parsed = llm_json_to_response(&response, json_data_part, &error);
+            llm_trace_end("parse_event", "parser", parse_start);
+            if (parsed) {
+                if (response.progress.valid) {
+                    if (callbacks && callbacks->on_progress) {
+                        callbacks->on_progress(&response.progress, callbacks->user_data);
+                    }
+                    // Not a token, even when it comes with an empty choice
+                    if (response.response_text && *response.response_text == '\0') {
+                        g_clear_pointer(&response.response_text, g_free);
+                    }
+                }
+
+                if (callbacks && callbacks->on_candidate_received) {
+                    callbacks->on_candidate_received(&response, callbacks->user_data);
+                }
+
+                if (response.response_text && callback_data->transfer) {
+                    callback_data->transfer->text_received = TRUE;
+                }
+                // The timings follow the first choice, the others stream in
+                // parallel and would inflate the rate by their number
+                if (response.response_text && response.index == 0 && callback_data->transfer) {
+                    LLMTransfer *transfer = callback_data->transfer;
+                    transfer->last_token_time = g_get_monotonic_time();
+                    if (transfer->first_token_time == 0) {
+                        transfer->first_token_time = transfer->last_token_time;
+                        llm_trace_instant("first_token", "network");
+                    }
+                    transfer->chunks++;
+                }
+
+                // llama.cpp reports its timings with the last token
+                if (response.timings.valid && callback_data->transfer) {
+                    callback_data->transfer->server = response.timings;
+                }
+
+                if (response.finish_reason != LLM_FINISH_NONE && response.index == 0 &&
+                    callback_data->transfer) {
+                    callback_data->transfer->finish_reason = response.finish_reason;
+                }
+
+                // Only the first choice is streamed live, the others are cycled later
+                if (response.response_text && response.index == 0 &&
+                    callbacks && callbacks->on_data_received) {
                     callbacks->on_data_received(response.response_text, callbacks->user_data);
                 }
                 
@@ -136,9 +159,19 @@ size_t llm_write_callback(void *contents, size_t size, size_t nmemb, void *userp
         current_data = json_accumulator->str; // Point to the remaining data
     }
 
+    llm_trace_end("sse_chunk", "network", trace_start);
     return total_size;
 }
 
+/// @brief Progress callback aborting the transfer on cancellation,
+/// also while the server is still processing the prompt and sends nothing.
+static int llm_progress_callback(void *clientp, curl_off_t dltotal, curl_off_t dlnow,
+    curl_off_t ultotal, curl_off_t ulnow)
+{
+    gboolean *cancel_flag = (gboolean *)clientp;
+    return LLM_CANCELLED(cancel_flag) ? 1 : 0;
+}
+
 // Helper: Map CURLcode to user-friendly error
 static const gchar* llm_curlcode_to_message(CURLcode code) {
     switch (code) {
@@ -155,6 +188,92 @@ static const gchar* llm_curlcode_to_message(CURLcode code) {
     }
 }
 
+/// @brief Response body of llm_http_fetch_full() and its limit
+typedef struct {
+    GString *body;
+    gsize max_bytes;
+} LLMFetchBody;
+
+/// @brief Collect the body of llm_http_fetch_full()
+static size_t llm_fetch_write_callback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+    size_t total_size = size * nmemb;
+    LLMFetchBody *fetch_body = (LLMFetchBody *)userp;
+
+    if (fetch_body->body->len + total_size > fetch_body->max_bytes) {
+        return 0;
+    }
+    g_string_append_len(fetch_body->body, (const gchar *)contents, total_size);
+    return total_size;
+}
+
+glong llm_http_fetch(
+    const gchar *server_uri,
+    const gchar *proxy_url,
+    const gchar *api_key,
+    const gchar *json_payload,
+    gboolean *cancel_flag,
+    GString *body_out)
+{
+    return llm_http_fetch_full(server_uri, proxy_url, api_key, json_payload, cancel_flag,
+        LLM_HTTP_FETCH_TIMEOUT_SEC, LLM_HTTP_FETCH_MAX_BYTES, body_out);
+}
+
+glong llm_http_fetch_full(
+    const gchar *server_uri,
+    const gchar *proxy_url,
+    const gchar *api_key,
+    const gchar *json_payload,
+    gboolean *cancel_flag,
+    glong timeout_sec,
+    gsize max_bytes,
+    GString *body_out)
+{
+    g_return_val_if_fail(server_uri && body_out, 0);
+
+    CURL *curl = curl_easy_init();
+    if (!curl) {
+        return 0;
+    }
+
+    struct curl_slist *headers = NULL;
+    headers = curl_slist_append(headers, "Accept: application/json");
+    if (json_payload) {
+        headers = curl_slist_append(headers, "Content-Type: application/json");
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_payload);
+    }
+    if (!IS_NULL_OR_EMPTY(api_key)) {
+        gchar *auth_header = g_strdup_printf("Authorization: Bearer %s", api_key);
+        headers = curl_slist_append(headers, auth_header);
+        g_free(auth_header);
+    }
+    g_string_truncate(body_out, 0);
+    LLMFetchBody fetch_body = { body_out, max_bytes };
+    curl_easy_setopt(curl, CURLOPT_URL, server_uri);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, llm_fetch_write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &fetch_body);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, llm_progress_callback);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, cancel_flag);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout_sec);
+    if (!IS_NULL_OR_EMPTY(proxy_url)) {
+        curl_easy_setopt(curl, CURLOPT_PROXY, proxy_url);
+    }
+
+    gint64 trace_start = llm_trace_begin();
+    CURLcode res = curl_easy_perform(curl);
+    llm_trace_end("http_fetch", "network", trace_start);
+
+    long http_code = 0;
+    if (res == CURLE_OK) {
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    }
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+    return http_code;
+}
+
 // Enhanced: Test connection to LLM server (diagnostics)
 gboolean llm_test_connection(const gchar *server_uri, const gchar *proxy_url, GString *diagnostics_out) {
     CURL *curl = curl_easy_init();
@@ -164,6 +283,7 @@ gboolean llm_test_connection(const gchar *server_uri, const gchar *proxy_url, GS
     }
     curl_easy_setopt(curl, CURLOPT_URL, server_uri);
     curl_easy_setopt(curl, CURLOPT_NOBODY, 1L); // HEAD request
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
     if (proxy_url && *proxy_url) {
         curl_easy_setopt(curl, CURLOPT_PROXY, proxy_url);
     }
@@ -186,9 +306,11 @@ gboolean llm_test_connection(const gchar *server_uri, const gchar *proxy_url, GS
 gboolean llm_execute_query(
     const gchar *server_uri,
     const gchar *proxy_url,
+    const gchar *api_key,
     const gchar *json_payload,
     LLMCallbacks *callbacks,
-    gboolean *cancel_flag)
+    gboolean *cancel_flag,
+    LLMTransfer *transfer)
 {
     if (!server_uri || !json_payload) {
         if (callbacks && callbacks->on_error) {
@@ -204,8 +326,13 @@ gboolean llm_execute_query(
     GString *accumulator_buffer = NULL;
     struct curl_slist *headers = NULL;
     CURL *curl = NULL;
+    LLMTransfer local_transfer = {0};
+    if (!transfer) {
+        transfer = &local_transfer;
+    }
+    int max_attempts = transfer->max_attempts > 0 ? (int)transfer->max_attempts : LLM_MAX_RETRIES;
 
-    while (attempt < LLM_MAX_RETRIES && !success) {
+    while (attempt < max_attempts && !success) {
         curl = curl_easy_init();
         if (!curl) {
             if (callbacks && callbacks->on_error) {
@@ -217,13 +344,15 @@ gboolean llm_execute_query(
         WriteCallbackData callback_data = {
             .accumulator = accumulator_buffer,
             .callbacks = callbacks,
-            .cancel_flag = cancel_flag
+            .cancel_flag = cancel_flag,
+            .transfer = transfer,
+            .capture = llm_capture_writer_new(server_uri, json_payload)
         };
         headers = NULL;
         headers = curl_slist_append(headers, "Content-Type: application/json");
         headers = curl_slist_append(headers, "Accept: text/event-stream");
-        if (llm_plugin && !IS_NULL_OR_EMPTY(llm_plugin->api_key)) {
-            gchar *auth_header = g_strdup_printf("Authorization: Bearer %s", llm_plugin->api_key);
+        if (!IS_NULL_OR_EMPTY(api_key)) {
+            gchar *auth_header = g_strdup_printf("Authorization: Bearer %s", api_key);
             headers = curl_slist_append(headers, auth_header);
             g_free(auth_header);
         }
@@ -232,30 +361,65 @@ gboolean llm_execute_query(
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, llm_write_callback);
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, &callback_data);
         curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, llm_progress_callback);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, cancel_flag);
         if (!IS_NULL_OR_EMPTY(proxy_url)) {
             curl_easy_setopt(curl, CURLOPT_PROXY, proxy_url);
         }
         // Set timeout for network operations
         curl_easy_setopt(curl, CURLOPT_TIMEOUT, 20L);
+        transfer->start_time = g_get_monotonic_time();
+        transfer->connect_time = 0;
+        transfer->first_byte_time = 0;
+        transfer->first_token_time = 0;
+        transfer->last_token_time = 0;
+        transfer->chunks = 0;
+        transfer->text_received = FALSE;
+        transfer->finish_reason = LLM_FINISH_NONE;
+        memset(&transfer->server, 0, sizeof(transfer->server));
+        gint64 trace_start = llm_trace_begin();
         res = curl_easy_perform(curl);
+        llm_trace_end("http_request", "network", trace_start);
+        transfer->end_time = g_get_monotonic_time();
         curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+        transfer->http_code = http_code;
+        llm_capture_writer_finish(callback_data.capture, http_code,
+            res == CURLE_OK ? "OK" : llm_curlcode_to_message(res));
+        curl_off_t connect_usec = 0;
+        if (curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect_usec) == CURLE_OK && connect_usec > 0) {
+            transfer->connect_time = transfer->start_time + connect_usec;
+        }
         if (res == CURLE_OK && http_code < 400) {
             success = TRUE;
+        } else if (LLM_CANCELLED(cancel_flag)) {
+            // Aborted on purpose, not an error worth reporting or retrying
+            g_string_free(accumulator_buffer, TRUE);
+            curl_slist_free_all(headers);
+            curl_easy_cleanup(curl);
+            return FALSE;
         } else {
-            // Only retry on transient errors
-            if (res == CURLE_OPERATION_TIMEDOUT || res == CURLE_COULDNT_CONNECT) {
+            // Only retry on transient errors, and not once text was streamed:
+            // the new attempt would repeat it. The caller may continue instead.
+            if ((res == CURLE_OPERATION_TIMEDOUT || res == CURLE_COULDNT_CONNECT) &&
+                !transfer->text_received) {
                 attempt++;
-                if (callbacks && callbacks->on_error) {
-                    gchar *msg = g_strdup_printf("Attempt %d/%d failed: %s. Retrying...", attempt, LLM_MAX_RETRIES, llm_curlcode_to_message(res));
-                    callbacks->on_error(msg, callbacks->user_data);
-                    g_free(msg);
+                if (attempt < max_attempts) {
+                    if (callbacks && callbacks->on_error) {
+                        gchar *msg = g_strdup_printf("Attempt %d/%d failed: %s. Retrying...", attempt, max_attempts, llm_curlcode_to_message(res));
+                        callbacks->on_error(msg, callbacks->user_data);
+                        g_free(msg);
+                    }
+                    sleep(LLM_RETRY_DELAY_SEC);
                 }
-                sleep(LLM_RETRY_DELAY_SEC);
             } else {
                 // Non-retryable error
                 if (callbacks && callbacks->on_error) {
                     callbacks->on_error(llm_curlcode_to_message(res), callbacks->user_data);
                 }
+                g_string_free(accumulator_buffer, TRUE);
+                curl_slist_free_all(headers);
+                curl_easy_cleanup(curl);
                 break;
             }
         }
@@ -1,12 +1,12 @@
 #ifndef __LLM_HTTP_H__
 #define __LLM_HTTP_H__
 
-#include "plugin.h" // LLMPlugin
+#include "llm_types.h"
 
-//// @brief  Append the received data to the output buffer
-/// @param user_data the string duplicated in data_received callback
-/// @return 
-gboolean llm_append_to_output_buffer(gpointer user_data);
+/// @brief Longer responses to llm_http_fetch() are cut off
+#define LLM_HTTP_FETCH_MAX_BYTES (1024 * 1024)
+/// @brief Timeout of llm_http_fetch(), it is meant for quick metadata requests
+#define LLM_HTTP_FETCH_TIMEOUT_SEC 10L
 
 /// @brief Callback function for writing response data.
 size_t llm_write_callback(
@@ -21,9 +21,37 @@ size_t llm_write_callback(
 gboolean llm_execute_query(
     const gchar *server_uri, 
     const gchar *proxy_url, 
+    const gchar *api_key,
     const gchar *json_payload, 
     LLMCallbacks *callbacks,
-    gboolean *cancel_flag);
+    gboolean *cancel_flag,
+    LLMTransfer *transfer);
+
+/// @brief Fetch a small document, such as /props or /health, in one piece
+/// @param json_payload body to POST, NULL for a GET
+/// @param cancel_flag aborts the transfer when set, may be NULL
+/// @param body_out receives the response body, at most LLM_HTTP_FETCH_MAX_BYTES
+/// @return the HTTP status, 0 if no response arrived
+glong llm_http_fetch(
+    const gchar *server_uri,
+    const gchar *proxy_url,
+    const gchar *api_key,
+    const gchar *json_payload,
+    gboolean *cancel_flag,
+    GString *body_out);
+
+/// @brief llm_http_fetch() with its own limits, e.g. for slow or large answers
+/// @param timeout_sec the whole transfer is aborted after this long
+/// @param max_bytes longer responses are cut off and the fetch fails
+glong llm_http_fetch_full(
+    const gchar *server_uri,
+    const gchar *proxy_url,
+    const gchar *api_key,
+    const gchar *json_payload,
+    gboolean *cancel_flag,
+    glong timeout_sec,
+    gsize max_bytes,
+    GString *body_out);
 
 // Enhanced: Test connection to LLM server (diagnostics)
 gboolean llm_test_connection(const gchar *server_uri, const gchar *proxy_url, GString *diagnostics_out);
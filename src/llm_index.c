@@ -0,0 +1,832 @@
+#include <math.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#include "llm_index.h"
+
+#define LLM_INDEX_MAGIC "LLMBM25\001"
+#define LLM_INDEX_MAGIC_LENGTH 8
+
+// Okapi BM25 with the usual parameters
+#define LLM_INDEX_BM25_K1 1.2
+#define LLM_INDEX_BM25_B 0.75
+
+#define LLM_INDEX_MIN_TERM_LENGTH 2
+#define LLM_INDEX_MAX_TERM_LENGTH 64
+/// @brief A NUL byte in the first this many bytes makes a file binary
+#define LLM_INDEX_BINARY_PROBE 4096
+
+typedef struct LLMIndexFile LLMIndexFile;
+
+typedef struct {
+    guint32 chunk;
+    guint32 count;      // Occurrences in the chunk
+} LLMPosting;
+
+typedef struct {
+    gchar *text;
+    GArray *postings;   // LLMPosting, empty once all its files are gone
+} LLMTerm;
+
+typedef struct {
+    LLMIndexFile *file; // NULL if the chunk is free
+    guint32 first_line;
+    guint32 last_line;
+    guint32 length;     // Terms in the chunk
+} LLMChunk;
+
+struct LLMIndexFile {
+    gchar *path;
+    gint64 mtime;
+    gint64 size;
+    GArray *chunks;     // Chunk ids, in line order
+    GArray *terms;      // Ids of the terms occurring in the file, each once
+};
+
+struct LLMIndex {
+    GMutex lock;
+    GPtrArray *terms;       // LLMTerm* by term id
+    GHashTable *term_ids;   // Text -> term id + 1
+    GArray *chunks;         // LLMChunk by chunk id
+    GArray *free_chunks;    // Ids of free chunks, reused first
+    GHashTable *files;      // Path -> LLMIndexFile*
+    guint live_chunks;
+    guint64 total_length;   // Terms in all live chunks
+    gboolean dirty;
+};
+
+/// @brief A chunk tokenized outside the lock
+typedef struct {
+    guint32 first_line;
+    guint32 last_line;
+    guint32 length;
+    GHashTable *counts;     // Term -> occurrences
+} LLMParsedChunk;
+
+static void llm_term_free(gpointer data)
+{
+    LLMTerm *term = (LLMTerm *)data;
+    g_free(term->text);
+    g_array_free(term->postings, TRUE);
+    g_free(term);
+}
+
+static LLMIndexFile *llm_index_file_new(const gchar *path, gint64 mtime, gint64 size)
+{
+    LLMIndexFile *file = g_new0(LLMIndexFile, 1);
+    file->path = g_strdup(path);
+    file->mtime = mtime;
+    file->size = size;
+    file->chunks = g_array_new(FALSE, FALSE, sizeof(guint32));
+    file->terms = g_array_new(FALSE, FALSE, sizeof(guint32));
+    return file;
+}
+
+static void llm_index_file_free(gpointer data)
+{
+    LLMIndexFile *file = (LLMIndexFile *)data;
+    g_free(file->path);
+    g_array_free(file->chunks, TRUE);
+    g_array_free(file->terms, TRUE);
+    g_free(file);
+}
+
+static void llm_parsed_chunk_free(gpointer data)
+{
+    LLMParsedChunk *chunk = (LLMParsedChunk *)data;
+    g_hash_table_destroy(chunk->counts);
+    g_free(chunk);
+}
+
+void llm_index_hit_free(gpointer data)
+{
+    LLMIndexHit *hit = (LLMIndexHit *)data;
+    g_free(hit->path);
+    g_free(hit);
+}
+
+LLMIndex *llm_index_new(void)
+{
+    LLMIndex *index = g_new0(LLMIndex, 1);
+    g_mutex_init(&index->lock);
+    index->terms = g_ptr_array_new_with_free_func(llm_term_free);
+    index->term_ids = g_hash_table_new(g_str_hash, g_str_equal);
+    index->chunks = g_array_new(FALSE, FALSE, sizeof(LLMChunk));
+    index->free_chunks = g_array_new(FALSE, FALSE, sizeof(guint32));
+    // Keys are the paths of the values
+    index->files = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, llm_index_file_free);
+    return index;
+}
+
+void llm_index_free(LLMIndex *index)
+{
+    if (!index) {
+        return;
+    }
+    g_hash_table_destroy(index->files);
+    g_hash_table_destroy(index->term_ids);
+    g_ptr_array_free(index->terms, TRUE);
+    g_array_free(index->chunks, TRUE);
+    g_array_free(index->free_chunks, TRUE);
+    g_mutex_clear(&index->lock);
+    g_free(index);
+}
+
+// Tokenizer
+
+static gboolean llm_index_identifier_start(gchar c)
+{
+    return g_ascii_isalpha(c) || c == '_';
+}
+
+static gboolean llm_index_identifier_char(gchar c)
+{
+    return g_ascii_isalnum(c) || c == '_';
+}
+
+static void llm_index_count(GHashTable *counts, const gchar *text, gsize length, guint32 *total)
+{
+    if (length < LLM_INDEX_MIN_TERM_LENGTH || length > LLM_INDEX_MAX_TERM_LENGTH) {
+        return;
+    }
+
+    gchar *term = g_ascii_strdown(text, length);
+    guint count = GPOINTER_TO_UINT(g_hash_table_lookup(counts, term));
+    // Keeps the old key and frees the new one
+    g_hash_table_insert(counts, term, GUINT_TO_POINTER(count + 1));
+    (*total)++;
+}
+
+/// @brief Find the next word of a snake_case or camelCase identifier
+/// @return start of the word, length if there is none
+static gsize llm_index_next_word(const gchar *identifier, gsize length, gsize pos, gsize *word_length)
+{
+    while (pos < length && identifier[pos] == '_') {
+        pos++;
+    }
+    if (pos >= length) {
+        return length;
+    }
+
+    gsize end = pos + 1;
+    while (end < length && identifier[end] != '_') {
+        gchar prev = identifier[end - 1];
+        gchar c = identifier[end];
+        // fooBar, foo2Bar and the end of an acronym: HTTPServer
+        if (g_ascii_isupper(c) && (g_ascii_islower(prev) || g_ascii_isdigit(prev) ||
+                (g_ascii_isupper(prev) && end + 1 < length && g_ascii_islower(identifier[end + 1])))) {
+            break;
+        }
+        end++;
+    }
+    *word_length = end - pos;
+    return pos;
+}
+
+/// @brief Count an identifier and, if it has several, its words
+static void llm_index_count_identifier(GHashTable *counts, const gchar *identifier, gsize length,
+    guint32 *total)
+{
+    llm_index_count(counts, identifier, length, total);
+
+    gsize word_length = 0;
+    guint words = 0;
+    for (gsize pos = llm_index_next_word(identifier, length, 0, &word_length); pos < length;
+         pos = llm_index_next_word(identifier, length, pos + word_length, &word_length)) {
+        words++;
+    }
+    if (words < 2) {
+        return;
+    }
+
+    for (gsize pos = llm_index_next_word(identifier, length, 0, &word_length); pos < length;
+         pos = llm_index_next_word(identifier, length, pos + word_length, &word_length)) {
+        llm_index_count(counts, identifier + pos, word_length, total);
+    }
+}
+
+static void llm_index_tokenize(const gchar *text, gsize size, GHashTable *counts, guint32 *total)
+{
+    gsize i = 0;
+    while (i < size) {
+        if (llm_index_identifier_start(text[i])) {
+            gsize start = i;
+            while (i < size && llm_index_identifier_char(text[i])) {
+                i++;
+            }
+            llm_index_count_identifier(counts, text + start, i - start, total);
+        } else if (g_ascii_isdigit(text[i])) {
+            // Numbers with their suffixes, 0x1fUL is not a term
+            while (i < size && llm_index_identifier_char(text[i])) {
+                i++;
+            }
+        } else {
+            i++;
+        }
+    }
+}
+
+/// @brief Cut a text into chunks of lines and tokenize them
+/// @return LLMParsedChunk*, chunks without terms left out
+static GPtrArray *llm_index_parse(const gchar *text, gsize size)
+{
+    GPtrArray *chunks = g_ptr_array_new_with_free_func(llm_parsed_chunk_free);
+    gsize start = 0;
+    guint32 line = 0;
+
+    while (start < size) {
+        gsize end = start;
+        guint32 lines = 0;
+        while (end < size && lines < LLM_INDEX_CHUNK_LINES) {
+            const gchar *newline = memchr(text + end, '\n', size - end);
+            end = newline ? (gsize)(newline - text) + 1 : size;
+            lines++;
+        }
+
+        LLMParsedChunk *chunk = g_new0(LLMParsedChunk, 1);
+        chunk->first_line = line;
+        chunk->last_line = line + lines - 1;
+        chunk->counts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        llm_index_tokenize(text + start, end - start, chunk->counts, &chunk->length);
+        if (chunk->length > 0) {
+            g_ptr_array_add(chunks, chunk);
+        } else {
+            llm_parsed_chunk_free(chunk);
+        }
+
+        line += lines;
+        start = end;
+    }
+    return chunks;
+}
+
+// Updates, with the lock held
+
+static guint32 llm_index_term_id_locked(LLMIndex *index, const gchar *text)
+{
+    gpointer id = g_hash_table_lookup(index->term_ids, text);
+    if (id) {
+        return GPOINTER_TO_UINT(id) - 1;
+    }
+
+    LLMTerm *term = g_new0(LLMTerm, 1);
+    term->text = g_strdup(text);
+    term->postings = g_array_new(FALSE, FALSE, sizeof(LLMPosting));
+    g_ptr_array_add(index->terms, term);
+    g_hash_table_insert(index->term_ids, term->text, GUINT_TO_POINTER(index->terms->len));
+    return index->terms->len - 1;
+}
+
+static guint32 llm_index_chunk_new_locked(LLMIndex *index, LLMIndexFile *file, guint32 first_line,
+    guint32 last_line, guint32 length)
+{
+    guint32 id;
+    if (index->free_chunks->len > 0) {
+        id = g_array_index(index->free_chunks, guint32, index->free_chunks->len - 1);
+        g_array_set_size(index->free_chunks, index->free_chunks->len - 1);
+    } else {
+        id = index->chunks->len;
+        g_array_set_size(index->chunks, id + 1);
+    }
+
+    LLMChunk *chunk = &g_array_index(index->chunks, LLMChunk, id);
+    chunk->file = file;
+    chunk->first_line = first_line;
+    chunk->last_line = last_line;
+    chunk->length = length;
+    g_array_append_val(file->chunks, id);
+    index->live_chunks++;
+    index->total_length += length;
+    return id;
+}
+
+static void llm_index_remove_locked(LLMIndex *index, LLMIndexFile *file)
+{
+    // Only the terms of the file have postings of its chunks
+    for (guint i = 0; i < file->terms->len; i++) {
+        LLMTerm *term = g_ptr_array_index(index->terms, g_array_index(file->terms, guint32, i));
+        guint kept = 0;
+        for (guint j = 0; j < term->postings->len; j++) {
+            LLMPosting posting = g_array_index(term->postings, LLMPosting, j);
+            if (g_array_index(index->chunks, LLMChunk, posting.chunk).file != file) {
+                g_array_index(term->postings, LLMPosting, kept++) = posting;
+            }
+        }
+        g_array_set_size(term->postings, kept);
+    }
+
+    for (guint i = 0; i < file->chunks->len; i++) {
+        guint32 id = g_array_index(file->chunks, guint32, i);
+        LLMChunk *chunk = &g_array_index(index->chunks, LLMChunk, id);
+        index->live_chunks--;
+        index->total_length -= chunk->length;
+        chunk->file = NULL;
+        g_array_append_val(index->free_chunks, id);
+    }
+
+    g_hash_table_remove(index->files, file->path);
+    index->dirty = TRUE;
+}
+
+static void llm_index_add_locked(LLMIndex *index, const gchar *path, gint64 mtime, gint64 size,
+    GPtrArray *parsed)
+{
+    LLMIndexFile *file = llm_index_file_new(path, mtime, size);
+    GHashTable *file_terms = g_hash_table_new(NULL, NULL);
+
+    for (guint i = 0; i < parsed->len; i++) {
+        LLMParsedChunk *parsed_chunk = g_ptr_array_index(parsed, i);
+        LLMPosting posting;
+        posting.chunk = llm_index_chunk_new_locked(index, file, parsed_chunk->first_line,
+            parsed_chunk->last_line, parsed_chunk->length);
+
+        GHashTableIter iter;
+        gpointer text, count;
+        g_hash_table_iter_init(&iter, parsed_chunk->counts);
+        while (g_hash_table_iter_next(&iter, &text, &count)) {
+            guint32 term_id = llm_index_term_id_locked(index, text);
+            LLMTerm *term = g_ptr_array_index(index->terms, term_id);
+            posting.count = GPOINTER_TO_UINT(count);
+            g_array_append_val(term->postings, posting);
+            g_hash_table_add(file_terms, GUINT_TO_POINTER(term_id + 1));
+        }
+    }
+
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, file_terms);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        guint32 term_id = GPOINTER_TO_UINT(key) - 1;
+        g_array_append_val(file->terms, term_id);
+    }
+    g_hash_table_destroy(file_terms);
+
+    g_hash_table_insert(index->files, file->path, file);
+    index->dirty = TRUE;
+}
+
+/// @brief TRUE if the file is indexed with this size and modification time
+static gboolean llm_index_current(LLMIndex *index, const gchar *path, gint64 mtime, gint64 size)
+{
+    g_mutex_lock(&index->lock);
+    LLMIndexFile *file = g_hash_table_lookup(index->files, path);
+    gboolean current = file && file->mtime == mtime && file->size == size;
+    g_mutex_unlock(&index->lock);
+    return current;
+}
+
+gboolean llm_index_update_file(LLMIndex *index, const gchar *path)
+{
+    GStatBuf st;
+    if (g_stat(path, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size > LLM_INDEX_MAX_FILE_BYTES) {
+        llm_index_remove_file(index, path);
+        return FALSE;
+    }
+
+    gint64 mtime = st.st_mtime;
+    gint64 size = st.st_size;
+    if (llm_index_current(index, path, mtime, size)) {
+        return TRUE;
+    }
+
+    GMappedFile *mapped = g_mapped_file_new(path, FALSE, NULL);
+    if (!mapped) {
+        llm_index_remove_file(index, path);
+        return FALSE;
+    }
+
+    // Empty files map to NULL
+    const gchar *text = g_mapped_file_get_contents(mapped);
+    gsize length = text ? g_mapped_file_get_length(mapped) : 0;
+    if (length > 0 && memchr(text, '\0', MIN(length, LLM_INDEX_BINARY_PROBE))) {
+        g_mapped_file_unref(mapped);
+        llm_index_remove_file(index, path);
+        return FALSE;
+    }
+    GPtrArray *parsed = llm_index_parse(text, length);
+    g_mapped_file_unref(mapped);
+
+    g_mutex_lock(&index->lock);
+    LLMIndexFile *file = g_hash_table_lookup(index->files, path);
+    // Another job may have indexed the same version meanwhile
+    if (!file || file->mtime != mtime || file->size != size) {
+        if (file) {
+            llm_index_remove_locked(index, file);
+        }
+        llm_index_add_locked(index, path, mtime, size, parsed);
+    }
+    g_mutex_unlock(&index->lock);
+
+    g_ptr_array_unref(parsed);
+    return TRUE;
+}
+
+void llm_index_remove_file(LLMIndex *index, const gchar *path)
+{
+    g_mutex_lock(&index->lock);
+    LLMIndexFile *file = g_hash_table_lookup(index->files, path);
+    if (file) {
+        llm_index_remove_locked(index, file);
+    }
+    g_mutex_unlock(&index->lock);
+}
+
+GPtrArray *llm_index_dup_paths(LLMIndex *index)
+{
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+
+    g_mutex_lock(&index->lock);
+    GHashTableIter iter;
+    gpointer path;
+    g_hash_table_iter_init(&iter, index->files);
+    while (g_hash_table_iter_next(&iter, &path, NULL)) {
+        g_ptr_array_add(paths, g_strdup(path));
+    }
+    g_mutex_unlock(&index->lock);
+
+    return paths;
+}
+
+gboolean llm_index_dirty(LLMIndex *index)
+{
+    g_mutex_lock(&index->lock);
+    gboolean dirty = index->dirty;
+    g_mutex_unlock(&index->lock);
+    return dirty;
+}
+
+// Search
+
+GPtrArray *llm_index_search(LLMIndex *index, const gchar *query, guint max_hits)
+{
+    GPtrArray *hits = g_ptr_array_new_with_free_func(llm_index_hit_free);
+    GHashTable *query_terms = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    guint32 query_length = 0;
+    if (query) {
+        llm_index_tokenize(query, strlen(query), query_terms, &query_length);
+    }
+    if (max_hits == 0 || query_length == 0) {
+        g_hash_table_destroy(query_terms);
+        return hits;
+    }
+
+    g_mutex_lock(&index->lock);
+    if (index->live_chunks == 0) {
+        g_mutex_unlock(&index->lock);
+        g_hash_table_destroy(query_terms);
+        return hits;
+    }
+
+    gdouble chunks = index->live_chunks;
+    gdouble average_length = (gdouble)index->total_length / chunks;
+    gdouble *scores = g_new0(gdouble, index->chunks->len);
+    GArray *scored = g_array_new(FALSE, FALSE, sizeof(guint32));
+
+    // Each term once, repeating a word in the question does not weigh it more
+    GHashTableIter iter;
+    gpointer text;
+    g_hash_table_iter_init(&iter, query_terms);
+    while (g_hash_table_iter_next(&iter, &text, NULL)) {
+        gpointer id = g_hash_table_lookup(index->term_ids, text);
+        if (!id) {
+            continue;
+        }
+        LLMTerm *term = g_ptr_array_index(index->terms, GPOINTER_TO_UINT(id) - 1);
+        gdouble frequency = term->postings->len;
+        if (frequency == 0) {
+            continue;
+        }
+
+        gdouble idf = log(1.0 + (chunks - frequency + 0.5) / (frequency + 0.5));
+        for (guint i = 0; i < term->postings->len; i++) {
+            LLMPosting posting = g_array_index(term->postings, LLMPosting, i);
+            LLMChunk *chunk = &g_array_index(index->chunks, LLMChunk, posting.chunk);
+            gdouble norm = LLM_INDEX_BM25_K1 *
+                (1.0 - LLM_INDEX_BM25_B + LLM_INDEX_BM25_B * chunk->length / average_length);
+            if (scores[posting.chunk] == 0) {
+                g_array_append_val(scored, posting.chunk);
+            }
+            scores[posting.chunk] += idf * posting.count * (LLM_INDEX_BM25_K1 + 1.0) / (posting.count + norm);
+        }
+    }
+
+    // Insertion into the few best, cheaper than sorting all chunks of a common term
+    guint32 *best = g_new(guint32, max_hits);
+    guint best_count = 0;
+    for (guint i = 0; i < scored->len; i++) {
+        guint32 id = g_array_index(scored, guint32, i);
+        if (best_count == max_hits && scores[id] <= scores[best[best_count - 1]]) {
+            continue;
+        }
+        guint pos = best_count < max_hits ? best_count++ : best_count - 1;
+        while (pos > 0 && scores[best[pos - 1]] < scores[id]) {
+            best[pos] = best[pos - 1];
+            pos--;
+        }
+        best[pos] = id;
+    }
+
+    for (guint i = 0; i < best_count; i++) {
+        LLMChunk *chunk = &g_array_index(index->chunks, LLMChunk, best[i]);
+        LLMIndexHit *hit = g_new0(LLMIndexHit, 1);
+        hit->path = g_strdup(chunk->file->path);
+        hit->first_line = chunk->first_line;
+        hit->last_line = chunk->last_line;
+        hit->score = scores[best[i]];
+        g_ptr_array_add(hits, hit);
+    }
+    g_mutex_unlock(&index->lock);
+
+    g_free(best);
+    g_array_free(scored, TRUE);
+    g_free(scores);
+    g_hash_table_destroy(query_terms);
+    return hits;
+}
+
+void llm_index_describe(LLMIndex *index, GString *out)
+{
+    g_mutex_lock(&index->lock);
+    guint terms = 0;
+    guint64 postings = 0;
+    for (guint i = 0; i < index->terms->len; i++) {
+        LLMTerm *term = g_ptr_array_index(index->terms, i);
+        terms += term->postings->len > 0;
+        postings += term->postings->len;
+    }
+    g_string_append_printf(out, "%u files, %u chunks of up to %u lines, %u terms, %" G_GUINT64_FORMAT " postings\n",
+        g_hash_table_size(index->files), index->live_chunks, LLM_INDEX_CHUNK_LINES, terms, postings);
+    g_mutex_unlock(&index->lock);
+}
+
+// File format: the magic, then files, chunks and terms, all numbers as
+// unsigned LEB128 varints.
+//   files:  count, then per file the path length, path, mtime and size
+//   chunks: count, then per chunk its file, first line, line count - 1 and length
+//   terms:  count, then per term the text length, text, posting count and
+//           the postings as (chunk id delta, occurrences)
+// Chunk ids are renumbered in file order, so the postings of a file are adjacent.
+
+static void llm_index_write_varint(GByteArray *out, guint64 value)
+{
+    guint8 bytes[10];
+    guint length = 0;
+    do {
+        bytes[length] = value & 0x7f;
+        value >>= 7;
+        if (value) {
+            bytes[length] |= 0x80;
+        }
+        length++;
+    } while (value);
+    g_byte_array_append(out, bytes, length);
+}
+
+static void llm_index_write_string(GByteArray *out, const gchar *text)
+{
+    gsize length = strlen(text);
+    llm_index_write_varint(out, length);
+    g_byte_array_append(out, (const guint8 *)text, length);
+}
+
+static gint llm_posting_compare(gconstpointer a, gconstpointer b)
+{
+    guint32 chunk_a = ((const LLMPosting *)a)->chunk;
+    guint32 chunk_b = ((const LLMPosting *)b)->chunk;
+    return chunk_a < chunk_b ? -1 : chunk_a > chunk_b;
+}
+
+gboolean llm_index_save(LLMIndex *index, const gchar *path, GError **error)
+{
+    GByteArray *out = g_byte_array_new();
+    g_byte_array_append(out, (const guint8 *)LLM_INDEX_MAGIC, LLM_INDEX_MAGIC_LENGTH);
+
+    g_mutex_lock(&index->lock);
+
+    GHashTable *file_numbers = g_hash_table_new(NULL, NULL);
+    guint32 *chunk_numbers = g_new(guint32, MAX(index->chunks->len, 1));
+    GPtrArray *files = g_ptr_array_new();
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, index->files);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        g_hash_table_insert(file_numbers, value, GUINT_TO_POINTER(files->len));
+        g_ptr_array_add(files, value);
+    }
+
+    llm_index_write_varint(out, files->len);
+    for (guint i = 0; i < files->len; i++) {
+        LLMIndexFile *file = g_ptr_array_index(files, i);
+        llm_index_write_string(out, file->path);
+        llm_index_write_varint(out, (guint64)file->mtime);
+        llm_index_write_varint(out, (guint64)file->size);
+    }
+
+    llm_index_write_varint(out, index->live_chunks);
+    guint32 number = 0;
+    for (guint i = 0; i < files->len; i++) {
+        LLMIndexFile *file = g_ptr_array_index(files, i);
+        for (guint j = 0; j < file->chunks->len; j++) {
+            guint32 id = g_array_index(file->chunks, guint32, j);
+            LLMChunk *chunk = &g_array_index(index->chunks, LLMChunk, id);
+            chunk_numbers[id] = number++;
+            llm_index_write_varint(out, i);
+            llm_index_write_varint(out, chunk->first_line);
+            llm_index_write_varint(out, chunk->last_line - chunk->first_line);
+            llm_index_write_varint(out, chunk->length);
+        }
+    }
+
+    guint terms = 0;
+    for (guint i = 0; i < index->terms->len; i++) {
+        terms += ((LLMTerm *)g_ptr_array_index(index->terms, i))->postings->len > 0;
+    }
+    llm_index_write_varint(out, terms);
+
+    GArray *postings = g_array_new(FALSE, FALSE, sizeof(LLMPosting));
+    for (guint i = 0; i < index->terms->len; i++) {
+        LLMTerm *term = g_ptr_array_index(index->terms, i);
+        if (term->postings->len == 0) {
+            continue;
+        }
+
+        g_array_set_size(postings, 0);
+        g_array_append_vals(postings, term->postings->data, term->postings->len);
+        for (guint j = 0; j < postings->len; j++) {
+            LLMPosting *posting = &g_array_index(postings, LLMPosting, j);
+            posting->chunk = chunk_numbers[posting->chunk];
+        }
+        g_array_sort(postings, llm_posting_compare);
+
+        llm_index_write_string(out, term->text);
+        llm_index_write_varint(out, postings->len);
+        guint32 previous = 0;
+        for (guint j = 0; j < postings->len; j++) {
+            LLMPosting *posting = &g_array_index(postings, LLMPosting, j);
+            llm_index_write_varint(out, posting->chunk - previous);
+            llm_index_write_varint(out, posting->count);
+            previous = posting->chunk;
+        }
+    }
+    index->dirty = FALSE;
+
+    g_mutex_unlock(&index->lock);
+
+    g_array_free(postings, TRUE);
+    g_ptr_array_free(files, TRUE);
+    g_free(chunk_numbers);
+    g_hash_table_destroy(file_numbers);
+
+    gboolean saved = g_file_set_contents(path, (const gchar *)out->data, out->len, error);
+    if (!saved) {
+        g_mutex_lock(&index->lock);
+        index->dirty = TRUE;
+        g_mutex_unlock(&index->lock);
+    }
+    g_byte_array_free(out, TRUE);
+    return saved;
+}
+
+typedef struct {
+    const guint8 *pos;
+    const guint8 *end;
+    gboolean valid;
+} LLMIndexReader;
+
+static guint64 llm_index_read_varint(LLMIndexReader *reader)
+{
+    guint64 value = 0;
+    for (guint shift = 0; shift < 64 && reader->pos < reader->end; shift += 7) {
+        guint8 byte = *reader->pos++;
+        value |= (guint64)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    reader->valid = FALSE;
+    return 0;
+}
+
+/// @brief Read a count of items taking at least a byte each
+static guint32 llm_index_read_count(LLMIndexReader *reader)
+{
+    guint64 count = llm_index_read_varint(reader);
+    if (count > (guint64)(reader->end - reader->pos)) {
+        reader->valid = FALSE;
+        return 0;
+    }
+    return (guint32)count;
+}
+
+static gchar *llm_index_read_string(LLMIndexReader *reader)
+{
+    guint32 length = llm_index_read_count(reader);
+    if (!reader->valid) {
+        return NULL;
+    }
+    gchar *text = g_strndup((const gchar *)reader->pos, length);
+    reader->pos += length;
+    return text;
+}
+
+LLMIndex *llm_index_load(const gchar *path, GError **error)
+{
+    GMappedFile *mapped = g_mapped_file_new(path, FALSE, error);
+    if (!mapped) {
+        return NULL;
+    }
+
+    LLMIndexReader reader;
+    reader.pos = (const guint8 *)g_mapped_file_get_contents(mapped);
+    reader.end = reader.pos + g_mapped_file_get_length(mapped);
+    reader.valid = reader.pos && reader.end - reader.pos >= LLM_INDEX_MAGIC_LENGTH &&
+        memcmp(reader.pos, LLM_INDEX_MAGIC, LLM_INDEX_MAGIC_LENGTH) == 0;
+    if (reader.valid) {
+        reader.pos += LLM_INDEX_MAGIC_LENGTH;
+    }
+
+    LLMIndex *index = llm_index_new();
+    GPtrArray *files = g_ptr_array_new();
+
+    guint32 file_count = reader.valid ? llm_index_read_count(&reader) : 0;
+    for (guint32 i = 0; reader.valid && i < file_count; i++) {
+        gchar *file_path = llm_index_read_string(&reader);
+        gint64 mtime = (gint64)llm_index_read_varint(&reader);
+        gint64 size = (gint64)llm_index_read_varint(&reader);
+        if (reader.valid && !g_hash_table_contains(index->files, file_path)) {
+            LLMIndexFile *file = llm_index_file_new(file_path, mtime, size);
+            g_hash_table_insert(index->files, file->path, file);
+            g_ptr_array_add(files, file);
+        } else {
+            reader.valid = FALSE;
+        }
+        g_free(file_path);
+    }
+
+    guint32 chunk_count = reader.valid ? llm_index_read_count(&reader) : 0;
+    for (guint32 i = 0; reader.valid && i < chunk_count; i++) {
+        guint64 file_number = llm_index_read_varint(&reader);
+        guint64 first_line = llm_index_read_varint(&reader);
+        guint64 lines = llm_index_read_varint(&reader);
+        guint64 length = llm_index_read_varint(&reader);
+        if (!reader.valid || file_number >= files->len || first_line + lines > G_MAXUINT32 ||
+            length > G_MAXUINT32) {
+            reader.valid = FALSE;
+            break;
+        }
+        llm_index_chunk_new_locked(index, g_ptr_array_index(files, file_number), first_line,
+            first_line + lines, length);
+    }
+
+    guint32 term_count = reader.valid ? llm_index_read_count(&reader) : 0;
+    for (guint32 i = 0; reader.valid && i < term_count; i++) {
+        gchar *text = llm_index_read_string(&reader);
+        guint32 posting_count = llm_index_read_count(&reader);
+        if (!reader.valid || g_hash_table_contains(index->term_ids, text)) {
+            reader.valid = FALSE;
+            g_free(text);
+            break;
+        }
+
+        guint32 term_id = llm_index_term_id_locked(index, text);
+        LLMTerm *term = g_ptr_array_index(index->terms, term_id);
+        g_free(text);
+
+        LLMIndexFile *previous_file = NULL;
+        guint64 chunk = 0;
+        for (guint32 j = 0; reader.valid && j < posting_count; j++) {
+            guint64 delta = llm_index_read_varint(&reader);
+            guint64 count = llm_index_read_varint(&reader);
+            chunk += delta;
+            if ((j > 0 && delta == 0) || chunk >= chunk_count || count == 0 || count > G_MAXUINT32) {
+                reader.valid = FALSE;
+                break;
+            }
+
+            LLMPosting posting = { (guint32)chunk, (guint32)count };
+            g_array_append_val(term->postings, posting);
+            // Postings are sorted, those of a file adjacent
+            LLMIndexFile *file = g_array_index(index->chunks, LLMChunk, posting.chunk).file;
+            if (file != previous_file) {
+                g_array_append_val(file->terms, term_id);
+                previous_file = file;
+            }
+        }
+    }
+
+    if (reader.valid && reader.pos != reader.end) {
+        reader.valid = FALSE;
+    }
+
+    g_ptr_array_free(files, TRUE);
+    g_mapped_file_unref(mapped);
+
+    if (!reader.valid) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s is not a valid index", path);
+        llm_index_free(index);
+        return NULL;
+    }
+    index->dirty = FALSE;
+    return index;
+}
@@ -0,0 +1,74 @@
+#ifndef __LLM_INDEX_H__
+#define __LLM_INDEX_H__
+
+#include "llm_types.h"
+
+/**
+ * Inverted index of source files for retrieval by BM25.
+ *
+ * Files are read through GMappedFile, cut into chunks of
+ * LLM_INDEX_CHUNK_LINES lines and tokenized on identifiers: every
+ * identifier counts as a term, lowercased, and so do its words when it is
+ * written in snake_case or camelCase, so "stop rules" finds
+ * llm_stop_rules_apply. A search scores the chunks holding any term of the
+ * query and returns the best ones.
+ *
+ * Files are indexed one at a time and again whenever their size or
+ * modification time changes, so keeping the index current only needs the
+ * paths that changed. On disk the index takes a compact binary form:
+ * varints throughout, postings sorted and delta coded.
+ *
+ * All functions are thread-safe. Tokenizing happens outside the lock, so
+ * searches do not wait for files being indexed.
+ */
+
+#define LLM_INDEX_CHUNK_LINES 40
+/// @brief Larger files are not indexed, they are rarely hand written
+#define LLM_INDEX_MAX_FILE_BYTES (1024 * 1024)
+
+typedef struct LLMIndex LLMIndex;
+
+/// @brief A chunk found by llm_index_search()
+typedef struct {
+    gchar *path;
+    guint first_line;   // 0-based
+    guint last_line;    // Inclusive
+    gdouble score;
+} LLMIndexHit;
+
+LLMIndex *llm_index_new(void);
+
+void llm_index_free(LLMIndex *index);
+
+/// @brief Read an index written by llm_index_save()
+/// @return NULL with error set if the file is missing, damaged or of another version
+LLMIndex *llm_index_load(const gchar *path, GError **error);
+
+/// @brief Write the index to a file, atomically
+gboolean llm_index_save(LLMIndex *index, const gchar *path, GError **error);
+
+/// @brief TRUE if the index changed since it was loaded or saved
+gboolean llm_index_dirty(LLMIndex *index);
+
+/// @brief Index a file, or index it again if it changed
+/// @return FALSE if the file is gone, too large or binary; it is then
+/// removed from the index
+gboolean llm_index_update_file(LLMIndex *index, const gchar *path);
+
+/// @brief Drop a file from the index
+void llm_index_remove_file(LLMIndex *index, const gchar *path);
+
+/// @brief Paths of all indexed files
+/// @return free with g_ptr_array_unref()
+GPtrArray *llm_index_dup_paths(LLMIndex *index);
+
+/// @brief The chunks scoring best for a query
+/// @return LLMIndexHit*, best first, free with g_ptr_array_unref()
+GPtrArray *llm_index_search(LLMIndex *index, const gchar *query, guint max_hits);
+
+void llm_index_hit_free(gpointer data);
+
+/// @brief Append the file, chunk and term counts to out
+void llm_index_describe(LLMIndex *index, GString *out);
+
+#endif // __LLM_INDEX_H__
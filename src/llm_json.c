@@ -1,70 +1,111 @@
 #include <glib.h>
+#include <stdio.h>
+#include <string.h>
 #include <json-c/json.h> 
 
 #include "llm_json.h"
 #include "llm_util.h"
 
 
-/// @brief Construct the JSON request payload using json-c for the completion endpoint
-gchar* llm_construct_completion_json_payload(const gchar* query, const gchar *current_document, const LLMArgs* args) {
-    // Create the root object
-    struct json_object *root = json_object_new_object();
-    
-    // Add model field
-    json_object_object_add(root, "model", 
-        json_object_new_string(args->model));
-    
-    // Construct the full prompt with all selected documents
-    GString *full_prompt = g_string_new("I will analyze the following documents:\n\n");
-    
-    // Include the current document if needed
-    if (current_document && llm_plugin->include_current_document) {
-        g_string_append(full_prompt, "--- CURRENT DOCUMENT ---\n");
-        g_string_append(full_prompt, current_document);
-        g_string_append(full_prompt, "\n\n");
+/// @brief Cut the documents at the end of the prompt so that the prompt, the
+/// question and the answer fit into the model's context window.
+static void llm_fit_documents_to_context(GString *prompt, gsize documents_start,
+    const gchar *question, const LLMArgs *args)
+{
+    if (args->context_size == 0 || args->context_size <= args->max_tokens) {
+        return;
+    }
+
+    gsize budget = (gsize)(args->context_size - args->max_tokens) * LLM_BYTES_PER_TOKEN;
+    gsize reserved = strlen(question) + 128; // Question and the closing instruction
+    if (prompt->len + reserved <= budget) {
+        return;
+    }
+
+    gsize keep = budget > reserved ? budget - reserved : 0;
+    keep = MAX(keep, documents_start);
+    if (keep >= prompt->len) {
+        return;
     }
+
+    // Do not split a UTF-8 sequence
+    const gchar *cut = g_utf8_find_prev_char(prompt->str, prompt->str + keep + 1);
+    g_string_truncate(prompt, cut ? (gsize)(cut - prompt->str) : keep);
+    g_string_append(prompt, "\n[... truncated to fit the context window ...]\n\n");
+    g_print("Prompt truncated to %" G_GSIZE_FORMAT " bytes for a %u token context\n", prompt->len, args->context_size);
+}
+
+/// @brief Assemble the prompt asking a question about the documents
+gchar* llm_construct_completion_prompt(const gchar* query, const GPtrArray *documents, const LLMArgs* args) {
+    // Construct the full prompt with all attached documents
+    GString *full_prompt = g_string_new("I will analyze the following documents:\n\n");
+    gsize documents_start = full_prompt->len;
     
-    // Include selected documents
-    if (llm_plugin->selected_document_ids) {
-        for (guint i = 0; i < llm_plugin->selected_document_ids->len; i++) {
-            GeanyDocument *doc = g_ptr_array_index(llm_plugin->selected_document_ids, i);
-            if (!doc || !doc->is_valid) {
-                continue; // Skip invalid documents
-            }
-            
-            // Skip if this is the current document and we already included it
-            if (llm_plugin->include_current_document && 
-                doc == document_get_current()) {
-                continue;
-            }
-            
-            // Get document content
-            ScintillaObject *sci = doc->editor->sci;
-            gsize length = scintilla_send_message(sci, SCI_GETTEXTLENGTH, 0, 0);
-            gchar* doc_content = g_malloc(length + 1);
-            
-            if (doc_content) {
-                scintilla_send_message(sci, SCI_GETTEXT, length + 1, (sptr_t)doc_content);
-                
-                g_string_append_printf(full_prompt, "--- DOCUMENT: %s ---\n", 
-                                     doc->file_name ? doc->file_name : "(unnamed)");
-                g_string_append(full_prompt, doc_content);
-                g_string_append(full_prompt, "\n\n");
-                
-                g_free(doc_content);
-            }
+    for (guint i = 0; documents && i < documents->len; i++) {
+        const LLMDocument *document = g_ptr_array_index(documents, i);
+        if (document->name) {
+            g_string_append_printf(full_prompt, "--- DOCUMENT: %s ---\n", document->name);
+        } else {
+            g_string_append(full_prompt, "--- CURRENT DOCUMENT ---\n");
         }
+        g_string_append(full_prompt, document->text);
+        g_string_append(full_prompt, "\n\n");
     }
     
+    llm_fit_documents_to_context(full_prompt, documents_start, query, args);
+
     g_string_append(full_prompt, "Based on the document(s), answer the following question:\n");
     g_string_append(full_prompt, query);
 
     // For debug:
     //g_print("Full prompt: %s\n", full_prompt->str);
+
+    return g_string_free(full_prompt, FALSE);
+}
+
+/// @brief Construct the JSON request payload using json-c for the completion endpoint
+gchar* llm_construct_completion_json_payload(const gchar* query, const GPtrArray *documents, const LLMArgs* args) {
+    gchar *prompt = llm_construct_completion_prompt(query, documents, args);
+    gchar *json_payload = llm_construct_prompt_json_payload(prompt, args);
+    g_free(prompt);
+
+    return json_payload;
+}
+
+/// @brief Construct the JSON request payload applying an instruction to a single document
+gchar* llm_construct_document_json_payload(const gchar *instruction, const gchar *document_name,
+    const gchar *document, const LLMArgs *args) {
+    GString *full_prompt = g_string_new("I will analyze the following document:\n\n");
+    gsize documents_start = full_prompt->len;
+
+    g_string_append_printf(full_prompt, "--- DOCUMENT: %s ---\n",
+                           document_name ? document_name : "(unnamed)");
+    g_string_append(full_prompt, document ? document : "");
+    g_string_append(full_prompt, "\n\n");
+
+    llm_fit_documents_to_context(full_prompt, documents_start, instruction, args);
+
+    g_string_append(full_prompt, "Based on the document, carry out the following instruction:\n");
+    g_string_append(full_prompt, instruction);
+
+    gchar *json_payload = llm_construct_prompt_json_payload(full_prompt->str, args);
+    g_string_free(full_prompt, TRUE);
+
+    return json_payload;
+}
+
+/// @brief Construct the JSON request payload for an already assembled prompt
+gchar* llm_construct_prompt_json_payload(const gchar *prompt, const LLMArgs *args) {
+    // Create the root object
+    struct json_object *root = json_object_new_object();
     
+    // Add model field
+    json_object_object_add(root, "model", 
+        json_object_new_string(args->model));
+
     // Add prompt field
     json_object_object_add(root, "prompt", 
-        json_object_new_string(full_prompt->str));
+        json_object_new_string(prompt));
     
     // Add max_tokens field
     json_object_object_add(root, "max_tokens", 
@@ -76,6 +117,29 @@ gchar* llm_construct_completion_json_payload(const gchar* query, const gchar *cu
     json_object_object_add(root, "temperature", 
     json_object_new_double_s(args->temperature, buffer));
     
+    // Request several alternatives in one call. "n" is the OpenAI field,
+    // "n_probs" makes llama.cpp report token probabilities for ranking.
+    if (args->n_candidates > 1) {
+        json_object_object_add(root, "n",
+            json_object_new_int(args->n_candidates));
+        json_object_object_add(root, "logprobs",
+            json_object_new_int(1));
+        json_object_object_add(root, "n_probs",
+            json_object_new_int(1));
+    }
+
+    // Continuations repeat the prompt and the answer so far, which
+    // llama.cpp then takes from the KV cache of the slot
+    if (args->cache_prompt) {
+        json_object_object_add(root, "cache_prompt",
+            json_object_new_boolean(TRUE));
+    }
+
+    if (args->return_progress) {
+        json_object_object_add(root, "return_progress",
+            json_object_new_boolean(TRUE));
+    }
+
     // Add stream field (TRUE for streaming tokens)
     json_object_object_add(root, "stream", 
         json_object_new_boolean(TRUE));
@@ -86,11 +150,171 @@ gchar* llm_construct_completion_json_payload(const gchar* query, const gchar *cu
     
     // Clean up
     json_object_put(root);  // Decrements refcount and frees when zero
-    g_string_free(full_prompt, TRUE);
     
     return json_payload;
 }
 
+gchar* llm_construct_embeddings_json_payload(const gchar *model, const gchar * const *inputs, guint count) {
+    struct json_object *root = json_object_new_object();
+
+    if (model && *model) {
+        json_object_object_add(root, "model",
+            json_object_new_string(model));
+    }
+
+    struct json_object *input = json_object_new_array();
+    for (guint i = 0; i < count; i++) {
+        json_object_array_add(input, json_object_new_string(inputs[i]));
+    }
+    json_object_object_add(root, "input", input);
+
+    gchar *json_payload = g_strdup(json_object_to_json_string_ext(root, JSON_C_TO_STRING_PLAIN));
+    json_object_put(root);
+    return json_payload;
+}
+
+gfloat* llm_json_to_embeddings(const gchar *body, guint count, guint *dimension)
+{
+    struct json_object *root = body ? json_tokener_parse(body) : NULL;
+    struct json_object *data = NULL;
+    if (!root || !json_object_object_get_ex(root, "data", &data) ||
+        !json_object_is_type(data, json_type_array) || json_object_array_length(data) != count) {
+        if (root) {
+            json_object_put(root);
+        }
+        return NULL;
+    }
+
+    gfloat *vectors = NULL;
+    guint length = 0;
+    guint filled = 0;
+    for (guint i = 0; i < count; i++) {
+        struct json_object *item = json_object_array_get_idx(data, i);
+        struct json_object *embedding = NULL;
+        struct json_object *index_obj = NULL;
+        if (!json_object_object_get_ex(item, "embedding", &embedding) ||
+            !json_object_is_type(embedding, json_type_array)) {
+            break;
+        }
+        // The order of the inputs is in "index", servers need not keep it
+        gint64 index = json_object_object_get_ex(item, "index", &index_obj) ?
+            json_object_get_int64(index_obj) : i;
+        guint item_length = (guint)json_object_array_length(embedding);
+        if (!vectors) {
+            length = item_length;
+            vectors = length > 0 ? g_new0(gfloat, (gsize)count * length) : NULL;
+        }
+        if (!vectors || item_length != length || index < 0 || index >= count) {
+            break;
+        }
+        for (guint j = 0; j < length; j++) {
+            vectors[index * length + j] = (gfloat)json_object_get_double(json_object_array_get_idx(embedding, j));
+        }
+        filled++;
+    }
+    json_object_put(root);
+
+    if (filled != count) {
+        g_free(vectors);
+        return NULL;
+    }
+    *dimension = length;
+    return vectors;
+}
+
+
+/// @brief Sum the "logprob" members of an array of token objects
+static gboolean llm_json_sum_token_logprobs(struct json_object *tokens, gdouble *sum)
+{
+    gboolean found = FALSE;
+    size_t len = json_object_array_length(tokens);
+
+    for (size_t i = 0; i < len; i++) {
+        struct json_object *token = json_object_array_get_idx(tokens, i);
+        struct json_object *logprob_obj = NULL;
+        if (json_object_is_type(token, json_type_object) &&
+            json_object_object_get_ex(token, "logprob", &logprob_obj)) {
+            *sum += json_object_get_double(logprob_obj);
+            found = TRUE;
+        }
+    }
+    return found;
+}
+
+/// @brief Extract the cumulative logprob of a streamed chunk.
+/// Handles OpenAI completions (logprobs.token_logprobs), OpenAI chat
+/// (logprobs.content[].logprob) and llama.cpp (completion_probabilities).
+static void llm_json_parse_logprobs(struct json_object *root, struct json_object *choice, LLMResponse *response)
+{
+    struct json_object *logprobs_obj = NULL;
+    struct json_object *tokens = NULL;
+    gdouble sum = 0.0;
+    gboolean found = FALSE;
+
+    if (choice &&
+        json_object_object_get_ex(choice, "logprobs", &logprobs_obj) &&
+        json_object_is_type(logprobs_obj, json_type_object))
+    {
+        if (json_object_object_get_ex(logprobs_obj, "token_logprobs", &tokens) &&
+            json_object_is_type(tokens, json_type_array))
+        {
+            size_t len = json_object_array_length(tokens);
+            for (size_t i = 0; i < len; i++) {
+                struct json_object *value = json_object_array_get_idx(tokens, i);
+                if (json_object_is_type(value, json_type_double) ||
+                    json_object_is_type(value, json_type_int)) {
+                    sum += json_object_get_double(value);
+                    found = TRUE;
+                }
+            }
+        }
+        else if (json_object_object_get_ex(logprobs_obj, "content", &tokens) &&
+                 json_object_is_type(tokens, json_type_array))
+        {
+            found = llm_json_sum_token_logprobs(tokens, &sum);
+        }
+    }
+    else if (json_object_object_get_ex(root, "completion_probabilities", &tokens) &&
+             json_object_is_type(tokens, json_type_array))
+    {
+        found = llm_json_sum_token_logprobs(tokens, &sum);
+    }
+
+    response->logprob = sum;
+    response->has_logprob = found;
+}
+
+/// @brief Read a number that may be encoded as an int or a double
+static gdouble llm_json_get_number(struct json_object *obj, const gchar *key)
+{
+    struct json_object *value = NULL;
+    if (json_object_object_get_ex(obj, key, &value) &&
+        (json_object_is_type(value, json_type_double) || json_object_is_type(value, json_type_int))) {
+        return json_object_get_double(value);
+    }
+    return 0.0;
+}
+
+/// @brief Parse llama.cpp's "timings" object
+static void llm_json_parse_timings(struct json_object *timings_obj, LLMServerTimings *timings)
+{
+    timings->prompt_n = (gint)llm_json_get_number(timings_obj, "prompt_n");
+    timings->prompt_ms = llm_json_get_number(timings_obj, "prompt_ms");
+    timings->predicted_n = (gint)llm_json_get_number(timings_obj, "predicted_n");
+    timings->predicted_ms = llm_json_get_number(timings_obj, "predicted_ms");
+    timings->predicted_per_second = llm_json_get_number(timings_obj, "predicted_per_second");
+    timings->valid = TRUE;
+}
+
+/// @brief Parse llama.cpp's "prompt_progress" object
+static void llm_json_parse_progress(struct json_object *progress_obj, LLMPromptProgress *progress)
+{
+    progress->total = (gint)llm_json_get_number(progress_obj, "total");
+    progress->cache = (gint)llm_json_get_number(progress_obj, "cache");
+    progress->processed = (gint)llm_json_get_number(progress_obj, "processed");
+    progress->time_ms = llm_json_get_number(progress_obj, "time_ms");
+    progress->valid = progress->total > 0;
+}
 
 /// @brief populate LLMResponse from raw JSON data
 gboolean llm_json_to_response(LLMResponse *response, GString *response_buffer, GError **error)
@@ -180,6 +404,22 @@ gboolean llm_json_to_response(LLMResponse *response, GString *response_buffer, G
         // If there's an error, we might not have choices, so don't make it fatal yet
     }
 
+    // llama.cpp adds its own timings to the final event
+    struct json_object *timings_obj = NULL;
+    if (json_object_object_get_ex(root, "timings", &timings_obj) &&
+        json_object_is_type(timings_obj, json_type_object))
+    {
+        llm_json_parse_timings(timings_obj, &response->timings);
+    }
+
+    // Sent while the prompt is processed, before the first token
+    struct json_object *progress_obj = NULL;
+    if (json_object_object_get_ex(root, "prompt_progress", &progress_obj) &&
+        json_object_is_type(progress_obj, json_type_object))
+    {
+        llm_json_parse_progress(progress_obj, &response->progress);
+    }
+
     // Extract text from choices if available
     struct json_object *choices_obj = NULL;
     if (json_object_object_get_ex(root, "choices", &choices_obj) && 
@@ -191,6 +431,24 @@ gboolean llm_json_to_response(LLMResponse *response, GString *response_buffer, G
             struct json_object *first_choice = json_object_array_get_idx(choices_obj, 0);
             if (json_object_is_type(first_choice, json_type_object))
             {
+                // With several candidates each streamed chunk carries its choice index
+                struct json_object *index_obj = NULL;
+                if (json_object_object_get_ex(first_choice, "index", &index_obj) &&
+                    json_object_is_type(index_obj, json_type_int))
+                {
+                    response->index = (guint)json_object_get_int(index_obj);
+                }
+                llm_json_parse_logprobs(root, first_choice, response);
+
+                // null until the last chunk of the choice
+                struct json_object *finish_obj = NULL;
+                if (json_object_object_get_ex(first_choice, "finish_reason", &finish_obj) &&
+                    json_object_is_type(finish_obj, json_type_string))
+                {
+                    response->finish_reason = strcmp(json_object_get_string(finish_obj), "length") == 0 ?
+                        LLM_FINISH_LENGTH : LLM_FINISH_STOP;
+                }
+
                 // Handle different potential structures (e.g., OpenAI chat vs completion)
                 const char *text_content = NULL;
                 
@@ -246,6 +504,6 @@ gboolean llm_json_to_response(LLMResponse *response, GString *response_buffer, G
 
     json_object_put(root);  // Free the parsed JSON object
 
-    // Return TRUE if we got *something* (text or error), FALSE only on parse failure
-    return (response->response_text != NULL || response->error != NULL);
+    // Return TRUE if we got *something* (text, error or progress), FALSE only on parse failure
+    return (response->response_text != NULL || response->error != NULL || response->progress.valid);
 }
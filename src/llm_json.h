@@ -1,18 +1,47 @@
 #ifndef __LLM_JSON_H__
 #define __LLM_JSON_H__
 
-#include "plugin.h" // LLMPlugin
+#include "llm_types.h"
+
+/// @brief Rough prompt size estimate used against the context window
+#define LLM_BYTES_PER_TOKEN 4
+
+/// @brief Assemble the prompt asking a question about the documents, fitted to the context
+gchar* llm_construct_completion_prompt(
+    const gchar* query,
+    const GPtrArray *documents,
+    const LLMArgs* args);
 
 /// @brief Construct the JSON request payload using json-glib for the completion endpoint
 gchar* llm_construct_completion_json_payload(
     const gchar* query, 
-    const gchar *current_document, 
+    const GPtrArray *documents, 
     const LLMArgs* args);
 
+/// @brief Construct the JSON request payload applying an instruction to a single document
+gchar* llm_construct_document_json_payload(
+    const gchar *instruction,
+    const gchar *document_name,
+    const gchar *document,
+    const LLMArgs *args);
+
+/// @brief Construct the JSON request payload for an already assembled prompt
+gchar* llm_construct_prompt_json_payload(const gchar *prompt, const LLMArgs *args);
+
 /// @brief Construct the JSON request payload using json-glib for the chat completion endpoint
 gchar* llm_construct_chat_completion_json_payload(const gchar* query, 
     const LLMArgs* args);
 
+/// @brief Construct the JSON request payload of the embeddings endpoint
+/// @param model may be NULL or empty for the model the server has loaded
+gchar* llm_construct_embeddings_json_payload(const gchar *model, const gchar * const *inputs, guint count);
+
+/// @brief Read the vectors of an embeddings answer, in the order of the inputs
+/// @param dimension set to the length of the vectors
+/// @return count * dimension floats, NULL if the answer does not have a vector
+/// of one length for every input; free with g_free()
+gfloat* llm_json_to_embeddings(const gchar *body, guint count, guint *dimension);
+
 /// @brief Populate LLMResponse from raw JSON data.
 gboolean llm_json_to_response(LLMResponse *response, GString *response_buffer, GError **error);
 
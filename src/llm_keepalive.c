@@ -0,0 +1,162 @@
+#include "llm_keepalive.h"
+#include "llm_http.h"
+#include "llm_json.h"
+#include "llm_util.h"
+#include "llm_endpoints.h"
+#include "llm_profiles.h"
+#include "llm_scheduler.h"
+#include "llm_trace.h"
+
+/// @brief Data of a warm-up job
+typedef struct {
+    LLMPlugin *plugin;
+    gchar *json_payload;
+} LLMWarmup;
+
+static void llm_warmup_free(gpointer data)
+{
+    LLMWarmup *warmup = (LLMWarmup *)data;
+    g_atomic_int_set(&warmup->plugin->warmup_pending, 0);
+    g_free(warmup->json_payload);
+    g_free(warmup);
+}
+
+static void llm_warmup_on_error(const gchar *error_message, gpointer user_data)
+{
+    g_print("Warm-up request failed: %s\n", error_message);
+}
+
+/// @brief Scheduler job sending the warm-up request to every chat server
+static void llm_warmup_thread_func(LLMJob *job, gpointer data)
+{
+    LLMWarmup *warmup = (LLMWarmup *)data;
+    LLMPlugin *plugin = warmup->plugin;
+    LLMEndpointSet *endpoints = llm_task_endpoints(plugin, LLM_TASK_CHAT);
+    LLMCallbacks callbacks = { .on_error = llm_warmup_on_error };
+    GPtrArray *tried = g_ptr_array_new_with_free_func((GDestroyNotify)llm_endpoint_unref);
+    LLMEndpoint *endpoint;
+    gint64 trace_start = llm_trace_begin();
+
+    // All of them, a failover must not land on a cold server either
+    while (!g_atomic_int_get(&job->cancel_flag) && (endpoint = llm_endpoints_acquire(endpoints, tried)) != NULL) {
+        g_ptr_array_add(tried, llm_endpoint_ref(endpoint));
+
+        gchar *server_uri = llm_construct_server_uri_string(endpoint->url, "/v1/completions");
+        LLMTransfer transfer = { .max_attempts = 1 };
+        if (server_uri && llm_execute_query(server_uri, plugin->proxy_url, plugin->api_key,
+                warmup->json_payload, &callbacks, &job->cancel_flag, &transfer)) {
+            g_print("Warmed up %s in %.0f ms\n", endpoint->url,
+                (transfer.end_time - transfer.start_time) / 1000.0);
+        }
+        g_free(server_uri);
+
+        // A model load says nothing about the latency of real requests
+        llm_endpoint_release(endpoints, endpoint, NULL, NULL);
+    }
+
+    g_ptr_array_free(tried, TRUE);
+    llm_trace_end("warmup_job", "worker", trace_start);
+}
+
+void llm_warmup_submit(LLMPlugin *plugin)
+{
+    if (!plugin || !plugin->scheduler ||
+        llm_endpoints_count(llm_task_endpoints(plugin, LLM_TASK_CHAT)) == 0) {
+        return;
+    }
+    if (!g_atomic_int_compare_and_exchange(&plugin->warmup_pending, 0, 1)) {
+        return;
+    }
+
+    // The chat model with a single token is all it takes to get it loaded
+    LLMArgs *args = llm_task_args_new(plugin, LLM_TASK_CHAT);
+    args->max_tokens = 1;
+    args->n_candidates = 1;
+    args->return_progress = FALSE;
+
+    LLMWarmup *warmup = g_new0(LLMWarmup, 1);
+    warmup->plugin = plugin;
+    warmup->json_payload = llm_construct_prompt_json_payload(LLM_WARMUP_PROMPT, args);
+    llm_args_free(args);
+
+    // Not activity: the editor may well be idle, and the interval stretches with that
+    plugin->last_request_time = g_get_monotonic_time();
+    llm_scheduler_submit(plugin->scheduler, LLM_PRIORITY_BACKGROUND,
+        llm_warmup_thread_func, warmup, llm_warmup_free);
+}
+
+/// @brief Ping the servers once no request went out for the interval,
+/// stretched by the time the editor has been idle (main thread)
+static gboolean llm_keepalive_tick(gpointer user_data)
+{
+    LLMPlugin *plugin = (LLMPlugin *)user_data;
+    gint64 now = g_get_monotonic_time();
+    gint64 idle = now - plugin->last_activity_time;
+
+    if (idle >= LLM_KEEPALIVE_MAX_IDLE_USEC) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    gint64 interval = (gint64)plugin->keepalive_interval * G_USEC_PER_SEC;
+    interval <<= idle / LLM_KEEPALIVE_IDLE_STEP_USEC;
+    if (now - plugin->last_request_time >= interval) {
+        llm_warmup_submit(plugin);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+void llm_keepalive_stop(LLMPlugin *plugin)
+{
+    if (plugin && plugin->keepalive_source) {
+        g_source_remove(plugin->keepalive_source);
+        plugin->keepalive_source = 0;
+    }
+}
+
+void llm_keepalive_apply(LLMPlugin *plugin)
+{
+    if (!plugin) {
+        return;
+    }
+
+    // The model or the servers may have changed
+    if (plugin->warmup_enabled) {
+        llm_warmup_submit(plugin);
+    }
+
+    llm_keepalive_stop(plugin);
+    if (plugin->keepalive_interval > 0) {
+        // Checked a few times per interval, so a ping is never late by a whole one
+        plugin->keepalive_source = g_timeout_add_seconds(MAX(plugin->keepalive_interval / 4, 1),
+            llm_keepalive_tick, plugin);
+    }
+}
+
+void llm_keepalive_touch(LLMPlugin *plugin)
+{
+    if (plugin) {
+        plugin->last_activity_time = g_get_monotonic_time();
+    }
+}
+
+void llm_keepalive_note_request(LLMPlugin *plugin)
+{
+    if (plugin) {
+        plugin->last_request_time = plugin->last_activity_time = g_get_monotonic_time();
+    }
+}
+
+gboolean on_llm_editor_notify(GObject *object, GeanyEditor *editor, SCNotification *notification,
+    gpointer user_data)
+{
+    // Painting, scrolling and UI updates notify as well
+    switch (notification->nmhdr.code) {
+        case SCN_MODIFIED:
+        case SCN_CHARADDED:
+            llm_keepalive_touch((LLMPlugin *)user_data);
+            break;
+        default:
+            break;
+    }
+    return FALSE;
+}
@@ -0,0 +1,40 @@
+#ifndef __LLM_KEEPALIVE_H__
+#define __LLM_KEEPALIVE_H__
+
+#include "plugin.h"
+
+/**
+ * Model warm-up and keep-alive. Backends that load models on demand, such
+ * as llama-server in router mode or Ollama, make the first request after a
+ * pause wait for the model to load. A warm-up sends a one token request to
+ * every chat server as a background job, so the model is loaded before the
+ * first question. The keep-alive repeats it whenever no request went out
+ * for an interval while the editor is in use. Every LLM_KEEPALIVE_IDLE_STEP
+ * without editing doubles the interval, and after LLM_KEEPALIVE_MAX_IDLE
+ * the model is left to unload.
+ */
+
+#define LLM_WARMUP_PROMPT "Hello"
+#define LLM_KEEPALIVE_IDLE_STEP_USEC (G_GINT64_CONSTANT(10 * 60) * G_USEC_PER_SEC)
+#define LLM_KEEPALIVE_MAX_IDLE_USEC (G_GINT64_CONSTANT(2 * 60 * 60) * G_USEC_PER_SEC)
+
+/// @brief Queue a warm-up of the chat servers unless one is queued already (main thread)
+void llm_warmup_submit(LLMPlugin *plugin);
+
+/// @brief Warm up if enabled and restart the keep-alive timer after the settings changed (main thread)
+void llm_keepalive_apply(LLMPlugin *plugin);
+
+/// @brief Stop the keep-alive timer (main thread)
+void llm_keepalive_stop(LLMPlugin *plugin);
+
+/// @brief Note that the editor is in use (main thread)
+void llm_keepalive_touch(LLMPlugin *plugin);
+
+/// @brief Note that a request went to the chat servers, which keeps the model loaded (main thread)
+void llm_keepalive_note_request(LLMPlugin *plugin);
+
+/// @brief Geany "editor-notify" handler counting edits as activity
+gboolean on_llm_editor_notify(GObject *object, GeanyEditor *editor, SCNotification *notification,
+    gpointer user_data);
+
+#endif // __LLM_KEEPALIVE_H__
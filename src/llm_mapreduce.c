@@ -0,0 +1,439 @@
+#include <string.h>
+
+#include "llm_mapreduce.h"
+#include "llm.h"
+#include "llm_json.h"
+#include "llm_scheduler.h"
+#include "llm_util.h"
+#include "settings.h"
+
+/// @brief One piece of an oversized document
+typedef struct {
+    gchar *text;
+    gchar *summary;     // Set once summarized or found in the cache
+    gchar *cache_path;
+} MapChunk;
+
+/// @brief Summarization shared by the request's job and its helper jobs.
+/// Helpers may start after the request is done with it, so it is counted.
+typedef struct {
+    gint ref_count;
+    LLMPlugin *plugin;
+    LLMTask task;
+    LLMArgs map_args;        // Borrows the model string of the request
+    gboolean *cancel_flag;   // Of the request's job
+    LLMCallbacks *callbacks;
+    guint total;
+
+    GMutex lock;             // Guards the fields below
+    GCond cond;              // Signalled when a chunk is finished
+    GQueue pending;          // MapChunk* still to summarize
+    guint in_flight;         // Chunks being summarized
+    guint done;              // Chunks summarized or found in the cache
+    gboolean closed;         // The request is done, chunks and callbacks are gone
+    gchar *error;            // First error, stops the other workers
+} MapState;
+
+/// @brief Accumulates one streamed summary
+typedef struct {
+    GString *text;
+    gchar *error;
+} MapRequest;
+
+static void map_chunk_free(gpointer data)
+{
+    MapChunk *chunk = (MapChunk *)data;
+    g_free(chunk->text);
+    g_free(chunk->summary);
+    g_free(chunk->cache_path);
+    g_free(chunk);
+}
+
+static void map_request_on_data(const gchar *data_chunk, gpointer user_data)
+{
+    MapRequest *request = (MapRequest *)user_data;
+    g_string_append(request->text, data_chunk);
+}
+
+static void map_request_on_error(const gchar *error_message, gpointer user_data)
+{
+    MapRequest *request = (MapRequest *)user_data;
+    if (!request->error) {
+        request->error = g_strdup(error_message);
+    }
+}
+
+static void map_state_unref(gpointer data)
+{
+    MapState *state = (MapState *)data;
+    if (g_atomic_int_dec_and_test(&state->ref_count)) {
+        g_queue_clear(&state->pending);
+        g_cond_clear(&state->cond);
+        g_mutex_clear(&state->lock);
+        g_free(state->error);
+        g_free(state);
+    }
+}
+
+static void llm_mapreduce_status(MapState *state, guint done)
+{
+    if (!state->callbacks || !state->callbacks->on_status) {
+        return;
+    }
+    gchar *message = g_strdup_printf("Summarizing large documents: %u of %u parts...",
+        done, state->total);
+    state->callbacks->on_status(message, state->callbacks->user_data);
+    g_free(message);
+}
+
+/// @brief Find where a chunk starting at start should end, at most at limit.
+/// Prefers the end of a top-level block (a line starting with '}'), then a
+/// blank line, then any line end, in the second half of the chunk.
+static gsize llm_mapreduce_find_boundary(const gchar *text, gsize start, gsize limit)
+{
+    gsize floor = start + (limit - start) / 2;
+
+    for (gsize i = limit; i > floor + 1; i--) {
+        if (text[i - 1] != '\n') {
+            continue;
+        }
+        gsize line = i - 1;
+        while (line > start && text[line - 1] != '\n') {
+            line--;
+        }
+        if (text[line] == '}') {
+            return i;
+        }
+    }
+    for (gsize i = limit; i > floor + 1; i--) {
+        if (text[i - 1] == '\n' && text[i - 2] == '\n') {
+            return i;
+        }
+    }
+    for (gsize i = limit; i > floor; i--) {
+        if (text[i - 1] == '\n') {
+            return i;
+        }
+    }
+
+    // Do not split a UTF-8 sequence
+    const gchar *cut = g_utf8_find_prev_char(text + start, text + limit + 1);
+    return cut && cut > text + start ? (gsize)(cut - text) : limit;
+}
+
+/// @brief Split a document into chunks of at most chunk_bytes
+static void llm_mapreduce_split(GPtrArray *chunks, const gchar *text, gsize chunk_bytes)
+{
+    gsize length = strlen(text);
+    gsize pos = 0;
+
+    while (pos < length) {
+        gsize end = pos + chunk_bytes >= length ? length :
+            llm_mapreduce_find_boundary(text, pos, pos + chunk_bytes);
+        MapChunk *chunk = g_new0(MapChunk, 1);
+        chunk->text = g_strndup(text + pos, end - pos);
+        g_ptr_array_add(chunks, chunk);
+        pos = end;
+    }
+}
+
+static gchar *llm_mapreduce_prompt(const MapChunk *chunk)
+{
+    return g_strdup_printf(
+        "Summarize the following part of a larger file. Keep the names of functions, "
+        "types and variables, what they do, and any details needed to answer questions "
+        "about the code later. Answer with the summary only.\n\n"
+        "--- PART ---\n%s\n--- END OF PART ---\n", chunk->text);
+}
+
+/// @brief TRUE once the request is stopped, failed or done (lock held)
+static gboolean llm_mapreduce_stopped_locked(MapState *state)
+{
+    return state->closed || state->error || LLM_CANCELLED(state->cancel_flag);
+}
+
+/// @brief Summarize pending chunks until none is left (worker thread)
+/// @param job_cancel cancel flag of the job running this, aborts its transfer
+static void llm_mapreduce_work(MapState *state, gboolean *job_cancel)
+{
+    for (;;) {
+        g_mutex_lock(&state->lock);
+        MapChunk *chunk = NULL;
+        if (!llm_mapreduce_stopped_locked(state) && !g_atomic_int_get(job_cancel)) {
+            chunk = g_queue_pop_head(&state->pending);
+        }
+        if (chunk) {
+            state->in_flight++;
+        }
+        g_mutex_unlock(&state->lock);
+        if (!chunk) {
+            break;
+        }
+
+        gchar *prompt = llm_mapreduce_prompt(chunk);
+        gchar *json_payload = llm_construct_prompt_json_payload(prompt, &state->map_args);
+        g_free(prompt);
+
+        MapRequest request = { g_string_new(NULL), NULL };
+        LLMCallbacks callbacks = {
+            .on_data_received = map_request_on_data,
+            .on_error = map_request_on_error,
+            .user_data = &request
+        };
+        // Not hedged: the summaries already use every slot they get
+        llm_execute_task_query(state->plugin, state->task, LLM_PRIORITY_BATCH, "/v1/completions",
+            json_payload, &callbacks, job_cancel, NULL);
+        g_free(json_payload);
+
+        gboolean ok = !request.error && !g_atomic_int_get(job_cancel);
+        if (ok) {
+            chunk->summary = g_strstrip(g_string_free(request.text, FALSE));
+            if (chunk->cache_path) {
+                GError *error = NULL;
+                if (!g_file_set_contents(chunk->cache_path, chunk->summary, -1, &error)) {
+                    g_print("Could not cache chunk summary: %s\n", error->message);
+                    g_error_free(error);
+                }
+            }
+        } else {
+            g_string_free(request.text, TRUE);
+        }
+
+        g_mutex_lock(&state->lock);
+        if (ok) {
+            state->done++;
+        } else if (g_atomic_int_get(job_cancel) && job_cancel != state->cancel_flag && !llm_mapreduce_stopped_locked(state)) {
+            // A helper preempted or cancelled, another worker takes the chunk
+            g_queue_push_head(&state->pending, chunk);
+        } else if (!g_atomic_int_get(job_cancel) && !llm_mapreduce_stopped_locked(state)) {
+            state->error = g_strdup_printf("Summarizing a large document failed: %s", request.error);
+        }
+        guint done = state->done;
+        state->in_flight--;
+        // Under the lock: the request waits for in_flight before its callbacks go away
+        if (ok) {
+            llm_mapreduce_status(state, done);
+        }
+        g_cond_broadcast(&state->cond);
+        g_mutex_unlock(&state->lock);
+        g_free(request.error);
+        if (!ok) {
+            break;
+        }
+    }
+}
+
+/// @brief Scheduler job helping a request with its summaries while a slot is free
+static void llm_mapreduce_helper_thread_func(LLMJob *job, gpointer data)
+{
+    llm_mapreduce_work((MapState *)data, &job->cancel_flag);
+}
+
+/// @brief Cancel the helper jobs of a request, those queued and those running
+static void llm_mapreduce_cancel_helpers(LLMPlugin *plugin, GArray *helpers)
+{
+    for (guint i = 0; plugin->scheduler && i < helpers->len; i++) {
+        llm_scheduler_cancel(plugin->scheduler, g_array_index(helpers, guint, i));
+    }
+}
+
+/// @brief Look the chunk up in the summary cache
+static void llm_mapreduce_cache_lookup(MapChunk *chunk, const gchar *cache_dir, const gchar *model)
+{
+    if (!cache_dir) {
+        return;
+    }
+
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(checksum, (const guchar *)LLM_MAPREDUCE_CACHE_VERSION, -1);
+    g_checksum_update(checksum, (const guchar *)"\n", 1);
+    g_checksum_update(checksum, (const guchar *)(model ? model : ""), -1);
+    g_checksum_update(checksum, (const guchar *)"\n", 1);
+    g_checksum_update(checksum, (const guchar *)chunk->text, -1);
+    chunk->cache_path = g_build_filename(cache_dir, g_checksum_get_string(checksum), NULL);
+    g_checksum_free(checksum);
+
+    if (!g_file_get_contents(chunk->cache_path, &chunk->summary, NULL, NULL)) {
+        chunk->summary = NULL;
+    }
+}
+
+static gsize llm_document_prompt_size(const LLMDocument *document)
+{
+    return strlen(document->text) + (document->name ? strlen(document->name) : 0) + 32;
+}
+
+static gint llm_document_compare_size(gconstpointer a, gconstpointer b)
+{
+    gsize size_a = strlen((*(LLMDocument * const *)a)->text);
+    gsize size_b = strlen((*(LLMDocument * const *)b)->text);
+    return size_a < size_b ? 1 : size_a > size_b ? -1 : 0;
+}
+
+/// @brief Make the documents fit the context window by summarizing the largest ones.
+GPtrArray *llm_mapreduce_documents(LLMPlugin *plugin, LLMTask task, GPtrArray *documents,
+    const gchar *question, const LLMArgs *args, LLMCallbacks *callbacks, gboolean *cancel_flag)
+{
+    if (!documents || documents->len == 0 || args->context_size <= args->max_tokens ||
+        args->context_size <= LLM_MAPREDUCE_SUMMARY_TOKENS) {
+        return documents ? g_ptr_array_ref(documents) : NULL;
+    }
+
+    gsize budget = (gsize)(args->context_size - args->max_tokens) * LLM_BYTES_PER_TOKEN;
+    gsize reserved = strlen(question) + 256; // Question and the instructions
+    budget = budget > reserved ? budget - reserved : 0;
+
+    gsize total = 0;
+    for (guint i = 0; i < documents->len; i++) {
+        total += llm_document_prompt_size(g_ptr_array_index(documents, i));
+    }
+    if (total <= budget) {
+        return g_ptr_array_ref(documents);
+    }
+
+    gsize chunk_bytes = (gsize)(args->context_size - LLM_MAPREDUCE_SUMMARY_TOKENS) * LLM_BYTES_PER_TOKEN;
+    chunk_bytes = chunk_bytes > LLM_MAPREDUCE_PROMPT_OVERHEAD * 2 ?
+        chunk_bytes - LLM_MAPREDUCE_PROMPT_OVERHEAD : chunk_bytes / 2;
+    chunk_bytes = MAX(chunk_bytes, LLM_MAPREDUCE_MIN_CHUNK_BYTES);
+    gsize summary_bytes = LLM_MAPREDUCE_SUMMARY_TOKENS * LLM_BYTES_PER_TOKEN;
+
+    // Summarize the largest documents until the rest fits
+    GPtrArray *by_size = g_ptr_array_sized_new(documents->len);
+    for (guint i = 0; i < documents->len; i++) {
+        g_ptr_array_add(by_size, g_ptr_array_index(documents, i));
+    }
+    g_ptr_array_sort(by_size, llm_document_compare_size);
+
+    GHashTable *summarized = g_hash_table_new(g_direct_hash, g_direct_equal); // LLMDocument* -> chunks
+    for (guint i = 0; i < by_size->len && total > budget; i++) {
+        LLMDocument *document = g_ptr_array_index(by_size, i);
+        gsize length = strlen(document->text);
+        gsize parts = (length + chunk_bytes - 1) / chunk_bytes;
+        if (parts * summary_bytes >= length) {
+            break; // Summaries would not be smaller, the prompt gets truncated instead
+        }
+        GPtrArray *chunks = g_ptr_array_new_with_free_func(map_chunk_free);
+        llm_mapreduce_split(chunks, document->text, chunk_bytes);
+        g_hash_table_insert(summarized, document, chunks);
+        total = total - length + chunks->len * summary_bytes;
+    }
+    g_ptr_array_free(by_size, TRUE);
+
+    // Cached summaries are reused, the rest is summarized several at a time
+    MapState *state = g_new0(MapState, 1);
+    state->ref_count = 1;
+    state->plugin = plugin;
+    state->task = task;
+    state->map_args = *args;
+    state->map_args.n_candidates = 1;
+    state->map_args.max_tokens = LLM_MAPREDUCE_SUMMARY_TOKENS;
+    state->map_args.temperature = MIN(args->temperature, 0.2);
+    state->cancel_flag = cancel_flag;
+    state->callbacks = callbacks;
+    g_mutex_init(&state->lock);
+    g_cond_init(&state->cond);
+    g_queue_init(&state->pending);
+
+    gchar *cache_dir = llm_plugin_data_dir(plugin, LLM_MAPREDUCE_CACHE_DIR);
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, summarized);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        GPtrArray *chunks = (GPtrArray *)value;
+        for (guint i = 0; i < chunks->len; i++) {
+            MapChunk *chunk = g_ptr_array_index(chunks, i);
+            llm_mapreduce_cache_lookup(chunk, cache_dir, args->model);
+            state->total++;
+            if (chunk->summary) {
+                state->done++;
+            } else {
+                g_queue_push_tail(&state->pending, chunk);
+            }
+        }
+    }
+    g_free(cache_dir);
+
+    guint pending = g_queue_get_length(&state->pending);
+    g_print("Map-reduce: %u chunks, %u cached\n", state->total, state->total - pending);
+    llm_mapreduce_status(state, state->done);
+
+    // The request's own slot summarizes, helper jobs join in as the
+    // scheduler has slots free, within the limits of the batch class
+    GArray *helpers = g_array_new(FALSE, FALSE, sizeof(guint));
+    guint n_helpers = MIN(pending, MAX(plugin->max_parallel_requests, 1)) - MIN(pending, 1);
+    for (guint i = 0; plugin->scheduler && i < n_helpers; i++) {
+        g_atomic_int_inc(&state->ref_count);
+        guint id = llm_scheduler_submit(plugin->scheduler, LLM_PRIORITY_BATCH,
+            llm_mapreduce_helper_thread_func, state, map_state_unref);
+        g_array_append_val(helpers, id);
+    }
+
+    gboolean no_cancel = FALSE;
+    gboolean *own_cancel = cancel_flag ? cancel_flag : &no_cancel;
+    gboolean helpers_cancelled = FALSE;
+    for (;;) {
+        llm_mapreduce_work(state, own_cancel);
+
+        // Chunks of preempted helpers come back, stopping helpers hurries their transfers
+        g_mutex_lock(&state->lock);
+        while (state->in_flight > 0) {
+            if (!helpers_cancelled && llm_mapreduce_stopped_locked(state)) {
+                g_mutex_unlock(&state->lock);
+                llm_mapreduce_cancel_helpers(plugin, helpers);
+                helpers_cancelled = TRUE;
+                g_mutex_lock(&state->lock);
+                continue;
+            }
+            g_cond_wait_until(&state->cond, &state->lock,
+                g_get_monotonic_time() + LLM_MAPREDUCE_POLL_USEC);
+        }
+        gboolean again = !g_queue_is_empty(&state->pending) && !llm_mapreduce_stopped_locked(state);
+        if (!again) {
+            // Helpers starting late find nothing to do
+            state->closed = TRUE;
+        }
+        g_mutex_unlock(&state->lock);
+        if (!again) {
+            break;
+        }
+    }
+    llm_mapreduce_cancel_helpers(plugin, helpers);
+    g_array_free(helpers, TRUE);
+
+    GPtrArray *result = NULL;
+    if (state->error) {
+        if (callbacks && callbacks->on_error) {
+            callbacks->on_error(state->error, callbacks->user_data);
+        }
+    } else if (!LLM_CANCELLED(cancel_flag)) {
+        // Reduce: the question is answered from the summaries
+        if (callbacks && callbacks->on_status) {
+            callbacks->on_status("Generating from summaries...", callbacks->user_data);
+        }
+        result = g_ptr_array_new_with_free_func(llm_document_free);
+        for (guint i = 0; i < documents->len; i++) {
+            LLMDocument *document = g_ptr_array_index(documents, i);
+            GPtrArray *chunks = g_hash_table_lookup(summarized, document);
+            if (!chunks) {
+                g_ptr_array_add(result, llm_document_new(document->name, g_strdup(document->text)));
+                continue;
+            }
+            GString *text = g_string_new(NULL);
+            g_string_append_printf(text, "[Too large for the context window, summarized in %u parts]\n", chunks->len);
+            for (guint j = 0; j < chunks->len; j++) {
+                MapChunk *chunk = g_ptr_array_index(chunks, j);
+                g_string_append_printf(text, "\nPart %u:\n%s\n", j + 1, chunk->summary);
+            }
+            g_ptr_array_add(result, llm_document_new(document->name, g_string_free(text, FALSE)));
+        }
+    }
+
+    g_hash_table_iter_init(&iter, summarized);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        g_ptr_array_free((GPtrArray *)value, TRUE);
+    }
+    g_hash_table_destroy(summarized);
+    map_state_unref(state);
+
+    return result;
+}
@@ -0,0 +1,44 @@
+#ifndef __LLM_MAPREDUCE_H__
+#define __LLM_MAPREDUCE_H__
+
+#include "plugin.h"
+
+/**
+ * Map-reduce for documents larger than the context window.
+ *
+ * Oversized documents are split at function or paragraph boundaries and
+ * every chunk is summarized on its own, several at a time: by the job of
+ * the request and by helper jobs in the batch class of the scheduler,
+ * which start as it has slots free. The question is
+ * then answered from the summaries (the reduce step). Summaries do not
+ * depend on the question, so they are cached by content hash and later
+ * questions about the same file reuse them.
+ */
+
+/// @brief Tokens generated per chunk summary
+#define LLM_MAPREDUCE_SUMMARY_TOKENS 256
+
+/// @brief Smallest chunk worth a request, in bytes
+#define LLM_MAPREDUCE_MIN_CHUNK_BYTES 2048
+
+/// @brief Bytes reserved for the instructions around a chunk
+#define LLM_MAPREDUCE_PROMPT_OVERHEAD 512
+
+/// @brief A request waiting for its helpers checks for a cancel this often
+#define LLM_MAPREDUCE_POLL_USEC (100 * 1000)
+
+/// @brief Bump when the summary prompt changes to invalidate the cache
+#define LLM_MAPREDUCE_CACHE_VERSION "1"
+
+/// @brief Directory below the plugin's config directory holding chunk summaries
+#define LLM_MAPREDUCE_CACHE_DIR "chunks"
+
+/// @brief Make the documents fit the context window by summarizing the largest ones.
+/// Runs on the job's worker thread and blocks until the summaries are done.
+/// @return the documents to answer from: a new reference to documents when they
+/// fit already, otherwise a new array. NULL when cancelled or failed, errors
+/// are reported through callbacks.
+GPtrArray *llm_mapreduce_documents(LLMPlugin *plugin, LLMTask task, GPtrArray *documents,
+    const gchar *question, const LLMArgs *args, LLMCallbacks *callbacks, gboolean *cancel_flag);
+
+#endif // __LLM_MAPREDUCE_H__
@@ -0,0 +1,488 @@
+/**
+ * llm-mock-server: a scriptable stand-in for llama-server, used together
+ * with llm-bench to measure the client without a model in the loop.
+ *
+ *     llm-mock-server --port 8089 --prefill-ms 200 --token-rate 50 --chunk-bytes 7
+ *     llm-bench --url http://127.0.0.1:8089 --prompt hi --max-cpu-per-chunk 200
+ *
+ * It speaks /v1/completions, /v1/chat/completions, /completion and /infill
+ * (streamed as Server-Sent Events or as one JSON answer), and answers
+ * /props, /slots, /health and /v1/models. Answers are made of a fixed
+ * vocabulary that includes multi-byte UTF-8, so fragmented writes split
+ * characters too. Prefill delay, token rate, fragmentation, bursts, failures
+ * and disconnects are set on the command line.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <gio/gio.h>
+#include <json-c/json.h>
+
+#define LLM_MOCK_DEFAULT_PORT 8089
+#define LLM_MOCK_MAX_BODY (16 * 1024 * 1024)
+#define LLM_MOCK_MAX_HEADER_LINES 100
+#define LLM_MOCK_MODEL "mock"
+
+/// @brief Kinds of generation endpoints, they differ in their event format
+typedef enum {
+    MOCK_API_COMPLETIONS,       // OpenAI /v1/completions: choices[].text
+    MOCK_API_CHAT,              // OpenAI /v1/chat/completions: choices[].delta.content
+    MOCK_API_LLAMA              // llama.cpp /completion and /infill: content, stop
+} MockApi;
+
+/// @brief Generation request as understood by the mock
+typedef struct {
+    MockApi api;
+    gboolean stream;
+    gint tokens;
+    gint n_choices;
+    gsize prompt_bytes;
+} MockRequest;
+
+static const gchar *mock_vocabulary[] = {
+    " the", " quick", " brown", " fox", "(", "x", ")", " {", "\n", "    return",
+    " caf\xc3\xa9", " \xe2\x86\x92", " \xe6\x97\xa5\xe6\x9c\xac", " \"quoted\"", "\t", " \xf0\x9f\x98\x80",
+    " jumps", " over", ";", "\n}"
+};
+
+static gint opt_port = LLM_MOCK_DEFAULT_PORT;
+static gint opt_tokens = 64;
+static gdouble opt_token_rate = 0;
+static gint opt_prefill_ms = 0;
+static gint opt_chunk_bytes = 0;
+static gint opt_chunk_gap_us = 200;
+static gint opt_burst = 1;
+static gint opt_fail_every = 0;
+static gint opt_disconnect_after = -1;
+static gint opt_slots = 4;
+static gint opt_n_ctx = 8192;
+static gint opt_requests = 0;
+static gboolean opt_verbose = FALSE;
+
+static GOptionEntry mock_options[] = {
+    { "port", 'p', 0, G_OPTION_ARG_INT, &opt_port, "Port on 127.0.0.1, 0 for any free one (default 8089)", "PORT" },
+    { "tokens", 'n', 0, G_OPTION_ARG_INT, &opt_tokens, "Tokens per answer unless the request asks for fewer (default 64)", "N" },
+    { "token-rate", 'r', 0, G_OPTION_ARG_DOUBLE, &opt_token_rate, "Tokens per second, 0 for as fast as possible", "RATE" },
+    { "prefill-ms", 0, 0, G_OPTION_ARG_INT, &opt_prefill_ms, "Delay before the first token", "MS" },
+    { "chunk-bytes", 0, 0, G_OPTION_ARG_INT, &opt_chunk_bytes, "Split every write into pieces of this size", "N" },
+    { "chunk-gap-us", 0, 0, G_OPTION_ARG_INT, &opt_chunk_gap_us, "Pause between the pieces of a split write (default 200)", "US" },
+    { "burst", 0, 0, G_OPTION_ARG_INT, &opt_burst, "Tokens sent together in one write (default 1)", "N" },
+    { "fail-every", 0, 0, G_OPTION_ARG_INT, &opt_fail_every, "Answer every Nth generation request with HTTP 500", "N" },
+    { "disconnect-after", 0, 0, G_OPTION_ARG_INT, &opt_disconnect_after, "Drop the connection after N tokens", "N" },
+    { "slots", 0, 0, G_OPTION_ARG_INT, &opt_slots, "Slots reported by /props and /slots (default 4)", "N" },
+    { "n-ctx", 0, 0, G_OPTION_ARG_INT, &opt_n_ctx, "Context size reported by /props (default 8192)", "N" },
+    { "requests", 0, 0, G_OPTION_ARG_INT, &opt_requests, "Exit after this many requests", "N" },
+    { "verbose", 'v', 0, G_OPTION_ARG_NONE, &opt_verbose, "Log every request", NULL },
+    { NULL }
+};
+
+static GMainLoop *mock_loop = NULL;
+static gint mock_request_count = 0;
+static gint mock_generation_count = 0;
+
+/// @brief Write data, split into opt_chunk_bytes pieces
+/// @return FALSE if the client went away
+static gboolean mock_send(GOutputStream *out, const gchar *data, gsize len)
+{
+    gsize piece = opt_chunk_bytes > 0 ? (gsize)opt_chunk_bytes : len;
+
+    for (gsize offset = 0; offset < len; offset += piece) {
+        gsize n = MIN(piece, len - offset);
+        if (!g_output_stream_write_all(out, data + offset, n, NULL, NULL, NULL)) {
+            return FALSE;
+        }
+        if (n < len - offset && opt_chunk_gap_us > 0) {
+            g_usleep(opt_chunk_gap_us);
+        }
+    }
+    return TRUE;
+}
+
+static gboolean mock_send_response(GOutputStream *out, gint status, const gchar *reason,
+    const gchar *content_type, const gchar *body)
+{
+    gchar *response = g_strdup_printf("HTTP/1.1 %d %s\r\nContent-Type: %s\r\n"
+        "Content-Length: %" G_GSIZE_FORMAT "\r\nConnection: close\r\n\r\n%s",
+        status, reason, content_type, strlen(body), body);
+    gboolean ok = mock_send(out, response, strlen(response));
+    g_free(response);
+    return ok;
+}
+
+static gboolean mock_send_json(GOutputStream *out, gint status, const gchar *reason, struct json_object *root)
+{
+    gboolean ok = mock_send_response(out, status, reason, "application/json",
+        json_object_to_json_string_ext(root, JSON_C_TO_STRING_PLAIN));
+    json_object_put(root);
+    return ok;
+}
+
+static struct json_object *mock_error_json(gint code, const gchar *message)
+{
+    struct json_object *root = json_object_new_object();
+    struct json_object *error = json_object_new_object();
+    json_object_object_add(error, "code", json_object_new_int(code));
+    json_object_object_add(error, "message", json_object_new_string(message));
+    json_object_object_add(root, "error", error);
+    return root;
+}
+
+static struct json_object *mock_props_json(void)
+{
+    struct json_object *root = json_object_new_object();
+    struct json_object *settings = json_object_new_object();
+    json_object_object_add(settings, "n_ctx", json_object_new_int(opt_n_ctx));
+    json_object_object_add(settings, "model", json_object_new_string(LLM_MOCK_MODEL));
+    json_object_object_add(root, "default_generation_settings", settings);
+    json_object_object_add(root, "total_slots", json_object_new_int(opt_slots));
+    json_object_object_add(root, "model_path", json_object_new_string(LLM_MOCK_MODEL ".gguf"));
+    return root;
+}
+
+static struct json_object *mock_slots_json(void)
+{
+    struct json_object *slots = json_object_new_array();
+    for (gint i = 0; i < opt_slots; i++) {
+        struct json_object *slot = json_object_new_object();
+        json_object_object_add(slot, "id", json_object_new_int(i));
+        json_object_object_add(slot, "n_ctx", json_object_new_int(opt_n_ctx / MAX(opt_slots, 1)));
+        json_object_object_add(slot, "is_processing", json_object_new_boolean(FALSE));
+        json_object_array_add(slots, slot);
+    }
+    return slots;
+}
+
+static struct json_object *mock_models_json(void)
+{
+    struct json_object *root = json_object_new_object();
+    struct json_object *data = json_object_new_array();
+    struct json_object *model = json_object_new_object();
+    json_object_object_add(model, "id", json_object_new_string(LLM_MOCK_MODEL));
+    json_object_object_add(model, "object", json_object_new_string("model"));
+    json_object_array_add(data, model);
+    json_object_object_add(root, "object", json_object_new_string("list"));
+    json_object_object_add(root, "data", data);
+    return root;
+}
+
+/// @brief Read what the mock cares about from the request body
+static void mock_parse_request(MockRequest *request, const gchar *body, gsize len)
+{
+    request->stream = FALSE;
+    request->tokens = opt_tokens;
+    request->n_choices = 1;
+    request->prompt_bytes = len;
+
+    struct json_object *root = json_tokener_parse(body);
+    if (!root) {
+        return;
+    }
+
+    struct json_object *value = NULL;
+    if (json_object_object_get_ex(root, "stream", &value)) {
+        request->stream = json_object_get_boolean(value);
+    }
+    if ((json_object_object_get_ex(root, "max_tokens", &value) ||
+         json_object_object_get_ex(root, "n_predict", &value)) &&
+        json_object_get_int(value) > 0) {
+        request->tokens = MIN(request->tokens, json_object_get_int(value));
+    }
+    if (json_object_object_get_ex(root, "n", &value) && json_object_get_int(value) > 1) {
+        request->n_choices = json_object_get_int(value);
+    }
+    json_object_put(root);
+}
+
+/// @brief One streamed event, or the final one when finish_reason is set
+static struct json_object *mock_event_json(const MockRequest *request, gint choice,
+    const gchar *text, const gchar *finish_reason)
+{
+    struct json_object *root = json_object_new_object();
+
+    if (request->api == MOCK_API_LLAMA) {
+        json_object_object_add(root, "content", json_object_new_string(text));
+        json_object_object_add(root, "index", json_object_new_int(choice));
+        json_object_object_add(root, "stop", json_object_new_boolean(finish_reason != NULL));
+        return root;
+    }
+
+    struct json_object *choices = json_object_new_array();
+    struct json_object *item = json_object_new_object();
+    if (request->api == MOCK_API_CHAT) {
+        struct json_object *delta = json_object_new_object();
+        if (!finish_reason || *text) {
+            json_object_object_add(delta, "content", json_object_new_string(text));
+        }
+        json_object_object_add(item, request->stream ? "delta" : "message", delta);
+    } else {
+        json_object_object_add(item, "text", json_object_new_string(text));
+        json_object_object_add(item, "logprobs", NULL);
+    }
+    json_object_object_add(item, "index", json_object_new_int(choice));
+    json_object_object_add(item, "finish_reason", finish_reason ? json_object_new_string(finish_reason) : NULL);
+    json_object_array_add(choices, item);
+
+    json_object_object_add(root, "choices", choices);
+    json_object_object_add(root, "model", json_object_new_string(LLM_MOCK_MODEL));
+    json_object_object_add(root, "object", json_object_new_string(
+        request->api == MOCK_API_CHAT ? (request->stream ? "chat.completion.chunk" : "chat.completion")
+                                      : "text_completion"));
+    return root;
+}
+
+/// @brief llama.cpp style timings for the final event
+static void mock_add_timings(struct json_object *root, const MockRequest *request, gint generated,
+    gint64 decode_start)
+{
+    gdouble predicted_ms = (g_get_monotonic_time() - decode_start) / 1000.0;
+    struct json_object *timings = json_object_new_object();
+    json_object_object_add(timings, "prompt_n", json_object_new_int(MAX(request->prompt_bytes / 4, 1)));
+    json_object_object_add(timings, "prompt_ms", json_object_new_double(opt_prefill_ms));
+    json_object_object_add(timings, "predicted_n", json_object_new_int(generated));
+    json_object_object_add(timings, "predicted_ms", json_object_new_double(predicted_ms));
+    json_object_object_add(timings, "predicted_per_second",
+        json_object_new_double(predicted_ms > 0 ? generated * 1000.0 / predicted_ms : 0));
+    json_object_object_add(root, "timings", timings);
+}
+
+static void mock_append_event(GString *out, struct json_object *event)
+{
+    g_string_append(out, "data: ");
+    g_string_append(out, json_object_to_json_string_ext(event, JSON_C_TO_STRING_PLAIN));
+    g_string_append(out, "\n\n");
+    json_object_put(event);
+}
+
+/// @brief Pace the answer to opt_token_rate
+static void mock_wait_for_token(gint64 decode_start, gint token)
+{
+    if (opt_token_rate <= 0) {
+        return;
+    }
+    gint64 due = decode_start + (gint64)(token * G_USEC_PER_SEC / opt_token_rate);
+    gint64 now = g_get_monotonic_time();
+    if (due > now) {
+        g_usleep(due - now);
+    }
+}
+
+static gboolean mock_generate(GOutputStream *out, const MockRequest *request)
+{
+    gint number = g_atomic_int_add(&mock_generation_count, 1) + 1;
+    if (opt_fail_every > 0 && number % opt_fail_every == 0) {
+        return mock_send_json(out, 500, "Internal Server Error", mock_error_json(500, "Mock failure"));
+    }
+
+    if (!request->stream) {
+        g_usleep((gulong)opt_prefill_ms * 1000);
+        gint64 decode_start = g_get_monotonic_time();
+        GString *text = g_string_new(NULL);
+        for (gint i = 0; i < request->tokens; i++) {
+            mock_wait_for_token(decode_start, i);
+            g_string_append(text, mock_vocabulary[i % G_N_ELEMENTS(mock_vocabulary)]);
+        }
+        struct json_object *root = mock_event_json(request, 0, text->str, "length");
+        mock_add_timings(root, request, request->tokens, decode_start);
+        g_string_free(text, TRUE);
+        return mock_send_json(out, 200, "OK", root);
+    }
+
+    const gchar *headers = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\nConnection: close\r\n\r\n";
+    if (!mock_send(out, headers, strlen(headers))) {
+        return FALSE;
+    }
+
+    g_usleep((gulong)opt_prefill_ms * 1000);
+    gint64 decode_start = g_get_monotonic_time();
+    GString *pending = g_string_new(NULL);
+    gboolean ok = TRUE;
+
+    for (gint i = 0; i < request->tokens && ok; i++) {
+        if (i == opt_disconnect_after) {
+            // Whatever was not flushed is lost, like on a dropped connection
+            g_string_free(pending, TRUE);
+            return FALSE;
+        }
+        mock_wait_for_token(decode_start, i);
+        const gchar *text = mock_vocabulary[i % G_N_ELEMENTS(mock_vocabulary)];
+        for (gint choice = 0; choice < request->n_choices; choice++) {
+            mock_append_event(pending, mock_event_json(request, choice, text, NULL));
+        }
+        if ((i + 1) % MAX(opt_burst, 1) == 0) {
+            ok = mock_send(out, pending->str, pending->len);
+            g_string_truncate(pending, 0);
+        }
+    }
+
+    if (ok) {
+        struct json_object *last = mock_event_json(request, 0, "", request->tokens < opt_tokens ? "length" : "stop");
+        mock_add_timings(last, request, request->tokens, decode_start);
+        mock_append_event(pending, last);
+        if (request->api != MOCK_API_LLAMA) {
+            g_string_append(pending, "data: [DONE]\n\n");
+        }
+        ok = mock_send(out, pending->str, pending->len);
+    }
+    g_string_free(pending, TRUE);
+    return ok;
+}
+
+/// @brief Read the request line, the headers and the body
+static gboolean mock_read_request(GDataInputStream *in, gchar **method, gchar **path, gchar **body, gsize *body_len)
+{
+    gchar *line = g_data_input_stream_read_line(in, NULL, NULL, NULL);
+    if (!line) {
+        return FALSE;
+    }
+    gchar **parts = g_strsplit(line, " ", 3);
+    g_free(line);
+    if (g_strv_length(parts) < 2) {
+        g_strfreev(parts);
+        return FALSE;
+    }
+    *method = g_strdup(parts[0]);
+    // The query string is of no interest
+    *path = g_strndup(parts[1], strcspn(parts[1], "?"));
+    g_strfreev(parts);
+
+    gsize content_length = 0;
+    for (gint i = 0; i < LLM_MOCK_MAX_HEADER_LINES; i++) {
+        line = g_data_input_stream_read_line(in, NULL, NULL, NULL);
+        if (!line || *line == '\0') {
+            g_free(line);
+            break;
+        }
+        if (g_ascii_strncasecmp(line, "Content-Length:", 15) == 0) {
+            content_length = g_ascii_strtoull(line + 15, NULL, 10);
+        }
+        g_free(line);
+    }
+
+    if (content_length > LLM_MOCK_MAX_BODY) {
+        return FALSE;
+    }
+    *body = g_malloc0(content_length + 1);
+    *body_len = content_length;
+    return content_length == 0 ||
+        g_input_stream_read_all(G_INPUT_STREAM(in), *body, content_length, NULL, NULL, NULL);
+}
+
+static gboolean mock_quit_idle(gpointer user_data)
+{
+    g_main_loop_quit(mock_loop);
+    return G_SOURCE_REMOVE;
+}
+
+/// @brief Serve one connection, on a thread of the socket service
+static gboolean on_mock_connection(GThreadedSocketService *service, GSocketConnection *connection,
+    GObject *source_object, gpointer user_data)
+{
+    GSocket *socket = g_socket_connection_get_socket(connection);
+    g_socket_set_option(socket, IPPROTO_TCP, TCP_NODELAY, 1, NULL);
+
+    GDataInputStream *in = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+    g_data_input_stream_set_newline_type(in, G_DATA_STREAM_NEWLINE_TYPE_CR_LF);
+    g_filter_input_stream_set_close_base_stream(G_FILTER_INPUT_STREAM(in), FALSE);
+    GOutputStream *out = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+
+    gchar *method = NULL, *path = NULL, *body = NULL;
+    gsize body_len = 0;
+    if (!mock_read_request(in, &method, &path, &body, &body_len)) {
+        mock_send_json(out, 400, "Bad Request", mock_error_json(400, "Malformed request"));
+        goto EXIT;
+    }
+
+    gint number = g_atomic_int_add(&mock_request_count, 1) + 1;
+    if (opt_verbose) {
+        g_print("#%d %s %s (%" G_GSIZE_FORMAT " bytes)\n", number, method, path, body_len);
+    }
+
+    MockRequest request = {0};
+    gboolean generate = g_strcmp0(method, "POST") == 0;
+    if (generate && g_strcmp0(path, "/v1/completions") == 0) {
+        request.api = MOCK_API_COMPLETIONS;
+    } else if (generate && g_strcmp0(path, "/v1/chat/completions") == 0) {
+        request.api = MOCK_API_CHAT;
+    } else if (generate && (g_strcmp0(path, "/completion") == 0 || g_strcmp0(path, "/infill") == 0)) {
+        request.api = MOCK_API_LLAMA;
+    } else {
+        generate = FALSE;
+    }
+
+    if (generate) {
+        mock_parse_request(&request, body, body_len);
+        mock_generate(out, &request);
+    } else if (g_strcmp0(path, "/props") == 0) {
+        mock_send_json(out, 200, "OK", mock_props_json());
+    } else if (g_strcmp0(path, "/slots") == 0) {
+        mock_send_json(out, 200, "OK", mock_slots_json());
+    } else if (g_strcmp0(path, "/v1/models") == 0) {
+        mock_send_json(out, 200, "OK", mock_models_json());
+    } else if (g_strcmp0(path, "/health") == 0) {
+        mock_send_response(out, 200, "OK", "application/json", "{\"status\":\"ok\"}");
+    } else {
+        mock_send_json(out, 404, "Not Found", mock_error_json(404, "Unknown endpoint"));
+    }
+
+    if (opt_requests > 0 && number >= opt_requests) {
+        g_idle_add(mock_quit_idle, NULL);
+    }
+
+EXIT:
+    g_io_stream_close(G_IO_STREAM(connection), NULL, NULL);
+    g_object_unref(in);
+    g_free(method);
+    g_free(path);
+    g_free(body);
+    return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+    GError *error = NULL;
+    GOptionContext *context = g_option_context_new("- scriptable stand-in for llama-server");
+    g_option_context_add_main_entries(context, mock_options, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 2;
+    }
+    g_option_context_free(context);
+
+    // Every connection gets its own thread, like a server slot
+    GSocketService *service = g_threaded_socket_service_new(MAX(opt_slots, 1) * 2);
+    GInetAddress *loopback = g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4);
+    GSocketAddress *address = g_inet_socket_address_new(loopback, opt_port);
+    GSocketAddress *bound = NULL;
+    g_object_unref(loopback);
+
+    if (!g_socket_listener_add_address(G_SOCKET_LISTENER(service), address, G_SOCKET_TYPE_STREAM,
+            G_SOCKET_PROTOCOL_TCP, NULL, &bound, &error)) {
+        g_printerr("Cannot listen on port %d: %s\n", opt_port, error->message);
+        g_error_free(error);
+        g_object_unref(address);
+        g_object_unref(service);
+        return 1;
+    }
+    g_object_unref(address);
+
+    g_signal_connect(service, "run", G_CALLBACK(on_mock_connection), NULL);
+    g_print("llm-mock-server listening on http://127.0.0.1:%u\n",
+        g_inet_socket_address_get_port(G_INET_SOCKET_ADDRESS(bound)));
+    fflush(stdout);
+    g_object_unref(bound);
+
+    mock_loop = g_main_loop_new(NULL, FALSE);
+    g_socket_service_start(service);
+    g_main_loop_run(mock_loop);
+
+    g_socket_service_stop(service);
+    g_socket_listener_close(G_SOCKET_LISTENER(service));
+    g_object_unref(service);
+    g_main_loop_unref(mock_loop);
+    g_print("Served %d requests\n", g_atomic_int_get(&mock_request_count));
+    return 0;
+}
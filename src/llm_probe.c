@@ -0,0 +1,157 @@
+#include "llm_probe.h"
+#include "llm_endpoints.h"
+#include "llm_scheduler.h"
+#include "llm_trace.h"
+#include "settings.h"
+
+/// @brief Data of a probe job
+typedef struct {
+    LLMPlugin *plugin;
+    GPtrArray *urls;    // Claimed with llm_caps_cache_begin_probe()
+} LLMProbe;
+
+static void llm_probe_free(gpointer data)
+{
+    LLMProbe *probe = (LLMProbe *)data;
+
+    // Also the claims of servers a cancelled job did not get to
+    for (guint i = 0; i < probe->urls->len; i++) {
+        llm_caps_cache_end_probe(probe->plugin->caps, g_ptr_array_index(probe->urls, i));
+    }
+    g_ptr_array_free(probe->urls, TRUE);
+    g_free(probe);
+}
+
+static void llm_probe_thread_func(LLMJob *job, gpointer data)
+{
+    LLMProbe *probe = (LLMProbe *)data;
+    LLMPlugin *plugin = probe->plugin;
+    gint64 trace_start = llm_trace_begin();
+
+    for (guint i = 0; i < probe->urls->len && !g_atomic_int_get(&job->cancel_flag); i++) {
+        const gchar *url = g_ptr_array_index(probe->urls, i);
+        LLMServerCaps *caps = llm_caps_probe(url, plugin->proxy_url, plugin->api_key, &job->cancel_flag);
+        if (!caps) {
+            break;
+        }
+
+        g_print("Probed %s: %s, model %s, context %u, slots %u\n", url,
+            caps->reachable ? (caps->healthy ? "ready" : "not ready") : "unreachable",
+            caps->model ? caps->model : "unknown", caps->context_size, caps->slots);
+        llm_caps_cache_store(plugin->caps, caps);
+        llm_server_caps_unref(caps);
+    }
+
+    llm_trace_end("probe_job", "worker", trace_start);
+}
+
+/// @brief Queue a probe of the servers not being probed already
+static void llm_probe_submit(LLMPlugin *plugin, GPtrArray *urls)
+{
+    LLMProbe *probe = g_new0(LLMProbe, 1);
+    probe->plugin = plugin;
+    probe->urls = g_ptr_array_new_with_free_func(g_free);
+
+    for (guint i = 0; i < urls->len; i++) {
+        const gchar *url = g_ptr_array_index(urls, i);
+        if (llm_caps_cache_begin_probe(plugin->caps, url)) {
+            g_ptr_array_add(probe->urls, g_strdup(url));
+        }
+    }
+
+    if (probe->urls->len == 0 || !plugin->scheduler) {
+        llm_probe_free(probe);
+        return;
+    }
+    llm_scheduler_submit(plugin->scheduler, LLM_PRIORITY_BACKGROUND,
+        llm_probe_thread_func, probe, llm_probe_free);
+}
+
+/// @brief Add the URLs of a set not in urls yet
+static void llm_probe_collect_urls(GPtrArray *urls, LLMEndpointSet *set)
+{
+    gchar **set_urls = llm_endpoints_dup_urls(set);
+    for (gint i = 0; set_urls[i] != NULL; i++) {
+        if (!g_ptr_array_find_with_equal_func(urls, set_urls[i], g_str_equal, NULL)) {
+            g_ptr_array_add(urls, g_strdup(set_urls[i]));
+        }
+    }
+    g_strfreev(set_urls);
+}
+
+void llm_probe_init(LLMPlugin *plugin)
+{
+    gchar *dir = llm_plugin_data_dir(plugin, LLM_CACHE_DIR);
+    gchar *path = dir ? g_build_filename(dir, LLM_PROBE_CACHE_FILE, NULL) : NULL;
+    plugin->caps = llm_caps_cache_new(path);
+    g_free(path);
+    g_free(dir);
+}
+
+void llm_probe_cleanup(LLMPlugin *plugin)
+{
+    llm_caps_cache_free(plugin->caps);
+    plugin->caps = NULL;
+}
+
+void llm_probe_refresh(LLMPlugin *plugin, gboolean force)
+{
+    if (!plugin || !plugin->caps) {
+        return;
+    }
+
+    GPtrArray *urls = g_ptr_array_new_with_free_func(g_free);
+    llm_probe_collect_urls(urls, plugin->endpoints);
+    for (gint task = 0; task < LLM_TASK_COUNT; task++) {
+        llm_probe_collect_urls(urls, plugin->profiles[task].endpoints);
+    }
+
+    if (!force) {
+        for (guint i = urls->len; i > 0; i--) {
+            LLMServerCaps *caps = llm_caps_cache_lookup(plugin->caps, g_ptr_array_index(urls, i - 1));
+            if (caps && !llm_server_caps_stale(caps)) {
+                g_ptr_array_remove_index(urls, i - 1);
+            }
+            llm_server_caps_unref(caps);
+        }
+    }
+
+    if (urls->len > 0) {
+        llm_probe_submit(plugin, urls);
+    }
+    g_ptr_array_free(urls, TRUE);
+}
+
+LLMServerCaps *llm_probe_lookup(LLMPlugin *plugin, const gchar *url)
+{
+    if (!plugin || !plugin->caps || !url) {
+        return NULL;
+    }
+
+    LLMServerCaps *caps = llm_caps_cache_lookup(plugin->caps, url);
+    if (!caps || llm_server_caps_stale(caps)) {
+        // The old answer is better than none while the new one is on its way
+        GPtrArray *urls = g_ptr_array_new();
+        g_ptr_array_add(urls, (gpointer)url);
+        llm_probe_submit(plugin, urls);
+        g_ptr_array_free(urls, TRUE);
+    }
+    return caps;
+}
+
+guint llm_probe_context_size(LLMPlugin *plugin, LLMEndpointSet *set)
+{
+    guint context_size = 0;
+
+    // Any of them may get the request
+    gchar **urls = llm_endpoints_dup_urls(set);
+    for (gint i = 0; urls[i] != NULL; i++) {
+        LLMServerCaps *caps = llm_probe_lookup(plugin, urls[i]);
+        if (caps && caps->context_size > 0) {
+            context_size = context_size == 0 ? caps->context_size : MIN(context_size, caps->context_size);
+        }
+        llm_server_caps_unref(caps);
+    }
+    g_strfreev(urls);
+    return context_size;
+}
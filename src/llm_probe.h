@@ -0,0 +1,36 @@
+#ifndef __LLM_PROBE_H__
+#define __LLM_PROBE_H__
+
+#include "plugin.h"
+#include "llm_caps.h"
+
+/**
+ * Capability probes of the configured servers, run as background jobs.
+ * The results land in the plugin's LLMCapsCache, written to
+ * LLM_PROBE_CACHE_FILE in the plugin's cache directory. Lookups answer from
+ * the cache right away and queue a probe when the entry is missing or stale.
+ */
+
+/// @brief Directory below the plugin's config directory for data worth keeping between sessions
+#define LLM_CACHE_DIR "cache"
+#define LLM_PROBE_CACHE_FILE "servers.conf"
+
+/// @brief Open the capability cache of the plugin (main thread)
+void llm_probe_init(LLMPlugin *plugin);
+
+/// @brief Free the capability cache, after the scheduler is gone (main thread)
+void llm_probe_cleanup(LLMPlugin *plugin);
+
+/// @brief Probe the configured servers in the background
+/// @param force probe all of them, otherwise only the new and the stale ones
+void llm_probe_refresh(LLMPlugin *plugin, gboolean force);
+
+/// @brief Capabilities of a server, queueing a probe if they are missing or stale (any thread)
+/// @return a new reference, release with llm_server_caps_unref(); NULL until probed
+LLMServerCaps *llm_probe_lookup(LLMPlugin *plugin, const gchar *url);
+
+/// @brief Smallest context size reported by the servers of a set (any thread)
+/// @return tokens, 0 if none reported one
+guint llm_probe_context_size(LLMPlugin *plugin, LLMEndpointSet *set);
+
+#endif // __LLM_PROBE_H__
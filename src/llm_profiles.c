@@ -0,0 +1,113 @@
+#include "llm_profiles.h"
+#include "llm_endpoints.h"
+#include "llm_probe.h"
+
+static const gchar *llm_task_names[LLM_TASK_COUNT] = {
+    "chat",
+    "completion",
+    "background"
+};
+
+const gchar *llm_task_name(LLMTask task)
+{
+    g_return_val_if_fail(task < LLM_TASK_COUNT, "unknown");
+    return llm_task_names[task];
+}
+
+LLMPriority llm_task_priority(LLMTask task)
+{
+    switch (task) {
+        case LLM_TASK_CHAT:
+            return LLM_PRIORITY_INTERACTIVE;
+        case LLM_TASK_COMPLETION:
+            return LLM_PRIORITY_COMPLETION;
+        default:
+            return LLM_PRIORITY_BACKGROUND;
+    }
+}
+
+gboolean llm_task_in_use(LLMTask task)
+{
+    return task != LLM_TASK_COMPLETION;
+}
+
+void llm_profiles_init(LLMPlugin *plugin)
+{
+    for (gint task = 0; task < LLM_TASK_COUNT; task++) {
+        LLMTaskProfile *profile = &plugin->profiles[task];
+        profile->model = g_strdup("");
+        profile->server_urls = g_strdup("");
+        profile->temperature = -1.0;
+        profile->max_tokens = 0;
+        profile->context_size = 0;
+        profile->endpoints = llm_endpoints_new();
+    }
+}
+
+void llm_profiles_free(LLMPlugin *plugin)
+{
+    for (gint task = 0; task < LLM_TASK_COUNT; task++) {
+        LLMTaskProfile *profile = &plugin->profiles[task];
+        g_free(profile->model);
+        g_free(profile->server_urls);
+        llm_endpoints_free(profile->endpoints);
+        profile->model = NULL;
+        profile->server_urls = NULL;
+        profile->endpoints = NULL;
+    }
+}
+
+void llm_profiles_update_endpoints(LLMPlugin *plugin)
+{
+    for (gint task = 0; task < LLM_TASK_COUNT; task++) {
+        LLMTaskProfile *profile = &plugin->profiles[task];
+        // The set is updated in place, running jobs may still hold it
+        llm_endpoints_set_urls(profile->endpoints, NULL, profile->server_urls);
+    }
+}
+
+LLMArgs *llm_task_args_new(LLMPlugin *plugin, LLMTask task)
+{
+    const LLMArgs *general = plugin->llm_args;
+    const LLMTaskProfile *profile = &plugin->profiles[task];
+    LLMArgs *args = g_new0(LLMArgs, 1);
+
+    args->model = g_strdup(!IS_NULL_OR_EMPTY(profile->model) ? profile->model : general->model);
+    args->temperature = profile->temperature >= 0.0 ? profile->temperature : general->temperature;
+    args->max_tokens = profile->max_tokens > 0 ? profile->max_tokens : general->max_tokens;
+    args->context_size = profile->context_size > 0 ? profile->context_size : general->context_size;
+    if (args->context_size == 0) {
+        // Unless configured, what the servers reported
+        args->context_size = llm_probe_context_size(plugin, llm_task_endpoints(plugin, task));
+    }
+    // Alternatives are only ranked for chat answers
+    args->n_candidates = task == LLM_TASK_CHAT ? general->n_candidates : 1;
+    args->system_instruction = general->system_instruction;
+    // Someone waits for the chat answer, show how far the prompt is
+    args->return_progress = task == LLM_TASK_CHAT;
+    // The configured stop rules are about chat answers
+    if (task == LLM_TASK_CHAT) {
+        args->stop_rules = plugin->stop_rules;
+    }
+
+    return args;
+}
+
+void llm_args_free(LLMArgs *args)
+{
+    if (!args) {
+        return;
+    }
+    g_free(args->model);
+    g_free(args);
+}
+
+LLMEndpointSet *llm_task_endpoints(LLMPlugin *plugin, LLMTask task)
+{
+    LLMTaskProfile *profile = &plugin->profiles[task];
+
+    if (llm_endpoints_count(profile->endpoints) > 0) {
+        return profile->endpoints;
+    }
+    return plugin->endpoints;
+}
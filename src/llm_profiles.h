@@ -0,0 +1,42 @@
+#ifndef __LLM_PROFILES_H__
+#define __LLM_PROFILES_H__
+
+#include "plugin.h"
+#include "llm_scheduler.h"
+
+/**
+ * Task profiles: every request type (chat, completion, background) can use
+ * its own model, servers, sampling defaults and context size, e.g. a small
+ * model for completions and a large one for chat questions.
+ */
+
+/// @brief Name of the task, used for config groups and labels
+const gchar *llm_task_name(LLMTask task);
+
+/// @brief Scheduler priority class of a task
+LLMPriority llm_task_priority(LLMTask task);
+
+/// @brief FALSE for a task no request is sent for yet, its settings are
+/// neither shown nor saved. Inline completions have no client so far.
+gboolean llm_task_in_use(LLMTask task);
+
+/// @brief Initialise the profiles with "use the general settings" values
+void llm_profiles_init(LLMPlugin *plugin);
+
+/// @brief Free the profiles' strings and endpoint sets
+void llm_profiles_free(LLMPlugin *plugin);
+
+/// @brief Rebuild the endpoint sets after the server settings changed
+void llm_profiles_update_endpoints(LLMPlugin *plugin);
+
+/// @brief Snapshot of the arguments of a task: the general settings with the profile's overrides.
+/// Free with llm_args_free().
+LLMArgs *llm_task_args_new(LLMPlugin *plugin, LLMTask task);
+
+/// @brief Free an LLMArgs created by llm_task_args_new()
+void llm_args_free(LLMArgs *args);
+
+/// @brief Endpoints a task is routed to
+LLMEndpointSet *llm_task_endpoints(LLMPlugin *plugin, LLMTask task);
+
+#endif // __LLM_PROFILES_H__
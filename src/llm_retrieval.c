@@ -0,0 +1,689 @@
+#include <string.h>
+
+#include "llm_retrieval.h"
+#include "llm_json.h"
+#include "llm_probe.h"
+#include "llm_scheduler.h"
+#include "llm_trace.h"
+#include "llm_util.h"
+#include "settings.h"
+
+/// @brief Index of one directory tree, shared by the plugin and its jobs
+struct LLMRetrieval {
+    gint ref_count;
+    gint closed;            // Atomic, set once the plugin let go of it
+    gint scanned;           // Atomic, the first scan finished
+    LLMPlugin *plugin;
+    gchar *base_dir;
+    gchar *pattern_text;    // The setting the patterns came from
+    gchar **patterns;
+    gchar *index_path;      // NULL without a cache directory
+    LLMIndex *index;
+    gchar *embedding_model; // The setting semantic came from
+    LLMSemantic *semantic;  // NULL unless code is also found by meaning
+    LLMSummaries *summaries;    // NULL unless the files are summarized
+
+    // Main thread only, freed on close
+    GPtrArray *monitors;    // GFileMonitor*, one per directory
+    GHashTable *pending;    // Paths changed since the last update job
+    guint update_source;
+    guint summaries_source; // Checks whether the editor is idle
+};
+
+typedef struct LLMRetrieval LLMRetrieval;
+
+/// @brief Data of the jobs and idle callbacks of a retrieval
+typedef struct {
+    LLMRetrieval *retrieval;    // Reference held
+    GPtrArray *paths;           // Files to index again, or directories to watch
+} LLMRetrievalPaths;
+
+static LLMRetrieval *llm_retrieval_ref(LLMRetrieval *retrieval)
+{
+    g_atomic_int_inc(&retrieval->ref_count);
+    return retrieval;
+}
+
+static void llm_retrieval_unref(LLMRetrieval *retrieval)
+{
+    if (retrieval && g_atomic_int_dec_and_test(&retrieval->ref_count)) {
+        llm_semantic_unref(retrieval->semantic);
+        llm_summaries_unref(retrieval->summaries);
+        g_free(retrieval->embedding_model);
+        llm_index_free(retrieval->index);
+        g_free(retrieval->base_dir);
+        g_free(retrieval->pattern_text);
+        g_strfreev(retrieval->patterns);
+        g_free(retrieval->index_path);
+        g_free(retrieval);
+    }
+}
+
+static LLMRetrievalPaths *llm_retrieval_paths_new(LLMRetrieval *retrieval, GPtrArray *paths)
+{
+    LLMRetrievalPaths *work = g_new0(LLMRetrievalPaths, 1);
+    work->retrieval = llm_retrieval_ref(retrieval);
+    work->paths = paths;
+    return work;
+}
+
+static void llm_retrieval_paths_free(gpointer data)
+{
+    LLMRetrievalPaths *work = (LLMRetrievalPaths *)data;
+    llm_retrieval_unref(work->retrieval);
+    if (work->paths) {
+        g_ptr_array_free(work->paths, TRUE);
+    }
+    g_free(work);
+}
+
+static gboolean llm_retrieval_closed(LLMRetrieval *retrieval, LLMJob *job)
+{
+    return g_atomic_int_get(&job->cancel_flag) || g_atomic_int_get(&retrieval->closed);
+}
+
+/// @brief TRUE if a file name is not hidden and matches one of the patterns
+static gboolean llm_retrieval_match(LLMRetrieval *retrieval, const gchar *name)
+{
+    if (name[0] == '.') {
+        return FALSE;
+    }
+    for (gint i = 0; retrieval->patterns[i] != NULL; i++) {
+        if (*retrieval->patterns[i] && g_pattern_match_simple(retrieval->patterns[i], name)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/// @brief TRUE if path is dir or below it
+static gboolean llm_retrieval_below(const gchar *path, const gchar *dir)
+{
+    gsize length = strlen(dir);
+    return strncmp(path, dir, length) == 0 &&
+        (path[length] == '\0' || G_IS_DIR_SEPARATOR(path[length]) ||
+         (length > 0 && G_IS_DIR_SEPARATOR(dir[length - 1])));
+}
+
+static void llm_retrieval_save(LLMRetrieval *retrieval)
+{
+    if (!retrieval->index_path || !llm_index_dirty(retrieval->index)) {
+        return;
+    }
+
+    GError *error = NULL;
+    if (!llm_index_save(retrieval->index, retrieval->index_path, &error)) {
+        g_print("Error writing %s: %s\n", retrieval->index_path, error->message);
+        g_error_free(error);
+    }
+}
+
+/// @brief Index a file again, by meaning as well
+/// @return FALSE if the file is gone or not indexed
+static gboolean llm_retrieval_update_file(LLMRetrieval *retrieval, const gchar *path)
+{
+    gboolean indexed = llm_index_update_file(retrieval->index, path);
+    if (retrieval->semantic && indexed) {
+        llm_semantic_update_file(retrieval->semantic, path);
+    } else if (retrieval->semantic) {
+        llm_semantic_remove_file(retrieval->semantic, path);
+    }
+    if (retrieval->summaries && !indexed) {
+        llm_summaries_remove_file(retrieval->summaries, path);
+    }
+    return indexed;
+}
+
+/// @brief Collect the matching files and the directories below a directory,
+/// skipping hidden entries and symbolic links to directories
+static void llm_retrieval_walk(LLMRetrieval *retrieval, LLMJob *job, const gchar *dir_path, gint depth,
+    GPtrArray *files, GPtrArray *dirs)
+{
+    if (llm_retrieval_closed(retrieval, job)) {
+        return;
+    }
+    GDir *dir = g_dir_open(dir_path, 0, NULL);
+    if (!dir) {
+        return;
+    }
+    g_ptr_array_add(dirs, g_strdup(dir_path));
+
+    const gchar *name;
+    while ((name = g_dir_read_name(dir)) != NULL && files->len < LLM_RETRIEVAL_MAX_FILES) {
+        if (name[0] == '.') {
+            continue;
+        }
+        gchar *path = g_build_filename(dir_path, name, NULL);
+        if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+            if (depth < LLM_RETRIEVAL_MAX_DEPTH && !g_file_test(path, G_FILE_TEST_IS_SYMLINK)) {
+                llm_retrieval_walk(retrieval, job, path, depth + 1, files, dirs);
+            }
+        } else if (llm_retrieval_match(retrieval, name)) {
+            g_ptr_array_add(files, path);
+            path = NULL;
+        }
+        g_free(path);
+    }
+    g_dir_close(dir);
+}
+
+static void on_llm_retrieval_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+    GFileMonitorEvent event, gpointer user_data);
+
+static void llm_retrieval_monitor_free(gpointer data)
+{
+    GFileMonitor *monitor = G_FILE_MONITOR(data);
+    // No events after this
+    g_file_monitor_cancel(monitor);
+    g_object_unref(monitor);
+}
+
+/// @brief Watch the directories a scan went through (main thread)
+static gboolean llm_retrieval_watch_idle(gpointer user_data)
+{
+    LLMRetrievalPaths *work = (LLMRetrievalPaths *)user_data;
+    LLMRetrieval *retrieval = work->retrieval;
+
+    for (guint i = 0; !g_atomic_int_get(&retrieval->closed) && i < work->paths->len &&
+         retrieval->monitors->len < LLM_RETRIEVAL_MAX_MONITORS; i++) {
+        GFile *dir = g_file_new_for_path(g_ptr_array_index(work->paths, i));
+        GFileMonitor *monitor = g_file_monitor_directory(dir, G_FILE_MONITOR_WATCH_MOVES, NULL, NULL);
+        g_object_unref(dir);
+        if (monitor) {
+            g_signal_connect(monitor, "changed", G_CALLBACK(on_llm_retrieval_changed), retrieval);
+            g_ptr_array_add(retrieval->monitors, monitor);
+        }
+    }
+
+    llm_retrieval_paths_free(work);
+    return G_SOURCE_REMOVE;
+}
+
+/// @brief Scheduler job bringing the whole index up to date
+static void llm_retrieval_scan_thread_func(LLMJob *job, gpointer data)
+{
+    LLMRetrievalPaths *work = (LLMRetrievalPaths *)data;
+    LLMRetrieval *retrieval = work->retrieval;
+    GPtrArray *files = g_ptr_array_new_with_free_func(g_free);
+    GPtrArray *dirs = g_ptr_array_new_with_free_func(g_free);
+    gint64 start = g_get_monotonic_time();
+    gint64 trace_start = llm_trace_begin();
+
+    llm_retrieval_walk(retrieval, job, retrieval->base_dir, 0, files, dirs);
+
+    // Unchanged files cost a stat() each
+    guint indexed = 0;
+    for (guint i = 0; i < files->len && !llm_retrieval_closed(retrieval, job); i++) {
+        indexed += llm_retrieval_update_file(retrieval, g_ptr_array_index(files, i));
+    }
+
+    gboolean complete = !llm_retrieval_closed(retrieval, job);
+    if (complete) {
+        // Deleted since the last session, or no longer matching the patterns
+        GHashTable *found = g_hash_table_new(g_str_hash, g_str_equal);
+        for (guint i = 0; i < files->len; i++) {
+            g_hash_table_add(found, g_ptr_array_index(files, i));
+        }
+        GPtrArray *indexed_paths = llm_index_dup_paths(retrieval->index);
+        for (guint i = 0; i < indexed_paths->len; i++) {
+            if (!g_hash_table_contains(found, g_ptr_array_index(indexed_paths, i))) {
+                llm_index_remove_file(retrieval->index, g_ptr_array_index(indexed_paths, i));
+            }
+        }
+        g_ptr_array_unref(indexed_paths);
+        g_hash_table_destroy(found);
+        if (retrieval->semantic) {
+            llm_semantic_retain(retrieval->semantic, files);
+        }
+    }
+
+    // Also what a cancelled scan got through, the next one starts from there
+    llm_retrieval_save(retrieval);
+    if (retrieval->semantic) {
+        llm_semantic_embed(retrieval->semantic);
+    }
+    // Summarized once the editor is idle
+    llm_summaries_invalidate(retrieval->summaries);
+
+    if (complete) {
+        g_print("Indexed %u files below %s in %.1f s\n", indexed, retrieval->base_dir,
+            (g_get_monotonic_time() - start) / (gdouble)G_USEC_PER_SEC);
+        g_atomic_int_set(&retrieval->scanned, 1);
+        // Monitors report to the main context of the thread that created them
+        gdk_threads_add_idle(llm_retrieval_watch_idle, llm_retrieval_paths_new(retrieval, dirs));
+        dirs = NULL;
+    }
+
+    if (dirs) {
+        g_ptr_array_free(dirs, TRUE);
+    }
+    g_ptr_array_free(files, TRUE);
+    llm_trace_end("index_scan_job", "worker", trace_start);
+}
+
+/// @brief Scheduler job indexing changed files again
+static void llm_retrieval_update_thread_func(LLMJob *job, gpointer data)
+{
+    LLMRetrievalPaths *work = (LLMRetrievalPaths *)data;
+    LLMRetrieval *retrieval = work->retrieval;
+    gint64 trace_start = llm_trace_begin();
+
+    for (guint i = 0; i < work->paths->len && !llm_retrieval_closed(retrieval, job); i++) {
+        // Deleted files are dropped
+        llm_retrieval_update_file(retrieval, g_ptr_array_index(work->paths, i));
+    }
+    llm_retrieval_save(retrieval);
+    if (retrieval->semantic) {
+        llm_semantic_embed(retrieval->semantic);
+    }
+    // Summarized once the editor is idle
+    llm_summaries_invalidate(retrieval->summaries);
+
+    llm_trace_end("index_update_job", "worker", trace_start);
+}
+
+/// @brief Submit the changes collected so far (main thread)
+static gboolean llm_retrieval_update_timeout(gpointer user_data)
+{
+    LLMRetrieval *retrieval = (LLMRetrieval *)user_data;
+    LLMPlugin *plugin = retrieval->plugin;
+    retrieval->update_source = 0;
+
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+    GHashTableIter iter;
+    gpointer path;
+    g_hash_table_iter_init(&iter, retrieval->pending);
+    while (g_hash_table_iter_next(&iter, &path, NULL)) {
+        g_ptr_array_add(paths, g_strdup(path));
+    }
+    g_hash_table_remove_all(retrieval->pending);
+
+    LLMRetrievalPaths *work = llm_retrieval_paths_new(retrieval, paths);
+    if (!plugin->scheduler) {
+        llm_retrieval_paths_free(work);
+        return G_SOURCE_REMOVE;
+    }
+    llm_scheduler_submit(plugin->scheduler, LLM_PRIORITY_BACKGROUND,
+        llm_retrieval_update_thread_func, work, llm_retrieval_paths_free);
+    return G_SOURCE_REMOVE;
+}
+
+/// @brief Queue a file to be indexed again shortly (main thread)
+static void llm_retrieval_queue(LLMRetrieval *retrieval, const gchar *path)
+{
+    gchar *name = g_path_get_basename(path);
+    gboolean wanted = llm_retrieval_match(retrieval, name);
+    g_free(name);
+    if (!wanted) {
+        return;
+    }
+
+    g_hash_table_add(retrieval->pending, g_strdup(path));
+    // Saving often writes a file several times, editors even a temporary one
+    if (!retrieval->update_source) {
+        retrieval->update_source = g_timeout_add(LLM_RETRIEVAL_UPDATE_DELAY_MS,
+            llm_retrieval_update_timeout, retrieval);
+    }
+}
+
+static void llm_retrieval_queue_file(LLMRetrieval *retrieval, GFile *file)
+{
+    gchar *path = file ? g_file_get_path(file) : NULL;
+    if (path) {
+        llm_retrieval_queue(retrieval, path);
+    }
+    g_free(path);
+}
+
+static void on_llm_retrieval_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+    GFileMonitorEvent event, gpointer user_data)
+{
+    LLMRetrieval *retrieval = (LLMRetrieval *)user_data;
+
+    switch (event) {
+        case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+        case G_FILE_MONITOR_EVENT_CREATED:
+        case G_FILE_MONITOR_EVENT_DELETED:
+        case G_FILE_MONITOR_EVENT_MOVED_IN:
+        case G_FILE_MONITOR_EVENT_MOVED_OUT:
+            llm_retrieval_queue_file(retrieval, file);
+            break;
+        case G_FILE_MONITOR_EVENT_RENAMED:
+            llm_retrieval_queue_file(retrieval, file);
+            llm_retrieval_queue_file(retrieval, other_file);
+            break;
+        default:
+            // Writes in progress end with a hint, attributes do not matter
+            break;
+    }
+}
+
+/// @brief Directory indexed: the project, else the current document's directory
+static gchar *llm_retrieval_base_dir(LLMPlugin *plugin)
+{
+    GeanyProject *project = plugin->geany_data->app->project;
+    if (project && project->base_path && *project->base_path) {
+        return g_strdup(project->base_path);
+    }
+    GeanyDocument *doc = document_get_current();
+    if (doc && doc->real_path) {
+        return g_path_get_dirname(doc->real_path);
+    }
+    // Not the working directory, that may well be the home directory
+    return NULL;
+}
+
+/// @brief File of a directory in the plugin's cache directory
+/// @param kind "index" or "vectors"
+static gchar *llm_retrieval_cache_path(LLMPlugin *plugin, const gchar *base_dir, const gchar *kind)
+{
+    gchar *dir = llm_plugin_data_dir(plugin, LLM_CACHE_DIR);
+    if (!dir) {
+        return NULL;
+    }
+
+    gchar *checksum = g_compute_checksum_for_string(G_CHECKSUM_SHA1, base_dir, -1);
+    gchar *name = g_strdup_printf("%s-%.16s.bin", kind, checksum);
+    gchar *path = g_build_filename(dir, name, NULL);
+    g_free(name);
+    g_free(checksum);
+    g_free(dir);
+    return path;
+}
+
+/// @brief Summarize the files that changed once the editor is idle (main thread)
+static gboolean llm_retrieval_summaries_timeout(gpointer user_data)
+{
+    LLMRetrieval *retrieval = (LLMRetrieval *)user_data;
+
+    // Files the scan has not reached yet would be dropped
+    if (g_atomic_int_get(&retrieval->scanned) && llm_summaries_due(retrieval->summaries)) {
+        llm_summaries_submit(retrieval->summaries, llm_index_dup_paths(retrieval->index));
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static LLMRetrieval *llm_retrieval_new(LLMPlugin *plugin, const gchar *base_dir)
+{
+    LLMRetrieval *retrieval = g_new0(LLMRetrieval, 1);
+    retrieval->ref_count = 1;
+    retrieval->plugin = plugin;
+    retrieval->base_dir = g_strdup(base_dir);
+    retrieval->pattern_text = g_strdup(plugin->retrieval_patterns);
+    retrieval->patterns = g_strsplit_set(plugin->retrieval_patterns ? plugin->retrieval_patterns : "",
+        ";, ", -1);
+    retrieval->index_path = llm_retrieval_cache_path(plugin, base_dir, "index");
+    retrieval->monitors = g_ptr_array_new_with_free_func(llm_retrieval_monitor_free);
+    retrieval->pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    if (retrieval->index_path) {
+        GError *error = NULL;
+        retrieval->index = llm_index_load(retrieval->index_path, &error);
+        if (!retrieval->index) {
+            if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+                g_print("Error reading %s: %s\n", retrieval->index_path, error->message);
+            }
+            g_error_free(error);
+        }
+    }
+    if (!retrieval->index) {
+        retrieval->index = llm_index_new();
+    }
+
+    if (plugin->semantic_enabled) {
+        gchar *vectors_path = llm_retrieval_cache_path(plugin, base_dir, "vectors");
+        retrieval->embedding_model = g_strdup(plugin->embedding_model);
+        retrieval->semantic = llm_semantic_new(plugin, base_dir, vectors_path);
+        g_free(vectors_path);
+    }
+    if (plugin->summaries_enabled) {
+        retrieval->summaries = llm_summaries_new(plugin, base_dir);
+        retrieval->summaries_source = g_timeout_add_seconds(LLM_SUMMARIES_CHECK_SEC,
+            llm_retrieval_summaries_timeout, retrieval);
+    }
+    return retrieval;
+}
+
+void llm_retrieval_close(LLMPlugin *plugin)
+{
+    LLMRetrieval *retrieval = plugin ? plugin->retrieval : NULL;
+    if (!retrieval) {
+        return;
+    }
+    plugin->retrieval = NULL;
+
+    g_atomic_int_set(&retrieval->closed, 1);
+    llm_semantic_close(retrieval->semantic);
+    llm_summaries_close(retrieval->summaries);
+    if (retrieval->summaries_source) {
+        g_source_remove(retrieval->summaries_source);
+        retrieval->summaries_source = 0;
+    }
+    if (retrieval->update_source) {
+        // The next scan catches up on them
+        g_source_remove(retrieval->update_source);
+        retrieval->update_source = 0;
+    }
+    g_ptr_array_free(retrieval->monitors, TRUE);
+    retrieval->monitors = NULL;
+    g_hash_table_destroy(retrieval->pending);
+    retrieval->pending = NULL;
+    llm_retrieval_unref(retrieval);
+}
+
+void llm_retrieval_apply(LLMPlugin *plugin)
+{
+    if (!plugin) {
+        return;
+    }
+
+    gchar *base_dir = plugin->retrieval_enabled ? llm_retrieval_base_dir(plugin) : NULL;
+    LLMRetrieval *current = plugin->retrieval;
+    if (current && plugin->retrieval_enabled &&
+        g_strcmp0(current->pattern_text, plugin->retrieval_patterns) == 0 &&
+        (current->semantic != NULL) == plugin->semantic_enabled &&
+        (!current->semantic || g_strcmp0(current->embedding_model, plugin->embedding_model) == 0) &&
+        (current->summaries != NULL) == plugin->summaries_enabled) {
+        gboolean keep;
+        if (plugin->geany_data->app->project) {
+            keep = g_strcmp0(current->base_dir, base_dir) == 0;
+        } else {
+            // Documents of subdirectories and new ones are covered already
+            keep = !base_dir || llm_retrieval_below(base_dir, current->base_dir);
+        }
+        if (keep) {
+            g_free(base_dir);
+            return;
+        }
+    }
+
+    llm_retrieval_close(plugin);
+    if (base_dir && plugin->scheduler) {
+        plugin->retrieval = llm_retrieval_new(plugin, base_dir);
+        llm_scheduler_submit(plugin->scheduler, LLM_PRIORITY_BACKGROUND, llm_retrieval_scan_thread_func,
+            llm_retrieval_paths_new(plugin->retrieval, NULL), llm_retrieval_paths_free);
+    }
+    g_free(base_dir);
+}
+
+/// @brief TRUE if a file is part of the context in full already
+static gboolean llm_retrieval_included(LLMPlugin *plugin, GeanyDocument *whole, const gchar *path)
+{
+    if (whole && g_strcmp0(whole->real_path, path) == 0) {
+        return TRUE;
+    }
+    for (guint i = 0; plugin->selected_document_ids && i < plugin->selected_document_ids->len; i++) {
+        GeanyDocument *doc = g_ptr_array_index(plugin->selected_document_ids, i);
+        if (doc && doc->is_valid && g_strcmp0(doc->real_path, path) == 0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/// @brief Lines of a file, from the editor if it is open
+/// @return NULL if the file has fewer lines now
+static gchar *llm_retrieval_read_lines(const gchar *path, guint first, guint last)
+{
+    GeanyDocument *doc = document_find_by_real_path(path);
+    if (doc) {
+        ScintillaObject *sci = doc->editor->sci;
+        gint lines = sci_get_line_count(sci);
+        if ((gint)first >= lines) {
+            return NULL;
+        }
+        gint start = sci_get_position_from_line(sci, first);
+        gint end = (gint)last + 1 < lines ? sci_get_position_from_line(sci, last + 1) : sci_get_length(sci);
+        return sci_get_contents_range(sci, start, end);
+    }
+
+    GMappedFile *mapped = g_mapped_file_new(path, FALSE, NULL);
+    if (!mapped) {
+        return NULL;
+    }
+    const gchar *text = g_mapped_file_get_contents(mapped);
+    gsize length = text ? g_mapped_file_get_length(mapped) : 0;
+    gsize start = 0;
+    for (guint line = 0; line < first && start < length; line++) {
+        const gchar *newline = memchr(text + start, '\n', length - start);
+        start = newline ? (gsize)(newline - text) + 1 : length;
+    }
+    gsize end = start;
+    for (guint line = first; line <= last && end < length; line++) {
+        const gchar *newline = memchr(text + end, '\n', length - end);
+        end = newline ? (gsize)(newline - text) + 1 : length;
+    }
+    gchar *lines = start < length ? g_strndup(text + start, end - start) : NULL;
+    g_mapped_file_unref(mapped);
+    return lines;
+}
+
+void llm_retrieval_collect(LLMPlugin *plugin, const gchar *question, GeanyDocument *whole,
+    GPtrArray *documents)
+{
+    if (!plugin || !plugin->retrieval_enabled || !question || !*question) {
+        return;
+    }
+    // Without a project, follow the current document to another directory
+    llm_retrieval_apply(plugin);
+    LLMRetrieval *retrieval = plugin->retrieval;
+    if (!retrieval) {
+        return;
+    }
+
+    gint64 start = g_get_monotonic_time();
+    // Some may be in the context already
+    GPtrArray *hits = llm_index_search(retrieval->index, question, plugin->retrieval_hits * 2);
+    guint added = 0;
+    for (guint i = 0; i < hits->len && added < plugin->retrieval_hits; i++) {
+        LLMIndexHit *hit = g_ptr_array_index(hits, i);
+        if (llm_retrieval_included(plugin, whole, hit->path)) {
+            continue;
+        }
+        gchar *text = llm_retrieval_read_lines(hit->path, hit->first_line, hit->last_line);
+        if (!text) {
+            continue;
+        }
+
+        const gchar *shown_path = hit->path;
+        if (llm_retrieval_below(hit->path, retrieval->base_dir)) {
+            shown_path += strlen(retrieval->base_dir);
+            while (G_IS_DIR_SEPARATOR(*shown_path)) {
+                shown_path++;
+            }
+        }
+        gchar *name = g_strdup_printf("%s:%u-%u (matches the question)", shown_path,
+            hit->first_line + 1, hit->last_line + 1);
+        LLMDocument *document = llm_document_new(name, text);
+        llm_document_set_source(document, hit->path, hit->first_line, hit->last_line);
+        g_ptr_array_add(documents, document);
+        g_free(name);
+        added++;
+    }
+    g_ptr_array_unref(hits);
+
+    g_print("Added %u chunks of %s in %.1f ms%s\n", added, retrieval->base_dir,
+        (g_get_monotonic_time() - start) / 1000.0,
+        g_atomic_int_get(&retrieval->scanned) ? "" : ", indexing still running");
+}
+
+void llm_retrieval_describe(LLMPlugin *plugin, GString *out)
+{
+    LLMRetrieval *retrieval = plugin->retrieval;
+    if (!retrieval) {
+        g_string_append(out, plugin->retrieval_enabled ? "No directory to index yet\n" : "Off\n");
+        return;
+    }
+
+    g_string_append_printf(out, "%s%s\n", retrieval->base_dir,
+        g_atomic_int_get(&retrieval->scanned) ? "" : " (indexing)");
+    llm_index_describe(retrieval->index, out);
+    g_string_append_printf(out, "%u directories watched, %u changes pending\n",
+        retrieval->monitors->len, g_hash_table_size(retrieval->pending));
+    if (retrieval->semantic) {
+        llm_semantic_describe(retrieval->semantic, out);
+    }
+    if (retrieval->summaries) {
+        llm_summaries_describe(retrieval->summaries, out);
+    }
+}
+
+void llm_retrieval_collect_summaries(LLMPlugin *plugin, const gchar *question, GPtrArray *documents)
+{
+    LLMRetrieval *retrieval = plugin ? plugin->retrieval : NULL;
+    if (!retrieval || !retrieval->summaries || plugin->summaries_tokens == 0) {
+        return;
+    }
+
+    // The files matching the question are the likeliest to matter
+    GPtrArray *first = g_ptr_array_new();
+    GPtrArray *hits = question && *question ?
+        llm_index_search(retrieval->index, question, plugin->retrieval_hits * 4) : NULL;
+    for (guint i = 0; hits && i < hits->len; i++) {
+        g_ptr_array_add(first, ((LLMIndexHit *)g_ptr_array_index(hits, i))->path);
+    }
+
+    LLMDocument *document = llm_summaries_document(retrieval->summaries, documents, first,
+        (gsize)plugin->summaries_tokens * LLM_BYTES_PER_TOKEN);
+    if (document) {
+        g_ptr_array_add(documents, document);
+    }
+    g_ptr_array_free(first, TRUE);
+    if (hits) {
+        g_ptr_array_unref(hits);
+    }
+}
+
+LLMSemantic *llm_retrieval_semantic(LLMPlugin *plugin)
+{
+    LLMRetrieval *retrieval = plugin ? plugin->retrieval : NULL;
+    return retrieval && retrieval->semantic ? llm_semantic_ref(retrieval->semantic) : NULL;
+}
+
+void on_llm_document_save(GObject *object, GeanyDocument *doc, gpointer user_data)
+{
+    LLMPlugin *plugin = (LLMPlugin *)user_data;
+    LLMRetrieval *retrieval = plugin ? plugin->retrieval : NULL;
+
+    // Also where no monitor watches, e.g. beyond LLM_RETRIEVAL_MAX_MONITORS
+    if (retrieval && doc && doc->real_path && llm_retrieval_below(doc->real_path, retrieval->base_dir)) {
+        llm_retrieval_queue(retrieval, doc->real_path);
+    }
+}
+
+static gboolean llm_retrieval_apply_idle(gpointer user_data)
+{
+    llm_retrieval_apply((LLMPlugin *)user_data);
+    return G_SOURCE_REMOVE;
+}
+
+void on_llm_project_open(GObject *object, GKeyFile *config, gpointer user_data)
+{
+    llm_retrieval_apply((LLMPlugin *)user_data);
+}
+
+void on_llm_project_close(GObject *object, gpointer user_data)
+{
+    // The project is still set while the signal is emitted
+    g_idle_add(llm_retrieval_apply_idle, user_data);
+}
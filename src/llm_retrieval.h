@@ -0,0 +1,65 @@
+#ifndef __LLM_RETRIEVAL_H__
+#define __LLM_RETRIEVAL_H__
+
+#include "plugin.h"
+#include "llm_index.h"
+#include "llm_semantic.h"
+#include "llm_summaries.h"
+
+/**
+ * Retrieval of project code for the chat. The source files below the
+ * project directory, or without a project the directory of the current
+ * document, are kept in an LLMIndex, open in Geany or not. The index is
+ * built by a background job, starting from the copy the last session left
+ * in the plugin's cache directory, so only files changed since are read.
+ *
+ * Afterwards a file monitor per directory and Geany's document-save signal
+ * queue the changed files, indexed again by a background job a moment
+ * later. A question then gets the chunks of code scoring best for it added
+ * to its context, without picking documents by hand, and if it is on the
+ * chunks most similar to it by meaning, see llm_semantic.h, and the
+ * summaries of the other files, see llm_summaries.h.
+ */
+
+#define LLM_RETRIEVAL_DEFAULT_HITS 5
+#define LLM_RETRIEVAL_DEFAULT_PATTERNS \
+    "*.c;*.h;*.cc;*.cpp;*.cxx;*.hh;*.hpp;*.cs;*.java;*.kt;*.go;*.rs;*.py;*.rb;*.pl;*.php;" \
+    "*.js;*.ts;*.lua;*.sh;*.vala;*.swift;*.m;*.md;*.txt;*.am;*.ac;*.cmake;CMakeLists.txt;Makefile"
+
+/// @brief Files indexed per project at most
+#define LLM_RETRIEVAL_MAX_FILES 20000
+#define LLM_RETRIEVAL_MAX_DEPTH 12
+/// @brief Directories watched at most, the rest is caught up on save and at the next start
+#define LLM_RETRIEVAL_MAX_MONITORS 1000
+/// @brief Changes are collected this long before they are indexed
+#define LLM_RETRIEVAL_UPDATE_DELAY_MS 1500
+
+/// @brief Start, retarget or stop indexing as the settings and the project say (main thread)
+void llm_retrieval_apply(LLMPlugin *plugin);
+
+/// @brief Stop indexing, jobs running finish on their own (main thread)
+void llm_retrieval_close(LLMPlugin *plugin);
+
+/// @brief Add the chunks of code scoring best for the question to documents (main thread)
+/// @param whole document included in full already, its chunks are skipped; may be NULL
+void llm_retrieval_collect(LLMPlugin *plugin, const gchar *question, GeanyDocument *whole,
+    GPtrArray *documents);
+
+/// @brief Add the summaries of the files not in documents in full, as the last document (main thread)
+void llm_retrieval_collect_summaries(LLMPlugin *plugin, const gchar *question, GPtrArray *documents);
+
+/// @brief Retrieval by meaning of the directory indexed (main thread)
+/// @return a new reference, NULL if it is off
+LLMSemantic *llm_retrieval_semantic(LLMPlugin *plugin);
+
+/// @brief Append the state of the index to out (main thread)
+void llm_retrieval_describe(LLMPlugin *plugin, GString *out);
+
+/// @brief Queue a saved file to be indexed again
+void on_llm_document_save(GObject *object, GeanyDocument *doc, gpointer user_data);
+
+void on_llm_project_open(GObject *object, GKeyFile *config, gpointer user_data);
+
+void on_llm_project_close(GObject *object, gpointer user_data);
+
+#endif // __LLM_RETRIEVAL_H__
@@ -0,0 +1,376 @@
+#include "llm_scheduler.h"
+#include "llm_trace.h"
+
+#define LLM_SCHEDULER_SHUTDOWN_WAIT_USEC (2 * G_USEC_PER_SEC)
+
+static void llm_scheduler_dispatch_locked(LLMScheduler *scheduler);
+
+static void llm_job_free(LLMJob *job)
+{
+    if (!job) {
+        return;
+    }
+    if (job->destroy) {
+        job->destroy(job->data);
+    }
+    g_free(job);
+}
+
+static guint llm_scheduler_pending_locked(LLMScheduler *scheduler)
+{
+    guint count = 0;
+    for (gint i = 0; i < LLM_PRIORITY_COUNT; i++) {
+        count += g_queue_get_length(&scheduler->pending[i]);
+    }
+    return count;
+}
+
+/// @brief Queue a job in its class, at the head for a restart
+static void llm_scheduler_enqueue_locked(LLMScheduler *scheduler, LLMJob *job, gboolean head)
+{
+    job->queued_time = g_get_monotonic_time();
+    if (head) {
+        g_queue_push_head(&scheduler->pending[job->priority], job);
+    } else {
+        g_queue_push_tail(&scheduler->pending[job->priority], job);
+    }
+
+    guint pending = llm_scheduler_pending_locked(scheduler);
+    scheduler->stats.peak_pending = MAX(scheduler->stats.peak_pending, pending);
+    llm_trace_counter("jobs_pending", pending);
+}
+
+/// @brief Pool worker running one job
+static void llm_scheduler_job_run(gpointer data, gpointer user_data)
+{
+    LLMJob *job = (LLMJob *)data;
+    LLMScheduler *scheduler = (LLMScheduler *)user_data;
+    gint64 start_time = g_get_monotonic_time();
+
+    job->func(job, job->data);
+
+    g_mutex_lock(&scheduler->lock);
+    scheduler->stats.busy_usec += g_get_monotonic_time() - start_time;
+    g_ptr_array_remove(scheduler->running, job);
+    scheduler->running_count[job->priority]--;
+    llm_trace_counter("jobs_running", scheduler->running->len);
+
+    if (job->preempted && !job->cancelled && !scheduler->shutting_down) {
+        // Restart later, ahead of the other jobs of its class
+        g_print("Requeueing preempted job %u\n", job->id);
+        job->preempted = FALSE;
+        g_atomic_int_set(&job->cancel_flag, FALSE);
+        llm_scheduler_enqueue_locked(scheduler, job, TRUE);
+    } else {
+        scheduler->stats.finished++;
+        llm_job_free(job);
+    }
+
+    if (!scheduler->shutting_down) {
+        llm_scheduler_dispatch_locked(scheduler);
+    }
+    g_cond_broadcast(&scheduler->idle_cond);
+    g_mutex_unlock(&scheduler->lock);
+}
+
+static gboolean llm_scheduler_can_start_locked(LLMScheduler *scheduler, LLMPriority priority)
+{
+    return scheduler->running->len < scheduler->slots &&
+           scheduler->running_count[priority] < scheduler->class_limits[priority];
+}
+
+static void llm_scheduler_start_locked(LLMScheduler *scheduler, LLMJob *job)
+{
+    g_ptr_array_add(scheduler->running, job);
+    scheduler->running_count[job->priority]++;
+    job->runs++;
+    scheduler->stats.started++;
+    scheduler->stats.wait_usec += g_get_monotonic_time() - job->queued_time;
+    llm_trace_counter("jobs_running", scheduler->running->len);
+    llm_trace_counter("jobs_pending", llm_scheduler_pending_locked(scheduler));
+
+    // Completion is tracked through the running list. The pool queues the
+    // job if every worker is still busy, e.g. finishing a preempted run.
+    GError *error = NULL;
+    if (!g_thread_pool_push(scheduler->pool, job, &error)) {
+        g_warning("Could not start a worker for job %u: %s", job->id, error->message);
+        g_error_free(error);
+    }
+}
+
+/// @brief Start queued jobs, highest priority first, while slots are free
+static void llm_scheduler_dispatch_locked(LLMScheduler *scheduler)
+{
+    for (gint priority = 0; priority < LLM_PRIORITY_COUNT; priority++) {
+        GQueue *queue = &scheduler->pending[priority];
+        while (!g_queue_is_empty(queue) && llm_scheduler_can_start_locked(scheduler, priority)) {
+            llm_scheduler_start_locked(scheduler, g_queue_pop_head(queue));
+        }
+    }
+}
+
+/// @brief Cancel the lowest priority running job below the given class
+/// @return TRUE if a job was asked to make room
+static gboolean llm_scheduler_preempt_locked(LLMScheduler *scheduler, LLMPriority priority)
+{
+    LLMJob *victim = NULL;
+
+    for (guint i = 0; i < scheduler->running->len; i++) {
+        LLMJob *job = g_ptr_array_index(scheduler->running, i);
+        if (job->priority <= priority || job->preempted || g_atomic_int_get(&job->cancel_flag)) {
+            continue;
+        }
+        // Prefer the lowest class, then the most recently started job
+        if (!victim || job->priority > victim->priority ||
+            (job->priority == victim->priority && job->id > victim->id)) {
+            victim = job;
+        }
+    }
+
+    if (!victim) {
+        return FALSE;
+    }
+
+    g_print("Preempting job %u (class %d) for class %d\n", victim->id, victim->priority, priority);
+    llm_trace_instant("preempt", "scheduler");
+    victim->preempted = TRUE;
+    g_atomic_int_set(&victim->cancel_flag, TRUE);
+    scheduler->stats.preempted++;
+    return TRUE;
+}
+
+/// @brief Number of running jobs already asked to stop
+static guint llm_scheduler_stopping_locked(LLMScheduler *scheduler)
+{
+    guint count = 0;
+    for (guint i = 0; i < scheduler->running->len; i++) {
+        LLMJob *job = g_ptr_array_index(scheduler->running, i);
+        if (g_atomic_int_get(&job->cancel_flag)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+LLMScheduler *llm_scheduler_new(void)
+{
+    LLMScheduler *scheduler = g_new0(LLMScheduler, 1);
+    g_mutex_init(&scheduler->lock);
+    g_cond_init(&scheduler->idle_cond);
+    for (gint i = 0; i < LLM_PRIORITY_COUNT; i++) {
+        g_queue_init(&scheduler->pending[i]);
+    }
+    scheduler->running = g_ptr_array_new();
+    scheduler->next_id = 1;
+    scheduler->created_time = g_get_monotonic_time();
+
+    // Exclusive, so its threads are started now and stay warm
+    GError *error = NULL;
+    scheduler->pool = g_thread_pool_new(llm_scheduler_job_run, scheduler,
+        LLM_SCHEDULER_DEFAULT_SLOTS, TRUE, &error);
+    if (error) {
+        g_warning("Could not start the LLM workers: %s", error->message);
+        g_error_free(error);
+    }
+
+    llm_scheduler_set_limits(scheduler, LLM_SCHEDULER_DEFAULT_SLOTS, 1, 1, 1, 1);
+    return scheduler;
+}
+
+void llm_scheduler_free(LLMScheduler *scheduler)
+{
+    if (!scheduler) {
+        return;
+    }
+
+    g_mutex_lock(&scheduler->lock);
+    scheduler->shutting_down = TRUE;
+
+    for (gint i = 0; i < LLM_PRIORITY_COUNT; i++) {
+        LLMJob *job;
+        while ((job = g_queue_pop_head(&scheduler->pending[i])) != NULL) {
+            llm_job_free(job);
+        }
+    }
+    for (guint i = 0; i < scheduler->running->len; i++) {
+        LLMJob *job = g_ptr_array_index(scheduler->running, i);
+        job->cancelled = TRUE;
+        g_atomic_int_set(&job->cancel_flag, TRUE);
+    }
+
+    gint64 deadline = g_get_monotonic_time() + LLM_SCHEDULER_SHUTDOWN_WAIT_USEC;
+    while (scheduler->running->len > 0) {
+        if (!g_cond_wait_until(&scheduler->idle_cond, &scheduler->lock, deadline)) {
+            // A transfer stuck, e.g. resolving a host name, ends on its own timeout
+            g_print("Waiting for %u LLM jobs to stop\n", scheduler->running->len);
+            break;
+        }
+    }
+    g_mutex_unlock(&scheduler->lock);
+
+    // However long it takes: the workers use the plugin's state, which is freed after this.
+    // Not immediate: jobs pushed to busy workers still run, cancelled, and free their data.
+    g_thread_pool_free(scheduler->pool, FALSE, TRUE);
+    g_ptr_array_free(scheduler->running, TRUE);
+    g_cond_clear(&scheduler->idle_cond);
+    g_mutex_clear(&scheduler->lock);
+    g_free(scheduler);
+}
+
+void llm_scheduler_set_limits(LLMScheduler *scheduler, guint slots,
+    guint interactive_limit, guint completion_limit, guint batch_limit,
+    guint background_limit)
+{
+    if (!scheduler) {
+        return;
+    }
+
+    g_mutex_lock(&scheduler->lock);
+    scheduler->slots = CLAMP(slots, 1, LLM_SCHEDULER_MAX_SLOTS);
+    scheduler->class_limits[LLM_PRIORITY_INTERACTIVE] = MAX(interactive_limit, 1);
+    scheduler->class_limits[LLM_PRIORITY_COMPLETION] = MAX(completion_limit, 1);
+    scheduler->class_limits[LLM_PRIORITY_BATCH] = MAX(batch_limit, 1);
+    scheduler->class_limits[LLM_PRIORITY_BACKGROUND] = MAX(background_limit, 1);
+    // Lowering the limit lets the surplus workers exit once idle
+    g_thread_pool_set_max_threads(scheduler->pool, scheduler->slots, NULL);
+    llm_scheduler_dispatch_locked(scheduler);
+    g_mutex_unlock(&scheduler->lock);
+}
+
+guint llm_scheduler_submit(LLMScheduler *scheduler, LLMPriority priority,
+    LLMJobFunc func, gpointer data, GDestroyNotify destroy)
+{
+    g_return_val_if_fail(scheduler && func && priority < LLM_PRIORITY_COUNT, 0);
+
+    LLMJob *job = g_new0(LLMJob, 1);
+    job->priority = priority;
+    job->func = func;
+    job->data = data;
+    job->destroy = destroy;
+    job->scheduler = scheduler;
+
+    g_mutex_lock(&scheduler->lock);
+    job->id = scheduler->next_id++;
+    if (scheduler->next_id == 0) {
+        scheduler->next_id = 1;
+    }
+
+    if (scheduler->shutting_down) {
+        g_mutex_unlock(&scheduler->lock);
+        llm_job_free(job);
+        return 0;
+    }
+
+    llm_scheduler_enqueue_locked(scheduler, job, FALSE);
+
+    // Only the slot budget is worth preempting for; a full class just waits its turn.
+    // Jobs already stopping will free their slots, so count them as free.
+    if (scheduler->running_count[priority] < scheduler->class_limits[priority] &&
+        scheduler->running->len - llm_scheduler_stopping_locked(scheduler) >= scheduler->slots) {
+        llm_scheduler_preempt_locked(scheduler, priority);
+    }
+
+    llm_scheduler_dispatch_locked(scheduler);
+    guint id = job->id;
+    g_mutex_unlock(&scheduler->lock);
+
+    return id;
+}
+
+static gint llm_job_compare_id(gconstpointer a, gconstpointer b)
+{
+    const LLMJob *job = (const LLMJob *)a;
+    return job->id == GPOINTER_TO_UINT(b) ? 0 : 1;
+}
+
+gboolean llm_scheduler_cancel(LLMScheduler *scheduler, guint job_id)
+{
+    if (!scheduler || job_id == 0) {
+        return FALSE;
+    }
+
+    g_mutex_lock(&scheduler->lock);
+    for (gint i = 0; i < LLM_PRIORITY_COUNT; i++) {
+        GList *link = g_queue_find_custom(&scheduler->pending[i], GUINT_TO_POINTER(job_id), llm_job_compare_id);
+        if (link) {
+            LLMJob *job = link->data;
+            g_queue_delete_link(&scheduler->pending[i], link);
+            g_mutex_unlock(&scheduler->lock);
+            llm_job_free(job);
+            return TRUE;
+        }
+    }
+
+    for (guint i = 0; i < scheduler->running->len; i++) {
+        LLMJob *job = g_ptr_array_index(scheduler->running, i);
+        if (job->id == job_id) {
+            job->cancelled = TRUE;
+            g_atomic_int_set(&job->cancel_flag, TRUE);
+            g_mutex_unlock(&scheduler->lock);
+            return TRUE;
+        }
+    }
+    g_mutex_unlock(&scheduler->lock);
+
+    return FALSE;
+}
+
+guint llm_scheduler_running(LLMScheduler *scheduler, LLMPriority priority)
+{
+    g_return_val_if_fail(scheduler && priority < LLM_PRIORITY_COUNT, 0);
+
+    g_mutex_lock(&scheduler->lock);
+    guint count = scheduler->running_count[priority];
+    g_mutex_unlock(&scheduler->lock);
+    return count;
+}
+
+guint llm_scheduler_pending(LLMScheduler *scheduler, LLMPriority priority)
+{
+    g_return_val_if_fail(scheduler && priority < LLM_PRIORITY_COUNT, 0);
+
+    g_mutex_lock(&scheduler->lock);
+    guint count = g_queue_get_length(&scheduler->pending[priority]);
+    g_mutex_unlock(&scheduler->lock);
+    return count;
+}
+
+void llm_scheduler_get_stats(LLMScheduler *scheduler, LLMSchedulerStats *stats)
+{
+    g_return_if_fail(scheduler && stats);
+
+    g_mutex_lock(&scheduler->lock);
+    *stats = scheduler->stats;
+    stats->workers = g_thread_pool_get_num_threads(scheduler->pool);
+    stats->running = scheduler->running->len;
+    stats->pending = llm_scheduler_pending_locked(scheduler);
+    stats->uptime_usec = g_get_monotonic_time() - scheduler->created_time;
+    g_mutex_unlock(&scheduler->lock);
+}
+
+void llm_scheduler_describe(LLMScheduler *scheduler, GString *out)
+{
+    static const gchar *class_names[LLM_PRIORITY_COUNT] = {
+        "interactive", "completion", "batch", "background"
+    };
+    LLMSchedulerStats stats;
+    llm_scheduler_get_stats(scheduler, &stats);
+
+    g_mutex_lock(&scheduler->lock);
+    guint slots = scheduler->slots;
+    g_string_append_printf(out, "  %u workers, %u of %u slots busy, %u queued (peak %u)\n",
+        stats.workers, stats.running, slots, stats.pending, stats.peak_pending);
+    for (gint i = 0; i < LLM_PRIORITY_COUNT; i++) {
+        g_string_append_printf(out, "  %-12s %u running (limit %u), %u queued\n", class_names[i],
+            scheduler->running_count[i], scheduler->class_limits[i],
+            g_queue_get_length(&scheduler->pending[i]));
+    }
+    g_mutex_unlock(&scheduler->lock);
+
+    gdouble utilisation = stats.uptime_usec > 0 ?
+        100.0 * stats.busy_usec / ((gdouble)stats.uptime_usec * slots) : 0;
+    g_string_append_printf(out, "  %u runs started, %u jobs finished, %u preempted\n",
+        stats.started, stats.finished, stats.preempted);
+    g_string_append_printf(out, "  mean queue wait %.1f ms, worker utilisation %.1f%%\n",
+        stats.started ? stats.wait_usec / 1000.0 / stats.started : 0, MIN(utilisation, 100.0));
+}
@@ -0,0 +1,114 @@
+#ifndef __LLM_SCHEDULER_H__
+#define __LLM_SCHEDULER_H__
+
+#include <glib.h>
+
+/**
+ * Priority request scheduler.
+ *
+ * Every request is a job in one of the priority classes below. Each class
+ * has its own concurrency limit and all classes share the server slot
+ * budget. When the budget is exhausted a new job preempts the lowest
+ * priority running job below its own class: that job is cancelled and
+ * requeued at the head of its class, so it restarts once a slot is free.
+ *
+ * Started jobs run on a pool of worker threads owned by the scheduler.
+ * The pool keeps one warm thread per server slot, so starting a job costs
+ * a queue push instead of a thread creation.
+ */
+
+/// @brief Priority classes, highest priority first
+typedef enum {
+    LLM_PRIORITY_INTERACTIVE,  // Chat questions from the panel
+    LLM_PRIORITY_COMPLETION,   // Inline completions
+    LLM_PRIORITY_BATCH,        // One instruction run over many files
+    LLM_PRIORITY_BACKGROUND,   // Warm-ups, indexing, summaries
+    LLM_PRIORITY_COUNT
+} LLMPriority;
+
+#define LLM_SCHEDULER_DEFAULT_SLOTS 2
+#define LLM_SCHEDULER_MAX_SLOTS 16
+
+typedef struct LLMJob LLMJob;
+typedef struct LLMScheduler LLMScheduler;
+
+/// @brief Job body, runs on a worker thread. It may run again after preemption.
+typedef void (*LLMJobFunc)(LLMJob *job, gpointer data);
+
+struct LLMJob {
+    guint id;
+    LLMPriority priority;
+    LLMJobFunc func;
+    gpointer data;
+    GDestroyNotify destroy;   // Frees data once the job is finished for good
+    gint cancel_flag;         // Atomic, polled by the transport, set on cancel, preemption and early stops
+    gboolean preempted;       // Cancelled to make room, will be requeued
+    gboolean cancelled;       // Cancelled by the user, will not be requeued
+    guint runs;               // Number of times func was started
+    gint64 queued_time;       // Monotonic time (us) the job was last queued
+    LLMScheduler *scheduler;
+};
+
+/// @brief Counters of the scheduler and its worker pool
+typedef struct {
+    guint workers;            // Threads of the pool
+    guint running;            // Jobs running now
+    guint pending;            // Jobs queued now, all classes
+    guint peak_pending;       // Most jobs queued at once
+    guint started;            // Job runs started, restarts included
+    guint finished;           // Jobs finished for good
+    guint preempted;          // Runs cancelled to make room
+    gint64 busy_usec;         // Time spent running jobs, all workers
+    gint64 wait_usec;         // Time started jobs spent queued
+    gint64 uptime_usec;       // Since the scheduler was created
+} LLMSchedulerStats;
+
+struct LLMScheduler {
+    GMutex lock;
+    GCond idle_cond;
+    GQueue pending[LLM_PRIORITY_COUNT];
+    GPtrArray *running;                 // LLMJob*
+    guint running_count[LLM_PRIORITY_COUNT];
+    guint class_limits[LLM_PRIORITY_COUNT];
+    guint slots;                        // Requests the server can run in parallel
+    guint next_id;
+    gboolean shutting_down;
+    GThreadPool *pool;                  // Workers, one per slot
+    LLMSchedulerStats stats;            // Cumulative counters
+    gint64 created_time;
+};
+
+/// @brief Create a scheduler with the default limits
+LLMScheduler *llm_scheduler_new(void);
+
+/// @brief Cancel everything, stop the workers and free the scheduler.
+/// Returns once every job has returned, so the state they use may be freed after.
+void llm_scheduler_free(LLMScheduler *scheduler);
+
+/// @brief Set the shared slot budget and the per-class limits
+void llm_scheduler_set_limits(LLMScheduler *scheduler, guint slots,
+    guint interactive_limit, guint completion_limit, guint batch_limit,
+    guint background_limit);
+
+/// @brief Queue a job and start it if a slot is free, preempting lower priority work if needed.
+/// @return the job id, never 0
+guint llm_scheduler_submit(LLMScheduler *scheduler, LLMPriority priority,
+    LLMJobFunc func, gpointer data, GDestroyNotify destroy);
+
+/// @brief Cancel a queued or running job. Unknown ids are ignored.
+/// @return TRUE if the job was found
+gboolean llm_scheduler_cancel(LLMScheduler *scheduler, guint job_id);
+
+/// @brief Number of running jobs in a priority class
+guint llm_scheduler_running(LLMScheduler *scheduler, LLMPriority priority);
+
+/// @brief Number of queued jobs in a priority class
+guint llm_scheduler_pending(LLMScheduler *scheduler, LLMPriority priority);
+
+/// @brief Read the counters
+void llm_scheduler_get_stats(LLMScheduler *scheduler, LLMSchedulerStats *stats);
+
+/// @brief Append a report of the queues and the worker utilisation
+void llm_scheduler_describe(LLMScheduler *scheduler, GString *out);
+
+#endif // __LLM_SCHEDULER_H__
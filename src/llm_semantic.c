@@ -0,0 +1,646 @@
+#include <string.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#include "llm_semantic.h"
+#include "llm_endpoints.h"
+#include "llm_http.h"
+#include "llm_index.h"
+#include "llm_json.h"
+#include "llm_profiles.h"
+#include "llm_scheduler.h"
+#include "llm_trace.h"
+#include "llm_util.h"
+
+/// @brief Vectors searched per chunk wanted, some are in the context already
+#define LLM_SEMANTIC_SEARCH_FACTOR 4
+/// @brief A NUL byte in the first this many bytes makes a file binary
+#define LLM_SEMANTIC_BINARY_PROBE 4096
+
+typedef struct {
+    guint64 key;        // llm_vectors_key() of the lines
+    guint32 first_line;
+    guint32 last_line;
+} LLMSemanticChunk;
+
+typedef struct {
+    gint64 mtime;
+    gint64 size;
+    GArray *chunks;     // LLMSemanticChunk, in line order
+} LLMSemanticFile;
+
+/// @brief A chunk and its file, the text is read when it is needed
+typedef struct {
+    gchar *path;
+    LLMSemanticChunk chunk;
+} LLMSemanticLocation;
+
+struct LLMSemantic {
+    gint ref_count;
+    gint closed;            // Atomic, set once the retrieval let go of it
+    gint embedding;         // Atomic, an embed job is queued or running
+    gint unsupported;       // Atomic, the servers have no embeddings endpoint
+    LLMPlugin *plugin;
+    gchar *base_dir;
+    gchar *model;           // Embedding model asked for, "" for the one loaded
+    gchar *vectors_path;    // NULL without a cache directory
+    LLMVectorStore *vectors;
+
+    GMutex lock;            // Guards the fields below
+    GHashTable *files;      // Path -> LLMSemanticFile*
+    GQueue pending;         // LLMSemanticLocation* of the chunks to embed
+    GHashTable *pending_keys;   // guint64* keys of the pending chunks
+    guint embedded;         // Chunks embedded this session
+};
+
+static void llm_semantic_file_free(gpointer data)
+{
+    LLMSemanticFile *file = (LLMSemanticFile *)data;
+    g_array_free(file->chunks, TRUE);
+    g_free(file);
+}
+
+static LLMSemanticLocation *llm_semantic_location_new(const gchar *path, const LLMSemanticChunk *chunk)
+{
+    LLMSemanticLocation *location = g_new0(LLMSemanticLocation, 1);
+    location->path = g_strdup(path);
+    location->chunk = *chunk;
+    return location;
+}
+
+static void llm_semantic_location_free(gpointer data)
+{
+    LLMSemanticLocation *location = (LLMSemanticLocation *)data;
+    if (location) {
+        g_free(location->path);
+        g_free(location);
+    }
+}
+
+LLMSemantic *llm_semantic_new(LLMPlugin *plugin, const gchar *base_dir, const gchar *vectors_path)
+{
+    LLMSemantic *semantic = g_new0(LLMSemantic, 1);
+    semantic->ref_count = 1;
+    semantic->plugin = plugin;
+    semantic->base_dir = g_strdup(base_dir);
+    semantic->model = g_strdup(plugin->embedding_model ? plugin->embedding_model : "");
+    semantic->vectors_path = g_strdup(vectors_path);
+    g_mutex_init(&semantic->lock);
+    semantic->files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, llm_semantic_file_free);
+    g_queue_init(&semantic->pending);
+    semantic->pending_keys = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+
+    if (vectors_path) {
+        GError *error = NULL;
+        semantic->vectors = llm_vectors_load(vectors_path, &error);
+        if (!semantic->vectors) {
+            if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+                g_print("Error reading %s: %s\n", vectors_path, error->message);
+            }
+            g_error_free(error);
+        }
+    }
+    // Vectors of different models are not comparable
+    const gchar *stored_model = semantic->vectors ? llm_vectors_model(semantic->vectors) : NULL;
+    if (semantic->vectors && g_strcmp0(stored_model ? stored_model : "", semantic->model) != 0) {
+        g_print("%s holds the vectors of another model, embedding again\n", vectors_path);
+        g_clear_pointer(&semantic->vectors, llm_vectors_free);
+    }
+    if (!semantic->vectors) {
+        semantic->vectors = llm_vectors_new(semantic->model);
+    }
+    return semantic;
+}
+
+LLMSemantic *llm_semantic_ref(LLMSemantic *semantic)
+{
+    g_atomic_int_inc(&semantic->ref_count);
+    return semantic;
+}
+
+void llm_semantic_unref(LLMSemantic *semantic)
+{
+    if (semantic && g_atomic_int_dec_and_test(&semantic->ref_count)) {
+        llm_vectors_free(semantic->vectors);
+        g_hash_table_destroy(semantic->files);
+        g_queue_clear_full(&semantic->pending, llm_semantic_location_free);
+        g_hash_table_destroy(semantic->pending_keys);
+        g_mutex_clear(&semantic->lock);
+        g_free(semantic->base_dir);
+        g_free(semantic->model);
+        g_free(semantic->vectors_path);
+        g_free(semantic);
+    }
+}
+
+void llm_semantic_close(LLMSemantic *semantic)
+{
+    if (semantic) {
+        g_atomic_int_set(&semantic->closed, 1);
+    }
+}
+
+static void llm_semantic_save(LLMSemantic *semantic)
+{
+    if (!semantic->vectors_path || !llm_vectors_dirty(semantic->vectors)) {
+        return;
+    }
+
+    GError *error = NULL;
+    if (!llm_vectors_save(semantic->vectors, semantic->vectors_path, &error)) {
+        g_print("Error writing %s: %s\n", semantic->vectors_path, error->message);
+        g_error_free(error);
+    }
+}
+
+/// @brief Byte range of lines first to last of a text
+/// @return FALSE if the text has fewer lines
+static gboolean llm_semantic_line_range(const gchar *text, gsize length, guint first, guint last,
+    gsize *start, gsize *end)
+{
+    gsize pos = 0;
+    for (guint line = 0; line < first && pos < length; line++) {
+        const gchar *newline = memchr(text + pos, '\n', length - pos);
+        pos = newline ? (gsize)(newline - text) + 1 : length;
+    }
+    if (pos >= length) {
+        return FALSE;
+    }
+
+    *start = pos;
+    for (guint line = first; line <= last && pos < length; line++) {
+        const gchar *newline = memchr(text + pos, '\n', length - pos);
+        pos = newline ? (gsize)(newline - text) + 1 : length;
+    }
+    *end = pos;
+    return TRUE;
+}
+
+/// @brief The lines of a chunk, NULL if the file changed since it was cut
+static gchar *llm_semantic_read(const LLMSemanticLocation *location)
+{
+    GMappedFile *mapped = g_mapped_file_new(location->path, FALSE, NULL);
+    if (!mapped) {
+        return NULL;
+    }
+
+    const gchar *text = g_mapped_file_get_contents(mapped);
+    gsize length = text ? g_mapped_file_get_length(mapped) : 0;
+    gsize start, end;
+    gchar *lines = NULL;
+    if (llm_semantic_line_range(text, length, location->chunk.first_line, location->chunk.last_line,
+            &start, &end) &&
+        llm_vectors_key(text + start, end - start) == location->chunk.key) {
+        lines = g_strndup(text + start, end - start);
+    }
+    g_mapped_file_unref(mapped);
+    return lines;
+}
+
+static gboolean llm_semantic_blank(const gchar *line, gsize length)
+{
+    for (gsize i = 0; i < length; i++) {
+        if (!g_ascii_isspace(line[i])) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/// @brief Cut a text into chunks at the blank lines before top-level code,
+/// so a chunk mostly holds whole definitions; chunks of blank lines are left out
+static GArray *llm_semantic_chunk(const gchar *text, gsize length)
+{
+    GArray *chunks = g_array_new(FALSE, FALSE, sizeof(LLMSemanticChunk));
+    guint line = 0, first = 0;
+    gsize start = 0, pos = 0;
+    gboolean after_blank = FALSE, content = FALSE;
+
+    while (pos <= length) {
+        gboolean at_end = pos == length;
+        const gchar *newline = at_end ? NULL : memchr(text + pos, '\n', length - pos);
+        gsize end = newline ? (gsize)(newline - text) + 1 : length;
+        gboolean blank = at_end || llm_semantic_blank(text + pos, end - pos);
+        // Top-level code starts in the first column, a closing brace only ends a block
+        gboolean boundary = after_blank && !blank && !g_ascii_isspace(text[pos]) && text[pos] != '}';
+        guint lines = line - first;
+
+        if (content && (at_end || (lines >= LLM_SEMANTIC_MIN_CHUNK_LINES && boundary) ||
+                        lines >= LLM_SEMANTIC_MAX_CHUNK_LINES)) {
+            LLMSemanticChunk chunk = { llm_vectors_key(text + start, pos - start), first, line - 1 };
+            g_array_append_val(chunks, chunk);
+            first = line;
+            start = pos;
+            content = FALSE;
+        }
+        if (at_end) {
+            break;
+        }
+        if (!content && blank) {
+            // Leading blank lines belong to no chunk
+            first = line + 1;
+            start = end;
+        }
+        content |= !blank;
+        after_blank = blank;
+        pos = end;
+        line++;
+    }
+    return chunks;
+}
+
+/// @brief Queue a chunk unless its vector is known or it is queued already
+static void llm_semantic_queue_locked(LLMSemantic *semantic, const gchar *path, const LLMSemanticChunk *chunk)
+{
+    if (g_hash_table_contains(semantic->pending_keys, &chunk->key) ||
+        llm_vectors_contains(semantic->vectors, chunk->key)) {
+        return;
+    }
+
+    guint64 *key = g_new(guint64, 1);
+    *key = chunk->key;
+    g_hash_table_add(semantic->pending_keys, key);
+    g_queue_push_tail(&semantic->pending, llm_semantic_location_new(path, chunk));
+}
+
+void llm_semantic_update_file(LLMSemantic *semantic, const gchar *path)
+{
+    GStatBuf st;
+    if (g_stat(path, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size > LLM_INDEX_MAX_FILE_BYTES) {
+        llm_semantic_remove_file(semantic, path);
+        return;
+    }
+
+    g_mutex_lock(&semantic->lock);
+    LLMSemanticFile *file = g_hash_table_lookup(semantic->files, path);
+    gboolean current = file && file->mtime == st.st_mtime && file->size == st.st_size;
+    g_mutex_unlock(&semantic->lock);
+    if (current) {
+        return;
+    }
+
+    GMappedFile *mapped = g_mapped_file_new(path, FALSE, NULL);
+    if (!mapped) {
+        llm_semantic_remove_file(semantic, path);
+        return;
+    }
+    // Empty files map to NULL
+    const gchar *text = g_mapped_file_get_contents(mapped);
+    gsize length = text ? g_mapped_file_get_length(mapped) : 0;
+    if (length > 0 && memchr(text, '\0', MIN(length, LLM_SEMANTIC_BINARY_PROBE))) {
+        g_mapped_file_unref(mapped);
+        llm_semantic_remove_file(semantic, path);
+        return;
+    }
+    GArray *chunks = llm_semantic_chunk(text, length);
+    g_mapped_file_unref(mapped);
+
+    g_mutex_lock(&semantic->lock);
+    file = g_hash_table_lookup(semantic->files, path);
+    if (!file) {
+        file = g_new0(LLMSemanticFile, 1);
+        g_hash_table_insert(semantic->files, g_strdup(path), file);
+    } else {
+        g_array_free(file->chunks, TRUE);
+    }
+    file->mtime = st.st_mtime;
+    file->size = st.st_size;
+    file->chunks = chunks;
+    // Only chunks whose text is new, the rest keep their vectors
+    for (guint i = 0; i < chunks->len; i++) {
+        llm_semantic_queue_locked(semantic, path, &g_array_index(chunks, LLMSemanticChunk, i));
+    }
+    g_mutex_unlock(&semantic->lock);
+}
+
+void llm_semantic_remove_file(LLMSemantic *semantic, const gchar *path)
+{
+    // Its queued chunks no longer read back and are dropped then
+    g_mutex_lock(&semantic->lock);
+    g_hash_table_remove(semantic->files, path);
+    g_mutex_unlock(&semantic->lock);
+}
+
+void llm_semantic_retain(LLMSemantic *semantic, GPtrArray *paths)
+{
+    GHashTable *found = g_hash_table_new(g_str_hash, g_str_equal);
+    for (guint i = 0; i < paths->len; i++) {
+        g_hash_table_add(found, g_ptr_array_index(paths, i));
+    }
+    GHashTable *keep = g_hash_table_new(g_int64_hash, g_int64_equal);
+
+    g_mutex_lock(&semantic->lock);
+    GHashTableIter iter;
+    gpointer path, value;
+    g_hash_table_iter_init(&iter, semantic->files);
+    while (g_hash_table_iter_next(&iter, &path, &value)) {
+        if (!g_hash_table_contains(found, path)) {
+            g_hash_table_iter_remove(&iter);
+            continue;
+        }
+        GArray *chunks = ((LLMSemanticFile *)value)->chunks;
+        for (guint i = 0; i < chunks->len; i++) {
+            g_hash_table_add(keep, &g_array_index(chunks, LLMSemanticChunk, i).key);
+        }
+    }
+    llm_vectors_retain(semantic->vectors, keep);
+    g_mutex_unlock(&semantic->lock);
+
+    g_hash_table_destroy(keep);
+    g_hash_table_destroy(found);
+    llm_semantic_save(semantic);
+}
+
+/// @brief The embedding model's vectors changed length: drop them all and
+/// queue every chunk again
+static void llm_semantic_reset(LLMSemantic *semantic)
+{
+    GHashTable *none = g_hash_table_new(g_int64_hash, g_int64_equal);
+
+    g_mutex_lock(&semantic->lock);
+    llm_vectors_retain(semantic->vectors, none);
+    GHashTableIter iter;
+    gpointer path, value;
+    g_hash_table_iter_init(&iter, semantic->files);
+    while (g_hash_table_iter_next(&iter, &path, &value)) {
+        GArray *chunks = ((LLMSemanticFile *)value)->chunks;
+        for (guint i = 0; i < chunks->len; i++) {
+            llm_semantic_queue_locked(semantic, path, &g_array_index(chunks, LLMSemanticChunk, i));
+        }
+    }
+    g_mutex_unlock(&semantic->lock);
+
+    g_hash_table_destroy(none);
+    g_print("The embeddings changed length, embedding %s again\n", semantic->base_dir);
+}
+
+/// @brief Embed texts with the first background server that answers, blocking
+/// @return count * dimension floats, NULL on failure
+static gfloat *llm_semantic_request(LLMSemantic *semantic, const gchar * const *texts, guint count,
+    glong timeout_sec, gboolean *cancel_flag, guint *dimension)
+{
+    LLMPlugin *plugin = semantic->plugin;
+    LLMEndpointSet *endpoints = llm_task_endpoints(plugin, LLM_TASK_BACKGROUND);
+    GPtrArray *tried = g_ptr_array_new_with_free_func((GDestroyNotify)llm_endpoint_unref);
+    gchar *json_payload = llm_construct_embeddings_json_payload(semantic->model, texts, count);
+    GString *body = g_string_new(NULL);
+    gfloat *vectors = NULL;
+    gboolean missing = TRUE;
+    LLMEndpoint *endpoint;
+
+    while (!vectors && !LLM_CANCELLED(cancel_flag) &&
+           (endpoint = llm_endpoints_acquire(endpoints, tried)) != NULL) {
+        g_ptr_array_add(tried, llm_endpoint_ref(endpoint));
+
+        gchar *server_uri = llm_construct_server_uri_string(endpoint->url, "/v1/embeddings");
+        glong http_code = server_uri ? llm_http_fetch_full(server_uri, plugin->proxy_url, plugin->api_key,
+            json_payload, cancel_flag, timeout_sec, LLM_SEMANTIC_MAX_RESPONSE_BYTES, body) : 0;
+        if (http_code == 200) {
+            vectors = llm_json_to_embeddings(body->str, count, dimension);
+        }
+        // llama-server answers 501 unless it runs with --embeddings
+        missing &= http_code == 404 || http_code == 501;
+        g_free(server_uri);
+
+        // Embeddings say nothing about the latency of chat answers
+        llm_endpoint_release(endpoints, endpoint, NULL, NULL);
+    }
+
+    if (!vectors && missing && tried->len > 0 &&
+        g_atomic_int_compare_and_exchange(&semantic->unsupported, 0, 1)) {
+        g_print("No server answers /v1/embeddings, code is not found by meaning\n");
+    }
+
+    g_string_free(body, TRUE);
+    g_free(json_payload);
+    g_ptr_array_free(tried, TRUE);
+    return vectors;
+}
+
+/// @brief Take up to count chunks off the queue, they stay in pending_keys
+static GPtrArray *llm_semantic_take(LLMSemantic *semantic, guint count)
+{
+    GPtrArray *batch = g_ptr_array_new();
+    g_mutex_lock(&semantic->lock);
+    while (batch->len < count && !g_queue_is_empty(&semantic->pending)) {
+        g_ptr_array_add(batch, g_queue_pop_head(&semantic->pending));
+    }
+    g_mutex_unlock(&semantic->lock);
+    return batch;
+}
+
+/// @brief Done with a batch: forget its keys, or queue it again first
+static void llm_semantic_finish(LLMSemantic *semantic, GPtrArray *batch, gboolean done, guint embedded)
+{
+    g_mutex_lock(&semantic->lock);
+    for (guint i = batch->len; i-- > 0;) {
+        LLMSemanticLocation *location = g_ptr_array_index(batch, i);
+        if (done) {
+            g_hash_table_remove(semantic->pending_keys, &location->chunk.key);
+            llm_semantic_location_free(location);
+        } else {
+            g_queue_push_head(&semantic->pending, location);
+        }
+    }
+    semantic->embedded += embedded;
+    g_mutex_unlock(&semantic->lock);
+    g_ptr_array_free(batch, TRUE);
+}
+
+/// @brief Scheduler job embedding the queued chunks batch by batch
+static void llm_semantic_embed_thread_func(LLMJob *job, gpointer data)
+{
+    LLMSemantic *semantic = (LLMSemantic *)data;
+    gint64 start = g_get_monotonic_time();
+    gint64 trace_start = llm_trace_begin();
+    guint batches = 0, embedded = 0;
+
+    while (!g_atomic_int_get(&job->cancel_flag) && !g_atomic_int_get(&semantic->closed) &&
+           !g_atomic_int_get(&semantic->unsupported)) {
+        GPtrArray *batch = llm_semantic_take(semantic, LLM_SEMANTIC_BATCH);
+        if (batch->len == 0) {
+            g_ptr_array_free(batch, TRUE);
+            break;
+        }
+
+        GPtrArray *texts = g_ptr_array_new_with_free_func(g_free);
+        GArray *keys = g_array_new(FALSE, FALSE, sizeof(guint64));
+        for (guint i = 0; i < batch->len; i++) {
+            LLMSemanticLocation *location = g_ptr_array_index(batch, i);
+            gchar *text = llm_semantic_read(location);
+            if (text) {
+                g_ptr_array_add(texts, text);
+                g_array_append_val(keys, location->chunk.key);
+            }
+        }
+
+        gboolean done = TRUE;
+        if (texts->len > 0) {
+            guint dimension = 0;
+            gfloat *vectors = llm_semantic_request(semantic, (const gchar * const *)texts->pdata, texts->len,
+                LLM_SEMANTIC_TIMEOUT_SEC, &job->cancel_flag, &dimension);
+            for (guint i = 0; vectors && i < keys->len; i++) {
+                guint64 key = g_array_index(keys, guint64, i);
+                if (!llm_vectors_add(semantic->vectors, key, vectors + (gsize)i * dimension, dimension)) {
+                    llm_semantic_reset(semantic);
+                    llm_vectors_add(semantic->vectors, key, vectors + (gsize)i * dimension, dimension);
+                }
+            }
+            // Cancelled or failed, the next job tries again
+            done = vectors != NULL;
+            g_free(vectors);
+        }
+
+        guint batch_embedded = done ? keys->len : 0;
+        embedded += batch_embedded;
+        llm_semantic_finish(semantic, batch, done, batch_embedded);
+        g_array_free(keys, TRUE);
+        g_ptr_array_free(texts, TRUE);
+        if (!done) {
+            break;
+        }
+        if (++batches % LLM_SEMANTIC_SAVE_BATCHES == 0) {
+            llm_semantic_save(semantic);
+        }
+    }
+
+    llm_semantic_save(semantic);
+    if (embedded > 0) {
+        g_print("Embedded %u chunks of %s in %.1f s\n", embedded, semantic->base_dir,
+            (g_get_monotonic_time() - start) / (gdouble)G_USEC_PER_SEC);
+    }
+    llm_trace_end("embed_job", "worker", trace_start);
+}
+
+static void llm_semantic_embed_free(gpointer data)
+{
+    LLMSemantic *semantic = (LLMSemantic *)data;
+    g_atomic_int_set(&semantic->embedding, 0);
+    llm_semantic_unref(semantic);
+}
+
+void llm_semantic_embed(LLMSemantic *semantic)
+{
+    LLMPlugin *plugin = semantic->plugin;
+    if (g_atomic_int_get(&semantic->closed) || g_atomic_int_get(&semantic->unsupported) || !plugin->scheduler) {
+        return;
+    }
+
+    g_mutex_lock(&semantic->lock);
+    gboolean empty = g_queue_is_empty(&semantic->pending);
+    g_mutex_unlock(&semantic->lock);
+    if (empty || !g_atomic_int_compare_and_exchange(&semantic->embedding, 0, 1)) {
+        return;
+    }
+
+    llm_scheduler_submit(plugin->scheduler, LLM_PRIORITY_BACKGROUND, llm_semantic_embed_thread_func,
+        llm_semantic_ref(semantic), llm_semantic_embed_free);
+}
+
+/// @brief TRUE if any of the documents holds lines of the chunk
+static gboolean llm_semantic_included(const GPtrArray *documents, const LLMSemanticLocation *location)
+{
+    for (guint i = 0; documents && i < documents->len; i++) {
+        if (llm_document_overlaps(g_ptr_array_index(documents, i), location->path,
+                location->chunk.first_line, location->chunk.last_line)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/// @brief Path of a file relative to the directory indexed, if it is below it
+static const gchar *llm_semantic_shown_path(LLMSemantic *semantic, const gchar *path)
+{
+    gsize length = strlen(semantic->base_dir);
+    if (strncmp(path, semantic->base_dir, length) != 0 ||
+        !(G_IS_DIR_SEPARATOR(path[length]) || (length > 0 && G_IS_DIR_SEPARATOR(semantic->base_dir[length - 1])))) {
+        return path;
+    }
+    path += length;
+    while (G_IS_DIR_SEPARATOR(*path)) {
+        path++;
+    }
+    return path;
+}
+
+GPtrArray *llm_semantic_collect(LLMSemantic *semantic, const gchar *question,
+    const GPtrArray *documents, guint max_chunks, gboolean *cancel_flag)
+{
+    GPtrArray *found = g_ptr_array_new_with_free_func(llm_document_free);
+    if (!question || !*question || max_chunks == 0 || g_atomic_int_get(&semantic->unsupported) ||
+        llm_vectors_count(semantic->vectors) == 0) {
+        return found;
+    }
+
+    gint64 start = g_get_monotonic_time();
+    guint dimension = 0;
+    gfloat *query = llm_semantic_request(semantic, &question, 1, LLM_SEMANTIC_QUERY_TIMEOUT_SEC,
+        cancel_flag, &dimension);
+    if (!query) {
+        return found;
+    }
+    GArray *hits = llm_vectors_search(semantic->vectors, query, dimension, max_chunks * LLM_SEMANTIC_SEARCH_FACTOR);
+    g_free(query);
+
+    // Where the hits are, the first copy of a text does
+    GHashTable *locations = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, llm_semantic_location_free);
+    for (guint i = 0; i < hits->len; i++) {
+        g_hash_table_insert(locations, &g_array_index(hits, LLMVectorHit, i).key, NULL);
+    }
+    g_mutex_lock(&semantic->lock);
+    GHashTableIter iter;
+    gpointer path, value;
+    g_hash_table_iter_init(&iter, semantic->files);
+    while (g_hash_table_iter_next(&iter, &path, &value)) {
+        GArray *chunks = ((LLMSemanticFile *)value)->chunks;
+        for (guint i = 0; i < chunks->len; i++) {
+            LLMSemanticChunk *chunk = &g_array_index(chunks, LLMSemanticChunk, i);
+            gpointer location;
+            if (g_hash_table_lookup_extended(locations, &chunk->key, NULL, &location) && !location) {
+                // Keeps the key of the hit
+                g_hash_table_insert(locations, &chunk->key, llm_semantic_location_new(path, chunk));
+            }
+        }
+    }
+    g_mutex_unlock(&semantic->lock);
+
+    for (guint i = 0; i < hits->len && found->len < max_chunks; i++) {
+        LLMSemanticLocation *location = g_hash_table_lookup(locations, &g_array_index(hits, LLMVectorHit, i).key);
+        if (!location || llm_semantic_included(documents, location) || llm_semantic_included(found, location)) {
+            continue;
+        }
+        gchar *text = llm_semantic_read(location);
+        if (!text) {
+            continue;
+        }
+
+        gchar *name = g_strdup_printf("%s:%u-%u (similar to the question)",
+            llm_semantic_shown_path(semantic, location->path),
+            location->chunk.first_line + 1, location->chunk.last_line + 1);
+        LLMDocument *document = llm_document_new(name, text);
+        llm_document_set_source(document, location->path, location->chunk.first_line, location->chunk.last_line);
+        g_ptr_array_add(found, document);
+        g_free(name);
+    }
+    g_hash_table_destroy(locations);
+    g_array_unref(hits);
+
+    g_print("Added %u similar chunks of %s in %.1f ms\n", found->len, semantic->base_dir,
+        (g_get_monotonic_time() - start) / 1000.0);
+    return found;
+}
+
+void llm_semantic_describe(LLMSemantic *semantic, GString *out)
+{
+    llm_vectors_describe(semantic->vectors, out);
+
+    g_mutex_lock(&semantic->lock);
+    g_string_append_printf(out, "%u files in chunks, %u chunks waiting to be embedded, %u embedded this session\n",
+        g_hash_table_size(semantic->files), g_queue_get_length(&semantic->pending), semantic->embedded);
+    g_mutex_unlock(&semantic->lock);
+
+    if (g_atomic_int_get(&semantic->unsupported)) {
+        g_string_append(out, "No server answers /v1/embeddings, llama-server needs --embeddings\n");
+    }
+}
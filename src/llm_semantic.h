@@ -0,0 +1,68 @@
+#ifndef __LLM_SEMANTIC_H__
+#define __LLM_SEMANTIC_H__
+
+#include "plugin.h"
+#include "llm_vectors.h"
+
+/**
+ * Retrieval of project code by meaning. The files of a project index are
+ * cut into chunks at the blank lines before top-level code, and the chunks
+ * are embedded in batches through the /v1/embeddings endpoint of the
+ * background servers by a background job. The vectors are kept in an
+ * LLMVectorStore in the plugin's cache directory, keyed by the hash of the
+ * chunk's text: a changed file only has its changed chunks embedded again,
+ * a moved one none.
+ *
+ * A question is embedded on the worker thread of its request, and the
+ * chunks most similar to it are added to its context, also those sharing
+ * no word with it.
+ */
+
+/// @brief Chunks are cut at a blank line once they have this many lines
+#define LLM_SEMANTIC_MIN_CHUNK_LINES 8
+#define LLM_SEMANTIC_MAX_CHUNK_LINES 60
+/// @brief Chunks per embeddings request
+#define LLM_SEMANTIC_BATCH 16
+/// @brief The vectors are written after this many batches, and when a job ends
+#define LLM_SEMANTIC_SAVE_BATCHES 20
+#define LLM_SEMANTIC_TIMEOUT_SEC 120
+/// @brief Embedding the question delays the answer at most this long
+#define LLM_SEMANTIC_QUERY_TIMEOUT_SEC 10
+#define LLM_SEMANTIC_MAX_RESPONSE_BYTES (16 * 1024 * 1024)
+
+typedef struct LLMSemantic LLMSemantic;
+
+/// @brief Start from the vectors the last session left for a directory (main thread)
+/// @param vectors_path file of the vectors, NULL to keep them in memory
+LLMSemantic *llm_semantic_new(LLMPlugin *plugin, const gchar *base_dir, const gchar *vectors_path);
+
+LLMSemantic *llm_semantic_ref(LLMSemantic *semantic);
+
+void llm_semantic_unref(LLMSemantic *semantic);
+
+/// @brief Stop embedding, a job running finishes its batch and saves
+void llm_semantic_close(LLMSemantic *semantic);
+
+/// @brief Chunk a file again if it changed and queue its new chunks (worker thread)
+void llm_semantic_update_file(LLMSemantic *semantic, const gchar *path);
+
+void llm_semantic_remove_file(LLMSemantic *semantic, const gchar *path);
+
+/// @brief After a complete scan: drop the files not in paths and the vectors
+/// of chunks that are gone
+void llm_semantic_retain(LLMSemantic *semantic, GPtrArray *paths);
+
+/// @brief Submit a job embedding the queued chunks, unless one runs already
+void llm_semantic_embed(LLMSemantic *semantic);
+
+/// @brief The chunks most similar to a question, blocking (worker thread)
+/// @param documents context so far, chunks overlapping it are skipped
+/// @param cancel_flag aborts embedding the question when set, may be NULL
+/// @return new LLMDocument*, free with g_ptr_array_unref()
+GPtrArray *llm_semantic_collect(LLMSemantic *semantic, const gchar *question,
+    const GPtrArray *documents, guint max_chunks, gboolean *cancel_flag);
+
+/// @brief Append the state of the vectors and the queue to out
+void llm_semantic_describe(LLMSemantic *semantic, GString *out);
+
+#endif // __LLM_SEMANTIC_H__
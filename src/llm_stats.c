@@ -0,0 +1,230 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include "llm_stats.h"
+
+/// @brief Ring buffer of the most recent samples of one statistic
+typedef struct {
+    gdouble samples[LLM_STATS_WINDOW];
+    guint count;
+    guint next;
+} LLMStatWindow;
+
+struct LLMStats {
+    LLMStatWindow windows[LLM_STAT_COUNT];
+    guint requests;
+};
+
+static const gchar *llm_stat_names[LLM_STAT_COUNT] = {
+    "Prepare (ms)",
+    "Connect (ms)",
+    "First byte (ms)",
+    "Time to first token (ms)",
+    "Prefill (tokens/s)",
+    "Decode (tokens/s)",
+    "UI flush (ms)",
+    "Total (ms)"
+};
+
+static gdouble llm_usec_to_ms(gint64 from, gint64 to)
+{
+    return (to - from) / 1000.0;
+}
+
+/// @brief Value of a statistic for one request
+/// @return FALSE if the request does not have it, e.g. no server timings
+static gboolean llm_stats_value(const LLMRequestMetrics *metrics, LLMStat stat, gdouble *value)
+{
+    const LLMTransfer *transfer = &metrics->transfer;
+
+    switch (stat) {
+        case LLM_STAT_PREPARE:
+            if (!metrics->payload_time) {
+                return FALSE;
+            }
+            *value = llm_usec_to_ms(metrics->submit_time, metrics->payload_time);
+            return TRUE;
+        case LLM_STAT_CONNECT:
+            if (!transfer->connect_time) {
+                return FALSE;
+            }
+            *value = llm_usec_to_ms(transfer->start_time, transfer->connect_time);
+            return TRUE;
+        case LLM_STAT_FIRST_BYTE:
+            if (!transfer->first_byte_time) {
+                return FALSE;
+            }
+            *value = llm_usec_to_ms(transfer->start_time, transfer->first_byte_time);
+            return TRUE;
+        case LLM_STAT_TTFT:
+            if (!transfer->first_token_time) {
+                return FALSE;
+            }
+            *value = llm_usec_to_ms(metrics->submit_time, transfer->first_token_time);
+            return TRUE;
+        case LLM_STAT_PREFILL_RATE:
+            if (!transfer->server.valid || transfer->server.prompt_ms <= 0) {
+                return FALSE;
+            }
+            *value = transfer->server.prompt_n * 1000.0 / transfer->server.prompt_ms;
+            return TRUE;
+        case LLM_STAT_DECODE_RATE:
+            if (transfer->server.valid && transfer->server.predicted_per_second > 0) {
+                *value = transfer->server.predicted_per_second;
+                return TRUE;
+            }
+            // The first chunk arrives after prefill, count the ones after it
+            if (transfer->chunks < 2 || transfer->last_token_time <= transfer->first_token_time) {
+                return FALSE;
+            }
+            *value = (transfer->chunks - 1) * (gdouble)G_USEC_PER_SEC /
+                (transfer->last_token_time - transfer->first_token_time);
+            return TRUE;
+        case LLM_STAT_UI_FLUSH:
+            if (!metrics->ui_flush_time || !transfer->last_token_time) {
+                return FALSE;
+            }
+            *value = llm_usec_to_ms(transfer->last_token_time, metrics->ui_flush_time);
+            return TRUE;
+        case LLM_STAT_TOTAL:
+            if (!metrics->ui_flush_time) {
+                return FALSE;
+            }
+            *value = llm_usec_to_ms(metrics->submit_time, metrics->ui_flush_time);
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+LLMStats *llm_stats_new(void)
+{
+    return g_new0(LLMStats, 1);
+}
+
+void llm_stats_free(LLMStats *stats)
+{
+    g_free(stats);
+}
+
+void llm_stats_record(LLMStats *stats, const LLMRequestMetrics *metrics)
+{
+    if (!stats || !metrics) {
+        return;
+    }
+
+    for (gint stat = 0; stat < LLM_STAT_COUNT; stat++) {
+        gdouble value;
+        if (!llm_stats_value(metrics, stat, &value)) {
+            continue;
+        }
+        LLMStatWindow *window = &stats->windows[stat];
+        window->samples[window->next] = value;
+        window->next = (window->next + 1) % LLM_STATS_WINDOW;
+        window->count = MIN(window->count + 1, LLM_STATS_WINDOW);
+    }
+    stats->requests++;
+}
+
+guint llm_stats_requests(LLMStats *stats)
+{
+    return stats ? stats->requests : 0;
+}
+
+static int llm_compare_doubles(const void *a, const void *b)
+{
+    gdouble x = *(const gdouble *)a, y = *(const gdouble *)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/// @brief Nearest-rank percentile of sorted samples
+static gdouble llm_percentile(const gdouble *sorted, guint count, gdouble p)
+{
+    guint rank = (guint)(p / 100.0 * count + 0.5);
+    return sorted[CLAMP(rank, 1, count) - 1];
+}
+
+gdouble llm_stats_median(LLMStats *stats, LLMStat stat)
+{
+    if (!stats || stats->windows[stat].count == 0) {
+        return 0.0;
+    }
+
+    gdouble sorted[LLM_STATS_WINDOW];
+    guint count = stats->windows[stat].count;
+    memcpy(sorted, stats->windows[stat].samples, count * sizeof(gdouble));
+    qsort(sorted, count, sizeof(gdouble), llm_compare_doubles);
+    return llm_percentile(sorted, count, 50);
+}
+
+static void llm_stats_describe_window(const LLMStatWindow *window, const gchar *name, GString *out)
+{
+    gdouble sorted[LLM_STATS_WINDOW];
+    guint count = window->count;
+
+    memcpy(sorted, window->samples, count * sizeof(gdouble));
+    qsort(sorted, count, sizeof(gdouble), llm_compare_doubles);
+
+    gdouble min = sorted[0], max = sorted[count - 1];
+    g_string_append_printf(out, "%s: n=%u  p50=%.1f  p90=%.1f  p99=%.1f  min=%.1f  max=%.1f\n",
+        name, count, llm_percentile(sorted, count, 50), llm_percentile(sorted, count, 90),
+        llm_percentile(sorted, count, 99), min, max);
+
+    if (max <= min) {
+        g_string_append(out, "\n");
+        return;
+    }
+
+    guint buckets[LLM_STATS_HISTOGRAM_BUCKETS] = {0};
+    guint peak = 0;
+    gdouble width = (max - min) / LLM_STATS_HISTOGRAM_BUCKETS;
+    for (guint i = 0; i < count; i++) {
+        guint bucket = MIN((guint)((sorted[i] - min) / width), LLM_STATS_HISTOGRAM_BUCKETS - 1);
+        buckets[bucket]++;
+        peak = MAX(peak, buckets[bucket]);
+    }
+
+    for (guint i = 0; i < LLM_STATS_HISTOGRAM_BUCKETS; i++) {
+        guint bar = (buckets[i] * LLM_STATS_HISTOGRAM_WIDTH + peak - 1) / peak;
+        g_string_append_printf(out, "  %10.1f | ", min + i * width);
+        for (guint j = 0; j < bar; j++) {
+            g_string_append_c(out, '#');
+        }
+        g_string_append_printf(out, " %u\n", buckets[i]);
+    }
+    g_string_append(out, "\n");
+}
+
+void llm_stats_describe(LLMStats *stats, GString *out)
+{
+    if (!stats || stats->requests == 0) {
+        g_string_append(out, "No finished requests yet.\n");
+        return;
+    }
+
+    g_string_append_printf(out, "Last %u of %u requests\n\n",
+        MIN(stats->requests, LLM_STATS_WINDOW), stats->requests);
+    for (gint stat = 0; stat < LLM_STAT_COUNT; stat++) {
+        if (stats->windows[stat].count > 0) {
+            llm_stats_describe_window(&stats->windows[stat], llm_stat_names[stat], out);
+        }
+    }
+}
+
+gchar *llm_stats_readout(const LLMRequestMetrics *metrics)
+{
+    GString *readout = g_string_new(NULL);
+    gdouble value;
+
+    if (llm_stats_value(metrics, LLM_STAT_TTFT, &value)) {
+        g_string_append_printf(readout, "TTFT %.2f s", value / 1000.0);
+    }
+    if (llm_stats_value(metrics, LLM_STAT_DECODE_RATE, &value)) {
+        g_string_append_printf(readout, "%s%.1f tok/s", readout->len ? ", " : "", value);
+    }
+    if (llm_stats_value(metrics, LLM_STAT_PREFILL_RATE, &value)) {
+        g_string_append_printf(readout, "%sprefill %.0f tok/s", readout->len ? ", " : "", value);
+    }
+
+    return g_string_free(readout, FALSE);
+}
@@ -0,0 +1,49 @@
+#ifndef __LLM_STATS_H__
+#define __LLM_STATS_H__
+
+#include "llm_types.h"
+
+/**
+ * Request latency and throughput statistics.
+ *
+ * Every finished chat request contributes its lifecycle timings, so a slow
+ * answer can be attributed to preparation, the network, prefill or decoding.
+ * Only the last LLM_STATS_WINDOW requests are kept. Main thread only.
+ */
+
+#define LLM_STATS_WINDOW 256
+#define LLM_STATS_HISTOGRAM_BUCKETS 10
+#define LLM_STATS_HISTOGRAM_WIDTH 40
+
+typedef enum {
+    LLM_STAT_PREPARE,       // Send clicked to payload built: snapshot, queueing, summaries
+    LLM_STAT_CONNECT,       // Request sent to connection established
+    LLM_STAT_FIRST_BYTE,    // Request sent to the first response byte
+    LLM_STAT_TTFT,          // Send clicked to the first token
+    LLM_STAT_PREFILL_RATE,  // Prompt tokens per second, as reported by the server
+    LLM_STAT_DECODE_RATE,   // Generated tokens per second
+    LLM_STAT_UI_FLUSH,      // Last token received to last chunk shown
+    LLM_STAT_TOTAL,         // Send clicked to last chunk shown
+    LLM_STAT_COUNT
+} LLMStat;
+
+LLMStats *llm_stats_new(void);
+
+void llm_stats_free(LLMStats *stats);
+
+/// @brief Add a finished request
+void llm_stats_record(LLMStats *stats, const LLMRequestMetrics *metrics);
+
+/// @brief Number of requests recorded since start
+guint llm_stats_requests(LLMStats *stats);
+
+/// @brief Median of the recent values of a statistic, 0 if none was recorded
+gdouble llm_stats_median(LLMStats *stats, LLMStat stat);
+
+/// @brief Percentiles and a histogram of every statistic
+void llm_stats_describe(LLMStats *stats, GString *out);
+
+/// @brief Compact "TTFT / tok/s" readout of one request
+gchar *llm_stats_readout(const LLMRequestMetrics *metrics);
+
+#endif // __LLM_STATS_H__
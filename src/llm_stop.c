@@ -0,0 +1,163 @@
+#include <string.h>
+
+#include "llm_stop.h"
+
+struct LLMStopMatcher {
+    LLMStopRules rules;
+    GString *line;          // Current line, up to the next newline
+    guint lines;            // Complete lines so far
+    gchar fence_char;       // Fence of the open code block, 0 outside of one
+    gsize fence_length;
+    GPtrArray *recent;      // Last non-blank lines, stripped, oldest first
+    const gchar *reason;
+};
+
+LLMStopMatcher *llm_stop_matcher_new(const LLMStopRules *rules)
+{
+    if (!rules || (!rules->code_block && rules->max_lines == 0 && !rules->repetition)) {
+        return NULL;
+    }
+
+    LLMStopMatcher *matcher = g_new0(LLMStopMatcher, 1);
+    matcher->rules = *rules;
+    matcher->line = g_string_new(NULL);
+    matcher->recent = g_ptr_array_new_with_free_func(g_free);
+    return matcher;
+}
+
+void llm_stop_matcher_free(LLMStopMatcher *matcher)
+{
+    if (!matcher) {
+        return;
+    }
+
+    g_string_free(matcher->line, TRUE);
+    g_ptr_array_free(matcher->recent, TRUE);
+    g_free(matcher);
+}
+
+/// @brief Track Markdown code fences
+/// @return TRUE when the line closes a block
+static gboolean llm_stop_fence_line(LLMStopMatcher *matcher, const gchar *line)
+{
+    // Up to three spaces of indentation, like Markdown
+    gint indent = 0;
+    while (indent < 3 && line[indent] == ' ') {
+        indent++;
+    }
+
+    gchar fence_char = line[indent];
+    if (fence_char != '`' && fence_char != '~') {
+        return FALSE;
+    }
+    gsize length = 0;
+    while (line[indent + length] == fence_char) {
+        length++;
+    }
+    if (length < 3) {
+        return FALSE;
+    }
+
+    if (!matcher->fence_char) {
+        // Opening fence, may be followed by the language
+        matcher->fence_char = fence_char;
+        matcher->fence_length = length;
+        return FALSE;
+    }
+    if (fence_char != matcher->fence_char || length < matcher->fence_length) {
+        return FALSE;
+    }
+    // A closing fence has nothing after it
+    for (const gchar *rest = line + indent + length; *rest; rest++) {
+        if (!g_ascii_isspace(*rest)) {
+            return FALSE;
+        }
+    }
+    matcher->fence_char = 0;
+    return TRUE;
+}
+
+/// @brief TRUE when the last lines are one group of lines several times over
+static gboolean llm_stop_repeats(LLMStopMatcher *matcher, const gchar *line)
+{
+    gchar *stripped = g_strstrip(g_strdup(line));
+    if (*stripped == '\0') {
+        // Blank lines separate the groups, they are not part of them
+        g_free(stripped);
+        return FALSE;
+    }
+
+    GPtrArray *recent = matcher->recent;
+    g_ptr_array_add(recent, stripped);
+    if (recent->len > LLM_STOP_REPEAT_MAX_LINES * LLM_STOP_REPEAT_COUNT) {
+        g_ptr_array_remove_index(recent, 0);
+    }
+
+    guint n = recent->len;
+    for (guint period = 1; period <= LLM_STOP_REPEAT_MAX_LINES && period * LLM_STOP_REPEAT_COUNT <= n; period++) {
+        gboolean repeated = TRUE;
+        gsize bytes = 0;
+        for (guint i = 0; i < period && repeated; i++) {
+            const gchar *last = g_ptr_array_index(recent, n - 1 - i);
+            bytes += strlen(last);
+            for (guint k = 1; k < LLM_STOP_REPEAT_COUNT && repeated; k++) {
+                repeated = strcmp(last, g_ptr_array_index(recent, n - 1 - i - k * period)) == 0;
+            }
+        }
+        if (repeated && bytes >= LLM_STOP_REPEAT_MIN_BYTES) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/// @brief Apply the rules to a complete line
+/// @return the rule that triggered, NULL if none did
+static const gchar *llm_stop_matcher_end_line(LLMStopMatcher *matcher)
+{
+    const gchar *line = matcher->line->str;
+    matcher->lines++;
+
+    if (matcher->rules.code_block && llm_stop_fence_line(matcher, line)) {
+        return "code block complete";
+    }
+    if (matcher->rules.max_lines > 0 && matcher->lines >= matcher->rules.max_lines) {
+        return "line limit reached";
+    }
+    if (matcher->rules.repetition && llm_stop_repeats(matcher, line)) {
+        return "output repeats";
+    }
+    return NULL;
+}
+
+gsize llm_stop_matcher_feed(LLMStopMatcher *matcher, const gchar *chunk, gsize length)
+{
+    if (!matcher) {
+        return length;
+    }
+    if (matcher->reason) {
+        return 0;
+    }
+
+    // Rules are only checked at line ends, the rest is kept for the next chunk
+    gsize start = 0;
+    const gchar *newline;
+    while ((newline = memchr(chunk + start, '\n', length - start)) != NULL) {
+        gsize end = (gsize)(newline - chunk);
+        g_string_append_len(matcher->line, chunk + start, end - start);
+        start = end + 1;
+
+        matcher->reason = llm_stop_matcher_end_line(matcher);
+        g_string_truncate(matcher->line, 0);
+        if (matcher->reason) {
+            return start;
+        }
+    }
+    g_string_append_len(matcher->line, chunk + start, length - start);
+    return length;
+}
+
+const gchar *llm_stop_matcher_reason(LLMStopMatcher *matcher)
+{
+    return matcher ? matcher->reason : NULL;
+}
@@ -0,0 +1,40 @@
+#ifndef __LLM_STOP_H__
+#define __LLM_STOP_H__
+
+#include "llm_types.h"
+
+/**
+ * Client-side stop rules. The server only knows stop strings; these rules
+ * look at the structure of the streamed answer and end it as soon as the
+ * part worth reading is complete, so the server slot is freed for the
+ * next request instead of generating text nobody reads.
+ *
+ * The matcher sees the answer chunk by chunk and says how much of each
+ * chunk to keep. Once a rule triggered, nothing more is kept.
+ */
+
+/// @brief Repeated groups of up to this many lines are detected
+#define LLM_STOP_REPEAT_MAX_LINES 8
+/// @brief A group must occur this many times in a row
+#define LLM_STOP_REPEAT_COUNT 3
+/// @brief Shorter groups are not repetition, e.g. closing braces
+#define LLM_STOP_REPEAT_MIN_BYTES 64
+
+typedef struct LLMStopMatcher LLMStopMatcher;
+
+/// @brief Create a matcher for the rules of a request
+/// @return NULL if no rule is set
+LLMStopMatcher *llm_stop_matcher_new(const LLMStopRules *rules);
+
+void llm_stop_matcher_free(LLMStopMatcher *matcher);
+
+/// @brief Check the next chunk of the answer
+/// @return the number of leading bytes of the chunk to keep: all of them
+/// while no rule triggered, those up to the end of the triggering line when
+/// one does, none afterwards
+gsize llm_stop_matcher_feed(LLMStopMatcher *matcher, const gchar *chunk, gsize length);
+
+/// @brief The rule that ended the answer, NULL while none did
+const gchar *llm_stop_matcher_reason(LLMStopMatcher *matcher);
+
+#endif // __LLM_STOP_H__
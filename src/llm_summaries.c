@@ -0,0 +1,461 @@
+#include <string.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#include "llm_summaries.h"
+#include "llm.h"
+#include "llm_index.h"
+#include "llm_json.h"
+#include "llm_probe.h"
+#include "llm_profiles.h"
+#include "llm_scheduler.h"
+#include "llm_trace.h"
+#include "llm_util.h"
+#include "settings.h"
+
+/// @brief A NUL byte in the first this many bytes makes a file binary
+#define LLM_SUMMARIES_BINARY_PROBE 4096
+
+typedef struct {
+    gint64 mtime;
+    gint64 size;
+    gchar *summary;
+} LLMSummariesFile;
+
+struct LLMSummaries {
+    gint ref_count;
+    gint closed;            // Atomic, set once the retrieval let go of it
+    gint running;           // Atomic, a job is queued or running
+    gint stale;             // Atomic, files may lack a current summary
+    LLMPlugin *plugin;
+    gchar *base_dir;
+    gchar *cache_dir;       // NULL without a cache directory
+    gint64 next_run;        // Main thread, monotonic time (us) a job may be submitted again
+
+    GMutex lock;            // Guards the fields below
+    GHashTable *files;      // Path -> LLMSummariesFile*
+    guint written;          // Summaries generated this session
+};
+
+/// @brief Data of a job, which may run again after preemption
+typedef struct {
+    LLMSummaries *summaries;    // Reference held
+    LLMArgs *args;              // Snapshot of the background settings
+    GPtrArray *paths;           // Files indexed
+} LLMSummariesJob;
+
+/// @brief Accumulates one streamed summary
+typedef struct {
+    GString *text;
+    gchar *error;
+} LLMSummariesRequest;
+
+static void llm_summaries_file_free(gpointer data)
+{
+    LLMSummariesFile *file = (LLMSummariesFile *)data;
+    g_free(file->summary);
+    g_free(file);
+}
+
+LLMSummaries *llm_summaries_new(LLMPlugin *plugin, const gchar *base_dir)
+{
+    LLMSummaries *summaries = g_new0(LLMSummaries, 1);
+    summaries->ref_count = 1;
+    summaries->stale = 1;
+    summaries->plugin = plugin;
+    summaries->base_dir = g_strdup(base_dir);
+    summaries->cache_dir = llm_plugin_data_dir(plugin, LLM_CACHE_DIR G_DIR_SEPARATOR_S LLM_SUMMARIES_CACHE_DIR);
+    g_mutex_init(&summaries->lock);
+    summaries->files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, llm_summaries_file_free);
+    return summaries;
+}
+
+LLMSummaries *llm_summaries_ref(LLMSummaries *summaries)
+{
+    g_atomic_int_inc(&summaries->ref_count);
+    return summaries;
+}
+
+void llm_summaries_unref(LLMSummaries *summaries)
+{
+    if (summaries && g_atomic_int_dec_and_test(&summaries->ref_count)) {
+        g_hash_table_destroy(summaries->files);
+        g_mutex_clear(&summaries->lock);
+        g_free(summaries->base_dir);
+        g_free(summaries->cache_dir);
+        g_free(summaries);
+    }
+}
+
+void llm_summaries_close(LLMSummaries *summaries)
+{
+    if (summaries) {
+        g_atomic_int_set(&summaries->closed, 1);
+    }
+}
+
+void llm_summaries_invalidate(LLMSummaries *summaries)
+{
+    if (summaries) {
+        g_atomic_int_set(&summaries->stale, 1);
+    }
+}
+
+void llm_summaries_remove_file(LLMSummaries *summaries, const gchar *path)
+{
+    g_mutex_lock(&summaries->lock);
+    g_hash_table_remove(summaries->files, path);
+    g_mutex_unlock(&summaries->lock);
+}
+
+/// @brief Path of a file relative to the directory indexed, if it is below it
+static const gchar *llm_summaries_shown_path(LLMSummaries *summaries, const gchar *path)
+{
+    gsize length = strlen(summaries->base_dir);
+    if (strncmp(path, summaries->base_dir, length) != 0 ||
+        !(G_IS_DIR_SEPARATOR(path[length]) || (length > 0 && G_IS_DIR_SEPARATOR(summaries->base_dir[length - 1])))) {
+        return path;
+    }
+    path += length;
+    while (G_IS_DIR_SEPARATOR(*path)) {
+        path++;
+    }
+    return path;
+}
+
+/// @brief File of a summary in the cache, by the hash of everything it depends on
+static gchar *llm_summaries_cache_path(LLMSummaries *summaries, const gchar *model, const gchar *name,
+    const gchar *text, gsize length)
+{
+    if (!summaries->cache_dir) {
+        return NULL;
+    }
+
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(checksum, (const guchar *)LLM_SUMMARIES_CACHE_VERSION, -1);
+    g_checksum_update(checksum, (const guchar *)"\n", 1);
+    g_checksum_update(checksum, (const guchar *)(model ? model : ""), -1);
+    g_checksum_update(checksum, (const guchar *)"\n", 1);
+    g_checksum_update(checksum, (const guchar *)name, -1);
+    g_checksum_update(checksum, (const guchar *)"\n", 1);
+    g_checksum_update(checksum, (const guchar *)text, length);
+    gchar *path = g_build_filename(summaries->cache_dir, g_checksum_get_string(checksum), NULL);
+    g_checksum_free(checksum);
+    return path;
+}
+
+static void llm_summaries_on_data(const gchar *data_chunk, gpointer user_data)
+{
+    LLMSummariesRequest *request = (LLMSummariesRequest *)user_data;
+    g_string_append(request->text, data_chunk);
+}
+
+static void llm_summaries_on_error(const gchar *error_message, gpointer user_data)
+{
+    LLMSummariesRequest *request = (LLMSummariesRequest *)user_data;
+    if (!request->error) {
+        request->error = g_strdup(error_message);
+    }
+}
+
+/// @brief Ask the background servers for the summary of a file, blocking
+/// @return NULL if cancelled or failed
+static gchar *llm_summaries_generate(LLMSummaries *summaries, LLMJob *job, const LLMArgs *args,
+    const gchar *name, const gchar *text, gsize length, gboolean truncated)
+{
+    gchar *prompt = g_strdup_printf(
+        "Summarize the following file of a project in one short paragraph: what it is for, "
+        "and the public functions, types and constants it defines, by name. "
+        "Answer with the paragraph only.\n\n"
+        "--- FILE %s%s ---\n%.*s\n--- END OF FILE ---\n",
+        name, truncated ? " (beginning)" : "", (gint)length, text);
+    gchar *json_payload = llm_construct_prompt_json_payload(prompt, args);
+    g_free(prompt);
+
+    LLMSummariesRequest request = { g_string_new(NULL), NULL };
+    LLMCallbacks callbacks = {
+        .on_data_received = llm_summaries_on_data,
+        .on_error = llm_summaries_on_error,
+        .user_data = &request
+    };
+    llm_execute_task_query(summaries->plugin, LLM_TASK_BACKGROUND, LLM_PRIORITY_BACKGROUND, "/v1/completions",
+        json_payload, &callbacks, &job->cancel_flag, NULL);
+    g_free(json_payload);
+
+    if (request.error || g_atomic_int_get(&job->cancel_flag)) {
+        if (request.error) {
+            g_print("Could not summarize %s: %s\n", name, request.error);
+        }
+        g_string_free(request.text, TRUE);
+        g_free(request.error);
+        return NULL;
+    }
+
+    gchar *summary = g_strstrip(g_string_free(request.text, FALSE));
+    // One paragraph, however the model answered
+    for (gchar *c = summary; *c; c++) {
+        if (*c == '\n' || *c == '\r') {
+            *c = ' ';
+        }
+    }
+    return summary;
+}
+
+/// @brief Bring the summary of a file up to date, from the cache if it has it
+/// @return FALSE if the summary is missing because of a failed or cancelled request
+static gboolean llm_summaries_update_file(LLMSummaries *summaries, LLMJob *job, const LLMArgs *args,
+    const gchar *path, gsize max_bytes)
+{
+    GStatBuf st;
+    if (g_stat(path, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size > LLM_INDEX_MAX_FILE_BYTES) {
+        llm_summaries_remove_file(summaries, path);
+        return TRUE;
+    }
+
+    g_mutex_lock(&summaries->lock);
+    LLMSummariesFile *file = g_hash_table_lookup(summaries->files, path);
+    gboolean current = file && file->mtime == st.st_mtime && file->size == st.st_size;
+    g_mutex_unlock(&summaries->lock);
+    if (current) {
+        return TRUE;
+    }
+
+    GMappedFile *mapped = g_mapped_file_new(path, FALSE, NULL);
+    if (!mapped) {
+        llm_summaries_remove_file(summaries, path);
+        return TRUE;
+    }
+    // Empty files map to NULL and have nothing to summarize
+    const gchar *text = g_mapped_file_get_contents(mapped);
+    gsize length = text ? g_mapped_file_get_length(mapped) : 0;
+    if (length == 0 || memchr(text, '\0', MIN(length, LLM_SUMMARIES_BINARY_PROBE))) {
+        g_mapped_file_unref(mapped);
+        llm_summaries_remove_file(summaries, path);
+        return TRUE;
+    }
+
+    gboolean truncated = length > max_bytes;
+    if (truncated) {
+        // Do not split a UTF-8 sequence
+        const gchar *cut = g_utf8_find_prev_char(text, text + max_bytes + 1);
+        length = cut && cut > text ? (gsize)(cut - text) : max_bytes;
+    }
+
+    const gchar *name = llm_summaries_shown_path(summaries, path);
+    gchar *cache_path = llm_summaries_cache_path(summaries, args->model, name, text, length);
+    gchar *summary = NULL;
+    if (!cache_path || !g_file_get_contents(cache_path, &summary, NULL, NULL)) {
+        summary = llm_summaries_generate(summaries, job, args, name, text, length, truncated);
+        if (summary && cache_path) {
+            GError *error = NULL;
+            if (!g_file_set_contents(cache_path, summary, -1, &error)) {
+                g_print("Could not cache file summary: %s\n", error->message);
+                g_error_free(error);
+            }
+        }
+        if (summary) {
+            g_mutex_lock(&summaries->lock);
+            summaries->written++;
+            g_mutex_unlock(&summaries->lock);
+        }
+    }
+    g_free(cache_path);
+    g_mapped_file_unref(mapped);
+    if (!summary) {
+        return FALSE;
+    }
+
+    g_mutex_lock(&summaries->lock);
+    file = g_hash_table_lookup(summaries->files, path);
+    if (!file) {
+        file = g_new0(LLMSummariesFile, 1);
+        g_hash_table_insert(summaries->files, g_strdup(path), file);
+    } else {
+        g_free(file->summary);
+    }
+    file->mtime = st.st_mtime;
+    file->size = st.st_size;
+    file->summary = summary;
+    g_mutex_unlock(&summaries->lock);
+    return TRUE;
+}
+
+/// @brief Scheduler job summarizing the files without a current summary
+static void llm_summaries_thread_func(LLMJob *job, gpointer data)
+{
+    LLMSummariesJob *work = (LLMSummariesJob *)data;
+    LLMSummaries *summaries = work->summaries;
+    gint64 start = g_get_monotonic_time();
+    gint64 trace_start = llm_trace_begin();
+
+    // Files larger than the context window are summarized from their beginning
+    gsize max_bytes = LLM_SUMMARIES_MAX_FILE_BYTES;
+    if (work->args->context_size > work->args->max_tokens + 256) {
+        max_bytes = MIN(max_bytes, (gsize)(work->args->context_size - work->args->max_tokens - 256) *
+            LLM_BYTES_PER_TOKEN);
+    }
+
+    g_mutex_lock(&summaries->lock);
+    guint written = summaries->written;
+    g_mutex_unlock(&summaries->lock);
+
+    gboolean complete = TRUE;
+    for (guint i = 0; i < work->paths->len; i++) {
+        if (g_atomic_int_get(&job->cancel_flag) || g_atomic_int_get(&summaries->closed) ||
+            !llm_summaries_update_file(summaries, job, work->args, g_ptr_array_index(work->paths, i),
+                max_bytes)) {
+            complete = FALSE;
+            break;
+        }
+    }
+
+    if (complete) {
+        // No longer indexed
+        GHashTable *found = g_hash_table_new(g_str_hash, g_str_equal);
+        for (guint i = 0; i < work->paths->len; i++) {
+            g_hash_table_add(found, g_ptr_array_index(work->paths, i));
+        }
+        g_mutex_lock(&summaries->lock);
+        GHashTableIter iter;
+        gpointer path;
+        g_hash_table_iter_init(&iter, summaries->files);
+        while (g_hash_table_iter_next(&iter, &path, NULL)) {
+            if (!g_hash_table_contains(found, path)) {
+                g_hash_table_iter_remove(&iter);
+            }
+        }
+        g_mutex_unlock(&summaries->lock);
+        g_hash_table_destroy(found);
+    } else {
+        // Cancelled or failed, the next idle time tries again
+        llm_summaries_invalidate(summaries);
+    }
+
+    g_mutex_lock(&summaries->lock);
+    written = summaries->written - written;
+    g_mutex_unlock(&summaries->lock);
+    if (written > 0) {
+        g_print("Summarized %u files of %s in %.1f s\n", written, summaries->base_dir,
+            (g_get_monotonic_time() - start) / (gdouble)G_USEC_PER_SEC);
+    }
+    llm_trace_end("summaries_job", "worker", trace_start);
+}
+
+static void llm_summaries_job_free(gpointer data)
+{
+    LLMSummariesJob *work = (LLMSummariesJob *)data;
+    g_atomic_int_set(&work->summaries->running, 0);
+    llm_summaries_unref(work->summaries);
+    llm_args_free(work->args);
+    g_ptr_array_free(work->paths, TRUE);
+    g_free(work);
+}
+
+gboolean llm_summaries_due(LLMSummaries *summaries)
+{
+    LLMPlugin *plugin = summaries->plugin;
+    gint64 now = g_get_monotonic_time();
+
+    return plugin->scheduler && !g_atomic_int_get(&summaries->closed) &&
+        g_atomic_int_get(&summaries->stale) && !g_atomic_int_get(&summaries->running) &&
+        now >= summaries->next_run &&
+        now - plugin->last_activity_time >= (gint64)LLM_SUMMARIES_IDLE_SEC * G_USEC_PER_SEC;
+}
+
+void llm_summaries_submit(LLMSummaries *summaries, GPtrArray *paths)
+{
+    LLMPlugin *plugin = summaries->plugin;
+    if (!plugin->scheduler || !g_atomic_int_compare_and_exchange(&summaries->running, 0, 1)) {
+        g_ptr_array_free(paths, TRUE);
+        return;
+    }
+    g_atomic_int_set(&summaries->stale, 0);
+    // Not again right away if the servers are down
+    summaries->next_run = g_get_monotonic_time() + (gint64)LLM_SUMMARIES_CHECK_SEC * G_USEC_PER_SEC;
+
+    LLMSummariesJob *work = g_new0(LLMSummariesJob, 1);
+    work->summaries = llm_summaries_ref(summaries);
+    work->args = llm_task_args_new(plugin, LLM_TASK_BACKGROUND);
+    work->args->max_tokens = LLM_SUMMARIES_TOKENS;
+    // Borrowed from the settings, which may change while the job runs
+    work->args->system_instruction = NULL;
+    work->paths = paths;
+    llm_scheduler_submit(plugin->scheduler, LLM_PRIORITY_BACKGROUND, llm_summaries_thread_func,
+        work, llm_summaries_job_free);
+}
+
+/// @brief TRUE if a file is part of the context in full
+static gboolean llm_summaries_included(const GPtrArray *documents, const gchar *path)
+{
+    for (guint i = 0; documents && i < documents->len; i++) {
+        const LLMDocument *document = g_ptr_array_index(documents, i);
+        if (document->first_line == 0 && document->last_line == G_MAXUINT &&
+            llm_document_overlaps(document, path, 0, G_MAXUINT)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/// @brief Append the summary of a file unless it is listed or in the context already
+/// @return FALSE if it did not fit
+static gboolean llm_summaries_append(LLMSummaries *summaries, GString *out, GHashTable *listed,
+    const GPtrArray *documents, const gchar *path, gsize max_bytes)
+{
+    LLMSummariesFile *file = g_hash_table_lookup(summaries->files, path);
+    if (!file || g_hash_table_contains(listed, path) || llm_summaries_included(documents, path)) {
+        return TRUE;
+    }
+
+    const gchar *name = llm_summaries_shown_path(summaries, path);
+    if (out->len + strlen(name) + strlen(file->summary) + 4 > max_bytes) {
+        return FALSE;
+    }
+    g_string_append_printf(out, "%s: %s\n\n", name, file->summary);
+    g_hash_table_add(listed, (gpointer)path);
+    return TRUE;
+}
+
+LLMDocument *llm_summaries_document(LLMSummaries *summaries, const GPtrArray *documents,
+    const GPtrArray *first, gsize max_bytes)
+{
+    GString *out = g_string_new(NULL);
+    GHashTable *listed = g_hash_table_new(g_str_hash, g_str_equal);
+    guint omitted = 0;
+
+    g_mutex_lock(&summaries->lock);
+    for (guint i = 0; first && i < first->len; i++) {
+        omitted += !llm_summaries_append(summaries, out, listed, documents, g_ptr_array_index(first, i),
+            max_bytes);
+    }
+    // Then the rest in the order of their paths, files of a directory together
+    GList *paths = g_list_sort(g_hash_table_get_keys(summaries->files), (GCompareFunc)strcmp);
+    for (GList *item = paths; item; item = item->next) {
+        omitted += !llm_summaries_append(summaries, out, listed, documents, item->data, max_bytes);
+    }
+    g_list_free(paths);
+    g_mutex_unlock(&summaries->lock);
+
+    guint count = g_hash_table_size(listed);
+    g_hash_table_destroy(listed);
+    if (count == 0) {
+        g_string_free(out, TRUE);
+        return NULL;
+    }
+    if (omitted > 0) {
+        g_string_append_printf(out, "(%u more files not summarized here)\n", omitted);
+    }
+
+    g_print("Added the summaries of %u files of %s\n", count, summaries->base_dir);
+    return llm_document_new("Summaries of other files of the project", g_string_free(out, FALSE));
+}
+
+void llm_summaries_describe(LLMSummaries *summaries, GString *out)
+{
+    g_mutex_lock(&summaries->lock);
+    g_string_append_printf(out, "%u files summarized, %u summaries written this session%s\n",
+        g_hash_table_size(summaries->files), summaries->written,
+        g_atomic_int_get(&summaries->running) ? ", summarizing" :
+        g_atomic_int_get(&summaries->stale) ? ", waiting for the editor to be idle" : "");
+    g_mutex_unlock(&summaries->lock);
+}
@@ -0,0 +1,71 @@
+#ifndef __LLM_SUMMARIES_H__
+#define __LLM_SUMMARIES_H__
+
+#include "plugin.h"
+
+/**
+ * One-paragraph summaries of the files of a project index: what a file is
+ * for and the public symbols it defines. They are written by a background
+ * job once the editor has been idle for a while, through the background
+ * servers, and cached in the plugin's cache directory by the hash of the
+ * model and the file's content, so a file is only summarized again after
+ * it changed, also across sessions.
+ *
+ * A question gets the summaries of the files not in its context in full
+ * as one more document, the files matching it first, so the model knows
+ * the rest of the project at a fraction of its size.
+ */
+
+/// @brief Tokens of context the summaries take per question by default
+#define LLM_SUMMARIES_DEFAULT_TOKENS 1500
+/// @brief Tokens generated per summary
+#define LLM_SUMMARIES_TOKENS 160
+/// @brief Files are summarized from their first this many bytes
+#define LLM_SUMMARIES_MAX_FILE_BYTES (16 * 1024)
+/// @brief Summaries are written once the editor has been idle this long
+#define LLM_SUMMARIES_IDLE_SEC 30
+/// @brief Idle time is checked this often, and a failed job tried again as late
+#define LLM_SUMMARIES_CHECK_SEC 60
+
+/// @brief Bump when the prompt changes to invalidate the cache
+#define LLM_SUMMARIES_CACHE_VERSION "1"
+/// @brief Directory below the plugin's cache directory holding the summaries
+#define LLM_SUMMARIES_CACHE_DIR "summaries"
+
+typedef struct LLMSummaries LLMSummaries;
+
+/// @brief Summaries of the files below a directory, none written yet (main thread)
+LLMSummaries *llm_summaries_new(LLMPlugin *plugin, const gchar *base_dir);
+
+LLMSummaries *llm_summaries_ref(LLMSummaries *summaries);
+
+void llm_summaries_unref(LLMSummaries *summaries);
+
+/// @brief Stop summarizing, a job running finishes its file
+void llm_summaries_close(LLMSummaries *summaries);
+
+/// @brief Files were indexed again, the next idle time checks them all
+void llm_summaries_invalidate(LLMSummaries *summaries);
+
+void llm_summaries_remove_file(LLMSummaries *summaries, const gchar *path);
+
+/// @brief TRUE if files may lack a current summary, the editor has been idle
+/// long enough and no job runs (main thread)
+gboolean llm_summaries_due(LLMSummaries *summaries);
+
+/// @brief Submit a job summarizing the files that changed (main thread)
+/// @param paths files indexed, taken; summaries of other files are dropped
+void llm_summaries_submit(LLMSummaries *summaries, GPtrArray *paths);
+
+/// @brief The summaries of the files not included in full, as one document (main thread)
+/// @param documents context so far
+/// @param first paths listed first, e.g. the files matching the question; may be NULL
+/// @param max_bytes size of the document at most
+/// @return NULL if there is no summary to add
+LLMDocument *llm_summaries_document(LLMSummaries *summaries, const GPtrArray *documents,
+    const GPtrArray *first, gsize max_bytes);
+
+/// @brief Append the number of summaries and the state of the job to out
+void llm_summaries_describe(LLMSummaries *summaries, GString *out);
+
+#endif // __LLM_SUMMARIES_H__
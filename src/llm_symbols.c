@@ -0,0 +1,384 @@
+#include <string.h>
+
+#include "llm_symbols.h"
+#include "llm_util.h"
+#include "document_manager.h"
+
+/// @brief Tag types sent as definitions; variables and members are not
+#define LLM_SYMBOLS_DEFINITION_TYPES (tm_tag_function_t | tm_tag_method_t | tm_tag_prototype_t | \
+    tm_tag_class_t | tm_tag_struct_t | tm_tag_union_t | tm_tag_enum_t | tm_tag_typedef_t | \
+    tm_tag_interface_t | tm_tag_macro_t | tm_tag_macro_with_arg_t)
+/// @brief A definition without a brace in this many lines has none
+#define LLM_SYMBOLS_SIGNATURE_LINES 8
+/// @brief Comment lines above a definition taken along with it
+#define LLM_SYMBOLS_MAX_COMMENT_LINES 10
+
+/// @brief A name waiting to be looked up
+typedef struct {
+    const gchar *name;  // Owned by LLMSymbolSearch.names
+    guint depth;        // Definitions followed to get here
+} LLMSymbolName;
+
+/// @brief State of one collection
+typedef struct {
+    GHashTable *sources;    // File name -> lines (gchar**)
+    GHashTable *names;      // Names queued so far
+    GHashTable *taken;      // "file:line" of the definitions taken
+    GQueue queue;           // LLMSymbolName*, breadth first
+    guint max_depth;
+    guint lines_left;
+    TMSourceFile *current;  // File of the cursor, its lines are taken already
+    guint window_first;     // Lines around the cursor, 0-based
+    guint window_last;
+    GPtrArray *documents;
+} LLMSymbolSearch;
+
+/// @brief Queue the identifiers of a text not seen yet
+static void llm_symbols_queue_names(LLMSymbolSearch *search, const gchar *text, guint depth)
+{
+    const gchar *p = text;
+
+    while (*p && g_hash_table_size(search->names) < LLM_SYMBOLS_MAX_NAMES) {
+        if (!g_ascii_isalpha(*p) && *p != '_') {
+            // Skip numbers whole, 0x1F is no identifier
+            if (g_ascii_isdigit(*p)) {
+                while (g_ascii_isalnum(*p) || *p == '_') {
+                    p++;
+                }
+            } else {
+                p++;
+            }
+            continue;
+        }
+
+        const gchar *start = p;
+        while (g_ascii_isalnum(*p) || *p == '_') {
+            p++;
+        }
+        if (p - start < 2) {
+            continue;
+        }
+
+        gchar *name = g_strndup(start, p - start);
+        if (g_hash_table_contains(search->names, name)) {
+            g_free(name);
+            continue;
+        }
+        g_hash_table_add(search->names, name);
+
+        LLMSymbolName *entry = g_new(LLMSymbolName, 1);
+        entry->name = name;
+        entry->depth = depth;
+        g_queue_push_tail(&search->queue, entry);
+    }
+}
+
+/// @brief Lines of a source file, open documents with their unsaved changes
+static gchar **llm_symbols_source_lines(LLMSymbolSearch *search, const gchar *file_name)
+{
+    gchar **lines = g_hash_table_lookup(search->sources, file_name);
+    if (lines) {
+        return lines;
+    }
+
+    gchar *text = NULL;
+    GeanyDocument *doc = document_find_by_real_path(file_name);
+    if (doc) {
+        text = get_document_text(doc);
+    } else if (!g_file_get_contents(file_name, &text, NULL, NULL)) {
+        text = NULL;
+    }
+
+    lines = g_strsplit(text ? text : "", "\n", -1);
+    g_free(text);
+    g_hash_table_insert(search->sources, g_strdup(file_name), lines);
+    return lines;
+}
+
+static gboolean llm_symbols_blank(const gchar *line)
+{
+    while (g_ascii_isspace(*line)) {
+        line++;
+    }
+    return *line == '\0';
+}
+
+static gsize llm_symbols_indent(const gchar *line)
+{
+    gsize indent = 0;
+    while (line[indent] == ' ' || line[indent] == '\t') {
+        indent++;
+    }
+    return indent;
+}
+
+/// @brief First line of a definition whose tag points at its closing brace,
+/// like typedef struct { ... } Name;
+static guint llm_symbols_definition_start(gchar **lines, guint line)
+{
+    if (lines[line][llm_symbols_indent(lines[line])] != '}') {
+        return line;
+    }
+
+    gint depth = 0;
+    for (guint i = line; i + LLM_SYMBOLS_MAX_DEFINITION_LINES > line; i--) {
+        for (const gchar *c = lines[i]; *c; c++) {
+            depth += *c == '}' ? 1 : (*c == '{' ? -1 : 0);
+        }
+        if (depth <= 0) {
+            return i;
+        }
+        if (i == 0) {
+            break;
+        }
+    }
+    return line;
+}
+
+/// @brief Last line of the definition starting at first
+static guint llm_symbols_definition_end(gchar **lines, guint n_lines, guint first, gboolean macro)
+{
+    guint last = MIN(n_lines, first + LLM_SYMBOLS_MAX_DEFINITION_LINES) - 1;
+
+    if (macro) {
+        // Up to the first line without a continuation
+        for (guint i = first; i < last; i++) {
+            gchar *line = g_strchomp(g_strdup(lines[i]));
+            gboolean continued = g_str_has_suffix(line, "\\");
+            g_free(line);
+            if (!continued) {
+                return i;
+            }
+        }
+        return last;
+    }
+
+    gint depth = 0;
+    gboolean opened = FALSE;
+    for (guint i = first; i <= last; i++) {
+        // Quotes do not span lines, a stray one in a comment is forgotten at the end of it
+        gchar quote = 0;
+        for (const gchar *c = lines[i]; *c; c++) {
+            if (quote) {
+                if (*c == '\\' && c[1]) {
+                    c++;
+                } else if (*c == quote) {
+                    quote = 0;
+                }
+            } else if (*c == '"' || *c == '\'') {
+                quote = *c;
+            } else if (*c == '/' && c[1] == '/') {
+                break;
+            } else if (*c == '{') {
+                depth++;
+                opened = TRUE;
+            } else if (*c == '}') {
+                depth--;
+                if (opened && depth <= 0) {
+                    return i;
+                }
+            } else if (*c == ';' && !opened && depth == 0) {
+                // A prototype or a declaration without a body
+                return i;
+            }
+        }
+        if (!opened && i - first >= LLM_SYMBOLS_SIGNATURE_LINES) {
+            break;
+        }
+    }
+    if (opened) {
+        return last;
+    }
+
+    // No braces, e.g. Python: the lines indented deeper than the definition
+    gsize indent = llm_symbols_indent(lines[first]);
+    guint end = first;
+    for (guint i = first + 1; i <= last; i++) {
+        if (llm_symbols_blank(lines[i])) {
+            continue;
+        }
+        if (llm_symbols_indent(lines[i]) <= indent) {
+            break;
+        }
+        end = i;
+    }
+    return end;
+}
+
+/// @brief First line of the comment right above a definition, first if there is none
+static guint llm_symbols_comment_start(gchar **lines, guint first)
+{
+    guint start = first;
+    while (start > 0 && first - start < LLM_SYMBOLS_MAX_COMMENT_LINES) {
+        const gchar *line = lines[start - 1] + llm_symbols_indent(lines[start - 1]);
+        if (!g_str_has_prefix(line, "//") && !g_str_has_prefix(line, "/*") && !g_str_has_prefix(line, "*")) {
+            break;
+        }
+        start--;
+    }
+    return start;
+}
+
+/// @brief Join lines first to last into a new string
+static gchar *llm_symbols_join(gchar **lines, guint first, guint last)
+{
+    GString *text = g_string_new(NULL);
+    for (guint i = first; i <= last; i++) {
+        g_string_append(text, lines[i]);
+        g_string_append_c(text, '\n');
+    }
+    return g_string_free(text, FALSE);
+}
+
+/// @brief Add the definition of a tag to the documents and queue the names in it
+static void llm_symbols_take(LLMSymbolSearch *search, const TMTag *tag, guint depth)
+{
+    gchar **lines = llm_symbols_source_lines(search, tag->file->file_name);
+    guint n_lines = g_strv_length(lines);
+    if (tag->line == 0 || tag->line > n_lines) {
+        // The file changed since it was parsed
+        return;
+    }
+
+    guint first = llm_symbols_definition_start(lines, (guint)tag->line - 1);
+    // The struct and its typedef are one definition
+    gchar *key = g_strdup_printf("%s:%u", tag->file->file_name, first);
+    if (!g_hash_table_add(search->taken, key)) {
+        return;
+    }
+
+    gboolean macro = (tag->type & (tm_tag_macro_t | tm_tag_macro_with_arg_t)) != 0;
+    guint last = llm_symbols_definition_end(lines, n_lines, first, macro);
+    if (tag->file == search->current && first <= search->window_last && last >= search->window_first) {
+        // Shown with the lines around the cursor
+        return;
+    }
+
+    first = llm_symbols_comment_start(lines, first);
+    last = MIN(last, first + search->lines_left - 1);
+    search->lines_left -= last - first + 1;
+
+    gchar *text = llm_symbols_join(lines, first, last);
+    gchar *name = g_strdup_printf("%s:%u-%u (%s)", tag->file->short_name, first + 1, last + 1, tag->name);
+    if (depth < search->max_depth) {
+        llm_symbols_queue_names(search, text, depth + 1);
+    }
+    LLMDocument *document = llm_document_new(name, text);
+    llm_document_set_source(document, tag->file->file_name, first, last);
+    g_ptr_array_add(search->documents, document);
+    g_free(name);
+}
+
+/// @brief Index of the first tag named name in the workspace tags, which are sorted by name
+static guint llm_symbols_find_first(GPtrArray *tags, const gchar *name)
+{
+    guint low = 0, high = tags->len;
+    while (low < high) {
+        guint mid = low + (high - low) / 2;
+        const TMTag *tag = g_ptr_array_index(tags, mid);
+        if (strcmp(tag->name, name) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/// @brief Take the definitions of a name, prototypes only if there is nothing else
+static void llm_symbols_lookup(LLMSymbolSearch *search, GPtrArray *tags, const LLMSymbolName *entry)
+{
+    guint first = llm_symbols_find_first(tags, entry->name);
+    guint end = first;
+    gboolean defined = FALSE;
+
+    for (; end < tags->len; end++) {
+        const TMTag *tag = g_ptr_array_index(tags, end);
+        if (strcmp(tag->name, entry->name) != 0) {
+            break;
+        }
+        defined |= (tag->type & LLM_SYMBOLS_DEFINITION_TYPES & ~tm_tag_prototype_t) != 0;
+    }
+
+    guint matches = 0;
+    for (guint i = first; i < end && matches < LLM_SYMBOLS_MAX_MATCHES && search->lines_left > 0; i++) {
+        const TMTag *tag = g_ptr_array_index(tags, i);
+        if (!tag->file || !(tag->type & LLM_SYMBOLS_DEFINITION_TYPES) ||
+            (defined && (tag->type & tm_tag_prototype_t))) {
+            continue;
+        }
+        llm_symbols_take(search, tag, entry->depth);
+        matches++;
+    }
+}
+
+gboolean llm_symbols_collect(LLMPlugin *plugin, GeanyDocument *doc, const gchar *question,
+    GPtrArray *documents)
+{
+    TMWorkspace *workspace = plugin->geany_data->app->tm_workspace;
+    if (!doc || !doc->is_valid || !doc->tm_file || !workspace || !workspace->tags_array) {
+        return FALSE;
+    }
+
+    // The editor has the lines as they are now, the file may be older
+    gchar *text = get_document_text(doc);
+    if (IS_NULL_OR_EMPTY(text)) {
+        g_free(text);
+        return FALSE;
+    }
+
+    LLMSymbolSearch search = {0};
+    search.sources = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_strfreev);
+    search.names = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    search.taken = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_queue_init(&search.queue);
+    search.max_depth = plugin->symbol_depth;
+    search.lines_left = MAX(plugin->symbol_max_lines, 1);
+    search.current = doc->tm_file;
+    search.documents = documents;
+
+    gchar **lines = g_strsplit(text, "\n", -1);
+    g_free(text);
+    g_hash_table_insert(search.sources, g_strdup(doc->tm_file->file_name), lines);
+    guint n_lines = g_strv_length(lines);
+
+    guint cursor = (guint)MAX(sci_get_current_line(doc->editor->sci), 0);
+    cursor = MIN(cursor, n_lines - 1);
+    search.window_first = cursor > LLM_SYMBOLS_CURSOR_LINES ? cursor - LLM_SYMBOLS_CURSOR_LINES : 0;
+    search.window_last = MIN(cursor + LLM_SYMBOLS_CURSOR_LINES, n_lines - 1);
+    search.lines_left -= MIN(search.window_last - search.window_first + 1, search.lines_left);
+
+    gchar *window = llm_symbols_join(lines, search.window_first, search.window_last);
+    gchar *name = g_strdup_printf("%s:%u-%u (around the cursor)", doc->tm_file->short_name,
+        search.window_first + 1, search.window_last + 1);
+    LLMDocument *document = llm_document_new(name, window);
+    llm_document_set_source(document, doc->tm_file->file_name, search.window_first, search.window_last);
+    g_ptr_array_add(documents, document);
+    g_free(name);
+
+    // What the question names comes first, then the cursor line and the lines nearest to it
+    llm_symbols_queue_names(&search, question ? question : "", 0);
+    for (guint distance = 0; distance <= LLM_SYMBOLS_CURSOR_LINES; distance++) {
+        if (distance <= cursor - search.window_first) {
+            llm_symbols_queue_names(&search, lines[cursor - distance], 0);
+        }
+        if (distance > 0 && cursor + distance <= search.window_last) {
+            llm_symbols_queue_names(&search, lines[cursor + distance], 0);
+        }
+    }
+
+    LLMSymbolName *entry;
+    guint definitions = documents->len;
+    while (search.lines_left > 0 && (entry = g_queue_pop_head(&search.queue)) != NULL) {
+        llm_symbols_lookup(&search, workspace->tags_array, entry);
+        g_free(entry);
+    }
+    g_print("Symbol context: %u definitions, %u of %u lines used\n", documents->len - definitions,
+        MAX(plugin->symbol_max_lines, 1) - search.lines_left, MAX(plugin->symbol_max_lines, 1));
+
+    g_queue_clear_full(&search.queue, g_free);
+    g_hash_table_destroy(search.sources);
+    g_hash_table_destroy(search.names);
+    g_hash_table_destroy(search.taken);
+    return TRUE;
+}
@@ -0,0 +1,36 @@
+#ifndef __LLM_SYMBOLS_H__
+#define __LLM_SYMBOLS_H__
+
+#include "plugin.h"
+
+/**
+ * Symbol-aware context. Instead of whole files, the prompt gets the lines
+ * around the cursor and the definitions of the functions, types and macros
+ * they or the question refer to, found in Geany's tag manager workspace
+ * across all files it knows. The identifiers in those definitions are
+ * followed in turn, up to a depth, until the line budget is spent.
+ *
+ * Definitions end where their braces close, where a macro has no line
+ * continuation left, or, for languages without braces, where the
+ * indentation returns to the level of the definition.
+ */
+
+/// @brief Lines before and after the cursor line included as they are
+#define LLM_SYMBOLS_CURSOR_LINES 25
+/// @brief Longest definition taken, longer ones are cut
+#define LLM_SYMBOLS_MAX_DEFINITION_LINES 120
+/// @brief Definitions taken per name, e.g. of overloads or of the same name in several files
+#define LLM_SYMBOLS_MAX_MATCHES 3
+/// @brief Names looked up per request at most
+#define LLM_SYMBOLS_MAX_NAMES 500
+
+#define LLM_SYMBOLS_DEFAULT_DEPTH 2
+#define LLM_SYMBOLS_DEFAULT_LINES 400
+
+/// @brief Add the lines around the cursor of doc and the definitions
+/// referenced by them or the question to documents (main thread)
+/// @return FALSE if the tag manager knows nothing about doc, nothing was added
+gboolean llm_symbols_collect(LLMPlugin *plugin, GeanyDocument *doc, const gchar *question,
+    GPtrArray *documents);
+
+#endif // __LLM_SYMBOLS_H__
@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <glib/gstdio.h>
+
+#include "llm_trace.h"
+
+typedef struct {
+    const gchar *name;
+    const gchar *category;
+    gint64 ts;            // Monotonic time, microseconds
+    gint64 value;         // Duration of a span, value of a counter
+    gchar phase;          // 'X' span, 'i' instant, 'C' counter
+} LLMTraceEvent;
+
+/// @brief Events are only written by the owning thread. count is published
+/// atomically after the event, so a reader sees complete events only.
+typedef struct LLMTraceBlock {
+    LLMTraceEvent events[LLM_TRACE_BLOCK_EVENTS];
+    gint count;
+    struct LLMTraceBlock *next;
+} LLMTraceBlock;
+
+/// @brief Owned by the list while its thread runs and is listed. A thread
+/// outliving llm_trace_free() keeps its buffer and frees it when it exits.
+typedef struct {
+    guint tid;
+    gboolean is_main;
+    gint listed;          // Atomic, in llm_trace_buffers
+    gboolean exited;      // Its thread is gone, guarded by llm_trace_lock
+    LLMTraceBlock *head;
+    LLMTraceBlock *tail;  // Owning thread only
+} LLMTraceBuffer;
+
+static gint llm_trace_active = 0;
+static gint llm_trace_events = 0;      // Events recorded or dropped, atomic
+static gint64 llm_trace_since = 0;     // Last start, earlier events are not saved
+static GMutex llm_trace_lock;          // Protects the buffer list
+static GPtrArray *llm_trace_buffers = NULL;
+
+static void llm_trace_blocks_free(LLMTraceBlock *block)
+{
+    while (block) {
+        LLMTraceBlock *next = block->next;
+        g_free(block);
+        block = next;
+    }
+}
+
+static void llm_trace_buffer_free(LLMTraceBuffer *buffer)
+{
+    if (buffer) {
+        llm_trace_blocks_free(buffer->head);
+        g_free(buffer);
+    }
+}
+
+/// @brief A thread that recorded exits
+static void llm_trace_thread_exit(gpointer data)
+{
+    LLMTraceBuffer *buffer = (LLMTraceBuffer *)data;
+
+    g_mutex_lock(&llm_trace_lock);
+    if (g_atomic_int_get(&buffer->listed)) {
+        // Its events are still saved, llm_trace_free() frees it
+        buffer->exited = TRUE;
+        buffer = NULL;
+    }
+    g_mutex_unlock(&llm_trace_lock);
+    llm_trace_buffer_free(buffer);
+}
+
+static GPrivate llm_trace_buffer_key = G_PRIVATE_INIT(llm_trace_thread_exit);
+
+/// @brief Buffer of the calling thread, registered on first use
+static LLMTraceBuffer *llm_trace_thread_buffer(void)
+{
+    LLMTraceBuffer *buffer = g_private_get(&llm_trace_buffer_key);
+    if (buffer && g_atomic_int_get(&buffer->listed)) {
+        return buffer;
+    }
+
+    if (buffer) {
+        // Dropped by llm_trace_free() while this thread ran: start over,
+        // nobody else reads an unlisted buffer
+        llm_trace_blocks_free(buffer->head);
+    } else {
+        buffer = g_new0(LLMTraceBuffer, 1);
+        buffer->is_main = g_main_context_is_owner(g_main_context_default());
+        g_private_set(&llm_trace_buffer_key, buffer);
+    }
+    buffer->head = buffer->tail = g_new0(LLMTraceBlock, 1);
+
+    g_mutex_lock(&llm_trace_lock);
+    if (!llm_trace_buffers) {
+        llm_trace_buffers = g_ptr_array_new();
+    }
+    buffer->tid = llm_trace_buffers->len + 1;
+    g_ptr_array_add(llm_trace_buffers, buffer);
+    g_atomic_int_set(&buffer->listed, 1);
+    g_mutex_unlock(&llm_trace_lock);
+
+    return buffer;
+}
+
+static void llm_trace_append(gchar phase, const gchar *name, const gchar *category, gint64 ts, gint64 value)
+{
+    if (g_atomic_int_add(&llm_trace_events, 1) >= LLM_TRACE_MAX_EVENTS) {
+        return;
+    }
+
+    LLMTraceBuffer *buffer = llm_trace_thread_buffer();
+    LLMTraceBlock *block = buffer->tail;
+    gint count = block->count;
+    if (count == LLM_TRACE_BLOCK_EVENTS) {
+        LLMTraceBlock *next = g_new0(LLMTraceBlock, 1);
+        g_atomic_pointer_set(&block->next, next);
+        buffer->tail = block = next;
+        count = 0;
+    }
+
+    LLMTraceEvent *event = &block->events[count];
+    event->name = name;
+    event->category = category;
+    event->ts = ts;
+    event->value = value;
+    event->phase = phase;
+    g_atomic_int_set(&block->count, count + 1);
+}
+
+void llm_trace_start(void)
+{
+    g_mutex_lock(&llm_trace_lock);
+    if (!g_atomic_int_get(&llm_trace_active)) {
+        llm_trace_since = g_get_monotonic_time();
+    }
+    g_mutex_unlock(&llm_trace_lock);
+    g_atomic_int_set(&llm_trace_active, 1);
+}
+
+void llm_trace_stop(void)
+{
+    g_atomic_int_set(&llm_trace_active, 0);
+}
+
+gboolean llm_trace_enabled(void)
+{
+    return g_atomic_int_get(&llm_trace_active);
+}
+
+gint64 llm_trace_begin(void)
+{
+    return g_atomic_int_get(&llm_trace_active) ? g_get_monotonic_time() : 0;
+}
+
+void llm_trace_end(const gchar *name, const gchar *category, gint64 start)
+{
+    if (start == 0 || !g_atomic_int_get(&llm_trace_active)) {
+        return;
+    }
+    llm_trace_append('X', name, category, start, g_get_monotonic_time() - start);
+}
+
+void llm_trace_instant(const gchar *name, const gchar *category)
+{
+    if (!g_atomic_int_get(&llm_trace_active)) {
+        return;
+    }
+    llm_trace_append('i', name, category, g_get_monotonic_time(), 0);
+}
+
+void llm_trace_counter(const gchar *name, gint64 value)
+{
+    if (!g_atomic_int_get(&llm_trace_active)) {
+        return;
+    }
+    llm_trace_append('C', name, "counter", g_get_monotonic_time(), value);
+}
+
+static void llm_trace_write_event(FILE *file, const LLMTraceBuffer *buffer, const LLMTraceEvent *event)
+{
+    fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%" G_GINT64_FORMAT ",\"pid\":1,\"tid\":%u",
+        event->name, event->category, event->phase, event->ts, buffer->tid);
+    switch (event->phase) {
+        case 'X':
+            fprintf(file, ",\"dur\":%" G_GINT64_FORMAT, event->value);
+            break;
+        case 'C':
+            fprintf(file, ",\"args\":{\"value\":%" G_GINT64_FORMAT "}", event->value);
+            break;
+        case 'i':
+            fprintf(file, ",\"s\":\"t\"");
+            break;
+    }
+    fputc('}', file);
+}
+
+gchar *llm_trace_save(const gchar *dir, GError **error)
+{
+    GDateTime *now = g_date_time_new_now_local();
+    gchar *stamp = g_date_time_format(now, "%Y%m%d-%H%M%S");
+    gchar *file_name = g_strdup_printf("trace-%s.json", stamp);
+    gchar *path = g_build_filename(dir, file_name, NULL);
+    g_free(file_name);
+    g_free(stamp);
+    g_date_time_unref(now);
+
+    FILE *file = g_fopen(path, "w");
+    if (!file) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+            "Could not write %s: %s", path, g_strerror(errno));
+        g_free(path);
+        return NULL;
+    }
+
+    guint written = 0;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+          "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"", file);
+    fputs(g_get_prgname() ? g_get_prgname() : "geany-llm", file);
+    fputs("\"}}", file);
+
+    g_mutex_lock(&llm_trace_lock);
+    for (guint i = 0; llm_trace_buffers && i < llm_trace_buffers->len; i++) {
+        LLMTraceBuffer *buffer = g_ptr_array_index(llm_trace_buffers, i);
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}",
+            buffer->tid, buffer->is_main ? "main" : "worker", buffer->tid);
+
+        for (LLMTraceBlock *block = buffer->head; block; block = g_atomic_pointer_get(&block->next)) {
+            gint count = g_atomic_int_get(&block->count);
+            for (gint j = 0; j < count; j++) {
+                if (block->events[j].ts < llm_trace_since) {
+                    continue;
+                }
+                llm_trace_write_event(file, buffer, &block->events[j]);
+                written++;
+            }
+        }
+    }
+    g_mutex_unlock(&llm_trace_lock);
+
+    fputs("\n]}\n", file);
+    if (fclose(file) != 0) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+            "Could not write %s: %s", path, g_strerror(errno));
+        g_free(path);
+        return NULL;
+    }
+
+    gint recorded = g_atomic_int_get(&llm_trace_events);
+    if (recorded > LLM_TRACE_MAX_EVENTS) {
+        g_print("Trace full, %d events were dropped\n", recorded - LLM_TRACE_MAX_EVENTS);
+    }
+    g_print("Wrote %u trace events to %s\n", written, path);
+    return path;
+}
+
+void llm_trace_free(void)
+{
+    llm_trace_stop();
+
+    LLMTraceBuffer *own = g_private_get(&llm_trace_buffer_key);
+    g_mutex_lock(&llm_trace_lock);
+    for (guint i = 0; llm_trace_buffers && i < llm_trace_buffers->len; i++) {
+        LLMTraceBuffer *buffer = g_ptr_array_index(llm_trace_buffers, i);
+        if (buffer->exited || buffer == own) {
+            llm_trace_buffer_free(buffer);
+        } else {
+            // Its thread may still be recording, it frees the buffer when it exits
+            g_atomic_int_set(&buffer->listed, 0);
+        }
+    }
+    if (llm_trace_buffers) {
+        g_ptr_array_free(llm_trace_buffers, TRUE);
+        llm_trace_buffers = NULL;
+    }
+    g_atomic_int_set(&llm_trace_events, 0);
+    g_mutex_unlock(&llm_trace_lock);
+
+    // The calling thread may record again later
+    g_private_set(&llm_trace_buffer_key, NULL);
+}
@@ -0,0 +1,56 @@
+#ifndef __LLM_TRACE_H__
+#define __LLM_TRACE_H__
+
+#include <glib.h>
+
+/**
+ * Request pipeline tracer writing the Chrome trace_event JSON format, to be
+ * opened in Perfetto or chrome://tracing.
+ *
+ * Every thread records into its own buffer: appending an event takes no
+ * lock and allocates only when a block of LLM_TRACE_BLOCK_EVENTS is full.
+ * Names and categories are not copied and must be string literals.
+ * While tracing is off every call returns after one atomic read.
+ *
+ *     gint64 trace_start = llm_trace_begin();
+ *     ...
+ *     llm_trace_end("parse_event", "parser", trace_start);
+ */
+
+#define LLM_TRACE_BLOCK_EVENTS 512
+/// @brief Events kept at most, later ones are dropped
+#define LLM_TRACE_MAX_EVENTS (1 << 20)
+/// @brief Directory below the plugin's config directory holding the traces
+#define LLM_TRACE_DIR "traces"
+
+/// @brief Start recording. Events recorded before are left out of later saves.
+void llm_trace_start(void);
+
+/// @brief Stop recording, the recorded events are kept until freed
+void llm_trace_stop(void);
+
+/// @brief TRUE while recording
+gboolean llm_trace_enabled(void);
+
+/// @brief Start of a span
+/// @return the current time, or 0 when not recording
+gint64 llm_trace_begin(void);
+
+/// @brief Record a span started with llm_trace_begin(). Does nothing if start is 0.
+void llm_trace_end(const gchar *name, const gchar *category, gint64 start);
+
+/// @brief Record a point in time
+void llm_trace_instant(const gchar *name, const gchar *category);
+
+/// @brief Record the value of a counter
+void llm_trace_counter(const gchar *name, gint64 value);
+
+/// @brief Write the events recorded since the last start to a new trace file in dir
+/// @return the path of the file, NULL on error
+gchar *llm_trace_save(const gchar *dir, GError **error);
+
+/// @brief Stop recording and free the buffers. Threads still running free
+/// their own buffers when they exit, or start new ones if they record again.
+void llm_trace_free(void);
+
+#endif // __LLM_TRACE_H__
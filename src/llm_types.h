@@ -0,0 +1,155 @@
+#ifndef __LLM_TYPES_H__
+#define __LLM_TYPES_H__
+
+#include <glib.h>
+
+#define IS_NULL_OR_EMPTY(str) ((str) == NULL || (str)[0] == '\0')
+/// @brief TRUE if a cancel flag is set, NULL is never. Flags are set from
+/// other threads than those polling them, so both go through atomics.
+#define LLM_CANCELLED(flag) ((flag) != NULL && g_atomic_int_get(flag))
+
+/**
+ * Types of the core library: transport, stream parsing and prompt assembly.
+ * Only GLib is used here, so the core builds without GTK or Geany.
+ */
+
+/// @brief Timings llama.cpp reports in the final stream event
+typedef struct {
+    gboolean valid;
+    gint prompt_n;                  // Prompt tokens evaluated, cached ones excluded
+    gdouble prompt_ms;
+    gint predicted_n;
+    gdouble predicted_ms;
+    gdouble predicted_per_second;
+} LLMServerTimings;
+
+/// @brief Prompt processing progress, streamed by llama.cpp with return_progress
+typedef struct {
+    gboolean valid;
+    gboolean estimated;     // Sent by the client with the request, only total is known
+    gint total;             // Prompt tokens
+    gint cache;             // Tokens taken from the KV cache
+    gint processed;         // Tokens done, the cached ones included
+    gdouble time_ms;        // Prefill time so far
+} LLMPromptProgress;
+
+/// @brief Why the server stopped generating, from the OpenAI finish_reason
+typedef enum {
+    LLM_FINISH_NONE,        // Not reported (yet)
+    LLM_FINISH_STOP,        // End of text or a stop sequence
+    LLM_FINISH_LENGTH       // Ran into max_tokens or the end of the context
+} LLMFinishReason;
+
+/// @brief LLM response descriptor
+typedef struct {
+    gchar *response_text;
+    gchar *error;
+    guint index;          // Choice index when several candidates are streamed
+    gdouble logprob;      // Sum of the token logprobs carried by this chunk
+    gboolean has_logprob;
+    LLMFinishReason finish_reason;
+    LLMServerTimings timings;
+    LLMPromptProgress progress;
+} LLMResponse;
+
+typedef void (*LLMDataCallback)(const gchar *data_chunk, gpointer user_data);
+typedef void (*LLMErrorCallback)(const gchar *error_message, gpointer user_data);
+typedef void (*LLMCompleteCallback)(gpointer user_data);
+typedef void (*LLMCandidateCallback)(const LLMResponse *response, gpointer user_data);
+typedef void (*LLMStatusCallback)(const gchar *message, gpointer user_data);
+typedef void (*LLMProgressCallback)(const LLMPromptProgress *progress, gpointer user_data);
+
+/// @brief Forward declaration of LLMRequestMetrics
+typedef struct LLMRequestMetrics LLMRequestMetrics;
+typedef void (*LLMMetricsCallback)(const LLMRequestMetrics *metrics, gpointer user_data);
+
+/// @brief Structure to hold the callbacks
+typedef struct {
+    LLMDataCallback on_data_received;
+    LLMErrorCallback on_error;
+    LLMCompleteCallback on_complete;
+    LLMCandidateCallback on_candidate_received; // Optional, receives every choice
+    LLMStatusCallback on_status;                // Optional, progress before the answer streams
+    LLMMetricsCallback on_metrics;              // Optional, lifecycle timings of a finished answer
+    LLMProgressCallback on_progress;            // Optional, prompt processing before the first token
+    gpointer user_data; // Data to be passed to callbacks (e.g., LLMPlugin*)
+} LLMCallbacks;
+
+typedef struct {
+    const gchar* role;    // "user", "assistant", "system"
+    const gchar* content; // The message content
+} ChatMessage;
+
+/// @brief Client-side rules ending an answer early, see llm_stop.h
+typedef struct {
+    gboolean code_block;    // After the first complete fenced code block
+    guint max_lines;        // After this many lines, 0 for no limit
+    gboolean repetition;    // When a group of lines keeps repeating
+} LLMStopRules;
+
+/// @brief LLM arguments descriptor
+typedef struct {
+    gchar* model;
+    guint max_tokens;
+    gdouble temperature;
+    guint n_candidates;              // Alternatives requested per call
+    const gchar* system_instruction; // E.g., "You are a helpful assistant."
+    ChatMessage* messages;           // Array of previous messages
+    guint messages_length;           // Number of messages
+    guint context_size;              // Context window in tokens, 0 if unknown
+    gboolean cache_prompt;           // Ask llama.cpp to reuse the KV cache of a shared prefix
+    gboolean return_progress;        // Ask llama.cpp to stream the prompt processing progress
+    LLMStopRules stop_rules;         // Applied by the client to the streamed answer
+} LLMArgs;
+
+/// @brief Snapshot of a document attached to a request, taken on the main thread
+typedef struct {
+    gchar *name;        // File name, NULL for the current document
+    gchar *text;
+    gchar *path;        // File the text is from, NULL if unknown
+    guint first_line;   // Lines of the file in text, 0-based
+    guint last_line;    // G_MAXUINT for the whole file
+} LLMDocument;
+
+/// @brief Per-transfer settings and timings, filled by llm_execute_query
+typedef struct {
+    guint max_attempts;       // Attempts on transient errors, 0 for the default
+    gint64 start_time;        // Monotonic time (us) the last attempt was sent
+    gint64 connect_time;      // Monotonic time (us) the connection was established
+    gint64 first_byte_time;   // Monotonic time (us) of the first response byte
+    gint64 first_token_time;  // Monotonic time (us) of the first streamed text of the first choice, 0 if none
+    gint64 last_token_time;   // Monotonic time (us) of the last streamed text of the first choice
+    gint64 end_time;          // Monotonic time (us) the transfer ended
+    guint chunks;             // Streamed text chunks of the first choice, roughly one per token
+    gboolean text_received;   // Text of any choice arrived, a retry would repeat it
+    glong http_code;
+    LLMFinishReason finish_reason; // Of the first choice
+    LLMServerTimings server;
+} LLMTransfer;
+
+/// @brief Lifecycle of a chat request, monotonic times in microseconds
+struct LLMRequestMetrics {
+    gint64 submit_time;       // Send clicked
+    gint64 snapshot_time;     // Documents copied on the main thread
+    gint64 payload_time;      // JSON payload built on the worker
+    LLMTransfer transfer;     // Connect, first byte, first and last token
+    gint64 ui_flush_time;     // Last chunk inserted into the output view
+};
+
+/// @brief Forward declaration of LLMStats
+typedef struct LLMStats LLMStats;
+
+/// @brief Forward declarations of the capture types, see llm_capture.h
+typedef struct LLMCapture LLMCapture;
+typedef struct LLMCaptureWriter LLMCaptureWriter;
+
+/// @brief structure to pass necessary info to write_callback
+typedef struct {
+    GString *accumulator;
+    LLMCallbacks *callbacks;
+    gboolean *cancel_flag;  
+    LLMTransfer *transfer;
+    LLMCaptureWriter *capture;  // Records the raw bytes, NULL when not capturing
+} WriteCallbackData;
+
+#endif // __LLM_TYPES_H__
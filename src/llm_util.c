@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "llm_util.h"
 
 
@@ -17,4 +19,43 @@ gchar* llm_construct_server_uri_string(const gchar* server_base_uri, const gchar
     }
     
     return g_strjoin(NULL, server_base_uri, path, NULL);
-}
\ No newline at end of file
+}
+
+/// @brief Create a document snapshot, taking ownership of text
+LLMDocument *llm_document_new(const gchar *name, gchar *text)
+{
+    LLMDocument *document = g_new0(LLMDocument, 1);
+    document->name = g_strdup(name);
+    document->text = text ? text : g_strdup("");
+    return document;
+}
+
+/// @brief Record the lines of a file a document holds
+void llm_document_set_source(LLMDocument *document, const gchar *path, guint first_line, guint last_line)
+{
+    g_free(document->path);
+    document->path = g_strdup(path);
+    document->first_line = first_line;
+    document->last_line = last_line;
+}
+
+/// @brief TRUE if a document holds any of the lines of a file
+gboolean llm_document_overlaps(const LLMDocument *document, const gchar *path, guint first_line,
+    guint last_line)
+{
+    return document->path && path && strcmp(document->path, path) == 0 &&
+        document->first_line <= last_line && first_line <= document->last_line;
+}
+
+/// @brief Free a document snapshot
+void llm_document_free(gpointer data)
+{
+    LLMDocument *document = (LLMDocument *)data;
+    if (!document) {
+        return;
+    }
+    g_free(document->name);
+    g_free(document->text);
+    g_free(document->path);
+    g_free(document);
+}
@@ -2,7 +2,22 @@
 #define __LLM_UTIL_H__
 
 #include <glib.h>
+#include "llm_types.h"
 
 gchar* llm_construct_server_uri_string(const gchar* server_base_uri, const gchar *path);
 
+/// @brief Create a document snapshot, taking ownership of text
+LLMDocument *llm_document_new(const gchar *name, gchar *text);
+
+/// @brief Record the lines of a file a document holds
+/// @param last_line G_MAXUINT for the whole file
+void llm_document_set_source(LLMDocument *document, const gchar *path, guint first_line, guint last_line);
+
+/// @brief TRUE if a document holds any of the lines of a file
+gboolean llm_document_overlaps(const LLMDocument *document, const gchar *path, guint first_line,
+    guint last_line);
+
+/// @brief Free a document snapshot
+void llm_document_free(gpointer data);
+
 #endif // __LLM_UTIL_H__
\ No newline at end of file
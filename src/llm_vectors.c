@@ -0,0 +1,558 @@
+#include <math.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LLM_VECTORS_X86 1
+#endif
+
+#include "llm_vectors.h"
+
+#define LLM_VECTORS_MAGIC "LLMVEC8\001"
+#define LLM_VECTORS_MAGIC_LENGTH 8
+/// @brief Rows are padded to this many bytes, the width of an AVX2 load
+#define LLM_VECTORS_ROW_ALIGN 32
+/// @brief Largest component of a quantized vector
+#define LLM_VECTORS_QUANT_MAX 127.0f
+
+#define LLM_VECTORS_FNV_OFFSET G_GUINT64_CONSTANT(14695981039346656037)
+#define LLM_VECTORS_FNV_PRIME G_GUINT64_CONSTANT(1099511628211)
+
+typedef gint32 (*LLMDotFunc)(const gint8 *a, const gint8 *b, guint stride);
+
+struct LLMVectorStore {
+    GMutex lock;
+    gchar *model;
+    guint dimension;
+    guint stride;               // Bytes per row, the dimension padded with zeros
+    GMappedFile *mapped;        // File holding the first mapped_count rows, NULL if none
+    const gint8 *mapped_rows;
+    guint mapped_count;
+    GByteArray *rows;           // Rows added since, stride bytes each
+    GArray *keys;               // guint64 by row, the mapped rows first
+    GArray *scales;             // gfloat by row, the normalized vector is row * scale
+    GHashTable *rows_by_key;    // guint64* key -> row + 1
+    gboolean dirty;
+};
+
+/// @brief Top hits of a slice of the rows
+typedef struct {
+    LLMVectorStore *store;
+    const gint8 *query;
+    guint first_row;
+    guint end_row;
+    guint max_hits;
+    LLMVectorHit *hits;         // Best first, max_hits entries
+    guint hit_count;
+} LLMVectorScan;
+
+static LLMDotFunc llm_vectors_dot;
+static const gchar *llm_vectors_dot_name;
+
+guint64 llm_vectors_key(const gchar *text, gsize length)
+{
+    guint64 hash = LLM_VECTORS_FNV_OFFSET;
+    for (gsize i = 0; i < length; i++) {
+        hash ^= (guint8)text[i];
+        hash *= LLM_VECTORS_FNV_PRIME;
+    }
+    return hash;
+}
+
+static gint32 llm_vectors_dot_scalar(const gint8 *a, const gint8 *b, guint stride)
+{
+    gint32 sum = 0;
+    for (guint i = 0; i < stride; i++) {
+        sum += (gint32)a[i] * b[i];
+    }
+    return sum;
+}
+
+#if defined(LLM_VECTORS_X86) && defined(__SSE2__)
+static gint32 llm_vectors_dot_sse2(const gint8 *a, const gint8 *b, guint stride)
+{
+    __m128i sum = _mm_setzero_si128();
+    for (guint i = 0; i < stride; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        // SSE2 has no sign extension of bytes: unpack each byte twice and shift
+        __m128i a_low = _mm_srai_epi16(_mm_unpacklo_epi8(va, va), 8);
+        __m128i a_high = _mm_srai_epi16(_mm_unpackhi_epi8(va, va), 8);
+        __m128i b_low = _mm_srai_epi16(_mm_unpacklo_epi8(vb, vb), 8);
+        __m128i b_high = _mm_srai_epi16(_mm_unpackhi_epi8(vb, vb), 8);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(a_low, b_low));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(a_high, b_high));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+#endif
+
+#ifdef LLM_VECTORS_X86
+__attribute__((target("avx2")))
+static gint32 llm_vectors_dot_avx2(const gint8 *a, const gint8 *b, guint stride)
+{
+    __m256i sum = _mm256_setzero_si256();
+    for (guint i = 0; i < stride; i += 16) {
+        __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(b + i)));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(va, vb));
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(half);
+}
+#endif
+
+/// @brief Pick the fastest dot product the CPU runs, once
+static void llm_vectors_init_dot(void)
+{
+    static gsize initialized = 0;
+    if (!g_once_init_enter(&initialized)) {
+        return;
+    }
+
+    llm_vectors_dot = llm_vectors_dot_scalar;
+    llm_vectors_dot_name = "scalar";
+#if defined(LLM_VECTORS_X86) && defined(__SSE2__)
+    llm_vectors_dot = llm_vectors_dot_sse2;
+    llm_vectors_dot_name = "SSE2";
+#endif
+#ifdef LLM_VECTORS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        llm_vectors_dot = llm_vectors_dot_avx2;
+        llm_vectors_dot_name = "AVX2";
+    }
+#endif
+    g_once_init_leave(&initialized, 1);
+}
+
+/// @brief Normalize and quantize a vector into a zeroed row
+/// @return the scale of the row, 0 for a zero vector
+static gfloat llm_vectors_quantize(const gfloat *vector, guint dimension, gint8 *row)
+{
+    gdouble norm = 0;
+    gfloat largest = 0;
+    for (guint i = 0; i < dimension; i++) {
+        norm += (gdouble)vector[i] * vector[i];
+        largest = MAX(largest, fabsf(vector[i]));
+    }
+    norm = sqrt(norm);
+    if (norm == 0 || !isfinite(norm)) {
+        return 0;
+    }
+
+    gfloat step = largest / LLM_VECTORS_QUANT_MAX;
+    for (guint i = 0; i < dimension; i++) {
+        row[i] = (gint8)CLAMP(lrintf(vector[i] / step), -127, 127);
+    }
+    return (gfloat)(step / norm);
+}
+
+static guint llm_vectors_stride(guint dimension)
+{
+    return (dimension + LLM_VECTORS_ROW_ALIGN - 1) / LLM_VECTORS_ROW_ALIGN * LLM_VECTORS_ROW_ALIGN;
+}
+
+static const gint8 *llm_vectors_row_locked(LLMVectorStore *store, guint row)
+{
+    if (row < store->mapped_count) {
+        return store->mapped_rows + (gsize)row * store->stride;
+    }
+    return (const gint8 *)store->rows->data + (gsize)(row - store->mapped_count) * store->stride;
+}
+
+static void llm_vectors_insert_key_locked(LLMVectorStore *store, guint64 key, guint row)
+{
+    guint64 *stored = g_new(guint64, 1);
+    *stored = key;
+    g_hash_table_insert(store->rows_by_key, stored, GUINT_TO_POINTER(row + 1));
+}
+
+LLMVectorStore *llm_vectors_new(const gchar *model)
+{
+    llm_vectors_init_dot();
+
+    LLMVectorStore *store = g_new0(LLMVectorStore, 1);
+    g_mutex_init(&store->lock);
+    store->model = g_strdup(model);
+    store->rows = g_byte_array_new();
+    store->keys = g_array_new(FALSE, FALSE, sizeof(guint64));
+    store->scales = g_array_new(FALSE, FALSE, sizeof(gfloat));
+    store->rows_by_key = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+    return store;
+}
+
+void llm_vectors_free(LLMVectorStore *store)
+{
+    if (!store) {
+        return;
+    }
+    g_hash_table_destroy(store->rows_by_key);
+    g_array_free(store->scales, TRUE);
+    g_array_free(store->keys, TRUE);
+    g_byte_array_free(store->rows, TRUE);
+    if (store->mapped) {
+        g_mapped_file_unref(store->mapped);
+    }
+    g_free(store->model);
+    g_mutex_clear(&store->lock);
+    g_free(store);
+}
+
+gboolean llm_vectors_dirty(LLMVectorStore *store)
+{
+    g_mutex_lock(&store->lock);
+    gboolean dirty = store->dirty;
+    g_mutex_unlock(&store->lock);
+    return dirty;
+}
+
+const gchar *llm_vectors_model(LLMVectorStore *store)
+{
+    // Set when the store is created and never changed
+    return store->model;
+}
+
+guint llm_vectors_dimension(LLMVectorStore *store)
+{
+    g_mutex_lock(&store->lock);
+    guint dimension = store->dimension;
+    g_mutex_unlock(&store->lock);
+    return dimension;
+}
+
+guint llm_vectors_count(LLMVectorStore *store)
+{
+    g_mutex_lock(&store->lock);
+    guint count = store->keys->len;
+    g_mutex_unlock(&store->lock);
+    return count;
+}
+
+gboolean llm_vectors_contains(LLMVectorStore *store, guint64 key)
+{
+    g_mutex_lock(&store->lock);
+    gboolean contains = g_hash_table_contains(store->rows_by_key, &key);
+    g_mutex_unlock(&store->lock);
+    return contains;
+}
+
+gboolean llm_vectors_add(LLMVectorStore *store, guint64 key, const gfloat *vector, guint dimension)
+{
+    g_return_val_if_fail(dimension > 0, FALSE);
+
+    g_mutex_lock(&store->lock);
+    if (store->dimension == 0) {
+        store->dimension = dimension;
+        store->stride = llm_vectors_stride(dimension);
+    } else if (store->dimension != dimension) {
+        g_mutex_unlock(&store->lock);
+        return FALSE;
+    }
+
+    if (!g_hash_table_contains(store->rows_by_key, &key)) {
+        guint length = store->rows->len;
+        g_byte_array_set_size(store->rows, length + store->stride);
+        gint8 *row = (gint8 *)store->rows->data + length;
+        memset(row, 0, store->stride);
+        gfloat scale = llm_vectors_quantize(vector, dimension, row);
+
+        guint row_number = store->keys->len;
+        g_array_append_val(store->keys, key);
+        g_array_append_val(store->scales, scale);
+        llm_vectors_insert_key_locked(store, key, row_number);
+        store->dirty = TRUE;
+    }
+    g_mutex_unlock(&store->lock);
+    return TRUE;
+}
+
+void llm_vectors_retain(LLMVectorStore *store, GHashTable *keep)
+{
+    g_mutex_lock(&store->lock);
+
+    guint kept = 0;
+    for (guint i = 0; i < store->keys->len; i++) {
+        kept += g_hash_table_contains(keep, &g_array_index(store->keys, guint64, i));
+    }
+    if (kept == store->keys->len) {
+        g_mutex_unlock(&store->lock);
+        return;
+    }
+
+    // Rebuilt in memory: the mapped rows cannot be compacted in place
+    GByteArray *rows = g_byte_array_sized_new(kept * store->stride);
+    GArray *keys = g_array_sized_new(FALSE, FALSE, sizeof(guint64), kept);
+    GArray *scales = g_array_sized_new(FALSE, FALSE, sizeof(gfloat), kept);
+    g_hash_table_remove_all(store->rows_by_key);
+
+    for (guint i = 0; i < store->keys->len; i++) {
+        guint64 key = g_array_index(store->keys, guint64, i);
+        if (!g_hash_table_contains(keep, &key)) {
+            continue;
+        }
+        g_byte_array_append(rows, (const guint8 *)llm_vectors_row_locked(store, i), store->stride);
+        llm_vectors_insert_key_locked(store, key, keys->len);
+        g_array_append_val(keys, key);
+        g_array_append_val(scales, g_array_index(store->scales, gfloat, i));
+    }
+
+    g_byte_array_free(store->rows, TRUE);
+    g_array_free(store->keys, TRUE);
+    g_array_free(store->scales, TRUE);
+    if (store->mapped) {
+        g_mapped_file_unref(store->mapped);
+    }
+    store->rows = rows;
+    store->keys = keys;
+    store->scales = scales;
+    store->mapped = NULL;
+    store->mapped_rows = NULL;
+    store->mapped_count = 0;
+    if (kept == 0) {
+        // Vectors of another length may follow
+        store->dimension = 0;
+        store->stride = 0;
+    }
+    store->dirty = TRUE;
+
+    g_mutex_unlock(&store->lock);
+}
+
+/// @brief Insert a hit into a list kept best first
+static void llm_vectors_offer(LLMVectorHit *hits, guint *count, guint max_hits, guint64 key, gfloat score)
+{
+    if (*count == max_hits && hits[max_hits - 1].score >= score) {
+        return;
+    }
+
+    guint position = *count < max_hits ? (*count)++ : max_hits - 1;
+    while (position > 0 && hits[position - 1].score < score) {
+        hits[position] = hits[position - 1];
+        position--;
+    }
+    hits[position].key = key;
+    hits[position].score = score;
+}
+
+static void llm_vectors_scan(LLMVectorScan *scan)
+{
+    LLMVectorStore *store = scan->store;
+    const guint64 *keys = (const guint64 *)store->keys->data;
+    const gfloat *scales = (const gfloat *)store->scales->data;
+
+    for (guint row = scan->first_row; row < scan->end_row; row++) {
+        gint32 dot = llm_vectors_dot(scan->query, llm_vectors_row_locked(store, row), store->stride);
+        llm_vectors_offer(scan->hits, &scan->hit_count, scan->max_hits, keys[row], dot * scales[row]);
+    }
+}
+
+static gpointer llm_vectors_scan_thread(gpointer data)
+{
+    llm_vectors_scan(data);
+    return NULL;
+}
+
+GArray *llm_vectors_search(LLMVectorStore *store, const gfloat *query, guint dimension, guint max_hits)
+{
+    GArray *result = g_array_new(FALSE, FALSE, sizeof(LLMVectorHit));
+
+    g_mutex_lock(&store->lock);
+    guint count = store->keys->len;
+    if (count == 0 || max_hits == 0 || dimension != store->dimension) {
+        g_mutex_unlock(&store->lock);
+        return result;
+    }
+
+    gint8 *query_row = g_malloc0(store->stride);
+    gfloat query_scale = llm_vectors_quantize(query, dimension, query_row);
+
+    guint threads = 1;
+    if (count >= LLM_VECTORS_PARALLEL_MIN_ROWS) {
+        threads = CLAMP(g_get_num_processors(), 1, LLM_VECTORS_MAX_THREADS);
+    }
+
+    // The lock is held throughout, the rows cannot move under the scanning threads
+    LLMVectorScan *scans = g_new0(LLMVectorScan, threads);
+    GThread **workers = g_new0(GThread *, threads);
+    guint slice = (count + threads - 1) / threads;
+    for (guint i = 0; i < threads; i++) {
+        LLMVectorScan *scan = &scans[i];
+        scan->store = store;
+        scan->query = query_row;
+        scan->first_row = MIN(i * slice, count);
+        scan->end_row = MIN(scan->first_row + slice, count);
+        scan->max_hits = max_hits;
+        scan->hits = g_new(LLMVectorHit, max_hits);
+        if (i > 0) {
+            workers[i] = g_thread_new("llm-vectors", llm_vectors_scan_thread, scan);
+        }
+    }
+    llm_vectors_scan(&scans[0]);
+
+    LLMVectorHit *best = g_new(LLMVectorHit, max_hits);
+    guint best_count = 0;
+    for (guint i = 0; i < threads; i++) {
+        if (workers[i]) {
+            g_thread_join(workers[i]);
+        }
+        for (guint j = 0; j < scans[i].hit_count; j++) {
+            llm_vectors_offer(best, &best_count, max_hits, scans[i].hits[j].key, scans[i].hits[j].score);
+        }
+        g_free(scans[i].hits);
+    }
+    g_mutex_unlock(&store->lock);
+
+    for (guint i = 0; i < best_count; i++) {
+        best[i].score *= query_scale;
+    }
+    g_array_append_vals(result, best, best_count);
+
+    g_free(best);
+    g_free(workers);
+    g_free(scans);
+    g_free(query_row);
+    return result;
+}
+
+void llm_vectors_describe(LLMVectorStore *store, GString *out)
+{
+    llm_vectors_init_dot();
+
+    g_mutex_lock(&store->lock);
+    g_string_append_printf(out, "%u vectors of %u dimensions as int8, %u mapped, model %s, %s dot products\n",
+        store->keys->len, store->dimension, store->mapped_count,
+        store->model && *store->model ? store->model : "(server default)", llm_vectors_dot_name);
+    g_mutex_unlock(&store->lock);
+}
+
+// File format, in the host's byte order as the file is a local cache:
+//   magic, then dimension, stride, count and model length as guint32
+//   the model name, padded with zeros to 8 bytes
+//   count keys as guint64 and count scales as gfloat
+//   zeros up to a multiple of LLM_VECTORS_ROW_ALIGN bytes from the start
+//   count rows of stride bytes, mapped as they are when the file is read
+
+static void llm_vectors_write_u32(GByteArray *out, guint32 value)
+{
+    g_byte_array_append(out, (const guint8 *)&value, sizeof(value));
+}
+
+static void llm_vectors_pad(GByteArray *out, guint alignment)
+{
+    static const guint8 zeros[LLM_VECTORS_ROW_ALIGN] = { 0 };
+    guint padding = (alignment - out->len % alignment) % alignment;
+    g_byte_array_append(out, zeros, padding);
+}
+
+gboolean llm_vectors_save(LLMVectorStore *store, const gchar *path, GError **error)
+{
+    g_mutex_lock(&store->lock);
+
+    guint count = store->keys->len;
+    gsize model_length = store->model ? strlen(store->model) : 0;
+    GByteArray *out = g_byte_array_sized_new(LLM_VECTORS_MAGIC_LENGTH + 16 + model_length +
+        count * (sizeof(guint64) + sizeof(gfloat) + store->stride) + 2 * LLM_VECTORS_ROW_ALIGN);
+
+    g_byte_array_append(out, (const guint8 *)LLM_VECTORS_MAGIC, LLM_VECTORS_MAGIC_LENGTH);
+    llm_vectors_write_u32(out, store->dimension);
+    llm_vectors_write_u32(out, store->stride);
+    llm_vectors_write_u32(out, count);
+    llm_vectors_write_u32(out, (guint32)model_length);
+    if (model_length > 0) {
+        g_byte_array_append(out, (const guint8 *)store->model, model_length);
+    }
+    llm_vectors_pad(out, sizeof(guint64));
+    g_byte_array_append(out, (const guint8 *)store->keys->data, count * sizeof(guint64));
+    g_byte_array_append(out, (const guint8 *)store->scales->data, count * sizeof(gfloat));
+    llm_vectors_pad(out, LLM_VECTORS_ROW_ALIGN);
+    if (store->mapped_count > 0) {
+        g_byte_array_append(out, (const guint8 *)store->mapped_rows,
+            (gsize)store->mapped_count * store->stride);
+    }
+    g_byte_array_append(out, store->rows->data, store->rows->len);
+    store->dirty = FALSE;
+
+    g_mutex_unlock(&store->lock);
+
+    // Written to a new file and renamed, a mapping of the old one stays valid
+    gboolean saved = g_file_set_contents(path, (const gchar *)out->data, out->len, error);
+    if (!saved) {
+        g_mutex_lock(&store->lock);
+        store->dirty = TRUE;
+        g_mutex_unlock(&store->lock);
+    }
+    g_byte_array_free(out, TRUE);
+    return saved;
+}
+
+LLMVectorStore *llm_vectors_load(const gchar *path, GError **error)
+{
+    GMappedFile *mapped = g_mapped_file_new(path, FALSE, error);
+    if (!mapped) {
+        return NULL;
+    }
+
+    const guint8 *start = (const guint8 *)g_mapped_file_get_contents(mapped);
+    gsize length = g_mapped_file_get_length(mapped);
+    guint32 header[4] = { 0 };
+    gboolean valid = start && length >= LLM_VECTORS_MAGIC_LENGTH + sizeof(header) &&
+        memcmp(start, LLM_VECTORS_MAGIC, LLM_VECTORS_MAGIC_LENGTH) == 0;
+    if (valid) {
+        memcpy(header, start + LLM_VECTORS_MAGIC_LENGTH, sizeof(header));
+    }
+
+    guint32 dimension = header[0], stride = header[1], count = header[2], model_length = header[3];
+    gsize offset = LLM_VECTORS_MAGIC_LENGTH + sizeof(header);
+    valid = valid && stride == llm_vectors_stride(dimension) && (dimension > 0 || count == 0) &&
+        model_length <= length - offset;
+
+    gsize keys_offset = 0, scales_offset = 0, rows_offset = 0;
+    if (valid) {
+        keys_offset = (offset + model_length + sizeof(guint64) - 1) / sizeof(guint64) * sizeof(guint64);
+        scales_offset = keys_offset + (gsize)count * sizeof(guint64);
+        rows_offset = scales_offset + (gsize)count * sizeof(gfloat);
+        rows_offset = (rows_offset + LLM_VECTORS_ROW_ALIGN - 1) / LLM_VECTORS_ROW_ALIGN * LLM_VECTORS_ROW_ALIGN;
+        valid = rows_offset <= length && (gsize)count * stride == length - rows_offset;
+    }
+
+    if (!valid) {
+        g_mapped_file_unref(mapped);
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s is not a valid vector store", path);
+        return NULL;
+    }
+
+    gchar *model = model_length > 0 ? g_strndup((const gchar *)start + offset, model_length) : NULL;
+    LLMVectorStore *store = llm_vectors_new(model);
+    g_free(model);
+
+    store->dimension = dimension;
+    store->stride = stride;
+    g_array_set_size(store->keys, count);
+    g_array_set_size(store->scales, count);
+    if (count > 0) {
+        memcpy(store->keys->data, start + keys_offset, (gsize)count * sizeof(guint64));
+        memcpy(store->scales->data, start + scales_offset, (gsize)count * sizeof(gfloat));
+    }
+
+    for (guint32 i = 0; i < count; i++) {
+        guint64 key = g_array_index(store->keys, guint64, i);
+        if (g_hash_table_contains(store->rows_by_key, &key)) {
+            g_mapped_file_unref(mapped);
+            llm_vectors_free(store);
+            g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s is not a valid vector store", path);
+            return NULL;
+        }
+        llm_vectors_insert_key_locked(store, key, i);
+    }
+
+    store->mapped = mapped;
+    store->mapped_rows = (const gint8 *)start + rows_offset;
+    store->mapped_count = count;
+    store->dirty = FALSE;
+    return store;
+}
@@ -0,0 +1,79 @@
+#ifndef __LLM_VECTORS_H__
+#define __LLM_VECTORS_H__
+
+#include "llm_types.h"
+
+/**
+ * Store of embedding vectors for similarity search.
+ *
+ * Vectors are normalized and quantized to int8 with one float scale per
+ * vector, a quarter of their float size, and looked up by a 64-bit key,
+ * the hash of the text they embed. The store is written to a file whose
+ * rows are memory-mapped when it is read again, so a session starts
+ * without reading every vector.
+ *
+ * A search scores every vector by its dot product with the query, the
+ * cosine similarity as all are normalized. The int8 dot products use
+ * AVX2 where the CPU has it and SSE2 otherwise, and large stores are
+ * scanned by several threads at once.
+ *
+ * All functions are thread-safe.
+ */
+
+/// @brief Stores with fewer vectors are scanned by the calling thread alone
+#define LLM_VECTORS_PARALLEL_MIN_ROWS 8192
+#define LLM_VECTORS_MAX_THREADS 8
+
+typedef struct LLMVectorStore LLMVectorStore;
+
+/// @brief A vector found by llm_vectors_search()
+typedef struct {
+    guint64 key;
+    gfloat score;   // Cosine similarity, -1 to 1
+} LLMVectorHit;
+
+/// @brief Key of a text: FNV-1a, 64 bits
+guint64 llm_vectors_key(const gchar *text, gsize length);
+
+/// @brief Create an empty store
+/// @param model name of the model the vectors come from, may be NULL
+LLMVectorStore *llm_vectors_new(const gchar *model);
+
+void llm_vectors_free(LLMVectorStore *store);
+
+/// @brief Read a store written by llm_vectors_save(), mapping its rows
+/// @return NULL with error set if the file is missing or damaged
+LLMVectorStore *llm_vectors_load(const gchar *path, GError **error);
+
+/// @brief Write the store to a file, atomically
+gboolean llm_vectors_save(LLMVectorStore *store, const gchar *path, GError **error);
+
+/// @brief TRUE if vectors were added or dropped since the store was loaded or saved
+gboolean llm_vectors_dirty(LLMVectorStore *store);
+
+/// @brief Model the vectors come from, NULL if unknown
+const gchar *llm_vectors_model(LLMVectorStore *store);
+
+/// @brief Length of the vectors, 0 while the store is empty
+guint llm_vectors_dimension(LLMVectorStore *store);
+
+guint llm_vectors_count(LLMVectorStore *store);
+
+gboolean llm_vectors_contains(LLMVectorStore *store, guint64 key);
+
+/// @brief Add the vector of a key, a key stored already keeps its vector
+/// @return FALSE if the dimension differs from the vectors stored already
+gboolean llm_vectors_add(LLMVectorStore *store, guint64 key, const gfloat *vector, guint dimension);
+
+/// @brief Drop the vectors whose keys are not in keep, all of them resets the dimension
+/// @param keep set of guint64 keys, hashed with g_int64_hash()
+void llm_vectors_retain(LLMVectorStore *store, GHashTable *keep);
+
+/// @brief The vectors most similar to a query
+/// @return LLMVectorHit, best first, free with g_array_unref()
+GArray *llm_vectors_search(LLMVectorStore *store, const gfloat *query, guint dimension, guint max_hits);
+
+/// @brief Append the vector count, dimension, model and SIMD path to out
+void llm_vectors_describe(LLMVectorStore *store, GString *out);
+
+#endif // __LLM_VECTORS_H__
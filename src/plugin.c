@@ -13,6 +13,21 @@
 
 #include "llm_http.h"
 #include "llm_json.h"
+#include "llm_candidates.h"
+#include "llm_scheduler.h"
+#include "llm_endpoints.h"
+#include "diagnostics.h"
+#include "llm_hedge.h"
+#include "llm_profiles.h"
+#include "batch.h"
+#include "llm_stats.h"
+#include "llm_trace.h"
+#include "llm_capture.h"
+#include "llm_answer.h"
+#include "llm_keepalive.h"
+#include "llm_probe.h"
+#include "llm_symbols.h"
+#include "llm_retrieval.h"
 
 #ifdef HAVE_CONFIG_H
 # include "config.h"
@@ -36,16 +51,57 @@ gboolean llm_plugin_init(GeanyPlugin *plugin, gpointer pdata)
     llm_plugin->proxy_url = NULL;
     llm_plugin->llm_args = g_new0(LLMArgs, 1); 
 
-    llm_plugin->is_generating = FALSE;
-    llm_plugin->cancel_requested = FALSE;
-    llm_plugin->active_thread_data = NULL;
+    llm_plugin->answer_state = 0;
+    llm_plugin->answer = NULL;
+    llm_answer_init(llm_plugin);
+    llm_plugin->active_job_id = 0;
+    llm_plugin->scheduler = llm_scheduler_new();
+    llm_plugin->max_parallel_requests = LLM_SCHEDULER_DEFAULT_SLOTS;
+    llm_plugin->completion_limit = 1;
+    llm_plugin->background_limit = 1;
+    llm_plugin->batch_runs = g_ptr_array_new();
+    llm_plugin->stats = llm_stats_new();
 
     // TODO: make them configurable
     llm_plugin->llm_args->max_tokens = 1024;
     llm_plugin->llm_args->temperature = 0.8f;
     llm_plugin->llm_args->model = NULL;
+    llm_plugin->llm_args->n_candidates = 1;
+
+    llm_plugin->endpoints = llm_endpoints_new();
+    llm_profiles_init(llm_plugin);
+    llm_plugin->hedge_enabled = FALSE;
+    llm_plugin->hedge_delay_ms = LLM_HEDGE_DEFAULT_DELAY_MS;
+    llm_plugin->trace_enabled = FALSE;
+    llm_plugin->capture_enabled = FALSE;
+    llm_plugin->continue_enabled = TRUE;
+    llm_plugin->stop_rules.code_block = FALSE;
+    llm_plugin->stop_rules.max_lines = 0;
+    llm_plugin->stop_rules.repetition = TRUE;
+    llm_plugin->warmup_enabled = FALSE;
+    llm_plugin->keepalive_interval = 0;
+    llm_plugin->symbol_context = FALSE;
+    llm_plugin->symbol_depth = LLM_SYMBOLS_DEFAULT_DEPTH;
+    llm_plugin->symbol_max_lines = LLM_SYMBOLS_DEFAULT_LINES;
+    llm_plugin->retrieval_enabled = FALSE;
+    llm_plugin->retrieval_hits = LLM_RETRIEVAL_DEFAULT_HITS;
+    llm_plugin->retrieval_patterns = g_strdup(LLM_RETRIEVAL_DEFAULT_PATTERNS);
+    llm_plugin->semantic_enabled = FALSE;
+    llm_plugin->embedding_model = g_strdup("");
+    llm_plugin->summaries_enabled = FALSE;
+    llm_plugin->summaries_tokens = LLM_SUMMARIES_DEFAULT_TOKENS;
+    llm_plugin->last_activity_time = g_get_monotonic_time();
 
     llm_plugin_settings_load(llm_plugin);
+    llm_probe_init(llm_plugin);
+    llm_plugin_apply_scheduler_limits(llm_plugin);
+    llm_plugin_apply_tracing(llm_plugin);
+    llm_plugin_apply_capture(llm_plugin);
+    llm_endpoints_set_urls(llm_plugin->endpoints, llm_plugin->llm_server_url, llm_plugin->extra_server_urls);
+    // Queued as background jobs, the servers are not waited for here
+    llm_probe_refresh(llm_plugin, TRUE);
+    llm_keepalive_apply(llm_plugin);
+    llm_retrieval_apply(llm_plugin);
 
     llm_plugin->selected_document_ids = NULL;
     llm_plugin->include_current_document = TRUE; // Default to including current document
@@ -81,6 +137,21 @@ gboolean llm_plugin_init(GeanyPlugin *plugin, gpointer pdata)
     // Connect to the document-close signal
     plugin_signal_connect(plugin, NULL, "document-close", TRUE, 
                          G_CALLBACK(on_document_close), llm_plugin);
+    // Editing counts as using Geany for the keep-alive
+    plugin_signal_connect(plugin, NULL, "editor-notify", FALSE,
+                         G_CALLBACK(on_llm_editor_notify), llm_plugin);
+    // Keep the project index current and follow the project
+    plugin_signal_connect(plugin, NULL, "document-save", TRUE,
+                         G_CALLBACK(on_llm_document_save), llm_plugin);
+    plugin_signal_connect(plugin, NULL, "project-open", TRUE,
+                         G_CALLBACK(on_llm_project_open), llm_plugin);
+    plugin_signal_connect(plugin, NULL, "project-close", TRUE,
+                         G_CALLBACK(on_llm_project_close), llm_plugin);
+
+    // Keybindings
+    GeanyKeyGroup *key_group = plugin_set_key_group(plugin, GEANY_LLM_PLUGIN_CONFIGNAME, LLM_KB_COUNT, NULL);
+    keybindings_set_item(key_group, LLM_KB_NEXT_CANDIDATE, on_next_candidate_key,
+                         0, 0, "next_candidate", _("Show next answer candidate"), NULL);
 
     return TRUE;
 }
@@ -91,9 +162,32 @@ void llm_plugin_cleanup(GeanyPlugin *plugin, gpointer pdata)
     g_print("LLM Plugin cleanup\n");
     if (llm_plugin)
     {
+        // Cancel and drain the workers before the state they use goes away
+        llm_keepalive_stop(llm_plugin);
+        llm_retrieval_close(llm_plugin);
+        llm_batch_close_all(llm_plugin);
+        g_ptr_array_free(llm_plugin->batch_runs, TRUE);
+        llm_scheduler_free(llm_plugin->scheduler);
+        llm_plugin->scheduler = NULL;
+        // No worker queues UI updates any more, drop those still pending
+        llm_answer_close(llm_plugin);
+        // Write the trace of this session while the config directory is known
+        llm_plugin->trace_enabled = FALSE;
+        llm_plugin_apply_tracing(llm_plugin);
+        llm_trace_free();
+        llm_capture_set_dir(NULL);
+        llm_probe_cleanup(llm_plugin);
+        llm_endpoints_free(llm_plugin->endpoints);
+        llm_stats_free(llm_plugin->stats);
+        llm_profiles_free(llm_plugin);
+        if (llm_plugin->llm_args)
+            g_free(llm_plugin->llm_args->model);
         g_free(llm_plugin->llm_args);
         g_free(llm_plugin->llm_server_url);
+        g_free(llm_plugin->extra_server_urls);
         g_free(llm_plugin->proxy_url);
+        g_free(llm_plugin->retrieval_patterns);
+        g_free(llm_plugin->embedding_model);
         if (llm_plugin->llm_panel)
             gtk_widget_destroy(llm_plugin->llm_panel);
         if (llm_plugin->selected_document_ids)
@@ -105,19 +199,110 @@ void llm_plugin_cleanup(GeanyPlugin *plugin, gpointer pdata)
     curl_global_cleanup();
 }
 
+/// @brief Create the grid of per-task model, server and sampling overrides
+static GtkWidget *llm_create_profiles_widget(LLMPlugin *plugin)
+{
+    static const gchar *task_labels[LLM_TASK_COUNT] = {
+        N_("Chat"),
+        N_("Completion"),
+        N_("Background")
+    };
+    GtkWidget *frame = gtk_frame_new(_("Task profiles (empty or 0 uses the general settings)"));
+    GtkWidget *grid = gtk_grid_new();
+    gtk_grid_set_row_spacing(GTK_GRID(grid), 2);
+    gtk_grid_set_column_spacing(GTK_GRID(grid), 5);
+    gtk_container_set_border_width(GTK_CONTAINER(grid), 5);
+    gtk_container_add(GTK_CONTAINER(frame), grid);
+
+    const gchar *headers[] = { "", _("Model"), _("Servers"), _("Temperature"), _("Max tokens"), _("Context") };
+    for (guint col = 0; col < G_N_ELEMENTS(headers); col++) {
+        GtkWidget *header = gtk_label_new(headers[col]);
+        gtk_widget_set_halign(header, GTK_ALIGN_START);
+        gtk_grid_attach(GTK_GRID(grid), header, col, 0, 1, 1);
+    }
+
+    gint row = 0;
+    for (gint task = 0; task < LLM_TASK_COUNT; task++) {
+        if (!llm_task_in_use(task)) {
+            continue;
+        }
+        LLMTaskProfile *profile = &plugin->profiles[task];
+        row++;
+
+        GtkWidget *label = gtk_label_new(_(task_labels[task]));
+        gtk_widget_set_halign(label, GTK_ALIGN_START);
+        gtk_grid_attach(GTK_GRID(grid), label, 0, row, 1, 1);
+
+        profile->model_entry = gtk_entry_new();
+        gtk_entry_set_text(GTK_ENTRY(profile->model_entry), profile->model ? profile->model : "");
+        gtk_entry_set_width_chars(GTK_ENTRY(profile->model_entry), 16);
+        gtk_grid_attach(GTK_GRID(grid), profile->model_entry, 1, row, 1, 1);
+
+        profile->servers_entry = gtk_entry_new();
+        gtk_entry_set_text(GTK_ENTRY(profile->servers_entry), profile->server_urls ? profile->server_urls : "");
+        gtk_entry_set_width_chars(GTK_ENTRY(profile->servers_entry), 24);
+        gtk_widget_set_tooltip_text(profile->servers_entry, _("Comma separated server URLs for this task"));
+        gtk_grid_attach(GTK_GRID(grid), profile->servers_entry, 2, row, 1, 1);
+
+        profile->temperature_spin = gtk_spin_button_new_with_range(-1.0, 2.0, 0.01);
+        gtk_spin_button_set_digits(GTK_SPIN_BUTTON(profile->temperature_spin), 2);
+        gtk_spin_button_set_value(GTK_SPIN_BUTTON(profile->temperature_spin), profile->temperature);
+        gtk_widget_set_tooltip_text(profile->temperature_spin, _("Negative uses the general temperature"));
+        gtk_grid_attach(GTK_GRID(grid), profile->temperature_spin, 3, row, 1, 1);
+
+        profile->max_tokens_spin = gtk_spin_button_new_with_range(0, 128000, 1);
+        gtk_spin_button_set_digits(GTK_SPIN_BUTTON(profile->max_tokens_spin), 0);
+        gtk_spin_button_set_value(GTK_SPIN_BUTTON(profile->max_tokens_spin), profile->max_tokens);
+        gtk_grid_attach(GTK_GRID(grid), profile->max_tokens_spin, 4, row, 1, 1);
+
+        profile->context_size_spin = gtk_spin_button_new_with_range(0, 1048576, 512);
+        gtk_spin_button_set_digits(GTK_SPIN_BUTTON(profile->context_size_spin), 0);
+        gtk_spin_button_set_value(GTK_SPIN_BUTTON(profile->context_size_spin), profile->context_size);
+        gtk_grid_attach(GTK_GRID(grid), profile->context_size_spin, 5, row, 1, 1);
+    }
+
+    return frame;
+}
+
 /// @brief Function to create the configuration widget for the plugin
 GtkWidget *llm_plugin_configure(GeanyPlugin *plugin, GtkDialog *dialog, gpointer pdata)
 {
     GtkWidget *vbox = NULL; // Main container for the configuration options
     GtkWidget *url_label = NULL; 
+    GtkWidget *extra_urls_label = NULL;
+    GtkWidget *diagnostics_button = NULL;
+    GtkWidget *hedge_box = NULL;
+    GtkWidget *hedge_delay_label = NULL;
+    GtkWidget *stop_box = NULL;
+    GtkWidget *stop_label = NULL;
+    GtkWidget *stop_lines_label = NULL;
+    GtkWidget *keepalive_box = NULL;
+    GtkWidget *keepalive_label = NULL;
     GtkWidget *proxy_label = NULL;
     GtkWidget *model_label = NULL; 
     GtkWidget *temperature_label = NULL;
     GtkWidget *temperature_spin = NULL;
     GtkWidget *max_tokens_label = NULL;
     GtkWidget *max_tokens_spin = NULL;
+    GtkWidget *context_size_label = NULL;
+    GtkWidget *context_size_spin = NULL;
+    GtkWidget *symbol_box = NULL;
+    GtkWidget *symbol_depth_label = NULL;
+    GtkWidget *symbol_lines_label = NULL;
+    GtkWidget *retrieval_box = NULL;
+    GtkWidget *retrieval_hits_label = NULL;
+    GtkWidget *retrieval_patterns_label = NULL;
+    GtkWidget *semantic_box = NULL;
+    GtkWidget *embedding_model_label = NULL;
+    GtkWidget *summaries_box = NULL;
+    GtkWidget *summaries_tokens_label = NULL;
+    GtkWidget *profiles_widget = NULL;
     GtkWidget *api_key_label = NULL;
     GtkWidget *api_key_entry = NULL;
+    GtkWidget *candidates_label = NULL;
+    GtkWidget *candidates_spin = NULL;
+    GtkWidget *parallel_label = NULL;
+    GtkWidget *parallel_spin = NULL;
 
     // Create a vertical box to hold the configuration widgets
     vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
@@ -139,6 +324,85 @@ GtkWidget *llm_plugin_configure(GeanyPlugin *plugin, GtkDialog *dialog, gpointer
     
     gtk_entry_set_placeholder_text(GTK_ENTRY(llm_plugin->url_entry), "e.g., http://localhost:8080/completion");
     
+    extra_urls_label = gtk_label_new(_("Additional servers (optional, comma separated):"));
+    gtk_widget_set_halign(extra_urls_label, GTK_ALIGN_START);
+    llm_plugin->extra_urls_entry = gtk_entry_new();
+    gtk_entry_set_text(GTK_ENTRY(llm_plugin->extra_urls_entry),
+        llm_plugin->extra_server_urls ? llm_plugin->extra_server_urls : "");
+    gtk_entry_set_placeholder_text(GTK_ENTRY(llm_plugin->extra_urls_entry), "e.g., http://gpu-box:8080, http://10.0.0.5:8080");
+    gtk_widget_set_tooltip_text(llm_plugin->extra_urls_entry,
+        _("Requests go to the server with the lowest measured latency and fail over to the others before the first token"));
+
+    // Hedging check button and delay spin button
+    hedge_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    llm_plugin->hedge_check = gtk_check_button_new_with_label(_("Hedge chat requests"));
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(llm_plugin->hedge_check), llm_plugin->hedge_enabled);
+    gtk_widget_set_tooltip_text(llm_plugin->hedge_check,
+        _("Also send a chat request to a second server when the first one has not answered in time; the slower one is cancelled"));
+    hedge_delay_label = gtk_label_new(_("after (ms):"));
+    llm_plugin->hedge_delay_spin = gtk_spin_button_new_with_range(100, 60000, 100);
+    gtk_spin_button_set_digits(GTK_SPIN_BUTTON(llm_plugin->hedge_delay_spin), 0);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(llm_plugin->hedge_delay_spin), llm_plugin->hedge_delay_ms);
+    gtk_box_pack_start(GTK_BOX(hedge_box), llm_plugin->hedge_check, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hedge_box), hedge_delay_label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hedge_box), llm_plugin->hedge_delay_spin, FALSE, FALSE, 0);
+
+    llm_plugin->trace_check = gtk_check_button_new_with_label(_("Record a request trace"));
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(llm_plugin->trace_check), llm_plugin->trace_enabled);
+    gtk_widget_set_tooltip_text(llm_plugin->trace_check,
+        _("Record the timeline of every request and write it to the traces folder of the plugin configuration when disabled or on exit; open it in Perfetto or chrome://tracing"));
+
+    llm_plugin->capture_check = gtk_check_button_new_with_label(_("Capture the raw responses"));
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(llm_plugin->capture_check), llm_plugin->capture_enabled);
+    gtk_widget_set_tooltip_text(llm_plugin->capture_check,
+        _("Write every request body and the response bytes as received to the captures folder of the plugin configuration, to be replayed from the diagnostics; the captures contain the documents sent"));
+
+    llm_plugin->continue_check = gtk_check_button_new_with_label(_("Continue truncated answers"));
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(llm_plugin->continue_check), llm_plugin->continue_enabled);
+    gtk_widget_set_tooltip_text(llm_plugin->continue_check,
+        _("When an answer stops at the token limit or the connection drops, ask the server to go on from where it stopped, reusing its cached prompt"));
+
+    // Client-side stop rules
+    stop_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    stop_label = gtk_label_new(_("Stop answers:"));
+    llm_plugin->stop_code_block_check = gtk_check_button_new_with_label(_("after the first code block"));
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(llm_plugin->stop_code_block_check), llm_plugin->stop_rules.code_block);
+    gtk_widget_set_tooltip_text(llm_plugin->stop_code_block_check,
+        _("End the answer once a fenced code block is complete, skipping the explanation that usually follows"));
+    stop_lines_label = gtk_label_new(_("after lines (0 for no limit):"));
+    llm_plugin->stop_lines_spin = gtk_spin_button_new_with_range(0, 10000, 1);
+    gtk_spin_button_set_digits(GTK_SPIN_BUTTON(llm_plugin->stop_lines_spin), 0);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(llm_plugin->stop_lines_spin), llm_plugin->stop_rules.max_lines);
+    llm_plugin->stop_repetition_check = gtk_check_button_new_with_label(_("when repeating"));
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(llm_plugin->stop_repetition_check), llm_plugin->stop_rules.repetition);
+    gtk_widget_set_tooltip_text(llm_plugin->stop_repetition_check,
+        _("End the answer when the same lines come three times in a row"));
+    gtk_box_pack_start(GTK_BOX(stop_box), stop_label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(stop_box), llm_plugin->stop_code_block_check, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(stop_box), stop_lines_label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(stop_box), llm_plugin->stop_lines_spin, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(stop_box), llm_plugin->stop_repetition_check, FALSE, FALSE, 0);
+
+    // Model warm-up and keep-alive
+    keepalive_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    llm_plugin->warmup_check = gtk_check_button_new_with_label(_("Warm up the model"));
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(llm_plugin->warmup_check), llm_plugin->warmup_enabled);
+    gtk_widget_set_tooltip_text(llm_plugin->warmup_check,
+        _("Send a tiny request in the background when Geany starts and when the settings change, so the first question does not wait for the model to load"));
+    keepalive_label = gtk_label_new(_("keep it loaded, ping every (s, 0 for never):"));
+    llm_plugin->keepalive_spin = gtk_spin_button_new_with_range(0, 3600, 30);
+    gtk_spin_button_set_digits(GTK_SPIN_BUTTON(llm_plugin->keepalive_spin), 0);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(llm_plugin->keepalive_spin), llm_plugin->keepalive_interval);
+    gtk_widget_set_tooltip_text(llm_plugin->keepalive_spin,
+        _("Repeat the tiny request when no other went out for this long, so servers that unload idle models keep it; the pings slow down while the editor is not used and stop after two idle hours"));
+    gtk_box_pack_start(GTK_BOX(keepalive_box), llm_plugin->warmup_check, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(keepalive_box), keepalive_label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(keepalive_box), llm_plugin->keepalive_spin, FALSE, FALSE, 0);
+
+    diagnostics_button = gtk_button_new_with_label(_("Diagnostics..."));
+    gtk_widget_set_halign(diagnostics_button, GTK_ALIGN_START);
+    g_signal_connect(diagnostics_button, "clicked", G_CALLBACK(on_diagnostics_clicked), llm_plugin);
+
     proxy_label = gtk_label_new(_("Proxy (optional):"));
     gtk_widget_set_halign(proxy_label, GTK_ALIGN_START);
     // Create an entry field for the Proxy
@@ -185,6 +449,107 @@ GtkWidget *llm_plugin_configure(GeanyPlugin *plugin, GtkDialog *dialog, gpointer
     gtk_spin_button_set_value(GTK_SPIN_BUTTON(max_tokens_spin), llm_plugin->llm_args ? llm_plugin->llm_args->max_tokens : 2048);
     llm_plugin->max_tokens_spin = max_tokens_spin;
 
+    // Context size label and spin button
+    context_size_label = gtk_label_new(_("Context size (tokens, 0 if unknown):"));
+    gtk_widget_set_halign(context_size_label, GTK_ALIGN_START);
+    context_size_spin = gtk_spin_button_new_with_range(0, 1048576, 512);
+    gtk_spin_button_set_digits(GTK_SPIN_BUTTON(context_size_spin), 0);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(context_size_spin), llm_plugin->llm_args ? llm_plugin->llm_args->context_size : 0);
+    llm_plugin->context_size_spin = context_size_spin;
+
+    // Symbol-aware context
+    symbol_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    llm_plugin->symbol_check = gtk_check_button_new_with_label(_("Send referenced definitions, not the whole document"));
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(llm_plugin->symbol_check), llm_plugin->symbol_context);
+    gtk_widget_set_tooltip_text(llm_plugin->symbol_check,
+        _("Instead of the current document, send the lines around the cursor and the definitions of the functions, types and macros they and the question name, as far as Geany's symbol list knows them"));
+    symbol_depth_label = gtk_label_new(_("depth:"));
+    llm_plugin->symbol_depth_spin = gtk_spin_button_new_with_range(0, 5, 1);
+    gtk_spin_button_set_digits(GTK_SPIN_BUTTON(llm_plugin->symbol_depth_spin), 0);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(llm_plugin->symbol_depth_spin), llm_plugin->symbol_depth);
+    gtk_widget_set_tooltip_text(llm_plugin->symbol_depth_spin,
+        _("How many times the names in the definitions found are followed in turn"));
+    symbol_lines_label = gtk_label_new(_("at most lines:"));
+    llm_plugin->symbol_lines_spin = gtk_spin_button_new_with_range(50, 10000, 50);
+    gtk_spin_button_set_digits(GTK_SPIN_BUTTON(llm_plugin->symbol_lines_spin), 0);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(llm_plugin->symbol_lines_spin), llm_plugin->symbol_max_lines);
+    gtk_box_pack_start(GTK_BOX(symbol_box), llm_plugin->symbol_check, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(symbol_box), symbol_depth_label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(symbol_box), llm_plugin->symbol_depth_spin, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(symbol_box), symbol_lines_label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(symbol_box), llm_plugin->symbol_lines_spin, FALSE, FALSE, 0);
+
+    retrieval_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    llm_plugin->retrieval_check = gtk_check_button_new_with_label(_("Add matching code of the project"));
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(llm_plugin->retrieval_check), llm_plugin->retrieval_enabled);
+    gtk_widget_set_tooltip_text(llm_plugin->retrieval_check,
+        _("Index the files of the project, or without one of the current document's directory, in the background and add the chunks of code matching the question to its context"));
+    retrieval_hits_label = gtk_label_new(_("chunks:"));
+    llm_plugin->retrieval_hits_spin = gtk_spin_button_new_with_range(1, 50, 1);
+    gtk_spin_button_set_digits(GTK_SPIN_BUTTON(llm_plugin->retrieval_hits_spin), 0);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(llm_plugin->retrieval_hits_spin), llm_plugin->retrieval_hits);
+    retrieval_patterns_label = gtk_label_new(_("files:"));
+    llm_plugin->retrieval_patterns_entry = gtk_entry_new();
+    gtk_entry_set_text(GTK_ENTRY(llm_plugin->retrieval_patterns_entry),
+        llm_plugin->retrieval_patterns ? llm_plugin->retrieval_patterns : "");
+    gtk_widget_set_tooltip_text(llm_plugin->retrieval_patterns_entry,
+        _("Patterns of the files indexed, separated by semicolons"));
+    gtk_box_pack_start(GTK_BOX(retrieval_box), llm_plugin->retrieval_check, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(retrieval_box), retrieval_hits_label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(retrieval_box), llm_plugin->retrieval_hits_spin, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(retrieval_box), retrieval_patterns_label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(retrieval_box), llm_plugin->retrieval_patterns_entry, TRUE, TRUE, 0);
+
+    semantic_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    llm_plugin->semantic_check = gtk_check_button_new_with_label(_("Also find code by meaning"));
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(llm_plugin->semantic_check), llm_plugin->semantic_enabled);
+    gtk_widget_set_tooltip_text(llm_plugin->semantic_check,
+        _("Embed the indexed code in the background through /v1/embeddings of the background servers and add the chunks most similar to the question, llama-server needs --embeddings"));
+    embedding_model_label = gtk_label_new(_("embedding model:"));
+    llm_plugin->embedding_model_entry = gtk_entry_new();
+    gtk_entry_set_text(GTK_ENTRY(llm_plugin->embedding_model_entry),
+        llm_plugin->embedding_model ? llm_plugin->embedding_model : "");
+    gtk_widget_set_tooltip_text(llm_plugin->embedding_model_entry,
+        _("Model asked for the embeddings, empty for the one the server has loaded"));
+    gtk_box_pack_start(GTK_BOX(semantic_box), llm_plugin->semantic_check, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(semantic_box), embedding_model_label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(semantic_box), llm_plugin->embedding_model_entry, TRUE, TRUE, 0);
+
+    summaries_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    llm_plugin->summaries_check = gtk_check_button_new_with_label(_("Also add summaries of the other files"));
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(llm_plugin->summaries_check), llm_plugin->summaries_enabled);
+    gtk_widget_set_tooltip_text(llm_plugin->summaries_check,
+        _("Summarize the indexed files through the background servers while the editor is idle, and add the summaries of the files not attached to the context of a question"));
+    summaries_tokens_label = gtk_label_new(_("tokens:"));
+    llm_plugin->summaries_tokens_spin = gtk_spin_button_new_with_range(100, 32000, 100);
+    gtk_spin_button_set_digits(GTK_SPIN_BUTTON(llm_plugin->summaries_tokens_spin), 0);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(llm_plugin->summaries_tokens_spin), llm_plugin->summaries_tokens);
+    gtk_widget_set_tooltip_text(llm_plugin->summaries_tokens_spin,
+        _("Context the summaries take per question at most"));
+    gtk_box_pack_start(GTK_BOX(summaries_box), llm_plugin->summaries_check, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(summaries_box), summaries_tokens_label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(summaries_box), llm_plugin->summaries_tokens_spin, FALSE, FALSE, 0);
+
+    profiles_widget = llm_create_profiles_widget(llm_plugin);
+
+    // Candidates label and spin button
+    candidates_label = gtk_label_new(_("Answer candidates per request:"));
+    gtk_widget_set_halign(candidates_label, GTK_ALIGN_START);
+    candidates_spin = gtk_spin_button_new_with_range(1, LLM_MAX_CANDIDATES, 1);
+    gtk_spin_button_set_digits(GTK_SPIN_BUTTON(candidates_spin), 0);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(candidates_spin), llm_plugin->llm_args ? llm_plugin->llm_args->n_candidates : 1);
+    gtk_widget_set_tooltip_text(candidates_spin, _("Alternatives generated in one server call, ranked locally and cycled with the next candidate button"));
+    llm_plugin->candidates_spin = candidates_spin;
+
+    // Parallel requests label and spin button
+    parallel_label = gtk_label_new(_("Parallel requests (server slots):"));
+    gtk_widget_set_halign(parallel_label, GTK_ALIGN_START);
+    parallel_spin = gtk_spin_button_new_with_range(1, LLM_SCHEDULER_MAX_SLOTS, 1);
+    gtk_spin_button_set_digits(GTK_SPIN_BUTTON(parallel_spin), 0);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(parallel_spin), llm_plugin->max_parallel_requests);
+    gtk_widget_set_tooltip_text(parallel_spin, _("Requests sent to the server at the same time. Chat preempts background work."));
+    llm_plugin->parallel_requests_spin = parallel_spin;
+
     // API Key label and entry
     api_key_label = gtk_label_new(_("API Key:"));
     gtk_widget_set_halign(api_key_label, GTK_ALIGN_START);
@@ -200,6 +565,15 @@ GtkWidget *llm_plugin_configure(GeanyPlugin *plugin, GtkDialog *dialog, gpointer
     // Pack the label and entry into the vertical box
     gtk_box_pack_start(GTK_BOX(vbox), url_label, FALSE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(vbox), llm_plugin->url_entry, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), extra_urls_label, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), llm_plugin->extra_urls_entry, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), hedge_box, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), llm_plugin->trace_check, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), llm_plugin->capture_check, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), llm_plugin->continue_check, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), stop_box, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), keepalive_box, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), diagnostics_button, FALSE, FALSE, 0);
     
     gtk_box_pack_start(GTK_BOX(vbox), proxy_label, FALSE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(vbox), llm_plugin->proxy_entry, FALSE, FALSE, 0);
@@ -210,8 +584,19 @@ GtkWidget *llm_plugin_configure(GeanyPlugin *plugin, GtkDialog *dialog, gpointer
     gtk_box_pack_start(GTK_BOX(vbox), temperature_spin, FALSE, FALSE, 2);
     gtk_box_pack_start(GTK_BOX(vbox), max_tokens_label, FALSE, FALSE, 2);
     gtk_box_pack_start(GTK_BOX(vbox), max_tokens_spin, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(vbox), context_size_label, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(vbox), context_size_spin, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(vbox), symbol_box, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(vbox), retrieval_box, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(vbox), semantic_box, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(vbox), summaries_box, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(vbox), candidates_label, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(vbox), candidates_spin, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(vbox), parallel_label, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(vbox), parallel_spin, FALSE, FALSE, 2);
     gtk_box_pack_start(GTK_BOX(vbox), api_key_label, FALSE, FALSE, 2);
     gtk_box_pack_start(GTK_BOX(vbox), api_key_entry, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(vbox), profiles_widget, FALSE, FALSE, 5);
 
     // Add any other configuration options here in a similar manner
     g_signal_connect(dialog, "response", G_CALLBACK(on_configure_response), llm_plugin);
@@ -12,6 +12,12 @@
 #define GEANY_LLM_PLUGIN_DESCRIPTION _("Integrates LLM capabilities into Geany.")
 #define GEANY_LLM_PLUGIN_AUTHOR "Erno Szabados <erno.szabados@windowslive.com>"
 
+/// @brief Keybinding identifiers
+enum {
+    LLM_KB_NEXT_CANDIDATE,
+    LLM_KB_COUNT
+};
+
 gboolean llm_plugin_init(GeanyPlugin *plugin, gpointer pdata);
 
 void llm_plugin_cleanup(GeanyPlugin *plugin, gpointer pdata);
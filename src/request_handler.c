@@ -1,81 +1,325 @@
 #include "request_handler.h"
 
 #include "llm_http.h"
+#include "llm_candidates.h"
+#include "llm_stats.h"
+#include "llm_trace.h"
 #include "ui.h"
+#include "llm_answer.h"
 
+/// @brief Refresh interval of the estimated prefill progress
+#define LLM_PREFILL_ESTIMATE_INTERVAL_MS 500
+
+/// @brief Data of the idle callbacks of an answer, allocated in its arena.
+/// Every queued callback holds a reference to the arena, see llm_answer_add_source().
 typedef struct {
-    LLMPlugin *plugin;
+    LLMAnswer *answer;
     gchar *msg;
 } StatusLabelData;
 
+typedef struct {
+    LLMAnswer *answer;
+    gchar *text;
+} OutputChunkData;
+
+typedef struct {
+    LLMAnswer *answer;
+    LLMPromptProgress progress;
+    gint64 time;        // Monotonic time (us) the progress was reported
+} ProgressData;
+
+/// @brief Insert text at the end of the output view (main thread)
+static void llm_output_append(const gchar *text)
+{
+    gint64 trace_start = llm_trace_begin();
+
+    if (!text || !llm_plugin || !llm_plugin->output_text_view) {
+        g_warning("Invalid text or plugin state.");
+        return;
+    }
+
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(llm_plugin->output_text_view));
+    if (buffer) {
+        GtkTextIter end_iter;
+        gtk_text_buffer_get_end_iter(buffer, &end_iter);
+        // Insert the text chunk
+        gtk_text_buffer_insert(buffer, &end_iter, text, -1);
+    } else {
+        g_warning("Failed to get text buffer.");
+    }
+
+    llm_trace_end("append_output", "ui", trace_start);
+}
+
+gboolean llm_append_to_output_buffer(gpointer user_data) {
+    // The user_data is a string duplicated by the caller
+    gchar *text_to_append = (gchar *)user_data;
+    llm_output_append(text_to_append);
+    g_free(text_to_append);
+    return FALSE; // Remove the idle source
+}
+
+/// @brief Show msg in the status label, hide it when msg is empty (main thread)
+static void llm_status_label_set(LLMPlugin *plugin, const gchar *msg) {
+    if (plugin->status_label) {
+        gtk_label_set_text(GTK_LABEL(plugin->status_label), msg ? msg : "");
+        gtk_widget_set_visible(plugin->status_label, msg && *msg);
+    }
+}
+
+/// @brief Show a streamed chunk, the text lives in the answer's arena (main thread)
+static gboolean append_output_chunk_idle(gpointer user_data) {
+    OutputChunkData *data = (OutputChunkData *)user_data;
+    LLMAnswer *answer = data->answer;
+    if (!llm_answer_is_current(answer)) {
+        return G_SOURCE_REMOVE;
+    }
+
+    if (!answer->output_started) {
+        answer->output_started = TRUE;
+        if (answer->progress_shown) {
+            llm_status_label_set(answer->plugin, "Generating...");
+        }
+    }
+    llm_output_append(data->text);
+    return G_SOURCE_REMOVE;
+}
+
 void on_llm_data_received(const gchar *data_chunk, gpointer user_data) {
-    LLMPlugin *plugin = (LLMPlugin *)user_data;
-    if (!plugin || !data_chunk || !plugin->output_text_view) {
+    LLMAnswer *answer = (LLMAnswer *)user_data;
+    if (!answer || !data_chunk || !llm_answer_is_current(answer)) {
         return;
     }
 
     // Run in the main thread via GDK
-    gdk_threads_add_idle((GSourceFunc)llm_append_to_output_buffer, g_strdup(data_chunk));
+    OutputChunkData *data = llm_arena_new0(answer->arena, OutputChunkData);
+    data->answer = answer;
+    data->text = llm_arena_strdup(answer->arena, data_chunk);
+    llm_answer_add_source(answer, 0, append_output_chunk_idle, data);
+}
+
+void on_llm_candidate_received(const LLMResponse *response, gpointer user_data) {
+    LLMAnswer *answer = (LLMAnswer *)user_data;
+    if (!answer || !response || !answer->candidates || !llm_answer_is_current(answer)) {
+        return;
+    }
+
+    // The set belongs to this answer, so a stale append cannot reach the next one
+    llm_candidates_append(answer->candidates, response->index,
+        response->response_text, response->logprob, response->has_logprob);
 }
 
 static gboolean set_status_label_idle(gpointer user_data) {
     StatusLabelData *data = (StatusLabelData *)user_data;
-    if (data && data->plugin && data->plugin->status_label) {
-        gtk_label_set_text(GTK_LABEL(data->plugin->status_label), data->msg ? data->msg : "");
-        gtk_widget_set_visible(data->plugin->status_label, data->msg && *data->msg);
+    if (llm_answer_is_current(data->answer)) {
+        llm_status_label_set(data->answer->plugin, data->msg);
     }
-    if (data) g_free(data->msg);
-    g_free(data);
     return G_SOURCE_REMOVE;
 }
 
-void on_llm_error(const gchar *error_message, gpointer user_data) {
-    LLMPlugin *plugin = (LLMPlugin *)user_data;
-    if (!plugin || !error_message) {
+/// @brief Reset the panel once an answer ended, with an error message or
+/// none. Queued after the output chunks, so it runs once the last one is
+/// shown (main thread)
+static gboolean answer_finished_idle(gpointer user_data) {
+    StatusLabelData *data = (StatusLabelData *)user_data;
+    LLMAnswer *answer = data->answer;
+    if (!llm_answer_is_current(answer)) {
+        return G_SOURCE_REMOVE;
+    }
+
+    LLMPlugin *plugin = answer->plugin;
+    plugin->active_job_id = 0;
+    gtk_spinner_stop(GTK_SPINNER(plugin->spinner));
+    gtk_widget_set_sensitive(plugin->stop_button, FALSE);
+    llm_status_label_set(plugin, data->msg);
+
+    // Replace the streamed first choice by the best ranked one
+    if (!data->msg && answer->candidates && llm_candidates_count(answer->candidates) >= 2) {
+        llm_candidates_rank(answer->candidates);
+        llm_show_candidate(plugin, llm_candidates_current(answer->candidates));
+    }
+    return G_SOURCE_REMOVE;
+}
+
+/// @brief Queue a status label update or the end of the answer from any thread
+static void answer_queue_status(LLMAnswer *answer, GSourceFunc func, const gchar *message)
+{
+    StatusLabelData *data = llm_arena_new0(answer->arena, StatusLabelData);
+    data->answer = answer;
+    data->msg = llm_arena_strdup(answer->arena, message);
+    llm_answer_add_source(answer, 0, func, data);
+}
+
+void on_llm_status(const gchar *message, gpointer user_data) {
+    LLMAnswer *answer = (LLMAnswer *)user_data;
+    if (!answer || !message || !llm_answer_is_current(answer)) {
         return;
     }
 
-    // Update status label in the main thread
-    StatusLabelData *data = g_new(StatusLabelData, 1);
-    data->plugin = plugin;
-    data->msg = g_strdup(error_message);
-    gdk_threads_add_idle(set_status_label_idle, data);
+    answer_queue_status(answer, set_status_label_idle, message);
+}
 
-    // Reset generation state and stop spinner
-    plugin->is_generating = FALSE;
-    plugin->active_thread_data = NULL;
-    plugin->cancel_requested = FALSE;
-    gdk_threads_add_idle_full(G_PRIORITY_HIGH_IDLE, stop_spinner_idle, plugin->spinner, NULL);
-    gdk_threads_add_idle_full(G_PRIORITY_HIGH_IDLE, disable_widget_idle, plugin->stop_button, NULL);
+/// @brief Append the remaining prefill time to a status message
+static void llm_append_eta(GString *message, gdouble seconds)
+{
+    if (seconds < 1.0) {
+        g_string_append(message, ", almost done");
+    } else if (seconds < 90.0) {
+        g_string_append_printf(message, ", about %.0f s left", seconds);
+    } else {
+        g_string_append_printf(message, ", about %.0f min left", seconds / 60.0);
+    }
 }
 
-void on_llm_complete(gpointer user_data) {
-    LLMPlugin *plugin = (LLMPlugin *)user_data;
-    if (!plugin) {
+/// @brief TRUE while the answer still waits for its first token (main thread)
+static gboolean llm_answer_in_prefill(LLMAnswer *answer)
+{
+    return llm_answer_is_current(answer) && llm_answer_running(answer->plugin) &&
+        !answer->output_started;
+}
+
+/// @brief Guess the prefill progress from the prompt size and the prefill
+/// rate of the recent requests, until the server reports its own progress
+/// or the first token arrives (main thread)
+static gboolean prefill_estimate_tick(gpointer user_data) {
+    ProgressData *data = (ProgressData *)user_data;
+    LLMAnswer *answer = data->answer;
+    if (!llm_answer_in_prefill(answer) || answer->server_progress) {
+        answer->estimating = FALSE;
+        return G_SOURCE_REMOVE;
+    }
+
+    gint total = data->progress.total;
+    gdouble elapsed = (g_get_monotonic_time() - answer->estimate_start) / (gdouble)G_USEC_PER_SEC;
+    gdouble rate = llm_stats_median(answer->plugin->stats, LLM_STAT_PREFILL_RATE);
+    GString *message = g_string_new(NULL);
+
+    if (rate > 0 && total > 0 && elapsed < total / rate) {
+        gdouble expected = total / rate;
+        g_string_printf(message, "Processing prompt: ~%.0f%% of ~%d tokens", 100.0 * elapsed / expected, total);
+        llm_append_eta(message, expected - elapsed);
+    } else if (rate > 0) {
+        g_string_printf(message, "Processing prompt: ~%d tokens, %.0f s, longer than usual", total, elapsed);
+    } else {
+        // No finished request to measure the server by yet
+        g_string_printf(message, "Processing prompt: ~%d tokens, %.0f s", total, elapsed);
+    }
+
+    answer->progress_shown = TRUE;
+    llm_status_label_set(answer->plugin, message->str);
+    g_string_free(message, TRUE);
+    return G_SOURCE_CONTINUE;
+}
+
+/// @brief Show the prompt processing progress reported by the server, or
+/// start estimating it when the request went out (main thread)
+static gboolean prompt_progress_idle(gpointer user_data) {
+    ProgressData *data = (ProgressData *)user_data;
+    LLMAnswer *answer = data->answer;
+    const LLMPromptProgress *progress = &data->progress;
+    if (!llm_answer_in_prefill(answer)) {
+        return G_SOURCE_REMOVE;
+    }
+
+    if (progress->estimated) {
+        if (!answer->server_progress && !answer->estimating) {
+            answer->estimating = TRUE;
+            answer->estimate_start = data->time;
+            llm_answer_add_source(answer, LLM_PREFILL_ESTIMATE_INTERVAL_MS, prefill_estimate_tick, data);
+        }
+        return G_SOURCE_REMOVE;
+    }
+
+    answer->server_progress = TRUE;
+    GString *message = g_string_new(NULL);
+    g_string_printf(message, "Processing prompt: %d%% of %d tokens",
+        (gint)(100.0 * progress->processed / progress->total), progress->total);
+    if (progress->cache > 0) {
+        g_string_append_printf(message, " (%d cached)", progress->cache);
+    }
+    // Cached tokens cost nothing, the rate is that of the evaluated ones
+    gint evaluated = progress->processed - progress->cache;
+    if (evaluated > 0 && progress->time_ms > 0 && progress->processed < progress->total) {
+        llm_append_eta(message, (progress->total - progress->processed) * progress->time_ms / evaluated / 1000.0);
+    }
+
+    answer->progress_shown = TRUE;
+    llm_status_label_set(answer->plugin, message->str);
+    g_string_free(message, TRUE);
+    return G_SOURCE_REMOVE;
+}
+
+void on_llm_progress(const LLMPromptProgress *progress, gpointer user_data) {
+    LLMAnswer *answer = (LLMAnswer *)user_data;
+    if (!answer || !progress || !llm_answer_is_current(answer)) {
         return;
     }
 
-    // Reset generation state
-    plugin->is_generating = FALSE;
-    plugin->active_thread_data = NULL;
-    plugin->cancel_requested = FALSE;
+    ProgressData *data = llm_arena_new0(answer->arena, ProgressData);
+    data->answer = answer;
+    data->progress = *progress;
+    data->time = g_get_monotonic_time();
+    llm_answer_add_source(answer, 0, prompt_progress_idle, data);
+}
 
-    // Stop spinner and disable stop button - use direct calls for reliability
-    gdk_threads_add_idle_full(G_PRIORITY_HIGH_IDLE,
-        stop_spinner_idle,  // Use the helper function
-        plugin->spinner,    // Pass the spinner widget
-        NULL);
+typedef struct {
+    LLMAnswer *answer;
+    LLMRequestMetrics metrics;
+} MetricsData;
 
-    g_print("Disabling stop button\n");
-    // Correctly disable the stop button using the helper function
-    gdk_threads_add_idle_full(G_PRIORITY_HIGH_IDLE,
-        disable_widget_idle, // Use the helper function
-        plugin->stop_button, // Pass the button as user_data
-        NULL); // No destroy notify needed for the widget pointer
+/// @brief Record a finished request. Queued after the output chunks,
+/// so it runs once the last one is shown (main thread)
+static gboolean record_metrics_idle(gpointer user_data) {
+    MetricsData *data = (MetricsData *)user_data;
+    LLMPlugin *plugin = data->answer->plugin;
 
-    // Clear status label on completion
-    if (plugin->status_label) {
-        gtk_label_set_text(GTK_LABEL(plugin->status_label), "");
-        gtk_widget_set_visible(plugin->status_label, FALSE);
+    data->metrics.ui_flush_time = g_get_monotonic_time();
+    llm_trace_instant("answer_shown", "ui");
+    llm_stats_record(plugin->stats, &data->metrics);
+
+    if (plugin->metrics_button) {
+        gchar *readout = llm_stats_readout(&data->metrics);
+        gtk_button_set_label(GTK_BUTTON(plugin->metrics_button), readout);
+        gtk_widget_set_visible(plugin->metrics_button, *readout != '\0');
+        g_free(readout);
     }
+
+    return G_SOURCE_REMOVE;
+}
+
+void on_llm_metrics(const LLMRequestMetrics *metrics, gpointer user_data) {
+    LLMAnswer *answer = (LLMAnswer *)user_data;
+    if (!answer || !metrics || !llm_answer_is_current(answer)) {
+        return;
+    }
+
+    MetricsData *data = llm_arena_new0(answer->arena, MetricsData);
+    data->answer = answer;
+    data->metrics = *metrics;
+    llm_answer_add_source(answer, 0, record_metrics_idle, data);
+}
+
+void on_llm_error(const gchar *error_message, gpointer user_data) {
+    LLMAnswer *answer = (LLMAnswer *)user_data;
+    if (!answer || !error_message || !llm_answer_is_current(answer)) {
+        return;
+    }
+
+    // The first error ends the answer, later ones are only shown
+    if (llm_answer_finish(answer)) {
+        answer_queue_status(answer, answer_finished_idle, error_message);
+    } else {
+        answer_queue_status(answer, set_status_label_idle, error_message);
+    }
+}
+
+void on_llm_complete(gpointer user_data) {
+    LLMAnswer *answer = (LLMAnswer *)user_data;
+    if (!answer || !llm_answer_finish(answer)) {
+        // Stopped, superseded or already ended by an error
+        return;
+    }
+
+    g_print("Answer %u complete\n", answer->generation);
+    answer_queue_status(answer, answer_finished_idle, NULL);
 }
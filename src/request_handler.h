@@ -5,8 +5,17 @@
 #include <gtk/gtk.h>
 #include "plugin.h"
 
+/// @brief Append a streamed chunk to the output view (main thread)
+/// @param user_data a string duplicated with g_strdup(), freed here
+gboolean llm_append_to_output_buffer(gpointer user_data);
+
+/// Callbacks of a chat answer, user_data is its LLMAnswer
 void on_llm_data_received(const gchar *data_chunk, gpointer user_data);
 void on_llm_error(const gchar *error_message, gpointer user_data);
 void on_llm_complete(gpointer user_data);
+void on_llm_candidate_received(const LLMResponse *response, gpointer user_data);
+void on_llm_status(const gchar *message, gpointer user_data);
+void on_llm_metrics(const LLMRequestMetrics *metrics, gpointer user_data);
+void on_llm_progress(const LLMPromptProgress *progress, gpointer user_data);
 
 #endif // REQUEST_HANDLER_H__
\ No newline at end of file
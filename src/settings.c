@@ -1,5 +1,16 @@
 #include "plugin.h"
 #include "settings.h"
+#include "llm_candidates.h"
+#include "llm_scheduler.h"
+#include "llm_endpoints.h"
+#include "llm_hedge.h"
+#include "llm_profiles.h"
+#include "llm_trace.h"
+#include "llm_capture.h"
+#include "llm_keepalive.h"
+#include "llm_probe.h"
+#include "llm_symbols.h"
+#include "llm_retrieval.h"
 #include <glib.h>
 
 static gchar* get_config_path()
@@ -7,6 +18,77 @@ static gchar* get_config_path()
     return  g_build_path(G_DIR_SEPARATOR_S, llm_plugin->geany_data->app->configdir, "plugins", "geanyllm", "geanyllm.conf", NULL);
 }
 
+/// @brief Read the task profile widgets into the profiles
+static void llm_profiles_read_widgets(LLMPlugin *llm_plugin)
+{
+    for (gint task = 0; task < LLM_TASK_COUNT; task++) {
+        LLMTaskProfile *profile = &llm_plugin->profiles[task];
+        if (!profile->model_entry) {
+            continue;
+        }
+
+        g_free(profile->model);
+        profile->model = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(profile->model_entry))));
+        g_free(profile->server_urls);
+        profile->server_urls = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(profile->servers_entry))));
+        profile->temperature = gtk_spin_button_get_value(GTK_SPIN_BUTTON(profile->temperature_spin));
+        profile->max_tokens = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(profile->max_tokens_spin));
+        profile->context_size = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(profile->context_size_spin));
+    }
+    llm_profiles_update_endpoints(llm_plugin);
+}
+
+/// @brief Store the task profiles in their own groups
+static void llm_profiles_save(LLMPlugin *llm_plugin, GKeyFile *key_file)
+{
+    for (gint task = 0; task < LLM_TASK_COUNT; task++) {
+        if (!llm_task_in_use(task)) {
+            continue;
+        }
+        LLMTaskProfile *profile = &llm_plugin->profiles[task];
+        gchar *group = g_strconcat(LLM_PROFILE_GROUP_PREFIX, llm_task_name(task), NULL);
+
+        g_key_file_set_string(key_file, group, LLM_ARGS_MODEL_KEY, profile->model);
+        g_key_file_set_string(key_file, group, LLM_PROFILE_SERVERS_KEY, profile->server_urls);
+        g_key_file_set_double(key_file, group, LLM_ARGS_TEMPERATURE_KEY, profile->temperature);
+        g_key_file_set_integer(key_file, group, LLM_ARGS_MAX_TOKENS_KEY, profile->max_tokens);
+        g_key_file_set_integer(key_file, group, LLM_ARGS_CONTEXT_SIZE_KEY, profile->context_size);
+        g_free(group);
+    }
+}
+
+/// @brief Load the task profiles, missing values keep "use the general settings"
+static void llm_profiles_load(LLMPlugin *llm_plugin, GKeyFile *key_file)
+{
+    for (gint task = 0; task < LLM_TASK_COUNT; task++) {
+        LLMTaskProfile *profile = &llm_plugin->profiles[task];
+        gchar *group = g_strconcat(LLM_PROFILE_GROUP_PREFIX, llm_task_name(task), NULL);
+
+        if (!g_key_file_has_group(key_file, group)) {
+            g_free(group);
+            continue;
+        }
+
+        gchar *value = g_key_file_get_string(key_file, group, LLM_ARGS_MODEL_KEY, NULL);
+        if (value) {
+            g_free(profile->model);
+            profile->model = value;
+        }
+        value = g_key_file_get_string(key_file, group, LLM_PROFILE_SERVERS_KEY, NULL);
+        if (value) {
+            g_free(profile->server_urls);
+            profile->server_urls = value;
+        }
+        if (g_key_file_has_key(key_file, group, LLM_ARGS_TEMPERATURE_KEY, NULL)) {
+            profile->temperature = g_key_file_get_double(key_file, group, LLM_ARGS_TEMPERATURE_KEY, NULL);
+        }
+        profile->max_tokens = g_key_file_get_integer(key_file, group, LLM_ARGS_MAX_TOKENS_KEY, NULL);
+        profile->context_size = g_key_file_get_integer(key_file, group, LLM_ARGS_CONTEXT_SIZE_KEY, NULL);
+        g_free(group);
+    }
+    llm_profiles_update_endpoints(llm_plugin);
+}
+
 void on_configure_response(GtkDialog *dialog, gint response, gpointer user_data) {
     LLMPlugin *llm_plugin = (LLMPlugin *)user_data;
      if (!llm_plugin) {
@@ -31,6 +113,25 @@ void on_configure_response(GtkDialog *dialog, gint response, gpointer user_data)
     llm_plugin->llm_server_url = g_strdup(url);
     g_strstrip(llm_plugin->llm_server_url);
     
+    const gchar *extra_urls = gtk_entry_get_text(GTK_ENTRY(llm_plugin->extra_urls_entry));
+    g_free(llm_plugin->extra_server_urls);
+    llm_plugin->extra_server_urls = g_strdup(extra_urls);
+    g_strstrip(llm_plugin->extra_server_urls);
+    llm_endpoints_set_urls(llm_plugin->endpoints, llm_plugin->llm_server_url, llm_plugin->extra_server_urls);
+    
+    llm_plugin->hedge_enabled = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(llm_plugin->hedge_check));
+    llm_plugin->hedge_delay_ms = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(llm_plugin->hedge_delay_spin));
+    llm_plugin->trace_enabled = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(llm_plugin->trace_check));
+    llm_plugin_apply_tracing(llm_plugin);
+    llm_plugin->capture_enabled = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(llm_plugin->capture_check));
+    llm_plugin_apply_capture(llm_plugin);
+    llm_plugin->continue_enabled = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(llm_plugin->continue_check));
+    llm_plugin->stop_rules.code_block = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(llm_plugin->stop_code_block_check));
+    llm_plugin->stop_rules.max_lines = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(llm_plugin->stop_lines_spin));
+    llm_plugin->stop_rules.repetition = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(llm_plugin->stop_repetition_check));
+    llm_plugin->warmup_enabled = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(llm_plugin->warmup_check));
+    llm_plugin->keepalive_interval = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(llm_plugin->keepalive_spin));
+    
     const gchar *proxy_url = gtk_entry_get_text(GTK_ENTRY(llm_plugin->proxy_entry));
     g_free(llm_plugin->proxy_url);
     llm_plugin->proxy_url = g_strdup(proxy_url);
@@ -49,21 +150,84 @@ void on_configure_response(GtkDialog *dialog, gint response, gpointer user_data)
     guint max_tokens = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(llm_plugin->max_tokens_spin));
     llm_plugin->llm_args->max_tokens = max_tokens;
 
+    // Get the context size from the spin button
+    llm_plugin->llm_args->context_size = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(llm_plugin->context_size_spin));
+    llm_plugin->symbol_context = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(llm_plugin->symbol_check));
+    llm_plugin->symbol_depth = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(llm_plugin->symbol_depth_spin));
+    llm_plugin->symbol_max_lines = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(llm_plugin->symbol_lines_spin));
+    llm_plugin->retrieval_enabled = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(llm_plugin->retrieval_check));
+    llm_plugin->retrieval_hits = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(llm_plugin->retrieval_hits_spin));
+    const gchar *retrieval_patterns = gtk_entry_get_text(GTK_ENTRY(llm_plugin->retrieval_patterns_entry));
+    g_free(llm_plugin->retrieval_patterns);
+    llm_plugin->retrieval_patterns = g_strdup(retrieval_patterns);
+    g_strstrip(llm_plugin->retrieval_patterns);
+    llm_plugin->semantic_enabled = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(llm_plugin->semantic_check));
+    const gchar *embedding_model = gtk_entry_get_text(GTK_ENTRY(llm_plugin->embedding_model_entry));
+    g_free(llm_plugin->embedding_model);
+    llm_plugin->embedding_model = g_strdup(embedding_model);
+    g_strstrip(llm_plugin->embedding_model);
+    llm_plugin->summaries_enabled = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(llm_plugin->summaries_check));
+    llm_plugin->summaries_tokens = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(llm_plugin->summaries_tokens_spin));
+    llm_retrieval_apply(llm_plugin);
+
+    llm_profiles_read_widgets(llm_plugin);
+
+    // Get the number of candidates from the spin button
+    llm_plugin->llm_args->n_candidates = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(llm_plugin->candidates_spin));
+
+    // Get the server slot count from the spin button
+    llm_plugin->max_parallel_requests = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(llm_plugin->parallel_requests_spin));
+    llm_plugin_apply_scheduler_limits(llm_plugin);
+
     // API key
     const gchar *api_key = gtk_entry_get_text(GTK_ENTRY(llm_plugin->api_key_entry));
     g_free(llm_plugin->api_key);
     llm_plugin->api_key = g_strdup(api_key);
     g_strstrip(llm_plugin->api_key);
 
+    // After everything the probes and the warm-up request are built from
+    llm_probe_refresh(llm_plugin, FALSE);
+    llm_keepalive_apply(llm_plugin);
+
     GError *error = NULL;
     GKeyFile *key_file = g_key_file_new();
     g_key_file_set_string(key_file, "General", LLM_SERVER_URL_KEY, llm_plugin->llm_server_url);
+    g_key_file_set_string(key_file, "General", LLM_EXTRA_SERVER_URLS_KEY, llm_plugin->extra_server_urls);
+    g_key_file_set_boolean(key_file, "General", LLM_HEDGE_ENABLED_KEY, llm_plugin->hedge_enabled);
+    g_key_file_set_integer(key_file, "General", LLM_HEDGE_DELAY_KEY, llm_plugin->hedge_delay_ms);
+    g_key_file_set_boolean(key_file, "General", LLM_TRACE_ENABLED_KEY, llm_plugin->trace_enabled);
+    g_key_file_set_boolean(key_file, "General", LLM_CAPTURE_ENABLED_KEY, llm_plugin->capture_enabled);
+    g_key_file_set_boolean(key_file, "General", LLM_CONTINUE_ENABLED_KEY, llm_plugin->continue_enabled);
+    g_key_file_set_boolean(key_file, "General", LLM_STOP_CODE_BLOCK_KEY, llm_plugin->stop_rules.code_block);
+    g_key_file_set_integer(key_file, "General", LLM_STOP_LINES_KEY, llm_plugin->stop_rules.max_lines);
+    g_key_file_set_boolean(key_file, "General", LLM_STOP_REPETITION_KEY, llm_plugin->stop_rules.repetition);
+    g_key_file_set_boolean(key_file, "General", LLM_WARMUP_ENABLED_KEY, llm_plugin->warmup_enabled);
+    g_key_file_set_integer(key_file, "General", LLM_KEEPALIVE_INTERVAL_KEY, llm_plugin->keepalive_interval);
+    g_key_file_set_boolean(key_file, "General", LLM_SYMBOL_CONTEXT_KEY, llm_plugin->symbol_context);
+    g_key_file_set_integer(key_file, "General", LLM_SYMBOL_DEPTH_KEY, llm_plugin->symbol_depth);
+    g_key_file_set_integer(key_file, "General", LLM_SYMBOL_LINES_KEY, llm_plugin->symbol_max_lines);
+    g_key_file_set_boolean(key_file, "General", LLM_RETRIEVAL_ENABLED_KEY, llm_plugin->retrieval_enabled);
+    g_key_file_set_integer(key_file, "General", LLM_RETRIEVAL_HITS_KEY, llm_plugin->retrieval_hits);
+    g_key_file_set_string(key_file, "General", LLM_RETRIEVAL_PATTERNS_KEY, llm_plugin->retrieval_patterns);
+    g_key_file_set_boolean(key_file, "General", LLM_SEMANTIC_ENABLED_KEY, llm_plugin->semantic_enabled);
+    g_key_file_set_string(key_file, "General", LLM_EMBEDDING_MODEL_KEY, llm_plugin->embedding_model);
+    g_key_file_set_boolean(key_file, "General", LLM_SUMMARIES_ENABLED_KEY, llm_plugin->summaries_enabled);
+    g_key_file_set_integer(key_file, "General", LLM_SUMMARIES_TOKENS_KEY, llm_plugin->summaries_tokens);
     g_key_file_set_string(key_file, "General", LLM_ARGS_MODEL_KEY, llm_plugin->llm_args->model);
     g_key_file_set_double(key_file, "General", LLM_ARGS_TEMPERATURE_KEY, llm_plugin->llm_args->temperature);
     g_key_file_set_integer(key_file, "General", LLM_ARGS_MAX_TOKENS_KEY, llm_plugin->llm_args->max_tokens);
+    g_key_file_set_integer(key_file, "General", LLM_ARGS_N_CANDIDATES_KEY, llm_plugin->llm_args->n_candidates);
+    g_key_file_set_integer(key_file, "General", LLM_ARGS_CONTEXT_SIZE_KEY, llm_plugin->llm_args->context_size);
+    g_key_file_set_integer(key_file, "General", LLM_PARALLEL_REQUESTS_KEY, llm_plugin->max_parallel_requests);
+    if (llm_task_in_use(LLM_TASK_COMPLETION)) {
+        g_key_file_set_integer(key_file, "General", LLM_COMPLETION_LIMIT_KEY, llm_plugin->completion_limit);
+    }
+    g_key_file_set_integer(key_file, "General", LLM_BACKGROUND_LIMIT_KEY, llm_plugin->background_limit);
     g_key_file_set_string(key_file, "General", PROXY_URL_KEY, llm_plugin->proxy_url);
     g_key_file_set_string(key_file, "General", LLM_API_KEY, llm_plugin->api_key);
 
+    llm_profiles_save(llm_plugin, key_file);
+
      // Save settings to a file
     if (!g_key_file_save_to_file(key_file, config_path, &error)) {
         g_print("Error saving settings: %s\n", error->message);
@@ -116,6 +280,176 @@ void llm_plugin_settings_load(gpointer user_data)
         llm_plugin->llm_server_url = g_strdup("");
     }
     
+    llm_plugin->extra_server_urls = g_key_file_get_string(key_file, "General", LLM_EXTRA_SERVER_URLS_KEY, &error);
+    if (!llm_plugin->extra_server_urls) {
+        g_print("Error reading %s: %s\n", LLM_EXTRA_SERVER_URLS_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->extra_server_urls = g_strdup("");
+    }
+    
+    llm_plugin->hedge_enabled = g_key_file_get_boolean(key_file, "General", LLM_HEDGE_ENABLED_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_HEDGE_ENABLED_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->hedge_enabled = FALSE;
+    }
+
+    llm_plugin->hedge_delay_ms = g_key_file_get_integer(key_file, "General", LLM_HEDGE_DELAY_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_HEDGE_DELAY_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->hedge_delay_ms = LLM_HEDGE_DEFAULT_DELAY_MS;
+    }
+
+    llm_plugin->trace_enabled = g_key_file_get_boolean(key_file, "General", LLM_TRACE_ENABLED_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_TRACE_ENABLED_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->trace_enabled = FALSE;
+    }
+
+    llm_plugin->capture_enabled = g_key_file_get_boolean(key_file, "General", LLM_CAPTURE_ENABLED_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_CAPTURE_ENABLED_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->capture_enabled = FALSE;
+    }
+
+    llm_plugin->continue_enabled = g_key_file_get_boolean(key_file, "General", LLM_CONTINUE_ENABLED_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_CONTINUE_ENABLED_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->continue_enabled = TRUE;
+    }
+
+    llm_plugin->stop_rules.code_block = g_key_file_get_boolean(key_file, "General", LLM_STOP_CODE_BLOCK_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_STOP_CODE_BLOCK_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->stop_rules.code_block = FALSE;
+    }
+
+    llm_plugin->stop_rules.max_lines = g_key_file_get_integer(key_file, "General", LLM_STOP_LINES_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_STOP_LINES_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->stop_rules.max_lines = 0;
+    }
+
+    llm_plugin->stop_rules.repetition = g_key_file_get_boolean(key_file, "General", LLM_STOP_REPETITION_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_STOP_REPETITION_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->stop_rules.repetition = TRUE;
+    }
+
+    llm_plugin->warmup_enabled = g_key_file_get_boolean(key_file, "General", LLM_WARMUP_ENABLED_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_WARMUP_ENABLED_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->warmup_enabled = FALSE;
+    }
+
+    llm_plugin->keepalive_interval = g_key_file_get_integer(key_file, "General", LLM_KEEPALIVE_INTERVAL_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_KEEPALIVE_INTERVAL_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->keepalive_interval = 0;
+    }
+
+    llm_plugin->symbol_context = g_key_file_get_boolean(key_file, "General", LLM_SYMBOL_CONTEXT_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_SYMBOL_CONTEXT_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->symbol_context = FALSE;
+    }
+
+    llm_plugin->symbol_depth = g_key_file_get_integer(key_file, "General", LLM_SYMBOL_DEPTH_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_SYMBOL_DEPTH_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->symbol_depth = LLM_SYMBOLS_DEFAULT_DEPTH;
+    }
+
+    llm_plugin->symbol_max_lines = g_key_file_get_integer(key_file, "General", LLM_SYMBOL_LINES_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_SYMBOL_LINES_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->symbol_max_lines = LLM_SYMBOLS_DEFAULT_LINES;
+    }
+
+    llm_plugin->retrieval_enabled = g_key_file_get_boolean(key_file, "General", LLM_RETRIEVAL_ENABLED_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_RETRIEVAL_ENABLED_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->retrieval_enabled = FALSE;
+    }
+
+    llm_plugin->retrieval_hits = g_key_file_get_integer(key_file, "General", LLM_RETRIEVAL_HITS_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_RETRIEVAL_HITS_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->retrieval_hits = LLM_RETRIEVAL_DEFAULT_HITS;
+    }
+
+    g_free(llm_plugin->retrieval_patterns);
+    llm_plugin->retrieval_patterns = g_key_file_get_string(key_file, "General", LLM_RETRIEVAL_PATTERNS_KEY, &error);
+    if (!llm_plugin->retrieval_patterns) {
+        g_print("Error reading %s: %s\n", LLM_RETRIEVAL_PATTERNS_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->retrieval_patterns = g_strdup(LLM_RETRIEVAL_DEFAULT_PATTERNS);
+    }
+
+    llm_plugin->semantic_enabled = g_key_file_get_boolean(key_file, "General", LLM_SEMANTIC_ENABLED_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_SEMANTIC_ENABLED_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->semantic_enabled = FALSE;
+    }
+
+    g_free(llm_plugin->embedding_model);
+    llm_plugin->embedding_model = g_key_file_get_string(key_file, "General", LLM_EMBEDDING_MODEL_KEY, &error);
+    if (!llm_plugin->embedding_model) {
+        g_print("Error reading %s: %s\n", LLM_EMBEDDING_MODEL_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->embedding_model = g_strdup("");
+    }
+
+    llm_plugin->summaries_enabled = g_key_file_get_boolean(key_file, "General", LLM_SUMMARIES_ENABLED_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_SUMMARIES_ENABLED_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->summaries_enabled = FALSE;
+    }
+
+    llm_plugin->summaries_tokens = g_key_file_get_integer(key_file, "General", LLM_SUMMARIES_TOKENS_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_SUMMARIES_TOKENS_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->summaries_tokens = LLM_SUMMARIES_DEFAULT_TOKENS;
+    }
+    
     llm_plugin->proxy_url = g_key_file_get_string(key_file, "General", PROXY_URL_KEY, &error);
     if (!llm_plugin->proxy_url) {
         g_print("Error reading %s: %s\n", PROXY_URL_KEY, error->message);
@@ -150,6 +484,49 @@ void llm_plugin_settings_load(gpointer user_data)
         llm_plugin->llm_args->max_tokens = 100;
     }
 
+    llm_plugin->llm_args->n_candidates = g_key_file_get_integer(key_file, "General", LLM_ARGS_N_CANDIDATES_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_ARGS_N_CANDIDATES_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->llm_args->n_candidates = 1;
+    }
+    llm_plugin->llm_args->n_candidates = CLAMP(llm_plugin->llm_args->n_candidates, 1, LLM_MAX_CANDIDATES);
+
+    llm_plugin->llm_args->context_size = g_key_file_get_integer(key_file, "General", LLM_ARGS_CONTEXT_SIZE_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_ARGS_CONTEXT_SIZE_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->llm_args->context_size = 0;
+    }
+
+    llm_profiles_load(llm_plugin, key_file);
+
+    llm_plugin->max_parallel_requests = g_key_file_get_integer(key_file, "General", LLM_PARALLEL_REQUESTS_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_PARALLEL_REQUESTS_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->max_parallel_requests = LLM_SCHEDULER_DEFAULT_SLOTS;
+    }
+
+    llm_plugin->completion_limit = g_key_file_get_integer(key_file, "General", LLM_COMPLETION_LIMIT_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_COMPLETION_LIMIT_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->completion_limit = 1;
+    }
+
+    llm_plugin->background_limit = g_key_file_get_integer(key_file, "General", LLM_BACKGROUND_LIMIT_KEY, &error);
+    if (error) {
+        g_print("Error reading %s: %s\n", LLM_BACKGROUND_LIMIT_KEY, error->message);
+        g_error_free(error);
+        error = NULL;
+        llm_plugin->background_limit = 1;
+    }
+
     // Check environment variable for API key (takes precedence)
     const gchar *env_api_key = g_getenv("OPENAI_API_KEY");
     if (env_api_key && env_api_key[0] != '\0') {
@@ -165,3 +542,72 @@ void llm_plugin_settings_load(gpointer user_data)
         }
     }
 }
+
+void llm_plugin_apply_scheduler_limits(LLMPlugin *llm_plugin)
+{
+    if (!llm_plugin || !llm_plugin->scheduler) {
+        return;
+    }
+
+    // Only one chat answer is shown at a time. Batch runs may fill every
+    // slot, chat and completions preempt them when they need one.
+    llm_scheduler_set_limits(llm_plugin->scheduler, llm_plugin->max_parallel_requests,
+        1, llm_plugin->completion_limit, llm_plugin->max_parallel_requests,
+        llm_plugin->background_limit);
+}
+
+void llm_plugin_apply_tracing(LLMPlugin *llm_plugin)
+{
+    if (!llm_plugin) {
+        return;
+    }
+
+    if (llm_plugin->trace_enabled) {
+        llm_trace_start();
+        return;
+    }
+    if (!llm_trace_enabled()) {
+        return;
+    }
+
+    llm_trace_stop();
+    gchar *dir = llm_plugin_data_dir(llm_plugin, LLM_TRACE_DIR);
+    if (dir) {
+        GError *error = NULL;
+        gchar *path = llm_trace_save(dir, &error);
+        if (!path) {
+            g_print("Error saving trace: %s\n", error->message);
+            g_error_free(error);
+        }
+        g_free(path);
+        g_free(dir);
+    }
+    // Workers may still be recording, the buffers are freed at unload
+}
+
+void llm_plugin_apply_capture(LLMPlugin *llm_plugin)
+{
+    if (!llm_plugin) {
+        return;
+    }
+
+    gchar *dir = llm_plugin->capture_enabled ? llm_plugin_data_dir(llm_plugin, LLM_CAPTURE_DIR) : NULL;
+    llm_capture_set_dir(dir);
+    g_free(dir);
+}
+
+gchar *llm_plugin_data_dir(LLMPlugin *llm_plugin, const gchar *name)
+{
+    if (!llm_plugin || !llm_plugin->geany_data || !llm_plugin->geany_data->app->configdir) {
+        return NULL;
+    }
+
+    gchar *path = g_build_path(G_DIR_SEPARATOR_S, llm_plugin->geany_data->app->configdir,
+        "plugins", "geanyllm", name, NULL);
+    if (g_mkdir_with_parents(path, 0700) != 0) {
+        g_print("Could not create %s\n", path);
+        g_free(path);
+        return NULL;
+    }
+    return path;
+}
@@ -4,11 +4,39 @@
 #include "plugin.h"
 
 #define LLM_SERVER_URL_KEY "llm_server_url"
+#define LLM_EXTRA_SERVER_URLS_KEY "extra_server_urls"
+#define LLM_HEDGE_ENABLED_KEY "hedge_requests"
+#define LLM_HEDGE_DELAY_KEY "hedge_delay_ms"
+#define LLM_TRACE_ENABLED_KEY "trace_requests"
+#define LLM_CAPTURE_ENABLED_KEY "capture_requests"
+#define LLM_CONTINUE_ENABLED_KEY "continue_answers"
+#define LLM_STOP_CODE_BLOCK_KEY "stop_after_code_block"
+#define LLM_STOP_LINES_KEY "stop_after_lines"
+#define LLM_STOP_REPETITION_KEY "stop_on_repetition"
+#define LLM_WARMUP_ENABLED_KEY "warmup_model"
+#define LLM_KEEPALIVE_INTERVAL_KEY "keepalive_interval"
+#define LLM_SYMBOL_CONTEXT_KEY "symbol_context"
+#define LLM_SYMBOL_DEPTH_KEY "symbol_context_depth"
+#define LLM_SYMBOL_LINES_KEY "symbol_context_lines"
+#define LLM_RETRIEVAL_ENABLED_KEY "project_index"
+#define LLM_RETRIEVAL_HITS_KEY "project_index_chunks"
+#define LLM_RETRIEVAL_PATTERNS_KEY "project_index_patterns"
+#define LLM_SEMANTIC_ENABLED_KEY "semantic_index"
+#define LLM_EMBEDDING_MODEL_KEY "embedding_model"
+#define LLM_SUMMARIES_ENABLED_KEY "project_summaries"
+#define LLM_SUMMARIES_TOKENS_KEY "project_summaries_tokens"
 #define LLM_ARGS_MODEL_KEY "model"
 #define LLM_ARGS_TEMPERATURE_KEY "temperature"
 #define LLM_ARGS_MAX_TOKENS_KEY "max_tokens"
+#define LLM_ARGS_N_CANDIDATES_KEY "n_candidates"
+#define LLM_ARGS_CONTEXT_SIZE_KEY "context_size"
+#define LLM_PROFILE_GROUP_PREFIX "Profile."
+#define LLM_PROFILE_SERVERS_KEY "servers"
 #define PROXY_URL_KEY "proxy"
 #define LLM_API_KEY "api_key"
+#define LLM_PARALLEL_REQUESTS_KEY "parallel_requests"
+#define LLM_COMPLETION_LIMIT_KEY "completion_limit"
+#define LLM_BACKGROUND_LIMIT_KEY "background_limit"
 
 /**
  * Functions to load and save the plugin configuration.
@@ -20,4 +48,17 @@ void on_configure_response(GtkDialog *dialog, gint response, gpointer user_data)
 /// @brief Load settings from config file.
 void llm_plugin_settings_load(gpointer user_data);
 
+/// @brief Push the configured concurrency limits to the scheduler.
+void llm_plugin_apply_scheduler_limits(LLMPlugin *llm_plugin);
+
+/// @brief Start or stop the request tracer. Stopping writes the recorded trace.
+void llm_plugin_apply_tracing(LLMPlugin *llm_plugin);
+
+/// @brief Start or stop writing the transfers to capture files.
+void llm_plugin_apply_capture(LLMPlugin *llm_plugin);
+
+/// @brief Directory below the plugin's config directory, created if needed.
+/// Safe to call from worker threads. Remember to g_free() the result.
+gchar *llm_plugin_data_dir(LLMPlugin *llm_plugin, const gchar *name);
+
 #endif //__SETTINGS_H__
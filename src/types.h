@@ -1,49 +1,49 @@
 #ifndef __TYPES_H__
 #define __TYPES_H__
 
-#define IS_NULL_OR_EMPTY(str) ((str) == NULL || (str)[0] == '\0')
+#include "llm_types.h"
+#include "llm_arena.h"
 
 /**
  * Shared plugin types.
  */
 
-typedef void (*LLMDataCallback)(const gchar *data_chunk, gpointer user_data);
-typedef void (*LLMErrorCallback)(const gchar *error_message, gpointer user_data);
-typedef void (*LLMCompleteCallback)(gpointer user_data);
+/// @brief Forward declaration of LLMEndpointSet
+typedef struct LLMEndpointSet LLMEndpointSet;
 
-/// @brief Structure to hold the callbacks
-typedef struct {
-    LLMDataCallback on_data_received;
-    LLMErrorCallback on_error;
-    LLMCompleteCallback on_complete;
-    gpointer user_data; // Data to be passed to callbacks (e.g., LLMPlugin*)
-} LLMCallbacks;
-
-typedef struct {
-    const gchar* role;    // "user", "assistant", "system"
-    const gchar* content; // The message content
-} ChatMessage;
+/// @brief Kinds of requests, each routed through its own profile
+typedef enum {
+    LLM_TASK_CHAT,        // Questions from the panel
+    LLM_TASK_COMPLETION,  // Inline / FIM completions, reserved: nothing sends them yet
+    LLM_TASK_BACKGROUND,  // Summaries, indexing, warm-ups
+    LLM_TASK_COUNT
+} LLMTask;
 
-/// @brief LLM arguments descriptor
+/// @brief Per-task model, servers and sampling defaults.
+/// Empty or zero fields fall back to the general settings.
 typedef struct {
-    gchar* model;
+    gchar *model;
+    gchar *server_urls;         // Comma separated, empty to use the general servers
+    gdouble temperature;        // Negative to use the general temperature
     guint max_tokens;
-    gdouble temperature;
-    const gchar* system_instruction; // E.g., "You are a helpful assistant."
-    ChatMessage* messages;           // Array of previous messages
-    guint messages_length;           // Number of messages
-} LLMArgs;
-
-
-/// @brief LLM response descriptor
-typedef struct {
-    gchar *response_text;
-    gchar *error;
-} LLMResponse;
+    guint context_size;
+    LLMEndpointSet *endpoints;  // Routing state of server_urls, always allocated
+    GtkWidget *model_entry;
+    GtkWidget *servers_entry;
+    GtkWidget *temperature_spin;
+    GtkWidget *max_tokens_spin;
+    GtkWidget *context_size_spin;
+} LLMTaskProfile;
 
 /// @brief Forward declaration of ThreadData
 typedef struct ThreadData ThreadData;
 
+/// @brief Forward declaration of LLMScheduler
+typedef struct LLMScheduler LLMScheduler;
+
+/// @brief Forward declaration of LLMCandidateSet
+typedef struct LLMCandidateSet LLMCandidateSet;
+
 /// @brief Plugin data descriptor
 typedef struct
 {
@@ -65,7 +65,10 @@ typedef struct
     GtkWidget *model_entry; // Entry for the LLM model
     GtkWidget *temperature_spin; // Spin button for temperature
     GtkWidget *max_tokens_spin;  // Spin button for max_tokens
+    GtkWidget *context_size_spin; // Spin button for the context size
     GtkWidget *api_key_entry; // Entry for API key
+    GtkWidget *candidates_spin; // Spin button for the number of candidates
+    GtkWidget *next_candidate_button; // Button to cycle answer candidates
     
     GtkWidget *status_label; // Label for error/status messages next to spinner
     
@@ -73,41 +76,134 @@ typedef struct
     
     // Plugin settings
     gchar *llm_server_url;
+    gchar *extra_server_urls; // Additional servers, comma separated
+    GtkWidget *extra_urls_entry;
+    LLMEndpointSet *endpoints; // Routing state of all configured servers
+    struct LLMCapsCache *caps; // What the servers reported, see llm_probe.h
+    gboolean hedge_enabled;    // Race a second server when the first one is slow
+    guint hedge_delay_ms;      // Wait for a first token before hedging
+    GtkWidget *hedge_check;
+    GtkWidget *hedge_delay_spin;
+    gboolean trace_enabled;    // Record a Chrome trace of every request
+    GtkWidget *trace_check;
+    gboolean capture_enabled;  // Write every transfer to a capture file
+    GtkWidget *capture_check;
+    gboolean continue_enabled; // Continue chat answers cut off by max_tokens or the network
+    GtkWidget *continue_check;
+    LLMStopRules stop_rules;   // End chat answers early on the client
+    GtkWidget *stop_code_block_check;
+    GtkWidget *stop_lines_spin;
+    GtkWidget *stop_repetition_check;
     gchar *proxy_url;
 
     // LLM arguments
     LLMArgs *llm_args; // LLM parameters (model, temp, max_token)
-
-    ThreadData *active_thread_data;
-    gboolean is_generating;
-    gboolean cancel_requested;
+    LLMTaskProfile profiles[LLM_TASK_COUNT]; // Overrides per request type
+
+    // Request scheduling
+    LLMScheduler *scheduler;
+    guint max_parallel_requests;  // Server slots shared by all priority classes
+    guint completion_limit;       // Concurrent inline completions, reserved like LLM_TASK_COMPLETION
+    guint background_limit;       // Concurrent background jobs
+    GtkWidget *parallel_requests_spin;
+
+    // Model warm-up and keep-alive, see llm_keepalive.h
+    gboolean warmup_enabled;      // Warm up the chat model at start and after settings changes
+    guint keepalive_interval;     // Seconds between keep-alive requests, 0 for none
+    GtkWidget *warmup_check;
+    GtkWidget *keepalive_spin;
+    guint keepalive_source;       // Keep-alive timer
+    gint64 last_activity_time;    // Monotonic time (us) the editor was last used
+    gint64 last_request_time;     // Monotonic time (us) a request last went to the chat servers
+    gint warmup_pending;          // A warm-up job is queued or running, atomic
+
+    guint active_job_id; // Scheduler job of the chat answer being generated
+    gint answer_state;   // Generation and running flag, atomic, see llm_answer.h
+    struct LLMAnswer *answer; // Last chat answer, holds a reference to its arena
+    GMutex answer_sources_lock;
+    GHashTable *answer_sources; // Pending idle and timeout sources of all answers, see llm_answer.h
+
+    // Ranked alternatives of the last request, owned by its answer
+    LLMCandidateSet *candidates;
+
+    // Latency and throughput of the recent requests
+    LLMStats *stats;
+    GtkWidget *metrics_button; // Readout of the last request, opens the statistics
+
+    // Open batch runs (BatchRun*), closed on unload
+    GPtrArray *batch_runs;
 
     // Document context management
     GPtrArray *selected_document_ids; // Array of document pointers or IDs
     gboolean include_current_document; // Whether to include the current document automatically
+    gboolean symbol_context;  // Send the referenced definitions instead of the whole current document
+    guint symbol_depth;       // Definitions followed from the ones referenced directly
+    guint symbol_max_lines;   // Line budget of the symbol context
+    GtkWidget *symbol_check;
+    GtkWidget *symbol_depth_spin;
+    GtkWidget *symbol_lines_spin;
+    gboolean retrieval_enabled; // Add the chunks of project code matching the question, see llm_retrieval.h
+    guint retrieval_hits;       // Chunks added per question
+    gchar *retrieval_patterns;  // Files indexed, e.g. "*.c;*.h"
+    struct LLMRetrieval *retrieval; // Index of the current directory tree, NULL if off
+    GtkWidget *retrieval_check;
+    GtkWidget *retrieval_hits_spin;
+    GtkWidget *retrieval_patterns_entry;
+    gboolean semantic_enabled;  // Also add the chunks most similar to the question, see llm_semantic.h
+    gchar *embedding_model;     // Model asked for embeddings, "" for the one the server has loaded
+    GtkWidget *semantic_check;
+    GtkWidget *embedding_model_entry;
+    gboolean summaries_enabled; // Add summaries of the other project files, see llm_summaries.h
+    guint summaries_tokens;     // Context the summaries take per question
+    GtkWidget *summaries_check;
+    GtkWidget *summaries_tokens_spin;
 
     // API key
     gchar *api_key; // Stored API key
 } LLMPlugin;
 
-/// @brief Data structure to pass to the worker thread
+/// @brief A chat answer from the send click to its last UI update, the
+/// user_data of its callbacks. Allocated in its request's arena.
+typedef struct LLMAnswer {
+    LLMPlugin *plugin;
+    LLMArena *arena;    // Owns everything the request allocates
+    guint generation;   // Callbacks and idle items of older answers are dropped
+    LLMCandidateSet *candidates; // Owned by the arena, NULL for a single answer
+
+    // Prefill feedback, main thread only
+    gboolean output_started;    // The first chunk is shown
+    gboolean progress_shown;    // The status label shows the prompt processing
+    gboolean server_progress;   // The server reports its progress, no estimate needed
+    gboolean estimating;        // The estimate timer runs
+    gint64 estimate_start;      // Monotonic time (us) the request was sent
+} LLMAnswer;
+
+/// @brief Data structure to pass to the worker thread, allocated in the
+/// request's arena along with everything it points to
 typedef struct ThreadData {
+    LLMArena *arena;    // Reference held by the job
     LLMPlugin *llm_plugin;
+    LLMTask task;
+    LLMArgs *args;  // Snapshot of the task's arguments at submit time
     gchar *query;
-    gchar *current_document;
+    GPtrArray *documents;   // LLMDocument*, current document first
+    struct LLMSemantic *semantic;   // Reference owned by the arena, NULL unless code is found by meaning
+    guint semantic_chunks;  // Chunks similar to the query added at most
     LLMCallbacks *callbacks;
-    // Pointer to a boolean flag for cancellation 
+    LLMRequestMetrics *metrics; // Optional, filled along the way
+    // Pointer to a boolean flag for cancellation, owned by the scheduler job
     gboolean *cancel_flag;  
-    // Store the thread handle
-    GThread *thread;        
 } ThreadData;
 
-/// @brief structure to pass necessary info to write_callback
+/// @brief Data of a job replaying a capture into the answer view, allocated in its arena
 typedef struct {
-    GString *accumulator;
+    LLMArena *arena;    // Reference held by the job
+    LLMCapture *capture;
+    gboolean realtime;      // Keep the recorded pace instead of replaying at once
     LLMCallbacks *callbacks;
-    gboolean *cancel_flag;  
-} WriteCallbackData;
+    LLMRequestMetrics *metrics;
+} LLMReplayData;
+
 
 
 #endif // __TYPES_H__
@@ -3,6 +3,15 @@
 #include "llm.h"
 #include "document_manager.h"
 #include "request_handler.h"
+#include "llm_candidates.h"
+#include "llm_profiles.h"
+#include "batch.h"
+#include "diagnostics.h"
+#include "llm_trace.h"
+#include "llm_capture.h"
+#include "llm_answer.h"
+#include "llm_keepalive.h"
+#include "llm_retrieval.h"
 
 
 /// @brief Create the input part of the plugin window.
@@ -50,12 +59,20 @@ GtkWidget *create_llm_input_widget(gpointer user_data) {
     gtk_widget_set_tooltip_text(docs_button, _("Select documents for context"));
     g_signal_connect(G_OBJECT(docs_button), "clicked", G_CALLBACK(on_select_documents_clicked), user_data);
 
+    // Create the "Batch" button running the request over several files
+    GtkWidget *batch_button = gtk_button_new();
+    GtkWidget *batch_icon = gtk_image_new_from_icon_name("system-run", GTK_ICON_SIZE_BUTTON);
+    gtk_button_set_image(GTK_BUTTON(batch_button), batch_icon);
+    gtk_widget_set_tooltip_text(batch_button, _("Run the request over several files"));
+    g_signal_connect(G_OBJECT(batch_button), "clicked", G_CALLBACK(on_batch_clicked), user_data);
+
     // Add label and buttons to the top row
     gtk_box_pack_start(GTK_BOX(top_row), input_label, FALSE, FALSE, 0);
     gtk_box_pack_end(GTK_BOX(top_row), stop_button, FALSE, FALSE, 0);
     gtk_box_pack_end(GTK_BOX(top_row), send_button, FALSE, FALSE, 0);
     gtk_box_pack_end(GTK_BOX(top_row), clear_button, FALSE, FALSE, 0);
     gtk_box_pack_end(GTK_BOX(top_row), docs_button, FALSE, FALSE, 0); // Add the new button
+    gtk_box_pack_end(GTK_BOX(top_row), batch_button, FALSE, FALSE, 0);
     
     // Create a text view (textarea) for the query
     GtkWidget *text_entry = gtk_entry_new();
@@ -83,6 +100,16 @@ GtkWidget *create_llm_output_widget()
     // Create the label
     GtkWidget *output_label = gtk_label_new(_("Answer"));
     gtk_box_pack_start(GTK_BOX(top_row), output_label, FALSE, FALSE, 0);
+
+    // Create the "Next candidate" button, enabled once several candidates are ranked
+    GtkWidget *next_button = gtk_button_new();
+    GtkWidget *next_icon = gtk_image_new_from_icon_name("go-next", GTK_ICON_SIZE_BUTTON);
+    gtk_button_set_image(GTK_BUTTON(next_button), next_icon);
+    gtk_widget_set_tooltip_text(next_button, _("Show next candidate"));
+    g_signal_connect(G_OBJECT(next_button), "clicked", G_CALLBACK(on_next_candidate_clicked), llm_plugin);
+    gtk_widget_set_sensitive(next_button, FALSE);
+    gtk_box_pack_end(GTK_BOX(top_row), next_button, FALSE, FALSE, 0);
+    llm_plugin->next_candidate_button = next_button;
     gtk_box_pack_start(GTK_BOX(main_box), top_row, FALSE, FALSE, 0);  
     
     GtkWidget *scrollwin = gtk_scrolled_window_new(NULL, NULL);
@@ -111,30 +138,24 @@ GtkWidget *create_llm_output_widget()
     gtk_box_pack_start(GTK_BOX(spinner_box), status_label, FALSE, FALSE, 0);
     llm_plugin->status_label = status_label;
 
+    // Add the TTFT / tok/s readout of the last answer, it opens the statistics
+    GtkWidget *metrics_button = gtk_button_new_with_label("");
+    gtk_button_set_relief(GTK_BUTTON(metrics_button), GTK_RELIEF_NONE);
+    gtk_widget_set_tooltip_text(metrics_button, _("Show request statistics"));
+    g_signal_connect(G_OBJECT(metrics_button), "clicked", G_CALLBACK(on_stats_clicked), llm_plugin);
+    gtk_widget_set_no_show_all(metrics_button, TRUE);
+    gtk_box_pack_end(GTK_BOX(spinner_box), metrics_button, FALSE, FALSE, 0);
+    llm_plugin->metrics_button = metrics_button;
+
     // Add the spinner box to the main box
     gtk_box_pack_start(GTK_BOX(main_box), spinner_box, FALSE, FALSE, 0);    
 
     return main_box;
 }
 
-/// @brief Handle send button click event in a separate thread.
-void on_input_send_clicked(GtkButton *button, gpointer user_data) {
-    LLMPlugin *llm_plugin = (LLMPlugin *)user_data;
-    if (!llm_plugin)
-        return;
-        
-    // If we're already generating, don't start another request
-    if (llm_plugin->is_generating) {
-        g_warning("Generation already in progress");
-        return;
-    }
-
-    const gchar *input_text = gtk_entry_get_text(GTK_ENTRY(llm_plugin->input_text_entry));
-    if (!input_text || *input_text == '\0') {
-        g_print("Input text is empty!\n");
-        return;
-    }
-
+/// @brief Prepare the output view and the state for a new answer
+static void llm_begin_answer(LLMPlugin *llm_plugin)
+{
     // Start spinner and enable stop button
     gtk_spinner_start(GTK_SPINNER(llm_plugin->spinner));
     gtk_widget_set_sensitive(llm_plugin->stop_button, TRUE);
@@ -145,45 +166,118 @@ void on_input_send_clicked(GtkButton *button, gpointer user_data) {
         gtk_text_buffer_set_text(buffer, "", -1);
     }
 
-    // Clear status label on new request
-    if (llm_plugin->status_label) {
-        gtk_label_set_text(GTK_LABEL(llm_plugin->status_label), "");
-        gtk_widget_set_visible(llm_plugin->status_label, FALSE);
-    }
+    // The candidates of the previous answer are gone
+    gtk_widget_set_sensitive(llm_plugin->next_candidate_button, FALSE);
 
     // Show a status message when generation starts
     if (llm_plugin->status_label) {
         gtk_label_set_text(GTK_LABEL(llm_plugin->status_label), "Generating...");
         gtk_widget_set_visible(llm_plugin->status_label, TRUE);
     }
+}
 
-    // Set state
-    llm_plugin->is_generating = TRUE;
-    llm_plugin->cancel_requested = FALSE;
-
-    // Create a copy of the query and thread data
-    gchar *query = g_strdup(input_text);
-    gchar *current_document = get_current_document(llm_plugin);
-    
-    // Create callbacks structure
-    LLMCallbacks *callbacks = g_new0(LLMCallbacks, 1);
+/// @brief Callbacks streaming an answer into the output view
+static LLMCallbacks *llm_answer_callbacks_new(LLMAnswer *answer)
+{
+    LLMCallbacks *callbacks = llm_arena_new0(answer->arena, LLMCallbacks);
     callbacks->on_data_received = on_llm_data_received;
     callbacks->on_error = on_llm_error;
     callbacks->on_complete = on_llm_complete;
-    callbacks->user_data = llm_plugin;
+    callbacks->on_candidate_received = answer->candidates ? on_llm_candidate_received : NULL;
+    callbacks->on_status = on_llm_status;
+    callbacks->on_metrics = on_llm_metrics;
+    callbacks->on_progress = on_llm_progress;
+    callbacks->user_data = answer;
+    return callbacks;
+}
+
+/// @brief Handle send button click event in a separate thread.
+void on_input_send_clicked(GtkButton *button, gpointer user_data) {
+    LLMPlugin *llm_plugin = (LLMPlugin *)user_data;
+    if (!llm_plugin)
+        return;
+
+    gint64 submit_time = g_get_monotonic_time();
+    gint64 trace_start = llm_trace_begin();
+        
+    // If we're already generating, don't start another request
+    if (llm_answer_running(llm_plugin)) {
+        g_warning("Generation already in progress");
+        return;
+    }
+
+    const gchar *input_text = gtk_entry_get_text(GTK_ENTRY(llm_plugin->input_text_entry));
+    if (!input_text || *input_text == '\0') {
+        g_print("Input text is empty!\n");
+        return;
+    }
+
+    LLMArgs *args = llm_task_args_new(llm_plugin, LLM_TASK_CHAT);
+    LLMCandidateSet *candidates = NULL;
+    if (args->n_candidates > 1) {
+        gchar *following_text = get_current_document_following_text(llm_plugin,
+            LLM_CANDIDATE_AGREEMENT_WINDOW * 2);
+        candidates = llm_candidates_new(following_text);
+        g_free(following_text);
+    }
+
+    // Everything of this request lives in its arena, released after the last UI update
+    LLMAnswer *answer = llm_answer_begin(llm_plugin, candidates);
+    LLMArena *arena = answer->arena;
+    llm_begin_answer(llm_plugin);
+    llm_arena_own(arena, args, (GDestroyNotify)llm_args_free);
+    GPtrArray *documents = llm_arena_own(arena, get_context_documents(llm_plugin, input_text),
+        (GDestroyNotify)g_ptr_array_unref);
+    LLMRequestMetrics *metrics = llm_arena_new0(arena, LLMRequestMetrics);
+    metrics->submit_time = submit_time;
+    metrics->snapshot_time = g_get_monotonic_time();
     
-    ThreadData *thread_data = g_malloc(sizeof(ThreadData));
+    ThreadData *thread_data = llm_arena_new0(arena, ThreadData);
+    thread_data->arena = arena;
     thread_data->llm_plugin = llm_plugin;
-    thread_data->query = query;
-    thread_data->current_document = current_document;
-    thread_data->callbacks = callbacks;
-    thread_data->cancel_flag = &llm_plugin->cancel_requested;
-    
-    // Store the thread data for potential cancellation
-    llm_plugin->active_thread_data = thread_data;
+    thread_data->task = LLM_TASK_CHAT;
+    thread_data->args = args;
+    thread_data->query = llm_arena_strdup(arena, input_text);
+    thread_data->documents = documents;
+    // Embedding the query takes a request, it is left to the worker
+    thread_data->semantic = llm_arena_own(arena, llm_retrieval_semantic(llm_plugin),
+        (GDestroyNotify)llm_semantic_unref);
+    thread_data->semantic_chunks = llm_plugin->retrieval_hits;
+    thread_data->callbacks = llm_answer_callbacks_new(answer);
+    thread_data->metrics = metrics;
+    thread_data->cancel_flag = NULL; // Set by the job when it runs
     
-    // Create a new thread to handle the blocking network request
-    thread_data->thread = g_thread_new("llm-thread", llm_thread_func, thread_data);
+    // Chat answers have the highest priority, they may preempt background work.
+    // Store the job id for potential cancellation.
+    llm_plugin->active_job_id = llm_scheduler_submit(llm_plugin->scheduler, llm_task_priority(thread_data->task),
+        llm_thread_func, thread_data, llm_thread_data_free);
+    llm_keepalive_note_request(llm_plugin);
+    llm_trace_end("send_clicked", "ui", trace_start);
+}
+
+gboolean llm_replay_capture(LLMPlugin *llm_plugin, LLMCapture *capture, gboolean realtime)
+{
+    LLMAnswer *answer = llm_plugin && capture ? llm_answer_begin(llm_plugin, NULL) : NULL;
+    if (!answer) {
+        return FALSE;
+    }
+
+    llm_begin_answer(llm_plugin);
+
+    LLMRequestMetrics *metrics = llm_arena_new0(answer->arena, LLMRequestMetrics);
+    metrics->submit_time = metrics->snapshot_time = g_get_monotonic_time();
+
+    LLMReplayData *replay = llm_arena_new0(answer->arena, LLMReplayData);
+    replay->arena = answer->arena;
+    replay->capture = llm_arena_own(answer->arena, capture, (GDestroyNotify)llm_capture_free);
+    replay->realtime = realtime;
+    replay->callbacks = llm_answer_callbacks_new(answer);
+    replay->metrics = metrics;
+
+    // Queued like a chat answer, so it competes for the same slot
+    llm_plugin->active_job_id = llm_scheduler_submit(llm_plugin->scheduler, llm_task_priority(LLM_TASK_CHAT),
+        llm_replay_thread_func, replay, llm_replay_data_free);
+    return TRUE;
 }
 /// @brief Invoke the same functionality as the send button click
 void on_input_enter_activate(GtkEntry *entry, gpointer user_data) {
@@ -198,33 +292,67 @@ void on_stop_generation_clicked(GtkButton *button, gpointer user_data)
         return;
     }
     
-    // IMPORTANT: Guard against clicks when no generation is happening
-    if (!plugin->is_generating || plugin->cancel_requested) {
-        // Just disable the button and do nothing else - prevents freezes
+    // The answer may have finished meanwhile
+    if (!llm_answer_stop(plugin)) {
         gtk_widget_set_sensitive(plugin->stop_button, FALSE);
         return;
     }
     
     g_print("Stop generation requested\n");
     
-    // Set the cancel flag
-    plugin->cancel_requested = TRUE;
-    
-    // Message to the output
-    gchar *message = g_strdup("\n\n[Generation stopped by user]\n");
-    gdk_threads_add_idle((GSourceFunc)llm_append_to_output_buffer, message);
+    // The worker winds down on its own, its pending output is dropped as
+    // stale and a new answer can be started right away
+    llm_scheduler_cancel(plugin->scheduler, plugin->active_job_id);
+    plugin->active_job_id = 0;
     
-    // Update UI immediately by stopping spinner and disabling stop button
-    gdk_threads_add_idle_full(G_PRIORITY_HIGH,
-    stop_spinner_idle,  // Use the helper function 
-    plugin->spinner,    // Pass the spinner widget
-    NULL);
-    
-    // Disable the stop button since generation is stopping 
-    gdk_threads_add_idle_full(G_PRIORITY_HIGH,
-        disable_widget_idle, // Use the helper function
-        plugin->stop_button, // Pass the button as user_data
-        NULL); // No destroy notify needed
+    llm_append_to_output_buffer(g_strdup("\n\n[Generation stopped by user]\n"));
+    gtk_spinner_stop(GTK_SPINNER(plugin->spinner));
+    gtk_widget_set_sensitive(plugin->stop_button, FALSE);
+    if (plugin->status_label) {
+        gtk_label_set_text(GTK_LABEL(plugin->status_label), "");
+        gtk_widget_set_visible(plugin->status_label, FALSE);
+    }
+}
+
+/// @brief Show the given answer candidate in the output view
+void llm_show_candidate(LLMPlugin *plugin, const gchar *text)
+{
+    if (!plugin || !plugin->candidates || !text) {
+        return;
+    }
+
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(plugin->output_text_view));
+    if (buffer) {
+        gtk_text_buffer_set_text(buffer, text, -1);
+    }
+
+    guint count = llm_candidates_count(plugin->candidates);
+    gtk_widget_set_sensitive(plugin->next_candidate_button, count > 1);
+
+    if (plugin->status_label) {
+        gchar *status = g_strdup_printf(_("Candidate %u/%u"), plugin->candidates->current + 1, count);
+        gtk_label_set_text(GTK_LABEL(plugin->status_label), status);
+        gtk_widget_set_visible(plugin->status_label, TRUE);
+        g_free(status);
+    }
+}
+
+/// @brief Handle next candidate button click event
+void on_next_candidate_clicked(GtkButton *button, gpointer user_data)
+{
+    LLMPlugin *plugin = (LLMPlugin *)user_data;
+    // Candidates are only cycled once ranked, i.e. after the stream completed
+    if (!plugin || !plugin->candidates || !plugin->candidates->ranked || llm_answer_running(plugin)) {
+        return;
+    }
+
+    llm_show_candidate(plugin, llm_candidates_cycle(plugin->candidates));
+}
+
+/// @brief Keybinding callback cycling the answer candidates
+void on_next_candidate_key(guint key_id)
+{
+    on_next_candidate_clicked(NULL, llm_plugin);
 }
 
 void on_input_clear_clicked(GtkButton *button, gpointer user_data)
@@ -235,29 +363,13 @@ void on_input_clear_clicked(GtkButton *button, gpointer user_data)
     }
     g_print("Clear Button was clicked!\n");
     gtk_entry_set_text(GTK_ENTRY(llm_plugin->input_text_entry), "");
+    if (!llm_answer_running(llm_plugin)) {
+        llm_answer_release(llm_plugin);
+        gtk_widget_set_sensitive(llm_plugin->next_candidate_button, FALSE);
+    }
       // Get the existing buffer and clear it instead
     GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(llm_plugin->output_text_view));
     if (buffer) {
         gtk_text_buffer_set_text(buffer, "", -1);
     }
 }
-
-// Helper function to disable a widget from an idle callback
-gboolean disable_widget_idle(gpointer user_data) {
-    GtkWidget *widget = GTK_WIDGET(user_data);
-    if (widget) {
-        gtk_widget_set_sensitive(widget, FALSE);
-    }
-    // Return FALSE (G_SOURCE_REMOVE) so the callback is only called once
-    return G_SOURCE_REMOVE;
-}
-
-// Helper function to stop spinner from an idle callback
-gboolean stop_spinner_idle(gpointer user_data) {
-    GtkSpinner *spinner = GTK_SPINNER(user_data);
-    if (spinner) {
-        gtk_spinner_stop(spinner);
-    }
-    // Return FALSE (G_SOURCE_REMOVE) so the callback is only called once
-    return G_SOURCE_REMOVE;
-}
@@ -10,15 +10,21 @@ GtkWidget *create_llm_input_widget(gpointer user_data);
 GtkWidget *create_llm_output_widget();
 /// @brief Handle send button click event in a separate thread.
 void on_input_send_clicked(GtkButton *button, gpointer user_data);
+/// @brief Stream a recorded answer into the output view through the chat
+/// pipeline, see llm_capture.h. Takes ownership of the capture on success.
+/// @return FALSE if an answer is being generated
+gboolean llm_replay_capture(LLMPlugin *llm_plugin, LLMCapture *capture, gboolean realtime);
 /// @brief Invoke the same functionality as the send button click
 void on_input_enter_activate(GtkEntry *entry, gpointer user_data);
 /// @brief Handle stop button click event
 void on_stop_generation_clicked(GtkButton *button, gpointer user_data);
 /// @brief Handle clear button click event
 void on_input_clear_clicked(GtkButton *button, gpointer user_data);
-/// @brief  Disable a widget from an idle callback
-gboolean disable_widget_idle(gpointer user_data);
-/// @brief  Stop the spinner from an idle callback
-gboolean stop_spinner_idle(gpointer user_data) ;
+/// @brief Show the given answer candidate in the output view
+void llm_show_candidate(LLMPlugin *plugin, const gchar *text);
+/// @brief Handle next candidate button click event
+void on_next_candidate_clicked(GtkButton *button, gpointer user_data);
+/// @brief Keybinding callback cycling the answer candidates
+void on_next_candidate_key(guint key_id);
 
 #endif // __UI_H__
\ No newline at end of file